@@ -8,6 +8,8 @@
  * @author [Nombre autor]
  */
 
+#define _GNU_SOURCE  // funciones de GNU usadas en 'funciones_sockets.h'
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>  // memset
@@ -4,11 +4,39 @@
  * Servidor para atender peticiones que usan protocolo UDP, y sockets de
  * datagramas(DGRAM).
  *
- * Compilación: gcc servidor_dgram.c -Wall -o servidor_dgram
+ * El destino se resuelve con un resolutor con caché('funciones_resolucion.h');
+ * con '--hosts' los nombres se buscan en un archivo con el formato de
+ * '/etc/hosts' en lugar de consultar al DNS.
+ *
+ * Con '--duracion SEG' se genera carga durante SEG segundos con '--conexiones'
+ * sockets, datagramas de '--tam-mensaje' bytes y, si se indica, una tasa
+ * objetivo('--tasa'); se muestra la tasa lograda y los percentiles de
+ * latencia, ver 'funciones_carga.h'. Con '--gso N' cada envío de la carga lleva
+ * N datagramas que el kernel segmenta(UDP_SEGMENT), ver 'funciones_gso.h'.
+ *
+ * Con '--ping N' se envían N pings con número de secuencia y marca de tiempo a
+ * un servidor con '--eco' y se muestra el RTT, la pérdida y el desorden de los
+ * ecos, ver 'funciones_ping.h'.
+ *
+ * Con '--confiable N' se envían N mensajes con entrega confiable y ordenada
+ * (secuencias, ACKs, retransmisiones y control de congestión) a un servidor con
+ * '--confiable', ver 'funciones_confiable.h'; '--perdida P' descarta al azar el
+ * P% de los paquetes enviados para probarlo en loopback.
+ *
+ * Si el destino es un grupo multicast(por ejemplo 239.1.2.3 o ff02::1234) cada
+ * línea se envía una sola vez y la reciben todos los 'servidor_dgram' unidos
+ * con '--grupo'; '--saltos', '--bucle' e '--interfaz' eligen el TTL(hop
+ * limit), si los datagramas regresan al mismo equipo y la interfaz de salida,
+ * ver 'funciones_multicast.h'. Los modos de carga, ping y confiable sólo usan
+ * unicast.
+ *
+ * Compilación: gcc cliente_dgram.c -Wall -pthread -o cliente_dgram
  *
  * @version 2.0 - 08/03/16
  */
 
+#define _GNU_SOURCE  // funciones de GNU usadas en 'funciones_sockets.h'
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>  // memset
@@ -16,12 +44,34 @@
 #include <getopt.h>  // 'getopt()'
 
 #include "funciones_sockets.h"
+#include "funciones_resolucion.h"
+#include "funciones_carga.h"
+#include "funciones_ping.h"
+#include "funciones_confiable.h"
+#include "funciones_gso.h"
+#include "funciones_multicast.h"
 
 // constantes
 const char *kPuerto = "6666";  // puerto de servicio
 const int kMaxBuffer = 100;
 const char *kMsjSalida = "exit"; // Mensaje para salir del programa
 
+int usar_archivo_hosts = 0;  // 1 para resolver con un archivo de hosts
+
+double duracion_carga = 0;  // segundos del modo de carga
+int conexiones_carga = 1;  // sockets del modo de carga
+double tasa_carga = 0;  // datagramas por segundo, 0 para lazo cerrado
+int hilos_carga = 0;  // 0 para usar un hilo por procesador
+long num_pings = 0;  // pings a enviar
+int intervalo_ping = 1000;  // milisegundos entre pings, 0 para ping-pong
+long tam_mensaje = 64;  // tamaño de los datagramas del modo de carga
+int segmentos_gso = 0;  // datagramas por envío de la carga, 0 sin GSO
+long mensajes_confiables = 0;  // mensajes a enviar con entrega confiable
+double perdida_simulada = 0;  // fracción de paquetes confiables descartados
+int saltos_multicast = 1;  // TTL(hop limit) multicast, 1 no sale de la red
+int bucle_multicast = 1;  // 1 para entregar a los receptores del mismo equipo
+char *interfaz_multicast = NULL;  // interfaz de salida del multicast
+
 /**
  * Analiza los argumentos introducidos por linea de comandos al ejecutar el
  * programa.
@@ -39,6 +89,22 @@ char* analizar_argumentos(int argc, char *argv[]) {
             {"help", no_argument, 0, 'h'},
             {"ipv4", no_argument, 0, '4'},
             {"ipv6", no_argument, 0, '6'},
+            {"hosts", required_argument, 0, 'H'},
+            {"duracion", required_argument, 0, 'D'},
+            {"conexiones", required_argument, 0, 'c'},
+            {"tasa", required_argument, 0, 's'},
+            {"hilos", required_argument, 0, 'j'},
+            {"ping", required_argument, 0, 'P'},
+            {"intervalo", required_argument, 0, 'i'},
+            {"tam-mensaje", required_argument, 0, 't'},
+            {"confiable", required_argument, 0, 'R'},
+            {"perdida", required_argument, 0, 'x'},
+            {"gso", required_argument, 0, 'G'},
+            {"saltos", required_argument, 0, 'l'},
+            {"bucle", required_argument, 0, 'b'},
+            {"interfaz", required_argument, 0, 'I'},
+            {"perfil", required_argument, 0, 'T'},
+            {"ajuste", required_argument, 0, 'O'},
             {0, 0, 0, 0}
         };
     int referencia = 0;  // variable usada para las opciones de los argumentos
@@ -50,7 +116,7 @@ char* analizar_argumentos(int argc, char *argv[]) {
 
     // si un argumento es obligatorio se colocan dos puntos después de la
     // 'opción'(corta) elegida
-    while ((opcion = getopt_long(argc, argv,"d:ha46",
+    while ((opcion = getopt_long(argc, argv,"d:ha46H:D:c:s:j:t:P:i:R:x:G:l:b:I:T:O:",
                    opciones_largas, &referencia)) != -1) {
         switch (opcion) {
             case 'd':
@@ -59,10 +125,44 @@ char* analizar_argumentos(int argc, char *argv[]) {
             case 'a': case 'h':
                 printf("\nModo de uso: %s [OPCIÓN]\n\n", argv[0]);
                 printf("\t-d [IP], --destino [IP]\tDirección IP del destino");
-                printf("(IPv4 o IPv6)\n");
+                printf("(IPv4 o IPv6), o unix:/ruta(unix:@nombre) para un ");
+                printf("socket de dominio Unix\n");
                 printf("\t-h --help\tLista de ayuda y opciones\n");
                 printf("\t-4, --ipv4\tUsar direcciones de tipo IPv4\n");
                 printf("\t-6, --ipv6\tUsar direcciones de tipo IPv6\n");
+                printf("\t-H [ARCHIVO], --hosts [ARCHIVO]\tResolver nombres ");
+                printf("con un archivo con formato de /etc/hosts\n");
+                printf("\t-D [SEG], --duracion [SEG]\tGenerar carga durante ");
+                printf("SEG segundos y medir latencias\n");
+                printf("\t-c [N], --conexiones [N]\tSockets de la carga(1 por ");
+                printf("defecto)\n");
+                printf("\t-s [N], --tasa [N]\tDatagramas por segundo de la ");
+                printf("carga(lazo cerrado por defecto)\n");
+                printf("\t-j [N], --hilos [N]\tHilos de la carga(uno por ");
+                printf("procesador por defecto)\n");
+                printf("\t-P [N], --ping [N]\tEnviar N pings a un servidor ");
+                printf("con --eco y medir el RTT\n");
+                printf("\t-i [MS], --intervalo [MS]\tMilisegundos entre pings ");
+                printf("(1000 por defecto, 0 para ping-pong)\n");
+                printf("\t-t [BYTES], --tam-mensaje [BYTES]\tTamaño de los ");
+                printf("datagramas de la carga(64 por defecto)\n");
+                printf("\t-R [N], --confiable [N]\tEnviar N mensajes con ");
+                printf("entrega confiable a un servidor con --confiable\n");
+                printf("\t-x [P], --perdida [P]\tDescartar al azar el P%% de ");
+                printf("los paquetes confiables enviados\n");
+                printf("\t-G [N], --gso [N]\tEnviar N datagramas por llamada ");
+                printf("en la carga(UDP_SEGMENT)\n");
+                printf("\t-l [N], --saltos [N]\tTTL(hop limit) de los ");
+                printf("datagramas multicast(1 por defecto)\n");
+                printf("\t-b [0|1], --bucle [0|1]\tEntregar el multicast a ");
+                printf("los receptores del mismo equipo(1 por defecto)\n");
+                printf("\t-I [NOMBRE], --interfaz [NOMBRE]\tInterfaz de ");
+                printf("salida del multicast, por ejemplo lo\n");
+                printf("\t-T [PERFIL], --perfil [PERFIL]\tAjustes de los ");
+                printf("sockets: normal, baja-latencia o masivo\n");
+                printf("\t-O [CLAVE=VALOR], --ajuste [CLAVE=VALOR]\tCambiar ");
+                printf("una opción de los sockets, después de --perfil(ver ");
+                printf("funciones_ajustes.h)\n");
                 printf("\nNOTA: Si no se especifica tipo de dirección se usará");
                 printf(" 'IPv4'(--ipv4) por defecto\n\n");
                 exit(0);
@@ -72,6 +172,84 @@ char* analizar_argumentos(int argc, char *argv[]) {
             case '6':
                 familia_direcciones =  kIPV6;
                 break;
+            case 'H':
+                archivo_hosts = optarg;
+                usar_archivo_hosts = 1;
+                break;
+            case 'D':
+                duracion_carga = atof(optarg);
+                break;
+            case 'c':
+                conexiones_carga = atoi(optarg);
+                if (conexiones_carga <= 0) {
+                    fprintf(stderr, "\nNúmero de sockets inválido: %s\n",
+                        optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 's':
+                tasa_carga = atof(optarg);
+                break;
+            case 'j':
+                hilos_carga = atoi(optarg);
+                break;
+            case 'P':
+                num_pings = atol(optarg);
+                break;
+            case 'i':
+                intervalo_ping = atoi(optarg);
+                break;
+            case 't':
+                tam_mensaje = atol(optarg);
+                // el máximo de un datagrama UDP sobre IPv4
+                if (tam_mensaje <= 0 || tam_mensaje > 65507) {
+                    fprintf(stderr, "\nTamaño de mensaje inválido: %s\n",
+                        optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'R':
+                mensajes_confiables = atol(optarg);
+                break;
+            case 'x':
+                perdida_simulada = atof(optarg)/100;
+                if (perdida_simulada < 0 || perdida_simulada >= 1) {
+                    fprintf(stderr, "\nPérdida inválida: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'G':
+                segmentos_gso = atoi(optarg);
+                if (segmentos_gso < 1 || segmentos_gso > kMaxSegmentosGso) {
+                    fprintf(stderr, "\nNúmero de segmentos inválido: %s\n",
+                        optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'l':
+                saltos_multicast = atoi(optarg);
+                if (saltos_multicast < 0 || saltos_multicast > 255) {
+                    fprintf(stderr, "\nNúmero de saltos inválido: %s\n",
+                        optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'b':
+                bucle_multicast = atoi(optarg) != 0;
+                break;
+            case 'I':
+                interfaz_multicast = optarg;
+                break;
+            case 'T':
+                if (seleccionar_perfil_socket(optarg) == -1) {
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'O':
+                if (cambiar_ajuste_socket(optarg) == -1) {
+                    exit(EXIT_FAILURE);
+                }
+                break;
             case '?': default: // si hay una opción no registrada o regresa 0
                 fprintf(stderr, "\nOpción inválida: -- %c\n", optopt);
                 fprintf(stderr, "Usa %s --help para más información.\n\n",argv[0]);
@@ -89,15 +267,208 @@ char* analizar_argumentos(int argc, char *argv[]) {
     return ip_destino;
 }
 
+/**
+ * Genera carga contra el servidor durante 'duracion_carga' segundos y muestra
+ * la tasa lograda y las latencias.
+ *
+ * @param info_destino direcciones del servidor
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int generar_carga(const struct addrinfo *info_destino) {
+    Config_carga config;
+    Resultado_carga resultado;
+
+    config.direcciones = info_destino;
+    config.tipo_socket = SOCK_DGRAM;
+    config.conexiones = conexiones_carga;
+    config.hilos = hilos_carga > 0 ? hilos_carga :
+        (int)sysconf(_SC_NPROCESSORS_ONLN);
+    config.tasa = tasa_carga;
+    config.tam_mensaje = tam_mensaje;
+    config.duracion = duracion_carga;
+    config.segmentos_gso = segmentos_gso;
+    if (segmentos_gso*tam_mensaje > kMaxTamGso) {
+        fprintf(stderr, "\n%d segmentos de %ld bytes pasan del máximo de un ",
+            segmentos_gso, tam_mensaje);
+        fprintf(stderr, "envío con GSO(%d bytes)\n", kMaxTamGso);
+        return -1;
+    }
+
+    int res = ejecutar_carga(&config, &resultado);
+    mostrar_resultado_carga(&config, &resultado);
+    destruir_histograma(&resultado.latencias);
+
+    return res;
+}
+
+/**
+ * Envía 'num_pings' pings al servidor y muestra las estadísticas de los ecos.
+ *
+ * @param descriptor socket conectado al servidor
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int medir_rtt(int descriptor) {
+    Estadisticas_ping estadisticas;
+
+    if (crear_estadisticas_ping(&estadisticas, num_pings) == -1) {
+        return -1;
+    }
+    int res = ejecutar_ping(descriptor, SOCK_DGRAM, num_pings, intervalo_ping,
+        tam_mensaje, &estadisticas);
+    mostrar_estadisticas_ping(&estadisticas);
+    destruir_estadisticas_ping(&estadisticas);
+
+    return res;
+}
+
+/**
+ * Envía 'mensajes_confiables' mensajes numerados por un canal confiable, espera
+ * a que se confirmen y muestra la tasa lograda y las estadísticas del canal.
+ *
+ * @param descriptor socket conectado al servidor
+ * @param info_destino dirección del servidor
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int enviar_mensajes_confiables(int descriptor,
+        const struct addrinfo *info_destino) {
+    Canal_confiable *canal = (Canal_confiable*)malloc(sizeof(Canal_confiable));
+    char mensaje[kMaxDatosConfiable];
+    long i;
+    int res = 0;
+
+    if (canal == NULL) {
+        fprintf(stderr,"\nError al reservar memoria para el canal\n");
+        return -1;
+    }
+    if (tam_mensaje > kMaxDatosConfiable) {
+        tam_mensaje = kMaxDatosConfiable;
+    }
+    crear_canal_confiable(canal, descriptor, info_destino->ai_addr, NULL,
+        perdida_simulada);
+    memset(mensaje, '.', sizeof(mensaje));
+
+    uint64_t inicio = obtener_ns_monotonicos();
+    for (i = 0; i < mensajes_confiables && res == 0; i++) {
+        int tam = snprintf(mensaje, sizeof(mensaje), "confiable %ld", i);
+        // el número queda al inicio y el resto se rellena
+        mensaje[tam] = tam < tam_mensaje ? '.' : '\0';
+        if (enviar_confiable(canal, mensaje, tam < tam_mensaje ? tam_mensaje :
+                tam) == -1) {
+            res = -1;
+        }
+    }
+    if (res == 0 && vaciar_canal_confiable(canal, 10*kRtoMaximoNs/1000000) ==
+            -1) {
+        res = -1;
+    }
+    double segundos = (obtener_ns_monotonicos() - inicio)/1e9;
+
+    if (res == -1) {
+        fprintf(stderr, "\nError en el canal confiable: %s\n", strerror(errno));
+    }
+    printf("%lu de %ld mensajes confirmados en %.3f s(%.0f mensajes/s)\n",
+        (unsigned long)canal->base, mensajes_confiables, segundos,
+        canal->base/segundos);
+    mostrar_estadisticas_confiable(canal);
+    free(canal);
+
+    return res;
+}
 
 int main(int argc,  char *argv[]) {
     char *ip_destino = analizar_argumentos(argc, argv);
     printf("Se usará la familia de direcciones: '%s'\n\n",
+        es_direccion_unix(ip_destino) ? kMensajeUnix :
         familia_direcciones == kIPV4 ? kMensajeIPV4 : kMensajeIPV6);
 
+    Resolutor_dns resolutor;
     struct addrinfo *info_destino = NULL;
-    int descriptor = inicializar_cliente(ip_destino, kPuerto, SOCK_DGRAM,
+    if (crear_resolutor(&resolutor, usar_archivo_hosts ?
+            resolver_con_archivo_hosts : NULL, 0) == -1) {
+        exit(EXIT_FAILURE);
+    }
+    int error = resolver_direccion(&resolutor, ip_destino, kPuerto, SOCK_DGRAM,
         &info_destino);
+    if (error != 0) {
+        fprintf(stderr, "\nError al resolver %s: %s\n", ip_destino,
+            gai_strerror(error));
+        exit(EXIT_FAILURE);
+    }
+    int multicast = es_direccion_multicast(info_destino->ai_addr);
+    if (multicast && (duracion_carga > 0 || num_pings > 0 ||
+            mensajes_confiables > 0)) {
+        fprintf(stderr, "\nLos modos de carga, ping y confiable no usan ");
+        fprintf(stderr, "multicast\n");
+        soltar_direccion(&resolutor, info_destino);
+        destruir_resolutor(&resolutor);
+        exit(EXIT_FAILURE);
+    }
+    if (duracion_carga > 0) {
+        int res = generar_carga(info_destino);
+        soltar_direccion(&resolutor, info_destino);
+        destruir_resolutor(&resolutor);
+        return res == -1 ? EXIT_FAILURE : 0;
+    }
+    int descriptor = crear_socket(info_destino);
+    if (descriptor == -1) {
+        exit(EXIT_FAILURE);
+    }
+    // sin nombre el servidor Unix no tendría a dónde enviar ecos y ACKs
+    if (info_destino->ai_family == AF_UNIX &&
+            asociar_unix_automatico(descriptor) == -1) {
+        close(descriptor);
+        exit(EXIT_FAILURE);
+    }
+    if (multicast) {
+        int indice_interfaz = obtener_indice_interfaz(interfaz_multicast);
+        if (indice_interfaz == -1 || configurar_envio_multicast(descriptor,
+                info_destino->ai_family, saltos_multicast, bucle_multicast,
+                indice_interfaz) == -1) {
+            close(descriptor);
+            exit(EXIT_FAILURE);
+        }
+        // el alcance de enlace(ff02::/16) sólo se envía con la interfaz
+        struct sockaddr_in6 *grupo_ipv6 =
+            (struct sockaddr_in6*)info_destino->ai_addr;
+        if (info_destino->ai_family == AF_INET6 &&
+                grupo_ipv6->sin6_scope_id == 0 &&
+                IN6_IS_ADDR_MC_LINKLOCAL(&grupo_ipv6->sin6_addr)) {
+            grupo_ipv6->sin6_scope_id = indice_interfaz;
+        }
+        printf("Publicando en el grupo multicast %s(saltos: %d)\n",
+            ip_destino, saltos_multicast);
+    }
+    if (ajustes_socket.modificado) {
+        mostrar_ajustes_socket(descriptor, SOCK_DGRAM);
+    }
+    if (num_pings > 0) {
+        // conectado, los ecos de otros orígenes se descartan
+        if (conectar(descriptor, info_destino) == -1) {
+            close(descriptor);
+            exit(EXIT_FAILURE);
+        }
+        int res = medir_rtt(descriptor);
+        close(descriptor);
+        soltar_direccion(&resolutor, info_destino);
+        destruir_resolutor(&resolutor);
+        return res == -1 ? EXIT_FAILURE : 0;
+    }
+
+    if (mensajes_confiables > 0) {
+        // conectado, para recibir los ACKs sólo del servidor
+        if (conectar(descriptor, info_destino) == -1) {
+            close(descriptor);
+            exit(EXIT_FAILURE);
+        }
+        int res = enviar_mensajes_confiables(descriptor, info_destino);
+        close(descriptor);
+        soltar_direccion(&resolutor, info_destino);
+        destruir_resolutor(&resolutor);
+        return res == -1 ? EXIT_FAILURE : 0;
+    }
 
     char *buffer = (char*)malloc(sizeof(char)*kMaxBuffer);
 
@@ -109,6 +480,8 @@ int main(int argc,  char *argv[]) {
 
     printf("\nApagando cliente...\n");
     close(descriptor);
+    soltar_direccion(&resolutor, info_destino);
+    destruir_resolutor(&resolutor);
 
     return 0;
 }
@@ -4,11 +4,52 @@
  * Servidor para atender peticiones que usan protocolo TCP, y sockets de
  * datagramas(STREAM).
  *
- * Compilación: gcc cliente_stream.c -Wall -o cliente_stream
+ * Cada línea capturada se envía como una trama de longitud prefijada, ver
+ * 'funciones_tramas.h'.
+ *
+ * Con '--archivo' se envía un archivo con 'sendfile()'(o con 'read()'/'send()'
+ * si se indica '--copia') y se muestra la tasa de transferencia, ver
+ * 'funciones_transferencia.h'. El servidor sólo lo recibe si se ejecuta con
+ * '--directorio'.
+ *
+ * Con '--tam-mensaje' se envían '--mensajes' mensajes del tamaño indicado y se
+ * muestra la tasa y el tiempo de CPU usado; con '--zerocopy' los mensajes
+ * grandes se envían con MSG_ZEROCOPY, ver 'funciones_zerocopy.h'.
+ *
+ * El destino se resuelve con un resolutor con caché('funciones_resolucion.h');
+ * con '--hosts' los nombres se buscan en un archivo con el formato de
+ * '/etc/hosts' en lugar de consultar al DNS. Si no se indica '--ipv4' o
+ * '--ipv6' se usan las direcciones de ambas familias y se conecta con "Happy
+ * Eyeballs", mostrando la latencia de cada intento, ver 'funciones_conexion.h'.
+ *
+ * Con '--repeticiones N' se hacen N peticiones cortas(una trama cada una), cada
+ * una con su propia conexión; con '--pool' las conexiones se reutilizan, ver
+ * 'funciones_pool_conexiones.h'.
+ *
+ * Con '--duracion SEG' se genera carga durante SEG segundos con '--conexiones'
+ * conexiones, mensajes de '--tam-mensaje' bytes y, si se indica, una tasa
+ * objetivo('--tasa'); se muestra la tasa lograda y los percentiles de
+ * latencia, ver 'funciones_carga.h'.
+ *
+ * Con '--ping N' se envían N pings con número de secuencia y marca de tiempo a
+ * un servidor con '--eco' y se muestra el RTT, la pérdida y el desorden de los
+ * ecos, ver 'funciones_ping.h'.
+ *
+ * Con '--suscribir[=TEMA]' el cliente se suscribe a un servidor con
+ * '--difusion' y muestra(o sólo cuenta, con '--silencioso') los mensajes que
+ * publican los demás clientes, ver 'funciones_difusion.h'.
+ *
+ * Con '--memoria /NOMBRE' los mensajes(o los pings) se envían por el canal de
+ * memoria compartida de un servidor del mismo equipo en lugar de un socket,
+ * ver 'funciones_memoria_compartida.h'.
+ *
+ * Compilación: gcc cliente_stream.c -Wall -pthread -o cliente_stream
  *
  * @version 2.0 - 03/04/16
  */
 
+#define _GNU_SOURCE  // funciones de GNU usadas en 'funciones_sockets.h'
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>  // memset
@@ -16,11 +57,44 @@
 #include <getopt.h>  // 'getopt()'
 
 #include "funciones_sockets.h"
+#include "funciones_resolucion.h"
+#include "funciones_conexion.h"
+#include "funciones_pool_conexiones.h"
+#include "funciones_tramas.h"
+#include "funciones_transferencia.h"
+#include "funciones_zerocopy.h"
+#include "funciones_carga.h"
+#include "funciones_ping.h"
+#include "funciones_memoria_compartida.h"
+#include <sys/resource.h>  // para 'getrusage()'
+#include <signal.h>  // para 'signal()'
 
 // constantes
 const char *kPuerto = "6666";  // puerto de servicio
 const int kMaxBuffer = 100;
 const char *kMsjSalida = "exit"; // Mensaje para salir del programa
+const int kLimiteConexionMs = 10000;  // tiempo máximo para conectarse
+
+int usar_archivo_hosts = 0;  // 1 para resolver con un archivo de hosts
+
+const char *ruta_archivo = NULL;  // archivo a enviar(modo transferencia)
+int copiar_archivo = 0;  // 1 para enviar el archivo con copias
+long tam_mensaje = 0;  // tamaño de los mensajes del modo de envío masivo
+long num_mensajes = 100;  // mensajes del modo de envío masivo
+int usar_zerocopy = 0;  // 1 para enviar con MSG_ZEROCOPY
+long repeticiones = 0;  // peticiones cortas a realizar
+int usar_pool = 0;  // 1 para reutilizar las conexiones entre peticiones
+double duracion_carga = 0;  // segundos del modo de carga
+int conexiones_carga = 1;  // conexiones simultáneas del modo de carga
+double tasa_carga = 0;  // mensajes por segundo, 0 para lazo cerrado
+int hilos_carga = 0;  // 0 para usar un hilo por procesador
+long num_pings = 0;  // pings a enviar
+int intervalo_ping = 1000;  // milisegundos entre pings, 0 para ping-pong
+const char *nombre_memoria = NULL;  // canal de memoria compartida a usar
+int suscribir = 0;  // 1 para recibir los mensajes de un difusor
+const char *tema_suscripcion = NULL;  // 'NULL' para recibir todos los temas
+long max_recibidos = 0;  // mensajes a recibir al suscribirse, 0 sin límite
+int silencioso = 0;  // 1 para no mostrar cada mensaje recibido
 
 /**
  * Analiza los argumentos introducidos por linea de comandos al ejecutar el
@@ -39,6 +113,25 @@ char* analizar_argumentos(int argc, char *argv[]) {
             {"help", no_argument, 0, 'h'},
             {"ipv4", no_argument, 0, '4'},
             {"ipv6", no_argument, 0, '6'},
+            {"hosts", required_argument, 0, 'H'},
+            {"archivo", required_argument, 0, 'f'},
+            {"copia", no_argument, 0, 'k'},
+            {"tam-mensaje", required_argument, 0, 't'},
+            {"mensajes", required_argument, 0, 'n'},
+            {"zerocopy", no_argument, 0, 'z'},
+            {"repeticiones", required_argument, 0, 'r'},
+            {"pool", no_argument, 0, 'p'},
+            {"duracion", required_argument, 0, 'D'},
+            {"conexiones", required_argument, 0, 'c'},
+            {"tasa", required_argument, 0, 's'},
+            {"hilos", required_argument, 0, 'j'},
+            {"ping", required_argument, 0, 'P'},
+            {"intervalo", required_argument, 0, 'i'},
+            {"memoria", required_argument, 0, 'M'},
+            {"suscribir", optional_argument, 0, 'S'},
+            {"silencioso", no_argument, 0, 'q'},
+            {"perfil", required_argument, 0, 'T'},
+            {"ajuste", required_argument, 0, 'O'},
             {0, 0, 0, 0}
         };
     int referencia = 0;  // variable usada para las opciones de los argumentos
@@ -50,7 +143,7 @@ char* analizar_argumentos(int argc, char *argv[]) {
 
     // si un argumento es obligatorio se colocan dos puntos después de la
     // 'opción'(corta) elegida
-    while ((opcion = getopt_long(argc, argv,"d:ha46",
+    while ((opcion = getopt_long(argc, argv,"d:ha46H:f:kt:n:zr:pD:c:s:j:P:i:M:S::qT:O:",
                    opciones_largas, &referencia)) != -1) {
         switch (opcion) {
             case 'd':
@@ -59,12 +152,53 @@ char* analizar_argumentos(int argc, char *argv[]) {
             case 'a': case 'h':
                 printf("\nModo de uso: %s [OPCIÓN]\n\n", argv[0]);
                 printf("\t-d [IP], --destino [IP]\tDirección IP del destino");
-                printf("(IPv4 o IPv6)\n");
+                printf("(IPv4 o IPv6), o unix:/ruta(unix:@nombre) para un ");
+                printf("socket de dominio Unix\n");
                 printf("\t-h --help\tLista de ayuda y opciones\n");
                 printf("\t-4, --ipv4\tUsar direcciones de tipo IPv4\n");
                 printf("\t-6, --ipv6\tUsar direcciones de tipo IPv6\n");
-                printf("\nNOTA: Si no se especifica tipo de dirección se usará");
-                printf(" 'IPv4'(--ipv4) por defecto\n\n");
+                printf("\t-H [ARCHIVO], --hosts [ARCHIVO]\tResolver nombres ");
+                printf("con un archivo con formato de /etc/hosts\n");
+                printf("\t-f [RUTA], --archivo [RUTA]\tEnviar un archivo ");
+                printf("(sendfile)\n");
+                printf("\t-k, --copia\tEnviar el archivo con read/send\n");
+                printf("\t-t [BYTES], --tam-mensaje [BYTES]\tEnviar mensajes ");
+                printf("de este tamaño en lugar de leerlos de la entrada\n");
+                printf("\t-n [N], --mensajes [N]\tNúmero de mensajes a enviar ");
+                printf("con --tam-mensaje(100 por defecto)\n");
+                printf("\t-z, --zerocopy\tEnviar mensajes grandes con ");
+                printf("MSG_ZEROCOPY\n");
+                printf("\t-r [N], --repeticiones [N]\tHacer N peticiones cortas, ");
+                printf("cada una con su conexión\n");
+                printf("\t-p, --pool\tReutilizar las conexiones entre ");
+                printf("peticiones\n");
+                printf("\t-D [SEG], --duracion [SEG]\tGenerar carga durante ");
+                printf("SEG segundos y medir latencias\n");
+                printf("\t-c [N], --conexiones [N]\tConexiones simultáneas de ");
+                printf("la carga(1 por defecto)\n");
+                printf("\t-s [N], --tasa [N]\tMensajes por segundo de la carga ");
+                printf("(lazo cerrado por defecto)\n");
+                printf("\t-j [N], --hilos [N]\tHilos de la carga(uno por ");
+                printf("procesador por defecto)\n");
+                printf("\t-P [N], --ping [N]\tEnviar N pings a un servidor ");
+                printf("con --eco y medir el RTT\n");
+                printf("\t-i [MS], --intervalo [MS]\tMilisegundos entre pings ");
+                printf("(1000 por defecto, 0 para ping-pong)\n");
+                printf("\t-M [NOMBRE], --memoria [NOMBRE]\tUsar el canal de ");
+                printf("memoria compartida de un servidor del mismo equipo ");
+                printf("en lugar de un socket(sin --destino)\n");
+                printf("\t-S[TEMA], --suscribir[=TEMA]\tRecibir los mensajes ");
+                printf("de un servidor con --difusion(todos o sólo los de ");
+                printf("TEMA); con --mensajes se termina tras recibir N\n");
+                printf("\t-q, --silencioso\tNo mostrar cada mensaje recibido ");
+                printf("con --suscribir\n");
+                printf("\t-T [PERFIL], --perfil [PERFIL]\tAjustes de los ");
+                printf("sockets: normal, baja-latencia o masivo\n");
+                printf("\t-O [CLAVE=VALOR], --ajuste [CLAVE=VALOR]\tCambiar ");
+                printf("una opción de los sockets, después de --perfil(ver ");
+                printf("funciones_ajustes.h)\n");
+                printf("\nNOTA: Si no se especifica tipo de dirección se usarán");
+                printf(" ambas(Happy Eyeballs) por defecto\n\n");
                 exit(0);
             case '4':
                 familia_direcciones =  kIPV4;
@@ -72,6 +206,79 @@ char* analizar_argumentos(int argc, char *argv[]) {
             case '6':
                 familia_direcciones =  kIPV6;
                 break;
+            case 'H':
+                archivo_hosts = optarg;
+                usar_archivo_hosts = 1;
+                break;
+            case 'f':
+                ruta_archivo = optarg;
+                break;
+            case 'k':
+                copiar_archivo = 1;
+                break;
+            case 't':
+                tam_mensaje = atol(optarg);
+                if (tam_mensaje <= 0 || tam_mensaje > (long)kMaxTrama) {
+                    fprintf(stderr, "\nTamaño de mensaje inválido: %s\n",
+                        optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'n':
+                num_mensajes = max_recibidos = atol(optarg);
+                break;
+            case 'z':
+                usar_zerocopy = 1;
+                break;
+            case 'r':
+                repeticiones = atol(optarg);
+                break;
+            case 'p':
+                usar_pool = 1;
+                break;
+            case 'D':
+                duracion_carga = atof(optarg);
+                break;
+            case 'c':
+                conexiones_carga = atoi(optarg);
+                if (conexiones_carga <= 0) {
+                    fprintf(stderr, "\nNúmero de conexiones inválido: %s\n",
+                        optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 's':
+                tasa_carga = atof(optarg);
+                break;
+            case 'j':
+                hilos_carga = atoi(optarg);
+                break;
+            case 'P':
+                num_pings = atol(optarg);
+                break;
+            case 'i':
+                intervalo_ping = atoi(optarg);
+                break;
+            case 'M':
+                nombre_memoria = optarg;
+                break;
+            case 'S':
+                suscribir = 1;
+                tema_suscripcion = optarg;
+                break;
+            case 'q':
+                silencioso = 1;
+                break;
+            case 'T':
+                if (seleccionar_perfil_socket(optarg) == -1) {
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'O':
+                if (cambiar_ajuste_socket(optarg) == -1) {
+                    exit(EXIT_FAILURE);
+                }
+                break;
             case '?': default: // si hay una opción no registrada o regresa 0
                 fprintf(stderr, "\nOpción inválida: -- %c\n", optopt);
                 fprintf(stderr, "Usa %s --help para más información.\n\n",argv[0]);
@@ -80,7 +287,7 @@ char* analizar_argumentos(int argc, char *argv[]) {
         }
     }
 
-    if(ip_destino == NULL) {
+    if(ip_destino == NULL && nombre_memoria == NULL) {
         fprintf(stderr, "\nFalta indicar la ip destino.\n");
         fprintf(stderr, "Usa %s --help para más información.\n\n",argv[0]);
         exit(1);
@@ -90,23 +297,507 @@ char* analizar_argumentos(int argc, char *argv[]) {
 }
 
 
+/**
+ * Anuncia y envía el archivo indicado en '--archivo', y muestra la tasa de
+ * transferencia.
+ *
+ * @param descriptor socket conectado al servidor
+ *
+ * @return número de bytes enviados, -1 en caso de error
+ */
+long long enviar_archivo(int descriptor) {
+    struct stat informacion;
+    struct timespec inicio;
+    long long enviados;
+
+    int descriptor_archivo = open(ruta_archivo, O_RDONLY | O_CLOEXEC);
+    if (descriptor_archivo == -1 || fstat(descriptor_archivo, &informacion)
+            == -1) {
+        fprintf(stderr, "\nError al abrir archivo %s: %s\n", ruta_archivo,
+            strerror(errno));
+        return -1;
+    }
+    const char *nombre = strrchr(ruta_archivo, '/');
+    nombre = nombre == NULL ? ruta_archivo : nombre + 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    if (anunciar_archivo(descriptor, informacion.st_size, nombre) == -1) {
+        close(descriptor_archivo);
+        return -1;
+    }
+    enviados = copiar_archivo ?
+        enviar_archivo_copia(descriptor, descriptor_archivo,
+            informacion.st_size) :
+        enviar_archivo_sendfile(descriptor, descriptor_archivo,
+            informacion.st_size);
+    close(descriptor_archivo);
+
+    if (enviados >= 0) {
+        printf("%lld bytes enviados(%s): %.2f MB/s\n", enviados,
+            copiar_archivo ? "read/send" : "sendfile",
+            calcular_mb_por_segundo(enviados, &inicio));
+    }
+
+    return enviados;
+}
+
+/**
+ * Envía 'num_mensajes' tramas de 'tam_mensaje' bytes, con MSG_ZEROCOPY si se
+ * indicó '--zerocopy', y muestra la tasa de envío y el tiempo de CPU usado.
+ *
+ * @param descriptor socket conectado al servidor
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int enviar_mensajes_masivos(int descriptor) {
+    Envio_zerocopy envio;
+    struct timespec inicio;
+    struct rusage uso;
+    long long enviados = 0;
+    long i;
+
+    char *mensaje = (char*)malloc(tam_mensaje);
+    if (mensaje == NULL) {
+        fprintf(stderr, "\nError al reservar memoria para el mensaje\n");
+        return -1;
+    }
+    memset(mensaje, 'x', tam_mensaje);
+
+    habilitar_zerocopy(&envio, descriptor, kUmbralZerocopy);
+    envio.habilitado = envio.habilitado && usar_zerocopy;
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (i = 0; i < num_mensajes; i++) {
+        long res = envio.habilitado ?
+            enviar_trama_zerocopy(&envio, mensaje, tam_mensaje) :
+            enviar_trama_stream(descriptor, mensaje, tam_mensaje);
+        if (res == -1) {
+            break;
+        }
+        enviados += res;
+    }
+    // el buffer no se libera hasta que el kernel termine de usarlo
+    esperar_completados_zerocopy(&envio, envio.siguiente_id);
+
+    getrusage(RUSAGE_SELF, &uso);
+    printf("%lld bytes enviados(%s): %.2f MB/s\n", enviados,
+        envio.habilitado ? "MSG_ZEROCOPY" : "send", calcular_mb_por_segundo(
+            enviados, &inicio));
+    printf("CPU: %.3f s usuario, %.3f s sistema\n",
+        uso.ru_utime.tv_sec + uso.ru_utime.tv_usec/1e6,
+        uso.ru_stime.tv_sec + uso.ru_stime.tv_usec/1e6);
+    if (envio.habilitado) {
+        printf("%lu envíos sin copia(%lu copiados por el kernel), ",
+            envio.envios_zerocopy, envio.envios_copiados);
+        printf("%lu con copia\n", envio.envios_normales);
+    }
+
+    free(mensaje);
+    return i == num_mensajes ? 0 : -1;
+}
+
+/**
+ * Se suscribe al difusor del servidor y recibe los mensajes publicados hasta
+ * que el servidor cierre la conexión(o hasta recibir 'max_recibidos'). Al
+ * final muestra la tasa de recepción, medida desde el primer mensaje.
+ *
+ * @param descriptor socket conectado a un servidor con '--difusion'
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int recibir_suscripcion(int descriptor) {
+    char suscripcion[kTamTemaDifusion + 16];
+    Buffer_tramas entrada;
+    struct timespec inicio;
+    long long bytes = 0;
+    long recibidos = 0;
+    char *mensaje;
+    uint32_t tam;
+    int res = 0;
+
+    int tam_suscripcion = tema_suscripcion == NULL ?
+        snprintf(suscripcion, sizeof(suscripcion), "%s", kPrefijoSuscripcion) :
+        snprintf(suscripcion, sizeof(suscripcion), "%s %s", kPrefijoSuscripcion,
+            tema_suscripcion);
+    if (tam_suscripcion >= (int)sizeof(suscripcion)) {
+        fprintf(stderr, "\nTema inválido: %s\n", tema_suscripcion);
+        return -1;
+    }
+    if (enviar_trama_stream(descriptor, suscripcion, tam_suscripcion) == -1) {
+        return -1;
+    }
+    printf("Suscrito a %s\n\n", tema_suscripcion == NULL ? "todos los temas" :
+        tema_suscripcion);
+
+    inicializar_buffer_tramas(&entrada);
+    while (max_recibidos == 0 || recibidos < max_recibidos) {
+        res = recibir_trama_stream(descriptor, &entrada, &mensaje, &tam);
+        if (res <= 0) {
+            break;  // el servidor cerró la conexión
+        }
+        if (recibidos++ == 0) {
+            clock_gettime(CLOCK_MONOTONIC, &inicio);
+        }
+        bytes += tam;
+        if (!silencioso) {
+            printf("%.*s\n", (int)tam, mensaje);
+        }
+    }
+
+    printf("%ld mensajes recibidos, %lld bytes", recibidos, bytes);
+    if (recibidos > 1) {
+        struct timespec fin;
+        clock_gettime(CLOCK_MONOTONIC, &fin);
+        double segundos = (fin.tv_sec - inicio.tv_sec) +
+            (fin.tv_nsec - inicio.tv_nsec)/1e9;
+        printf(": %.0f mensajes/s, %.2f MB/s", recibidos/segundos,
+            calcular_mb_por_segundo(bytes, &inicio));
+    }
+    printf("\n");
+    liberar_buffer_tramas(&entrada);
+
+    return res == -1 ? -1 : 0;
+}
+
+/**
+ * Hace 'repeticiones' peticiones cortas(una trama) al servidor, obteniendo
+ * la conexión de un pool. Sin '--pool' cada conexión se cierra al terminar su
+ * petición, así se compara el costo de conectarse en cada petición.
+ *
+ * @param ip_destino nombre o dirección del servidor
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int enviar_peticiones_repetidas(const char *ip_destino) {
+    Resolutor_dns resolutor;
+    Pool_conexiones pool;
+    struct timespec inicio;
+    char mensaje[64];
+    long i;
+    int descriptor, res = 0;
+
+    if (crear_resolutor(&resolutor, usar_archivo_hosts ?
+            resolver_con_archivo_hosts : NULL, 0) == -1) {
+        return -1;
+    }
+    if (crear_pool_conexiones(&pool, kMaxPorDestino, kMaxPorDestino,
+            kLimiteConexionMs, &resolutor) == -1) {
+        destruir_resolutor(&resolutor);
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (i = 0; i < repeticiones; i++) {
+        descriptor = tomar_conexion(&pool, ip_destino, kPuerto);
+        if (descriptor == -1) {
+            fprintf(stderr, "\nError al obtener conexión: %s\n",
+                strerror(errno));
+            res = -1;
+            break;
+        }
+        snprintf(mensaje, sizeof(mensaje), "peticion %ld", i);
+        res = enviar_trama_stream(descriptor, mensaje, strlen(mensaje));
+        devolver_conexion(&pool, descriptor, usar_pool && res != -1);
+        if (res == -1) {
+            break;
+        }
+    }
+    double ms = calcular_ms_transcurridos(&inicio);
+
+    printf("%ld peticiones en %.3f ms(%.3f ms por petición)\n", i, ms,
+        i == 0 ? 0.0 : ms/i);
+    printf("Conexiones: %lu nuevas, %lu reutilizadas, %lu descartadas\n",
+        pool.nuevas, pool.reutilizadas, pool.descartadas);
+
+    destruir_pool_conexiones(&pool);
+    destruir_resolutor(&resolutor);
+    return res == -1 ? -1 : 0;
+}
+
+/**
+ * Genera carga contra el servidor durante 'duracion_carga' segundos y muestra
+ * la tasa lograda y las latencias.
+ *
+ * @param info_destino direcciones del servidor
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int generar_carga(const struct addrinfo *info_destino) {
+    Config_carga config;
+    Resultado_carga resultado;
+
+    config.direcciones = info_destino;
+    config.tipo_socket = SOCK_STREAM;
+    config.conexiones = conexiones_carga;
+    config.hilos = hilos_carga > 0 ? hilos_carga :
+        (int)sysconf(_SC_NPROCESSORS_ONLN);
+    config.tasa = tasa_carga;
+    config.tam_mensaje = tam_mensaje > 0 ? tam_mensaje : 64;
+    config.duracion = duracion_carga;
+    config.segmentos_gso = 0;
+
+    // una conexión cerrada por el servidor se cuenta como error
+    signal(SIGPIPE, SIG_IGN);
+    int res = ejecutar_carga(&config, &resultado);
+    mostrar_resultado_carga(&config, &resultado);
+    destruir_histograma(&resultado.latencias);
+
+    return res;
+}
+
+/**
+ * Envía 'num_pings' pings al servidor y muestra las estadísticas de los ecos.
+ *
+ * @param descriptor socket conectado al servidor
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int medir_rtt(int descriptor) {
+    Estadisticas_ping estadisticas;
+
+    if (crear_estadisticas_ping(&estadisticas, num_pings) == -1) {
+        return -1;
+    }
+    int res = ejecutar_ping(descriptor, SOCK_STREAM, num_pings, intervalo_ping,
+        tam_mensaje, &estadisticas);
+    mostrar_estadisticas_ping(&estadisticas);
+    destruir_estadisticas_ping(&estadisticas);
+
+    return res;
+}
+
+/**
+ * Envía 'num_pings' pings por el canal de memoria compartida y espera el eco
+ * de cada uno antes del siguiente(a lo más 'kEsperaEcoMs').
+ *
+ * @param canal canal conectado al servidor(con '--eco')
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int medir_rtt_memoria(Canal_memoria *canal) {
+    Estadisticas_ping estadisticas;
+    size_t tam_ping = (size_t)(tam_mensaje < kTamPing ? kTamPing : tam_mensaje);
+    uint64_t inicio, ahora, limite;
+    int bytes, secuencia, res = 0;
+    long i;
+
+    // el buffer del eco va después del mensaje
+    char *mensaje = (char*)malloc(2*tam_ping + 1);
+    if (mensaje == NULL || crear_estadisticas_ping(&estadisticas, num_pings)
+            == -1) {
+        fprintf(stderr,"\nError al reservar memoria para el ping\n");
+        free(mensaje);
+        return -1;
+    }
+    memset(mensaje, 'x', tam_ping);
+
+    for (i = 0; i < num_pings && res == 0; i++) {
+        inicio = obtener_ns_monotonicos();
+        escribir_ping(mensaje, i, inicio);
+        if (enviar_datos_memoria(canal, mensaje, tam_ping, 0) == -1) {
+            fprintf(stderr, "\nError al enviar ping: %s\n", strerror(errno));
+            res = -1;
+            break;
+        }
+        estadisticas.enviados++;
+        limite = inicio + (uint64_t)kEsperaEcoMs*1000000ull;
+        secuencia = -1;
+        while (secuencia != i) {
+            bytes = recibir_datos_memoria(canal, mensaje + tam_ping,
+                tam_ping + 1, MSG_DONTWAIT);
+            if (bytes > 0) {
+                secuencia = registrar_eco_ping(&estadisticas,
+                    mensaje + tam_ping, bytes, intervalo_ping > 0);
+                continue;
+            }
+            if (bytes == 0) {
+                fprintf(stderr, "\nEl servidor cerró el canal\n");
+                res = -1;
+                break;
+            }
+            ahora = obtener_ns_monotonicos();
+            if (ahora >= limite) {
+                break;  // el eco se cuenta como perdido
+            }
+            esperar_datos_memoria(canal, (int)((limite - ahora)/1000000) + 1);
+        }
+        if (intervalo_ping > 0) {
+            struct timespec proximo = {
+                (inicio + (uint64_t)intervalo_ping*1000000ull)/1000000000ull,
+                (inicio + (uint64_t)intervalo_ping*1000000ull)%1000000000ull};
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &proximo, NULL);
+        }
+    }
+
+    mostrar_estadisticas_ping(&estadisticas);
+    destruir_estadisticas_ping(&estadisticas);
+    free(mensaje);
+    return res;
+}
+
+/**
+ * Envía 'num_mensajes' mensajes de 'tam_mensaje' bytes por el canal de
+ * memoria compartida y muestra la tasa de envío y el tiempo de CPU usado.
+ *
+ * @param canal canal conectado al servidor
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int enviar_mensajes_memoria(Canal_memoria *canal) {
+    struct timespec inicio;
+    struct rusage uso;
+    long long enviados = 0;
+    long i;
+
+    char *mensaje = (char*)malloc(tam_mensaje);
+    if (mensaje == NULL) {
+        fprintf(stderr, "\nError al reservar memoria para el mensaje\n");
+        return -1;
+    }
+    memset(mensaje, 'x', tam_mensaje);
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (i = 0; i < num_mensajes; i++) {
+        int res = enviar_datos_memoria(canal, mensaje, tam_mensaje, 0);
+        if (res == -1) {
+            fprintf(stderr, "\nError al enviar mensaje: %s\n",
+                strerror(errno));
+            break;
+        }
+        enviados += res;
+    }
+
+    getrusage(RUSAGE_SELF, &uso);
+    printf("%lld bytes enviados(memoria compartida): %.2f MB/s\n", enviados,
+        calcular_mb_por_segundo(enviados, &inicio));
+    printf("CPU: %.3f s usuario, %.3f s sistema\n",
+        uso.ru_utime.tv_sec + uso.ru_utime.tv_usec/1e6,
+        uso.ru_stime.tv_sec + uso.ru_stime.tv_usec/1e6);
+
+    free(mensaje);
+    return i == num_mensajes ? 0 : -1;
+}
+
+/**
+ * Usa el canal de memoria compartida de '--memoria' en lugar de un socket:
+ * mide el RTT con '--ping', envía mensajes masivos con '--tam-mensaje' o
+ * envía cada línea capturada.
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int usar_canal_memoria(void) {
+    Canal_memoria canal;
+    int res = 0;
+
+    if (ruta_archivo != NULL || repeticiones > 0 || duracion_carga > 0) {
+        fprintf(stderr, "\n--archivo, --repeticiones y --duracion usan ");
+        fprintf(stderr, "sockets, no están disponibles con --memoria\n");
+        return -1;
+    }
+    if (conectar_canal_memoria(&canal, nombre_memoria) == -1) {
+        return -1;
+    }
+    printf("Conectado al canal de memoria compartida %s\n\n", nombre_memoria);
+
+    if (num_pings > 0) {
+        res = medir_rtt_memoria(&canal);
+    } else if (tam_mensaje > 0) {
+        res = enviar_mensajes_memoria(&canal);
+    } else {
+        char *buffer = (char*)calloc(kMaxBuffer, sizeof(char));
+        while (strcmp(buffer, kMsjSalida) != 0) {
+            scanf("%[^\n]s", buffer); // leo frase hasta el salto de línea
+            clear_buffer();
+            if (enviar_datos_memoria(&canal, buffer, strlen(buffer), 0) == -1) {
+                res = -1;
+                break;
+            }
+        }
+        free(buffer);
+    }
+
+    mostrar_estadisticas_memoria(&canal);
+    cerrar_canal_memoria(&canal);
+    return res;
+}
+
 int main(int argc,  char *argv[]) {
+    familia_direcciones = kAMBAS;
     char *ip_destino = analizar_argumentos(argc, argv);
+    if (nombre_memoria != NULL) {
+        return usar_canal_memoria() == -1 ? EXIT_FAILURE : 0;
+    }
     printf("Se usará la familia de direcciones: '%s'\n\n",
-        familia_direcciones == kIPV4 ? kMensajeIPV4 : kMensajeIPV6);
+        es_direccion_unix(ip_destino) ? kMensajeUnix :
+        familia_direcciones == kIPV4 ? kMensajeIPV4 :
+        familia_direcciones == kIPV6 ? kMensajeIPV6 : kMensajeAmbas);
+
+    if (repeticiones > 0) {
+        return enviar_peticiones_repetidas(ip_destino) == -1 ? EXIT_FAILURE : 0;
+    }
 
+    Resolutor_dns resolutor;
     struct addrinfo *info_destino = NULL;
-    int descriptor = inicializar_cliente(ip_destino, kPuerto, SOCK_STREAM,
+    if (crear_resolutor(&resolutor, usar_archivo_hosts ?
+            resolver_con_archivo_hosts : NULL, 0) == -1) {
+        exit(EXIT_FAILURE);
+    }
+    int error = resolver_direccion(&resolutor, ip_destino, kPuerto, SOCK_STREAM,
         &info_destino);
+    if (error != 0) {
+        fprintf(stderr, "\nError al resolver %s: %s\n", ip_destino,
+            gai_strerror(error));
+        exit(EXIT_FAILURE);
+    }
+    if (duracion_carga > 0) {
+        int res = generar_carga(info_destino);
+        soltar_direccion(&resolutor, info_destino);
+        destruir_resolutor(&resolutor);
+        return res == -1 ? EXIT_FAILURE : 0;
+    }
+    Intento_conexion intentos[kMaxIntentosConexion];
+    int num_intentos;
+    int descriptor = conectar_happy_eyeballs(info_destino, kLimiteConexionMs,
+        intentos, &num_intentos);
+    printf("Intentos de conexión a %s:\n", ip_destino);
+    mostrar_intentos_conexion(intentos, num_intentos);
+    soltar_direccion(&resolutor, info_destino);
+    destruir_resolutor(&resolutor);
+    if (descriptor == -1) {
+        fprintf(stderr,"\nError al conectar: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (ajustes_socket.modificado) {
+        mostrar_ajustes_socket(descriptor, SOCK_STREAM);
+    }
 
-    conectar(descriptor, info_destino);
+    if (ruta_archivo != NULL) {
+        int res = enviar_archivo(descriptor);
+        close(descriptor);
+        return res == -1 ? EXIT_FAILURE : 0;
+    }
+    if (suscribir) {
+        int res = recibir_suscripcion(descriptor);
+        close(descriptor);
+        return res == -1 ? EXIT_FAILURE : 0;
+    }
+    if (num_pings > 0) {
+        int res = medir_rtt(descriptor);
+        close(descriptor);
+        return res == -1 ? EXIT_FAILURE : 0;
+    }
+    if (tam_mensaje > 0) {
+        int res = enviar_mensajes_masivos(descriptor);
+        close(descriptor);
+        return res == -1 ? EXIT_FAILURE : 0;
+    }
 
     char *buffer = (char*)malloc(sizeof(char)*kMaxBuffer);
 
     while (strcmp(buffer, kMsjSalida) != 0) {
         scanf("%[^\n]s", buffer); // leo frase hasta que se pulsa salto de línea
         clear_buffer();
-        enviar_datos_stream(descriptor, buffer, kMaxBuffer-1, 0);
+        enviar_trama_stream(descriptor, buffer, strlen(buffer));
     }
 
     printf("\nApagando cliente...\n");
@@ -0,0 +1,308 @@
+/**
+ * Funciones para ajustar las opciones de los sockets
+ *
+ * Los ajustes del proceso('ajustes_socket') se aplican a cada socket al
+ * crearlo('crear_socket()', los intentos de conexión y los sockets de la
+ * carga). Se parte de un perfil y se puede cambiar cada opción:
+ *
+ * 	clave           opción               normal  baja-latencia  masivo
+ * 	nodelay         TCP_NODELAY          -       1              0
+ * 	quickack        TCP_QUICKACK         -       1              -
+ * 	sndbuf          SO_SNDBUF(bytes)     -       -              4194304
+ * 	rcvbuf          SO_RCVBUF(bytes)     -       -              4194304
+ * 	busy-poll       SO_BUSY_POLL(µs)     -       50             -
+ * 	notsent-lowat   TCP_NOTSENT_LOWAT    -       16384          -
+ * 	prioridad       SO_PRIORITY          -       6              -
+ * 	reserva         'listen()'           10      1024           128
+ *
+ * ('-' deja el valor del sistema)
+ *
+ * Notas:
+ * - Las opciones TCP sólo se aplican a sockets de flujo.
+ * - Los sockets aceptados heredan las opciones del socket que escucha, salvo
+ * 	TCP_QUICKACK, que el kernel desactiva solo; se aplica a cada conexión con
+ * 	'aplicar_ajustes_aceptado()'.
+ * - El kernel duplica SO_SNDBUF/SO_RCVBUF y los limita a 'net.core.wmem_max'
+ * 	y 'net.core.rmem_max'; SO_BUSY_POLL y prioridades mayores a 6 requieren
+ * 	CAP_NET_ADMIN. Por eso 'mostrar_ajustes_socket()' muestra los valores
+ * 	efectivos leídos con 'getsockopt()'.
+ * - Una opción que no se pudo aplicar se avisa y no detiene al programa.
+ *
+ * Para más información consultar 'man 7 socket' y 'man 7 tcp'.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_AJUSTES_H_
+#define FUNCIONES_AJUSTES_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>  // 'offsetof()'
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>  // 'TCP_NODELAY', 'TCP_QUICKACK', ...
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#ifndef TCP_NOTSENT_LOWAT
+#define TCP_NOTSENT_LOWAT 25
+#endif
+
+// valor de una opción que no se cambia
+enum {kSinAjuste = -1};
+
+// opciones aplicadas a cada socket
+typedef struct Ajustes_socket {
+    const char *perfil;
+    int sin_retardo;  // TCP_NODELAY
+    int ack_rapido;  // TCP_QUICKACK
+    int buffer_envio;  // SO_SNDBUF
+    int buffer_recepcion;  // SO_RCVBUF
+    int sondeo_activo;  // SO_BUSY_POLL
+    int umbral_no_enviado;  // TCP_NOTSENT_LOWAT
+    int prioridad;  // SO_PRIORITY
+    int reserva;  // conexiones pendientes de 'listen()'
+    int modificado;  // 1 si se eligió un perfil o se cambió una opción
+} Ajustes_socket;
+
+// opción que se puede cambiar con 'cambiar_ajuste_socket()'
+typedef struct Opcion_ajuste {
+    const char *clave;
+    const char *nombre;  // nombre de la opción del sistema
+    int nivel;  // nivel de 'setsockopt()', 0 si no es opción de socket
+    int opcion;
+    int solo_flujo;  // 1 si sólo aplica a sockets de flujo
+    size_t desplazamiento;  // campo en 'Ajustes_socket'
+} Opcion_ajuste;
+
+const Ajustes_socket kPerfilesSocket[] = {
+    {"normal", kSinAjuste, kSinAjuste, kSinAjuste, kSinAjuste, kSinAjuste,
+        kSinAjuste, kSinAjuste, 10, 0},
+    {"baja-latencia", 1, 1, kSinAjuste, kSinAjuste, 50, 16384, 6, 1024, 0},
+    {"masivo", 0, kSinAjuste, 4194304, 4194304, kSinAjuste, kSinAjuste,
+        kSinAjuste, 128, 0},
+};
+const int kNumPerfilesSocket = sizeof(kPerfilesSocket)/sizeof(Ajustes_socket);
+
+const Opcion_ajuste kOpcionesAjuste[] = {
+    {"nodelay", "TCP_NODELAY", IPPROTO_TCP, TCP_NODELAY, 1,
+        offsetof(Ajustes_socket, sin_retardo)},
+    {"quickack", "TCP_QUICKACK", IPPROTO_TCP, TCP_QUICKACK, 1,
+        offsetof(Ajustes_socket, ack_rapido)},
+    {"sndbuf", "SO_SNDBUF", SOL_SOCKET, SO_SNDBUF, 0,
+        offsetof(Ajustes_socket, buffer_envio)},
+    {"rcvbuf", "SO_RCVBUF", SOL_SOCKET, SO_RCVBUF, 0,
+        offsetof(Ajustes_socket, buffer_recepcion)},
+    {"busy-poll", "SO_BUSY_POLL", SOL_SOCKET, SO_BUSY_POLL, 0,
+        offsetof(Ajustes_socket, sondeo_activo)},
+    {"notsent-lowat", "TCP_NOTSENT_LOWAT", IPPROTO_TCP, TCP_NOTSENT_LOWAT, 1,
+        offsetof(Ajustes_socket, umbral_no_enviado)},
+    {"prioridad", "SO_PRIORITY", SOL_SOCKET, SO_PRIORITY, 0,
+        offsetof(Ajustes_socket, prioridad)},
+    {"reserva", "listen", 0, 0, 1, offsetof(Ajustes_socket, reserva)},
+};
+const int kNumOpcionesAjuste = sizeof(kOpcionesAjuste)/sizeof(Opcion_ajuste);
+
+// ajustes del proceso, por defecto el perfil "normal"
+Ajustes_socket ajustes_socket = {"normal", kSinAjuste, kSinAjuste, kSinAjuste,
+    kSinAjuste, kSinAjuste, kSinAjuste, kSinAjuste, 10, 0};
+
+/* Prototipos */
+
+int seleccionar_perfil_socket(const char *nombre);
+int cambiar_ajuste_socket(const char *asignacion);
+int* obtener_campo_ajuste(Ajustes_socket *ajustes, const Opcion_ajuste *opcion);
+int aplicar_ajustes_socket(int descriptor, int tipo_socket);
+void aplicar_ajustes_aceptado(int descriptor);
+void mostrar_ajustes_socket(int descriptor, int tipo_socket);
+void mostrar_perfiles_socket(void);
+
+/* Funciones */
+
+/**
+ * Obtiene el campo de los ajustes que corresponde a una opción.
+ *
+ * @param ajustes ajustes
+ * @param opcion opción
+ *
+ * @return apuntador al valor de la opción
+ */
+int* obtener_campo_ajuste(Ajustes_socket *ajustes, const Opcion_ajuste *opcion) {
+    return (int*)((char*)ajustes + opcion->desplazamiento);
+}
+
+/**
+ * Reemplaza los ajustes del proceso por los de un perfil.
+ *
+ * @param nombre nombre del perfil
+ *
+ * @return 0 en caso de éxito, -1 si el perfil no existe
+ */
+int seleccionar_perfil_socket(const char *nombre) {
+    int i;
+
+    for (i = 0; i < kNumPerfilesSocket; i++) {
+        if (strcmp(kPerfilesSocket[i].perfil, nombre) == 0) {
+            ajustes_socket = kPerfilesSocket[i];
+            ajustes_socket.modificado = 1;
+            return 0;
+        }
+    }
+    fprintf(stderr, "\nPerfil de socket desconocido: %s\n", nombre);
+    mostrar_perfiles_socket();
+
+    return -1;
+}
+
+/**
+ * Cambia una opción de los ajustes del proceso.
+ *
+ * @param asignacion texto de la forma "clave=valor", por ejemplo
+ *                   "sndbuf=1048576"
+ *
+ * @return 0 en caso de éxito, -1 si la clave o el valor no son válidos
+ */
+int cambiar_ajuste_socket(const char *asignacion) {
+    const char *igual = strchr(asignacion, '=');
+    char *fin;
+    int i;
+
+    if (igual != NULL) {
+        for (i = 0; i < kNumOpcionesAjuste; i++) {
+            const Opcion_ajuste *opcion = &kOpcionesAjuste[i];
+            if (strlen(opcion->clave) != (size_t)(igual - asignacion) ||
+                    strncmp(opcion->clave, asignacion, igual - asignacion) != 0) {
+                continue;
+            }
+            long valor = strtol(igual + 1, &fin, 10);
+            if (*(igual + 1) == '\0' || *fin != '\0' || valor < 0 ||
+                    valor > 0x7fffffff) {
+                break;
+            }
+            *obtener_campo_ajuste(&ajustes_socket, opcion) = (int)valor;
+            ajustes_socket.modificado = 1;
+            return 0;
+        }
+    }
+    fprintf(stderr, "\nAjuste de socket inválido: %s\n", asignacion);
+    mostrar_perfiles_socket();
+
+    return -1;
+}
+
+/**
+ * Aplica los ajustes del proceso a un socket recién creado.
+ *
+ * @param descriptor identificador del socket
+ * @param tipo_socket SOCK_STREAM o SOCK_DGRAM
+ *
+ * @return 0 si se aplicaron todas las opciones, -1 si alguna falló
+ */
+int aplicar_ajustes_socket(int descriptor, int tipo_socket) {
+    int i, res = 0, dominio = -1;
+    socklen_t tam = sizeof(int);
+
+    for (i = 0; i < kNumOpcionesAjuste; i++) {
+        const Opcion_ajuste *opcion = &kOpcionesAjuste[i];
+        int valor = *obtener_campo_ajuste(&ajustes_socket, opcion);
+        if (valor == kSinAjuste || opcion->nivel == 0 ||
+                (opcion->solo_flujo && tipo_socket != SOCK_STREAM)) {
+            continue;
+        }
+        // las opciones de TCP no aplican a sockets de dominio Unix
+        if (opcion->nivel == IPPROTO_TCP && dominio == -1 &&
+                getsockopt(descriptor, SOL_SOCKET, SO_DOMAIN, &dominio,
+                    &tam) == -1) {
+            dominio = AF_UNSPEC;
+        }
+        if (opcion->nivel == IPPROTO_TCP && dominio == AF_UNIX) {
+            continue;
+        }
+        if (setsockopt(descriptor, opcion->nivel, opcion->opcion, &valor,
+                sizeof(int)) == -1) {
+            fprintf(stderr, "\nNo se pudo aplicar %s=%d: %s\n", opcion->nombre,
+                valor, strerror(errno));
+            res = -1;
+        }
+    }
+
+    return res;
+}
+
+/**
+ * Aplica a una conexión aceptada las opciones que no hereda del socket que
+ * escucha(TCP_QUICKACK).
+ *
+ * @param descriptor identificador de la conexión
+ */
+void aplicar_ajustes_aceptado(int descriptor) {
+    if (ajustes_socket.ack_rapido != kSinAjuste) {
+        setsockopt(descriptor, IPPROTO_TCP, TCP_QUICKACK,
+            &ajustes_socket.ack_rapido, sizeof(int));
+    }
+}
+
+/**
+ * Muestra el valor efectivo de cada opción del socket(leído con
+ * 'getsockopt()') junto al valor pedido.
+ *
+ * @param descriptor identificador del socket
+ * @param tipo_socket SOCK_STREAM o SOCK_DGRAM
+ */
+void mostrar_ajustes_socket(int descriptor, int tipo_socket) {
+    int i;
+
+    printf("Ajustes del socket(perfil '%s'):\n", ajustes_socket.perfil);
+    for (i = 0; i < kNumOpcionesAjuste; i++) {
+        const Opcion_ajuste *opcion = &kOpcionesAjuste[i];
+        int pedido = *obtener_campo_ajuste(&ajustes_socket, opcion);
+        int valor;
+        socklen_t tam = sizeof(int);
+        if (opcion->solo_flujo && tipo_socket != SOCK_STREAM) {
+            continue;
+        }
+        if (opcion->nivel == 0) {
+            // la reserva sólo importa en un socket que escucha
+            if (getsockopt(descriptor, SOL_SOCKET, SO_ACCEPTCONN, &valor,
+                    &tam) == 0 && valor) {
+                printf("\t%-18s%d\n", opcion->nombre, pedido);
+            }
+            continue;
+        }
+        printf("\t%-18s", opcion->nombre);
+        if (getsockopt(descriptor, opcion->nivel, opcion->opcion, &valor,
+                &tam) == -1) {
+            printf("no disponible(%s)\n", strerror(errno));
+            continue;
+        }
+        printf("%d", valor);
+        if (pedido != kSinAjuste) {
+            printf("(pedido %d)", pedido);
+        }
+        printf("\n");
+    }
+}
+
+/**
+ * Muestra los perfiles y las claves de las opciones que se pueden cambiar.
+ */
+void mostrar_perfiles_socket(void) {
+    int i;
+
+    fprintf(stderr, "Perfiles:");
+    for (i = 0; i < kNumPerfilesSocket; i++) {
+        fprintf(stderr, " %s", kPerfilesSocket[i].perfil);
+    }
+    fprintf(stderr, "\nClaves:");
+    for (i = 0; i < kNumOpcionesAjuste; i++) {
+        fprintf(stderr, " %s(%s)", kOpcionesAjuste[i].clave,
+            kOpcionesAjuste[i].nombre);
+    }
+    fprintf(stderr, "\n");
+}
+
+#endif  // FUNCIONES_AJUSTES_H_
@@ -0,0 +1,317 @@
+/**
+ * Funciones para una bitácora asíncrona de mensajes recibidos
+ *
+ * Mostrar cada mensaje con 'printf()' desde el ciclo de recepción hace que, a
+ * tasas altas, la salida estándar sea el cuello de botella y bloquee la
+ * recepción. Con la bitácora el hilo que recibe sólo copia un registro de
+ * tamaño fijo(dirección, longitud y el inicio del mensaje) a un anillo propio;
+ * un hilo de fondo da formato a los registros de todos los anillos y los
+ * escribe por lotes con un solo 'fwrite()'.
+ *
+ * Notas:
+ * - Cada anillo tiene un solo productor(su hilo) y un solo consumidor(el hilo
+ * 	de fondo), así no se necesitan candados: basta publicar los índices con
+ * 	semántica de adquisición/liberación.
+ * - Si un anillo está lleno el registro se descarta y se cuenta; la recepción
+ * 	nunca espera a la salida.
+ * - Con 'muestreo' N sólo se registra uno de cada N mensajes de cada hilo; con
+ * 	0 no se registra ninguno.
+ * - La dirección se guarda ya formateada: el llamador puede pasar la que ya
+ * 	tiene(p. ej. la de su tabla de pares, ver 'funciones_pares.h'); si no, se
+ * 	formatea al registrar, sólo para los mensajes que pasan el muestreo.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_BITACORA_H_
+#define FUNCIONES_BITACORA_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>  // 'nanosleep()'
+
+#include "funciones_sockets.h"
+
+// registros de cada anillo(potencia de 2)
+const unsigned kCapacidadBitacora = 4096;
+// bytes que se guardan de cada mensaje
+enum {kMaxTextoBitacora = 100};
+// tiempo que duerme el hilo de fondo cuando no hay registros
+const long kEsperaBitacoraNs = 10000000;
+// tamaño del buffer de salida del hilo de fondo
+const int kTamSalidaBitacora = 65536;
+
+typedef struct Registro_bitacora {
+    char origen[INET6_ADDRSTRLEN];  // dirección imprimible
+    uint32_t bytes;  // longitud del mensaje recibido
+    uint32_t tam_texto;  // bytes guardados en 'texto'
+    char texto[kMaxTextoBitacora];
+} Registro_bitacora;
+
+// anillo de un hilo productor
+typedef struct Anillo_bitacora {
+    Registro_bitacora *registros;
+    uint64_t cabeza;  // siguiente registro a escribir(sólo lo escribe el hilo)
+    uint64_t cola;  // siguiente registro a mostrar(sólo lo escribe el fondo)
+    uint64_t descartados;  // registros perdidos por anillo lleno
+    uint64_t omitidos;  // mensajes no registrados por el muestreo
+    unsigned cuenta_muestreo;
+    struct Anillo_bitacora *siguiente;
+} Anillo_bitacora;
+
+typedef struct Bitacora {
+    FILE *salida;
+    unsigned capacidad;
+    unsigned muestreo;  // registrar 1 de cada N mensajes, 0 para ninguno
+    Anillo_bitacora *anillos;  // anillos de todos los hilos
+    pthread_mutex_t candado;  // protege la lista de anillos
+    pthread_t hilo;
+    volatile int activa;
+    char *buffer;  // buffer de salida del hilo de fondo
+} Bitacora;
+
+Bitacora bitacora;  // bitácora del proceso
+__thread Anillo_bitacora *anillo_bitacora = NULL;  // anillo del hilo
+
+/* Prototipos */
+
+int iniciar_bitacora(FILE *salida, unsigned capacidad, unsigned muestreo);
+Anillo_bitacora* obtener_anillo_bitacora(void);
+void registrar_mensaje_bitacora(const struct sockaddr_storage *origen,
+        const char *ip, const char *mensaje, uint32_t tam_mensaje);
+int vaciar_anillos_bitacora(void);
+void* ejecutar_bitacora(void *argumento);
+void obtener_contadores_bitacora(uint64_t *descartados, uint64_t *omitidos);
+void detener_bitacora(void);
+
+/* Funciones */
+
+/**
+ * Inicializa la bitácora del proceso y crea el hilo de fondo.
+ *
+ * @param salida archivo donde se escriben los registros(por ejemplo 'stdout')
+ * @param capacidad registros de cada anillo, potencia de 2
+ * @param muestreo registrar 1 de cada 'muestreo' mensajes, 0 para ninguno
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int iniciar_bitacora(FILE *salida, unsigned capacidad, unsigned muestreo) {
+    memset(&bitacora, 0, sizeof(Bitacora));
+    bitacora.salida = salida;
+    bitacora.capacidad = capacidad;
+    bitacora.muestreo = muestreo;
+    bitacora.activa = 1;
+    pthread_mutex_init(&bitacora.candado, NULL);
+    bitacora.buffer = (char*)malloc(kTamSalidaBitacora);
+    if (bitacora.buffer == NULL) {
+        fprintf(stderr,"\nError al reservar memoria para la bitácora\n");
+        return -1;
+    }
+    if (pthread_create(&bitacora.hilo, NULL, ejecutar_bitacora, NULL) != 0) {
+        fprintf(stderr,"\nError al crear el hilo de la bitácora\n");
+        free(bitacora.buffer);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Obtiene el anillo del hilo que llama; la primera vez lo crea y lo agrega a
+ * la bitácora.
+ *
+ * @return anillo del hilo, NULL si no hay memoria
+ */
+Anillo_bitacora* obtener_anillo_bitacora(void) {
+    if (anillo_bitacora != NULL) {
+        return anillo_bitacora;
+    }
+    Anillo_bitacora *anillo = (Anillo_bitacora*)calloc(1,
+        sizeof(Anillo_bitacora));
+    if (anillo == NULL) {
+        return NULL;
+    }
+    anillo->registros = (Registro_bitacora*)malloc(sizeof(Registro_bitacora)*
+        bitacora.capacidad);
+    if (anillo->registros == NULL) {
+        free(anillo);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&bitacora.candado);
+    anillo->siguiente = bitacora.anillos;
+    bitacora.anillos = anillo;
+    pthread_mutex_unlock(&bitacora.candado);
+    anillo_bitacora = anillo;
+
+    return anillo;
+}
+
+/**
+ * Registra un mensaje recibido. No bloquea: si el anillo está lleno el
+ * registro se descarta.
+ *
+ * @param origen dirección de quien envió el mensaje
+ * @param ip 'origen' ya formateada, o 'NULL' para formatearla aquí
+ * @param mensaje datos recibidos
+ * @param tam_mensaje longitud del mensaje
+ */
+void registrar_mensaje_bitacora(const struct sockaddr_storage *origen,
+        const char *ip, const char *mensaje, uint32_t tam_mensaje) {
+    if (bitacora.muestreo == 0) {
+        return;
+    }
+    Anillo_bitacora *anillo = obtener_anillo_bitacora();
+    if (anillo == NULL) {
+        return;
+    }
+    if (++anillo->cuenta_muestreo < bitacora.muestreo) {
+        __atomic_store_n(&anillo->omitidos, anillo->omitidos + 1,
+            __ATOMIC_RELAXED);
+        return;
+    }
+    anillo->cuenta_muestreo = 0;
+
+    uint64_t cabeza = anillo->cabeza;
+    if (cabeza - __atomic_load_n(&anillo->cola, __ATOMIC_ACQUIRE) ==
+            bitacora.capacidad) {
+        __atomic_store_n(&anillo->descartados, anillo->descartados + 1,
+            __ATOMIC_RELAXED);
+        return;
+    }
+    Registro_bitacora *registro =
+        &anillo->registros[cabeza & (bitacora.capacidad - 1)];
+    if (ip == NULL) {
+        ip = escribir_direccion_imprimible((struct sockaddr*)origen,
+            registro->origen, sizeof(registro->origen));
+    }
+    if (ip != registro->origen) {
+        snprintf(registro->origen, sizeof(registro->origen), "%s", ip);
+    }
+    registro->bytes = tam_mensaje;
+    registro->tam_texto = tam_mensaje > kMaxTextoBitacora ? kMaxTextoBitacora :
+        tam_mensaje;
+    memcpy(registro->texto, mensaje, registro->tam_texto);
+    // el registro queda visible para el hilo de fondo hasta aquí
+    __atomic_store_n(&anillo->cabeza, cabeza + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Da formato a los registros pendientes de todos los anillos y los escribe
+ * por lotes.
+ *
+ * @return número de registros escritos
+ */
+int vaciar_anillos_bitacora(void) {
+    Anillo_bitacora *anillo;
+    int usados = 0, escritos = 0;
+
+    pthread_mutex_lock(&bitacora.candado);
+    anillo = bitacora.anillos;
+    pthread_mutex_unlock(&bitacora.candado);
+
+    // los anillos sólo se agregan al inicio de la lista, nunca se quitan
+    for (; anillo != NULL; anillo = anillo->siguiente) {
+        uint64_t cola = anillo->cola;
+        uint64_t cabeza = __atomic_load_n(&anillo->cabeza, __ATOMIC_ACQUIRE);
+        for (; cola != cabeza; cola++) {
+            Registro_bitacora *registro =
+                &anillo->registros[cola & (bitacora.capacidad - 1)];
+            // espacio para un registro completo con su formato
+            if (kTamSalidaBitacora - usados < 2*kMaxTextoBitacora +
+                    INET6_ADDRSTRLEN + 128) {
+                fwrite(bitacora.buffer, 1, usados, bitacora.salida);
+                usados = 0;
+            }
+            usados += snprintf(bitacora.buffer + usados,
+                kTamSalidaBitacora - usados,
+                "-------------------------------------------------\n"
+                "%u datos recibidos de %s\nEl mensaje es: \"%.*s\"\n",
+                registro->bytes, registro->origen,
+                (int)strnlen(registro->texto, registro->tam_texto),
+                registro->texto);
+            escritos++;
+        }
+        __atomic_store_n(&anillo->cola, cola, __ATOMIC_RELEASE);
+    }
+    if (usados > 0) {
+        fwrite(bitacora.buffer, 1, usados, bitacora.salida);
+        fflush(bitacora.salida);
+    }
+
+    return escritos;
+}
+
+/**
+ * Función del hilo de fondo: vacía los anillos y duerme cuando no hay
+ * registros. Al detenerse vacía lo que quede.
+ *
+ * @param argumento no se usa
+ *
+ * @return NULL
+ */
+void* ejecutar_bitacora(void *argumento) {
+    struct timespec espera = {0, kEsperaBitacoraNs};
+
+    while (bitacora.activa) {
+        if (vaciar_anillos_bitacora() == 0) {
+            nanosleep(&espera, NULL);
+        }
+    }
+    vaciar_anillos_bitacora();
+
+    return NULL;
+}
+
+/**
+ * Suma los registros descartados y los mensajes omitidos por el muestreo de
+ * todos los hilos.
+ *
+ * @param descartados donde se guardan los registros perdidos
+ * @param omitidos donde se guardan los mensajes omitidos
+ */
+void obtener_contadores_bitacora(uint64_t *descartados, uint64_t *omitidos) {
+    Anillo_bitacora *anillo;
+
+    *descartados = *omitidos = 0;
+    pthread_mutex_lock(&bitacora.candado);
+    for (anillo = bitacora.anillos; anillo != NULL;
+            anillo = anillo->siguiente) {
+        *descartados += __atomic_load_n(&anillo->descartados,
+            __ATOMIC_RELAXED);
+        *omitidos += __atomic_load_n(&anillo->omitidos, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&bitacora.candado);
+}
+
+/**
+ * Detiene el hilo de fondo después de escribir los registros pendientes,
+ * muestra cuántos se descartaron u omitieron y libera los anillos. Los hilos
+ * productores ya no deben registrar.
+ */
+void detener_bitacora(void) {
+    Anillo_bitacora *anillo, *siguiente;
+    uint64_t descartados, omitidos;
+
+    bitacora.activa = 0;
+    pthread_join(bitacora.hilo, NULL);
+    obtener_contadores_bitacora(&descartados, &omitidos);
+    if (descartados > 0 || omitidos > 0) {
+        fprintf(bitacora.salida, "Bitácora: %llu registros descartados(anillo "
+            "lleno), %llu mensajes omitidos(muestreo)\n",
+            (unsigned long long)descartados, (unsigned long long)omitidos);
+    }
+    for (anillo = bitacora.anillos; anillo != NULL; anillo = siguiente) {
+        siguiente = anillo->siguiente;
+        free(anillo->registros);
+        free(anillo);
+    }
+    bitacora.anillos = NULL;
+    free(bitacora.buffer);
+    pthread_mutex_destroy(&bitacora.candado);
+}
+
+#endif  // FUNCIONES_BITACORA_H_
@@ -0,0 +1,363 @@
+/**
+ * Funciones para generar carga y medir latencias
+ *
+ * 'ejecutar_carga()' abre N conexiones(o sockets de datagramas) con el
+ * servidor, las reparte entre varios hilos y envía mensajes del tamaño
+ * indicado durante un tiempo fijo. Al terminar se reporta la tasa de mensajes
+ * y bytes, y los percentiles de latencia con un histograma por hilo que se
+ * combinan al final, ver 'funciones_histograma.h'.
+ *
+ * Notas:
+ * - Con una tasa objetivo(lazo abierto) cada mensaje tiene un instante
+ * 	programado y su latencia se mide desde ese instante hasta que termina el
+ * 	envío. Si el generador se atrasa(el servidor no lee y el socket se llena)
+ * 	el atraso cuenta en la latencia, así no se cae en la "omisión
+ * 	coordinada" de medir solo los mensajes que sí se pudieron enviar.
+ * - Sin tasa(lazo cerrado) cada mensaje se envía en cuanto termina el
+ * 	anterior y la latencia es la duración del envío.
+ * - Los mensajes de cada hilo se reparten en turno entre sus conexiones.
+ * - Los sockets de datagramas se conectan('connect()') al destino para
+ * 	enviar con 'send()'; los de dominio Unix antes se asocian a un nombre
+ * 	abstracto para que el servidor pueda responder.
+ * - Cada 'kDescartarCada' mensajes se descartan las respuestas recibidas, así
+ * 	un servidor con '--eco' no acumula ecos sin leer(y no cierra la
+ * 	conexión por ello).
+ * - Con 'segmentos_gso' cada envío de datagramas lleva varios mensajes que el
+ * 	kernel corta con GSO(ver 'funciones_gso.h'); la tasa cuenta datagramas y
+ * 	la latencia es la de cada envío.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_CARGA_H_
+#define FUNCIONES_CARGA_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>  // 'clock_gettime()', 'clock_nanosleep()'
+
+#include "funciones_sockets.h"
+#include "funciones_conexion.h"
+#include "funciones_tramas.h"
+#include "funciones_histograma.h"
+#include "funciones_gso.h"
+
+// tiempo máximo para establecer cada conexión de carga
+const int kLimiteConexionCargaMs = 5000;
+// mensajes entre cada descarte de respuestas
+const int kDescartarCada = 64;
+
+typedef struct Config_carga {
+    const struct addrinfo *direcciones;  // destino(de 'resolver_direccion()')
+    int tipo_socket;  // SOCK_STREAM o SOCK_DGRAM
+    int conexiones;  // conexiones(o sockets) simultáneas
+    int hilos;
+    double tasa;  // envíos por segundo en total, 0 para lazo cerrado
+    size_t tam_mensaje;
+    double duracion;  // segundos
+    int segmentos_gso;  // datagramas por envío con GSO, 0 para no usarlo
+} Config_carga;
+
+typedef struct Resultado_carga {
+    unsigned long mensajes;
+    unsigned long long bytes;
+    unsigned long errores;
+    int conexiones;  // conexiones establecidas
+    double segundos;
+    Histograma latencias;  // nanosegundos
+} Resultado_carga;
+
+typedef struct Hilo_carga {
+    const Config_carga *config;
+    pthread_t hilo;
+    pthread_barrier_t *barrera;  // para iniciar todos los hilos a la vez
+    int num_conexiones;
+    Resultado_carga resultado;
+} Hilo_carga;
+
+/* Prototipos */
+
+uint64_t obtener_ns_monotonicos(void);
+int abrir_conexion_carga(const Config_carga *config);
+int enviar_mensaje_carga(int descriptor, int tipo_socket, char *mensaje,
+        size_t tam_mensaje);
+void descartar_respuestas_carga(int *descriptores, int num_descriptores);
+void* ejecutar_hilo_carga(void *datos);
+int ejecutar_carga(const Config_carga *config, Resultado_carga *resultado);
+void mostrar_resultado_carga(const Config_carga *config,
+        const Resultado_carga *resultado);
+
+/* Funciones */
+
+/**
+ * Obtiene el tiempo del reloj monótono en nanosegundos.
+ *
+ * @return nanosegundos de CLOCK_MONOTONIC
+ */
+uint64_t obtener_ns_monotonicos(void) {
+    struct timespec ahora;
+    clock_gettime(CLOCK_MONOTONIC, &ahora);
+    return (uint64_t)ahora.tv_sec*1000000000ull + ahora.tv_nsec;
+}
+
+/**
+ * Abre una conexión de carga: de flujo con Happy Eyeballs o un socket de
+ * datagramas conectado a la primera dirección(con GSO si se pidió).
+ *
+ * @param config configuración de la carga
+ *
+ * @return descriptor del socket, -1 en caso de error
+ */
+int abrir_conexion_carga(const Config_carga *config) {
+    Intento_conexion intentos[kMaxIntentosConexion];
+    const struct addrinfo *direccion = config->direcciones;
+    int num_intentos;
+
+    if (config->tipo_socket == SOCK_STREAM) {
+        return conectar_happy_eyeballs(direccion, kLimiteConexionCargaMs,
+            intentos, &num_intentos);
+    }
+
+    int descriptor = socket(direccion->ai_family, direccion->ai_socktype |
+        SOCK_CLOEXEC, direccion->ai_protocol);
+    if (descriptor == -1) {
+        return -1;
+    }
+    aplicar_ajustes_socket(descriptor, direccion->ai_socktype);
+    if ((direccion->ai_family == AF_UNIX &&
+            asociar_unix_automatico(descriptor) == -1) ||
+            connect(descriptor, direccion->ai_addr, direccion->ai_addrlen)
+            == -1 ||
+            (config->segmentos_gso > 0 &&
+            habilitar_gso(descriptor, config->tam_mensaje) == -1)) {
+        close(descriptor);
+        return -1;
+    }
+
+    return descriptor;
+}
+
+/**
+ * Envía un mensaje de carga: una trama en sockets de flujo o un datagrama.
+ *
+ * @param descriptor socket conectado
+ * @param tipo_socket SOCK_STREAM o SOCK_DGRAM
+ * @param mensaje datos a enviar
+ * @param tam_mensaje número de bytes
+ *
+ * @return número de bytes enviados, -1 en caso de error
+ */
+int enviar_mensaje_carga(int descriptor, int tipo_socket, char *mensaje,
+        size_t tam_mensaje) {
+    if (tipo_socket == SOCK_STREAM) {
+        return enviar_trama_stream(descriptor, mensaje, tam_mensaje);
+    }
+
+    ssize_t res;
+    do {
+        res = send(descriptor, mensaje, tam_mensaje, 0);
+    } while (res == -1 && errno == EINTR);
+    return res;
+}
+
+/**
+ * Lee y descarta, sin bloquear, lo que el servidor haya enviado por cada
+ * conexión.
+ *
+ * @param descriptores sockets de las conexiones(-1 si está cerrada)
+ * @param num_descriptores número de sockets
+ */
+void descartar_respuestas_carga(int *descriptores, int num_descriptores) {
+    char buffer[16384];
+    int i;
+
+    for (i = 0; i < num_descriptores; i++) {
+        while (descriptores[i] != -1 && recv(descriptores[i], buffer,
+                sizeof(buffer), MSG_DONTWAIT) > 0) {
+        }
+    }
+}
+
+/**
+ * Función de cada hilo de carga: abre sus conexiones, espera a los demás
+ * hilos y envía mensajes hasta que se cumple la duración.
+ *
+ * @param datos apuntador al 'Hilo_carga'
+ *
+ * @return NULL
+ */
+void* ejecutar_hilo_carga(void *datos) {
+    Hilo_carga *hilo = (Hilo_carga*)datos;
+    const Config_carga *config = hilo->config;
+    Resultado_carga *resultado = &hilo->resultado;
+    int descriptores[hilo->num_conexiones];
+    int i, activas = 0, siguiente = 0;
+    uint64_t k, programado, fin, intervalo = 0;
+    // con GSO cada envío lleva varios mensajes seguidos
+    size_t tam_envio = config->tam_mensaje*(config->segmentos_gso > 0 ?
+        config->segmentos_gso : 1);
+
+    char *mensaje = (char*)malloc(tam_envio);
+    for (i = 0; i < hilo->num_conexiones; i++) {
+        descriptores[i] = mensaje == NULL ? -1 : abrir_conexion_carga(config);
+        if (descriptores[i] == -1) {
+            resultado->errores++;
+        } else {
+            activas++;
+        }
+    }
+    resultado->conexiones = activas;
+    if (mensaje != NULL) {
+        memset(mensaje, 'x', tam_envio);
+    }
+    pthread_barrier_wait(hilo->barrera);
+
+    // la tasa del hilo es proporcional a sus conexiones
+    if (config->tasa > 0) {
+        intervalo = (uint64_t)(1e9*config->conexiones/
+            (config->tasa*hilo->num_conexiones));
+    }
+    uint64_t inicio = obtener_ns_monotonicos();
+    uint64_t limite = inicio + (uint64_t)(config->duracion*1e9);
+
+    for (k = 0; activas > 0; k++) {
+        programado = intervalo > 0 ? inicio + k*intervalo :
+            obtener_ns_monotonicos();
+        if (programado >= limite) {
+            break;
+        }
+        if (intervalo > 0) {
+            struct timespec espera = {programado/1000000000ull,
+                programado%1000000000ull};
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &espera,
+                    NULL) == EINTR) {
+            }
+        }
+
+        // siguiente conexión abierta, en turno
+        while (descriptores[siguiente] == -1) {
+            siguiente = (siguiente + 1) % hilo->num_conexiones;
+        }
+        int res = enviar_mensaje_carga(descriptores[siguiente],
+            config->tipo_socket, mensaje, tam_envio);
+        fin = obtener_ns_monotonicos();
+        if (res == -1) {
+            resultado->errores++;
+            // un datagrama perdido no invalida el socket, una conexión sí
+            if (config->tipo_socket == SOCK_STREAM) {
+                close(descriptores[siguiente]);
+                descriptores[siguiente] = -1;
+                activas--;
+            }
+        } else {
+            resultado->mensajes += config->segmentos_gso > 0 ?
+                contar_segmentos_udp(res, config->tam_mensaje) : 1;
+            resultado->bytes += res;
+            registrar_valor_histograma(&resultado->latencias, fin - programado);
+        }
+        siguiente = (siguiente + 1) % hilo->num_conexiones;
+        if (k % kDescartarCada == kDescartarCada - 1) {
+            descartar_respuestas_carga(descriptores, hilo->num_conexiones);
+        }
+    }
+    resultado->segundos = (obtener_ns_monotonicos() - inicio)/1e9;
+
+    for (i = 0; i < hilo->num_conexiones; i++) {
+        if (descriptores[i] != -1) {
+            close(descriptores[i]);
+        }
+    }
+    free(mensaje);
+    return NULL;
+}
+
+/**
+ * Genera la carga descrita en 'config' y combina los resultados de todos los
+ * hilos.
+ *
+ * @param config configuración de la carga
+ * @param resultado donde se guardan los resultados; sus latencias deben
+ *                  destruirse con 'destruir_histograma()'
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int ejecutar_carga(const Config_carga *config, Resultado_carga *resultado) {
+    pthread_barrier_t barrera;
+    int i, num_hilos = config->hilos;
+
+    num_hilos = num_hilos > config->conexiones ? config->conexiones : num_hilos;
+    num_hilos = num_hilos < 1 ? 1 : num_hilos;
+    memset(resultado, 0, sizeof(Resultado_carga));
+    Hilo_carga *hilos = (Hilo_carga*)calloc(num_hilos, sizeof(Hilo_carga));
+    if (hilos == NULL || crear_histograma(&resultado->latencias) == -1) {
+        fprintf(stderr,"\nError al reservar memoria para la carga\n");
+        free(hilos);
+        return -1;
+    }
+
+    pthread_barrier_init(&barrera, NULL, num_hilos);
+    for (i = 0; i < num_hilos; i++) {
+        hilos[i].config = config;
+        hilos[i].barrera = &barrera;
+        // las conexiones que sobran se reparten entre los primeros hilos
+        hilos[i].num_conexiones = config->conexiones/num_hilos +
+            (i < config->conexiones%num_hilos);
+        crear_histograma(&hilos[i].resultado.latencias);
+        if (pthread_create(&hilos[i].hilo, NULL, ejecutar_hilo_carga,
+                &hilos[i]) != 0) {
+            fprintf(stderr,"\nError al crear hilo de carga\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (i = 0; i < num_hilos; i++) {
+        Resultado_carga *parcial = &hilos[i].resultado;
+        pthread_join(hilos[i].hilo, NULL);
+        resultado->mensajes += parcial->mensajes;
+        resultado->bytes += parcial->bytes;
+        resultado->errores += parcial->errores;
+        resultado->conexiones += parcial->conexiones;
+        if (parcial->segundos > resultado->segundos) {
+            resultado->segundos = parcial->segundos;
+        }
+        combinar_histogramas(&resultado->latencias, &parcial->latencias);
+        destruir_histograma(&parcial->latencias);
+    }
+    pthread_barrier_destroy(&barrera);
+    free(hilos);
+
+    return resultado->conexiones > 0 ? 0 : -1;
+}
+
+/**
+ * Muestra la tasa de mensajes y bytes, los errores y las latencias de una
+ * carga.
+ *
+ * @param config configuración de la carga
+ * @param resultado resultados de 'ejecutar_carga()'
+ */
+void mostrar_resultado_carga(const Config_carga *config,
+        const Resultado_carga *resultado) {
+    double segundos = resultado->segundos > 0 ? resultado->segundos : 1;
+
+    printf("Carga(%s): %d/%d conexiones, mensajes de %zu bytes, ",
+        config->direcciones->ai_family == AF_UNIX ? kMensajeUnix :
+        config->tipo_socket == SOCK_STREAM ? "TCP" : "UDP",
+        resultado->conexiones, config->conexiones, config->tam_mensaje);
+    if (config->tasa > 0) {
+        printf("tasa objetivo %.0f envíos/s", config->tasa);
+    } else {
+        printf("lazo cerrado");
+    }
+    if (config->segmentos_gso > 0) {
+        printf(", %d datagramas por envío(GSO)", config->segmentos_gso);
+    }
+    printf("\n");
+    printf("%lu mensajes en %.3f s: %.0f mensajes/s, %.2f MB/s, %lu errores\n",
+        resultado->mensajes, resultado->segundos, resultado->mensajes/segundos,
+        resultado->bytes/1e6/segundos, resultado->errores);
+    mostrar_histograma(&resultado->latencias, config->tasa > 0 ?
+        "Latencia desde el instante programado" : "Latencia de envío");
+}
+
+#endif  // FUNCIONES_CARGA_H_
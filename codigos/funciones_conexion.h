@@ -0,0 +1,307 @@
+/**
+ * Funciones para establecer conexiones de flujo
+ *
+ * Un nombre puede resolverse a varias direcciones IPv4 e IPv6. Si una familia
+ * no funciona(o es lenta), intentar las direcciones una por una con
+ * 'connect()' bloqueante puede tardar lo que el tiempo de espera de TCP por
+ * cada dirección. 'conectar_happy_eyeballs()' sigue el algoritmo "Happy
+ * Eyeballs"(RFC 8305): inicia intentos NO bloqueantes escalonados, alternando
+ * las familias, y se queda con el primero que se conecte.
+ *
+ * Notas:
+ * - Cada intento nuevo inicia 'kRetrasoIntentoMs' después del anterior, o de
+ * 	inmediato si todos los intentos en curso fallaron.
+ * - El orden de preferencia es el que entrega 'getaddrinfo()'(RFC 6724); la
+ * 	primera familia de la lista va primero y después se alternan.
+ * - Se guarda la latencia y el resultado de cada intento para mostrarlos.
+ *
+ * Para más información consultar 'man 2 connect'(EINPROGRESS).
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_CONEXION_H_
+#define FUNCIONES_CONEXION_H_
+
+#include <time.h>  // 'clock_gettime()'
+
+#include "funciones_sockets.h"
+
+// retraso entre el inicio de intentos de conexión("Connection Attempt Delay")
+const int kRetrasoIntentoMs = 250;
+// número máximo de direcciones que se intentan
+const int kMaxIntentosConexion = 16;
+
+// estado de un intento de conexión
+typedef enum {kIntentoSinIniciar, kIntentoEnCurso, kIntentoExitoso,
+    kIntentoFallido, kIntentoCancelado} Estado_intento;
+
+typedef struct Intento_conexion {
+    const struct addrinfo *direccion;
+    int descriptor;
+    Estado_intento estado;
+    int error;  // 'errno' del intento fallido
+    struct timespec inicio;
+    double ms;  // duración del intento
+} Intento_conexion;
+
+/* Prototipos */
+
+double calcular_ms_transcurridos(const struct timespec *inicio);
+int ordenar_direcciones_alternadas(const struct addrinfo *direcciones,
+        Intento_conexion *intentos, int max_intentos);
+int iniciar_intento_conexion(Intento_conexion *intento);
+int conectar_happy_eyeballs(const struct addrinfo *direcciones, int limite_ms,
+        Intento_conexion *intentos, int *num_intentos);
+void mostrar_intentos_conexion(const Intento_conexion *intentos, int num);
+
+/* Funciones */
+
+/**
+ * Calcula los milisegundos transcurridos desde 'inicio'(CLOCK_MONOTONIC).
+ *
+ * @param inicio instante inicial
+ *
+ * @return milisegundos transcurridos
+ */
+double calcular_ms_transcurridos(const struct timespec *inicio) {
+    struct timespec fin;
+    clock_gettime(CLOCK_MONOTONIC, &fin);
+    return (fin.tv_sec - inicio->tv_sec)*1e3 +
+        (fin.tv_nsec - inicio->tv_nsec)/1e6;
+}
+
+/**
+ * Ordena las direcciones para los intentos: se conserva el orden de
+ * 'getaddrinfo()' dentro de cada familia y se alternan las familias,
+ * empezando por la de la primera dirección.
+ *
+ * @param direcciones lista de direcciones(de 'getaddrinfo()')
+ * @param intentos arreglo donde se guardan los intentos, sin iniciar
+ * @param max_intentos tamaño del arreglo
+ *
+ * @return número de intentos
+ */
+int ordenar_direcciones_alternadas(const struct addrinfo *direcciones,
+        Intento_conexion *intentos, int max_intentos) {
+    const struct addrinfo *primarias[max_intentos], *secundarias[max_intentos];
+    const struct addrinfo *direccion;
+    int num_primarias = 0, num_secundarias = 0, i = 0, j = 0, num = 0;
+
+    for (direccion = direcciones; direccion != NULL;
+            direccion = direccion->ai_next) {
+        if (direccion->ai_family == direcciones->ai_family) {
+            if (num_primarias < max_intentos) {
+                primarias[num_primarias++] = direccion;
+            }
+        } else if (num_secundarias < max_intentos) {
+            secundarias[num_secundarias++] = direccion;
+        }
+    }
+
+    while (num < max_intentos && (i < num_primarias || j < num_secundarias)) {
+        memset(&intentos[num], 0, sizeof(Intento_conexion));
+        intentos[num].descriptor = -1;
+        if (i < num_primarias && (num % 2 == 0 || j == num_secundarias)) {
+            intentos[num].direccion = primarias[i++];
+        } else {
+            intentos[num].direccion = secundarias[j++];
+        }
+        num++;
+    }
+
+    return num;
+}
+
+/**
+ * Crea un socket NO bloqueante para la dirección del intento e inicia la
+ * conexión.
+ *
+ * @param intento intento sin iniciar
+ *
+ * @return 1 si la conexión está en curso, 0 si se completó de inmediato, -1
+ *         si falló(el error queda en el intento)
+ */
+int iniciar_intento_conexion(Intento_conexion *intento) {
+    const struct addrinfo *direccion = intento->direccion;
+
+    clock_gettime(CLOCK_MONOTONIC, &intento->inicio);
+    intento->descriptor = socket(direccion->ai_family, direccion->ai_socktype |
+        SOCK_NONBLOCK | SOCK_CLOEXEC, direccion->ai_protocol);
+    if (intento->descriptor != -1) {
+        aplicar_ajustes_socket(intento->descriptor, direccion->ai_socktype);
+    }
+    if (intento->descriptor != -1 && connect(intento->descriptor,
+            direccion->ai_addr, direccion->ai_addrlen) == 0) {
+        intento->estado = kIntentoExitoso;
+        intento->ms = calcular_ms_transcurridos(&intento->inicio);
+        return 0;
+    }
+    if (intento->descriptor != -1 && errno == EINPROGRESS) {
+        intento->estado = kIntentoEnCurso;
+        return 1;
+    }
+
+    intento->error = errno;
+    intento->estado = kIntentoFallido;
+    intento->ms = calcular_ms_transcurridos(&intento->inicio);
+    if (intento->descriptor != -1) {
+        close(intento->descriptor);
+        intento->descriptor = -1;
+    }
+    return -1;
+}
+
+/**
+ * Se conecta a la primera dirección que responda, con intentos escalonados
+ * y alternando familias(Happy Eyeballs, RFC 8305). Los intentos restantes se
+ * cancelan. El socket conectado se regresa en modo bloqueante.
+ *
+ * @param direcciones lista de direcciones de flujo(SOCK_STREAM)
+ * @param limite_ms tiempo máximo total en milisegundos, -1 para no limitar
+ * @param intentos arreglo de 'kMaxIntentosConexion' intentos, donde se guarda
+ *                 el resultado de cada uno
+ * @param num_intentos donde se guarda el número de intentos
+ *
+ * @return descriptor del socket conectado, -1 si ningún intento se conectó
+ *         ('errno' es el error del último intento o ETIMEDOUT)
+ */
+int conectar_happy_eyeballs(const struct addrinfo *direcciones, int limite_ms,
+        Intento_conexion *intentos, int *num_intentos) {
+    struct pollfd descriptores[kMaxIntentosConexion];
+    int indices[kMaxIntentosConexion];
+    struct timespec inicio, ultimo_inicio;
+    int num = ordenar_direcciones_alternadas(direcciones, intentos,
+        kMaxIntentosConexion);
+    int siguiente = 0, en_curso = 0, ganador = -1, ultimo_error = ECONNREFUSED;
+    int i, res;
+
+    *num_intentos = num;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+
+    while (ganador == -1 && (siguiente < num || en_curso > 0)) {
+        double transcurrido = calcular_ms_transcurridos(&inicio);
+        if (limite_ms >= 0 && transcurrido >= limite_ms) {
+            ultimo_error = ETIMEDOUT;
+            break;
+        }
+
+        // se inicia otro intento si no hay ninguno en curso o ya pasó el
+        // retraso desde el último
+        if (siguiente < num && (en_curso == 0 ||
+                calcular_ms_transcurridos(&ultimo_inicio) >= kRetrasoIntentoMs)) {
+            res = iniciar_intento_conexion(&intentos[siguiente]);
+            ultimo_inicio = intentos[siguiente].inicio;
+            if (res == 0) {
+                ganador = siguiente;
+            } else if (res == 1) {
+                en_curso++;
+            } else {
+                ultimo_error = intentos[siguiente].error;
+            }
+            siguiente++;
+            continue;
+        }
+
+        // espera a que algún intento termine o a que toque iniciar otro
+        int espera = -1, num_descriptores = 0;
+        if (siguiente < num) {
+            espera = kRetrasoIntentoMs - (int)calcular_ms_transcurridos(
+                &ultimo_inicio);
+            espera = espera < 0 ? 0 : espera;
+        }
+        if (limite_ms >= 0) {
+            int restante = limite_ms - (int)transcurrido;
+            espera = espera == -1 || restante < espera ? restante : espera;
+        }
+        for (i = 0; i < siguiente; i++) {
+            if (intentos[i].estado == kIntentoEnCurso) {
+                descriptores[num_descriptores].fd = intentos[i].descriptor;
+                descriptores[num_descriptores].events = POLLOUT;
+                indices[num_descriptores] = i;
+                num_descriptores++;
+            }
+        }
+        res = poll(descriptores, num_descriptores, espera);
+        if (res == -1 && errno != EINTR) {
+            ultimo_error = errno;
+            break;
+        }
+
+        for (i = 0; i < num_descriptores && res > 0; i++) {
+            if (descriptores[i].revents == 0) {
+                continue;
+            }
+            Intento_conexion *intento = &intentos[indices[i]];
+            int error = 0;
+            socklen_t tam = sizeof(int);
+            getsockopt(intento->descriptor, SOL_SOCKET, SO_ERROR, &error, &tam);
+            intento->ms = calcular_ms_transcurridos(&intento->inicio);
+            en_curso--;
+            if (error == 0) {
+                intento->estado = kIntentoExitoso;
+                ganador = indices[i];
+                break;
+            }
+            intento->estado = kIntentoFallido;
+            intento->error = ultimo_error = error;
+            close(intento->descriptor);
+            intento->descriptor = -1;
+        }
+    }
+
+    // se cancelan los intentos que siguen en curso
+    for (i = 0; i < siguiente; i++) {
+        if (intentos[i].estado == kIntentoEnCurso) {
+            intentos[i].estado = kIntentoCancelado;
+            intentos[i].ms = calcular_ms_transcurridos(&intentos[i].inicio);
+            close(intentos[i].descriptor);
+            intentos[i].descriptor = -1;
+        }
+    }
+
+    if (ganador == -1) {
+        errno = ultimo_error;
+        return -1;
+    }
+    int descriptor = intentos[ganador].descriptor;
+    fcntl(descriptor, F_SETFL, fcntl(descriptor, F_GETFL) & ~O_NONBLOCK);
+    return descriptor;
+}
+
+/**
+ * Muestra la dirección, el resultado y la latencia de cada intento de
+ * conexión.
+ *
+ * @param intentos intentos de 'conectar_happy_eyeballs()'
+ * @param num número de intentos
+ */
+void mostrar_intentos_conexion(const Intento_conexion *intentos, int num) {
+    char ip[INET6_ADDRSTRLEN];
+    int i;
+
+    for (i = 0; i < num; i++) {
+        const Intento_conexion *intento = &intentos[i];
+        printf("\t%s %s: ", intento->direccion->ai_family == AF_INET ?
+            kMensajeIPV4 : intento->direccion->ai_family == AF_UNIX ?
+            kMensajeUnix : kMensajeIPV6, escribir_direccion_imprimible(
+                intento->direccion->ai_addr, ip, sizeof(ip)));
+        switch (intento->estado) {
+            case kIntentoExitoso:
+                printf("conectado en %.3f ms\n", intento->ms);
+                break;
+            case kIntentoFallido:
+                printf("falló en %.3f ms(%s)\n", intento->ms,
+                    strerror(intento->error));
+                break;
+            case kIntentoCancelado:
+                printf("cancelado tras %.3f ms\n", intento->ms);
+                break;
+            default:
+                printf("no se intentó\n");
+                break;
+        }
+    }
+}
+
+#endif  // FUNCIONES_CONEXION_H_
@@ -0,0 +1,692 @@
+/**
+ * Funciones para entrega confiable y ordenada sobre datagramas
+ *
+ * UDP no confirma ni ordena los datagramas. Un canal confiable agrega sobre un
+ * socket de datagramas un protocolo ligero, parecido a TCP pero por mensajes:
+ *
+ * 	+--------+--------+-----------+--------------+-------------+-------------+
+ * 	| tipo   | 0      | tam(2)    | secuencia(4) | ack(4)      | sack(4)     |
+ * 	+--------+--------+-----------+--------------+-------------+-------------+
+ *
+ * - Cada mensaje de datos lleva un número de secuencia; el receptor guarda los
+ * 	que llegan fuera de orden(dentro de la ventana) y los entrega en orden.
+ * - Cada mensaje de datos se confirma con un ACK acumulado('ack' es la
+ * 	siguiente secuencia esperada) y selectivo('sack': el bit i indica que
+ * 	llegó la secuencia ack + 1 + i). El ACK repite en 'secuencia' la del
+ * 	mensaje que lo provocó; el RTT se mide sólo con ese mensaje, así una
+ * 	pérdida anterior no infla la muestra.
+ * - El emisor mantiene una ventana deslizante de hasta 'kVentanaConfiable'
+ * 	mensajes sin confirmar y un temporizador de retransmisión calculado con
+ * 	el RTT estimado(SRTT y RTTVAR, RFC 6298); al expirar se retransmite el
+ * 	mensaje más antiguo y el temporizador se duplica.
+ * - Con 'kUmbralDuplicados' ACKs duplicados(menos si hay pocos mensajes en
+ * 	vuelo) se entra en recuperación: se retransmiten de inmediato los huecos
+ * 	que el SACK muestra y, con cada ACK parcial, el nuevo mensaje más antiguo
+ * 	(retransmisión rápida, como NewReno).
+ * - Control de congestión simple(AIMD): arranque lento hasta 'ssthresh',
+ * 	después la ventana crece un mensaje por RTT; una pérdida la reduce a la
+ * 	mitad(retransmisión rápida) o a 1(expiración).
+ * - Un receptor que no puede crear el canal(p. ej. sin lugar para más
+ * 	clientes) responde con un paquete de rechazo, sólo el encabezado; el
+ * 	emisor abandona el canal con ECONNREFUSED en lugar de retransmitir.
+ *
+ * Notas:
+ * - Para probarlo en loopback cada canal puede descartar al azar una fracción
+ * 	de los paquetes que envía('perdida'), datos o ACKs.
+ * - El emisor sólo avanza cuando recibe ACKs, así que debe atender el socket:
+ * 	'enviar_confiable()' y 'vaciar_canal_confiable()' lo hacen mientras
+ * 	esperan.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_CONFIABLE_H_
+#define FUNCIONES_CONFIABLE_H_
+
+#include <stdint.h>
+#include <stdlib.h>  // 'rand_r()'
+
+#include "funciones_sockets.h"
+#include "funciones_carga.h"  // 'obtener_ns_monotonicos()'
+
+// tipos de paquete
+enum {kPaqueteDatos = 1, kPaqueteAck = 2, kPaqueteRechazo = 3};
+// mensajes sin confirmar en la ventana(también bits del SACK)
+enum {kVentanaConfiable = 32};
+// bytes de datos por mensaje, caben en un paquete Ethernet
+enum {kMaxDatosConfiable = 1200};
+const int kTamEncabezadoConfiable = 16;
+const int kUmbralDuplicados = 3;
+const uint64_t kRtoInicialNs = 200000000ull;  // 200 ms
+const uint64_t kRtoMinimoNs = 5000000ull;  // 5 ms
+const uint64_t kRtoMaximoNs = 2000000000ull;  // 2 s
+// expiraciones seguidas del mismo mensaje antes de abandonar el canal
+const int kMaxExpiraciones = 10;
+
+// mensaje enviado que espera su confirmación
+typedef struct Ranura_envio {
+    int ocupada;
+    int confirmada;  // confirmada por SACK, fuera de orden
+    int retransmitida;  // ya no sirve para medir el RTT(algoritmo de Karn)
+    int expiraciones;
+    uint32_t secuencia;
+    uint16_t tam;
+    uint64_t enviado;  // instante del último envío
+    char datos[kMaxDatosConfiable];
+} Ranura_envio;
+
+// mensaje recibido fuera de orden que espera a los anteriores
+typedef struct Ranura_recepcion {
+    int ocupada;
+    uint32_t secuencia;
+    uint16_t tam;
+    char datos[kMaxDatosConfiable + 1];  // con espacio para el fin de cadena
+} Ranura_recepcion;
+
+struct Canal_confiable;
+// función que recibe cada mensaje entregado en orden(terminado en '\0')
+typedef void (*Al_entregar_confiable)(struct Canal_confiable *canal,
+        char *datos, size_t tam);
+
+typedef struct Canal_confiable {
+    int descriptor;
+    struct sockaddr_storage remoto;
+    // emisor
+    Ranura_envio envio[kVentanaConfiable];
+    uint32_t base;  // mensaje más antiguo sin confirmar
+    uint32_t siguiente;  // secuencia del siguiente mensaje
+    uint32_t confirmadas;  // mensajes en la ventana confirmados por SACK
+    int acks_duplicados;
+    int en_recuperacion;
+    uint32_t fin_recuperacion;  // 'siguiente' al iniciar la recuperación
+    double cwnd;  // ventana de congestión, en mensajes
+    double ssthresh;
+    double srtt;  // RTT suavizado(ns), 0 sin muestras
+    double rttvar;
+    uint64_t rto;  // tiempo de retransmisión(ns)
+    uint64_t expiracion;  // instante en que expira el temporizador, 0 sin él
+    int rechazado;  // 1 si el otro extremo rechazó el canal
+    // receptor
+    Ranura_recepcion recepcion[kVentanaConfiable];
+    uint32_t esperado;  // siguiente secuencia a entregar
+    Al_entregar_confiable al_entregar;
+    void *datos;  // datos adicionales para 'al_entregar'
+    // simulación de pérdidas
+    double perdida;  // fracción de paquetes enviados que se descartan
+    unsigned semilla;
+    // estadísticas
+    unsigned long enviados;  // mensajes nuevos
+    unsigned long retransmisiones;
+    unsigned long expiraciones;
+    unsigned long recuperaciones;  // retransmisiones rápidas
+    unsigned long entregados;
+    unsigned long duplicados;  // mensajes recibidos más de una vez
+    unsigned long simulados;  // paquetes descartados por la simulación
+} Canal_confiable;
+
+/* Prototipos */
+
+int comparar_secuencias(uint32_t a, uint32_t b);
+int ventana_llena_confiable(const Canal_confiable *canal);
+void crear_canal_confiable(Canal_confiable *canal, int descriptor,
+        const struct sockaddr *remoto, Al_entregar_confiable al_entregar,
+        double perdida);
+int transmitir_paquete_confiable(Canal_confiable *canal, int tipo,
+        uint32_t secuencia, const char *datos, uint16_t tam, uint32_t ack,
+        uint32_t sack);
+int rechazar_confiable(int descriptor, const struct sockaddr *remoto);
+void retransmitir_confiable(Canal_confiable *canal, Ranura_envio *ranura);
+void enviar_ack_confiable(Canal_confiable *canal, uint32_t secuencia);
+void actualizar_rto_confiable(Canal_confiable *canal, uint64_t muestra);
+void procesar_ack_confiable(Canal_confiable *canal, uint32_t secuencia,
+        uint32_t ack, uint32_t sack);
+void procesar_datos_confiable(Canal_confiable *canal, uint32_t secuencia,
+        const char *datos, uint16_t tam);
+int procesar_paquete_confiable(Canal_confiable *canal, const char *paquete,
+        size_t tam_paquete);
+int revisar_temporizador_confiable(Canal_confiable *canal);
+int atender_canal_confiable(Canal_confiable *canal, int milisegundos);
+int enviar_confiable(Canal_confiable *canal, const char *datos, size_t tam);
+int vaciar_canal_confiable(Canal_confiable *canal, int limite_ms);
+void mostrar_estadisticas_confiable(const Canal_confiable *canal);
+
+/* Funciones */
+
+/**
+ * Compara dos números de secuencia considerando que dan la vuelta.
+ *
+ * @param a secuencia
+ * @param b secuencia
+ *
+ * @return negativo si 'a' va antes que 'b', 0 si son iguales, positivo si va
+ *         después
+ */
+int comparar_secuencias(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b);
+}
+
+/**
+ * Indica si el emisor debe esperar ACKs antes de enviar otro mensaje: los
+ * mensajes en vuelo(sin contar los confirmados por SACK, como el 'pipe' del
+ * RFC 6675) ya llenan la ventana de congestión, o la ventana de secuencias
+ * está completa.
+ *
+ * @param canal canal
+ *
+ * @return 1 si la ventana está llena, 0 en otro caso
+ */
+int ventana_llena_confiable(const Canal_confiable *canal) {
+    uint32_t pendientes = canal->siguiente - canal->base;
+
+    return pendientes >= kVentanaConfiable ||
+        pendientes - canal->confirmadas >= (uint32_t)canal->cwnd;
+}
+
+/**
+ * Inicializa un canal con el extremo remoto.
+ *
+ * @param canal canal a inicializar
+ * @param descriptor socket de datagramas
+ * @param remoto dirección del otro extremo
+ * @param al_entregar función para los mensajes recibidos, o NULL
+ * @param perdida fracción(0 a 1) de paquetes enviados que se descartan para
+ *                simular pérdidas
+ */
+void crear_canal_confiable(Canal_confiable *canal, int descriptor,
+        const struct sockaddr *remoto, Al_entregar_confiable al_entregar,
+        double perdida) {
+    memset(canal, 0, sizeof(Canal_confiable));
+    canal->descriptor = descriptor;
+    memcpy(&canal->remoto, remoto, obtener_tam_sockaddr(remoto));
+    canal->al_entregar = al_entregar;
+    canal->cwnd = 2;
+    canal->ssthresh = kVentanaConfiable;
+    canal->rto = kRtoInicialNs;
+    canal->perdida = perdida;
+    canal->semilla = (unsigned)obtener_ns_monotonicos();
+}
+
+/**
+ * Arma y envía un paquete, salvo que la simulación lo descarte.
+ *
+ * @param canal canal
+ * @param tipo kPaqueteDatos o kPaqueteAck
+ * @param secuencia secuencia de los datos, o del mensaje que provocó el ACK
+ * @param datos datos del mensaje, o NULL
+ * @param tam longitud de los datos
+ * @param ack siguiente secuencia esperada(ACK)
+ * @param sack mapa de secuencias recibidas después de 'ack'(ACK)
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int transmitir_paquete_confiable(Canal_confiable *canal, int tipo,
+        uint32_t secuencia, const char *datos, uint16_t tam, uint32_t ack,
+        uint32_t sack) {
+    char paquete[kTamEncabezadoConfiable + kMaxDatosConfiable];
+    uint16_t tam_red = htons(tam);
+
+    if (canal->perdida > 0 &&
+            rand_r(&canal->semilla) < canal->perdida*RAND_MAX) {
+        canal->simulados++;
+        return 0;
+    }
+    secuencia = htonl(secuencia);
+    ack = htonl(ack);
+    sack = htonl(sack);
+    paquete[0] = (char)tipo;
+    paquete[1] = 0;
+    memcpy(paquete + 2, &tam_red, sizeof(uint16_t));
+    memcpy(paquete + 4, &secuencia, sizeof(uint32_t));
+    memcpy(paquete + 8, &ack, sizeof(uint32_t));
+    memcpy(paquete + 12, &sack, sizeof(uint32_t));
+    if (tam > 0) {
+        memcpy(paquete + kTamEncabezadoConfiable, datos, tam);
+    }
+
+    ssize_t res = sendto(canal->descriptor, paquete,
+        kTamEncabezadoConfiable + tam, 0, (struct sockaddr*)&canal->remoto,
+        obtener_tam_sockaddr((struct sockaddr*)&canal->remoto));
+    // si el socket está lleno el paquete se trata como perdido
+    return res == -1 && errno != EAGAIN && errno != EWOULDBLOCK &&
+        errno != ECONNREFUSED ? -1 : 0;
+}
+
+/**
+ * Envía un paquete de rechazo a quien no se le puede crear un canal.
+ *
+ * @param descriptor identificador del socket
+ * @param remoto dirección del otro extremo
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int rechazar_confiable(int descriptor, const struct sockaddr *remoto) {
+    char paquete[kTamEncabezadoConfiable];
+
+    memset(paquete, 0, sizeof(paquete));
+    paquete[0] = (char)kPaqueteRechazo;
+    ssize_t res = sendto(descriptor, paquete, sizeof(paquete), 0, remoto,
+        obtener_tam_sockaddr(remoto));
+
+    return res == -1 && errno != EAGAIN && errno != EWOULDBLOCK &&
+        errno != ECONNREFUSED ? -1 : 0;
+}
+
+/**
+ * Vuelve a enviar un mensaje sin confirmar.
+ *
+ * @param canal canal
+ * @param ranura mensaje a retransmitir
+ */
+void retransmitir_confiable(Canal_confiable *canal, Ranura_envio *ranura) {
+    ranura->retransmitida = 1;
+    ranura->enviado = obtener_ns_monotonicos();
+    canal->retransmisiones++;
+    transmitir_paquete_confiable(canal, kPaqueteDatos, ranura->secuencia,
+        ranura->datos, ranura->tam, 0, 0);
+}
+
+/**
+ * Envía un ACK con la siguiente secuencia esperada y el mapa de los mensajes
+ * recibidos fuera de orden.
+ *
+ * @param canal canal
+ * @param secuencia secuencia del mensaje que provocó el ACK
+ */
+void enviar_ack_confiable(Canal_confiable *canal, uint32_t secuencia) {
+    uint32_t sack = 0;
+    int i;
+
+    for (i = 0; i < kVentanaConfiable - 1; i++) {
+        uint32_t siguiente = canal->esperado + 1 + i;
+        Ranura_recepcion *ranura =
+            &canal->recepcion[siguiente % kVentanaConfiable];
+        if (ranura->ocupada && ranura->secuencia == siguiente) {
+            sack |= 1u << i;
+        }
+    }
+    transmitir_paquete_confiable(canal, kPaqueteAck, secuencia, NULL, 0,
+        canal->esperado, sack);
+}
+
+/**
+ * Actualiza el RTT estimado y el tiempo de retransmisión con una muestra
+ * (RFC 6298).
+ *
+ * @param canal canal
+ * @param muestra RTT medido en nanosegundos
+ */
+void actualizar_rto_confiable(Canal_confiable *canal, uint64_t muestra) {
+    if (canal->srtt == 0) {
+        canal->srtt = muestra;
+        canal->rttvar = muestra/2.0;
+    } else {
+        double diferencia = canal->srtt - muestra;
+        canal->rttvar = 0.75*canal->rttvar + 0.25*(diferencia < 0 ?
+            -diferencia : diferencia);
+        canal->srtt = 0.875*canal->srtt + 0.125*muestra;
+    }
+    canal->rto = (uint64_t)(canal->srtt + 4*canal->rttvar);
+    canal->rto = canal->rto < kRtoMinimoNs ? kRtoMinimoNs :
+        canal->rto > kRtoMaximoNs ? kRtoMaximoNs : canal->rto;
+}
+
+/**
+ * Procesa un ACK: libera los mensajes confirmados, mide el RTT, ajusta la
+ * ventana de congestión y, tras varios ACKs duplicados, retransmite los huecos.
+ *
+ * @param canal canal
+ * @param secuencia secuencia del mensaje que provocó el ACK
+ * @param ack siguiente secuencia que espera el receptor
+ * @param sack mapa de secuencias recibidas después de 'ack'
+ */
+void procesar_ack_confiable(Canal_confiable *canal, uint32_t secuencia,
+        uint32_t ack, uint32_t sack) {
+    uint64_t ahora = obtener_ns_monotonicos();
+    uint32_t mayor_sack = ack;
+    int i;
+
+    if (comparar_secuencias(secuencia, canal->base) >= 0 &&
+            comparar_secuencias(secuencia, canal->siguiente) < 0) {
+        Ranura_envio *ranura = &canal->envio[secuencia % kVentanaConfiable];
+        if (ranura->ocupada && !ranura->retransmitida) {
+            actualizar_rto_confiable(canal, ahora - ranura->enviado);
+        }
+    }
+
+    if (comparar_secuencias(ack, canal->base) > 0 &&
+            comparar_secuencias(ack, canal->siguiente) <= 0) {
+        uint32_t nuevos = ack - canal->base;
+        for (secuencia = canal->base; secuencia != ack; secuencia++) {
+            Ranura_envio *ranura = &canal->envio[secuencia % kVentanaConfiable];
+            canal->confirmadas -= ranura->confirmada;
+            ranura->ocupada = ranura->confirmada = 0;
+        }
+        canal->base = ack;
+        canal->acks_duplicados = 0;
+
+        if (canal->en_recuperacion &&
+                comparar_secuencias(ack, canal->fin_recuperacion) >= 0) {
+            canal->en_recuperacion = 0;
+        }
+        // arranque lento, o un mensaje por RTT fuera de la recuperación
+        if (canal->cwnd < canal->ssthresh) {
+            canal->cwnd += nuevos;
+        } else if (!canal->en_recuperacion) {
+            canal->cwnd += nuevos/canal->cwnd;
+        }
+        canal->cwnd = canal->cwnd > kVentanaConfiable ? kVentanaConfiable :
+            canal->cwnd;
+        // llegaron datos nuevos: el temporizador se reinicia
+        canal->expiracion = canal->base == canal->siguiente ? 0 :
+            ahora + canal->rto;
+    } else if (ack == canal->base && canal->base != canal->siguiente) {
+        canal->acks_duplicados++;
+    }
+
+    for (i = 0; i < kVentanaConfiable - 1; i++) {
+        if (!(sack & (1u << i))) {
+            continue;
+        }
+        secuencia = ack + 1 + i;
+        if (comparar_secuencias(secuencia, canal->base) >= 0 &&
+                comparar_secuencias(secuencia, canal->siguiente) < 0) {
+            Ranura_envio *ranura = &canal->envio[secuencia % kVentanaConfiable];
+            if (!ranura->confirmada) {
+                ranura->confirmada = 1;
+                canal->confirmadas++;
+            }
+            mayor_sack = secuencia;
+        }
+    }
+
+    if (canal->base == canal->siguiente) {
+        return;
+    }
+    if (!canal->en_recuperacion) {
+        // con pocos mensajes en vuelo no llegan tres duplicados(RFC 5827)
+        int en_vuelo = canal->siguiente - canal->base;
+        int umbral = en_vuelo - 1 < kUmbralDuplicados ? en_vuelo - 1 :
+            kUmbralDuplicados;
+        if (canal->acks_duplicados == 0 || canal->acks_duplicados < umbral) {
+            return;
+        }
+        canal->en_recuperacion = 1;
+        canal->fin_recuperacion = canal->siguiente;
+        canal->ssthresh = en_vuelo/2.0 < 2 ? 2 : en_vuelo/2.0;
+        canal->cwnd = canal->ssthresh;
+        canal->recuperaciones++;
+    }
+    // en la recuperación cada ACK repara el primer mensaje y los huecos antes
+    // del mayor SACK, sin repetir la retransmisión antes de un RTT
+    uint64_t intervalo = canal->srtt > 0 ? (uint64_t)canal->srtt : canal->rto;
+    for (secuencia = canal->base; secuencia == canal->base ||
+            comparar_secuencias(secuencia, mayor_sack) < 0; secuencia++) {
+        Ranura_envio *ranura = &canal->envio[secuencia % kVentanaConfiable];
+        if (ranura->ocupada && !ranura->confirmada &&
+                ahora - ranura->enviado >= intervalo) {
+            retransmitir_confiable(canal, ranura);
+        }
+    }
+}
+
+/**
+ * Procesa un mensaje de datos: lo guarda si está dentro de la ventana,
+ * entrega en orden los que ya estén completos y envía el ACK.
+ *
+ * @param canal canal
+ * @param secuencia secuencia del mensaje
+ * @param datos datos del mensaje
+ * @param tam longitud de los datos
+ */
+void procesar_datos_confiable(Canal_confiable *canal, uint32_t secuencia,
+        const char *datos, uint16_t tam) {
+    int distancia = comparar_secuencias(secuencia, canal->esperado);
+
+    if (distancia < 0) {
+        canal->duplicados++;  // ya entregado, su ACK se perdió
+    } else if (distancia < kVentanaConfiable) {
+        Ranura_recepcion *ranura =
+            &canal->recepcion[secuencia % kVentanaConfiable];
+        if (ranura->ocupada) {
+            canal->duplicados++;
+        } else {
+            ranura->ocupada = 1;
+            ranura->secuencia = secuencia;
+            ranura->tam = tam;
+            memcpy(ranura->datos, datos, tam);
+            ranura->datos[tam] = '\0';
+        }
+    }
+
+    while (1) {
+        Ranura_recepcion *ranura =
+            &canal->recepcion[canal->esperado % kVentanaConfiable];
+        if (!ranura->ocupada || ranura->secuencia != canal->esperado) {
+            break;
+        }
+        canal->esperado++;
+        canal->entregados++;
+        if (canal->al_entregar != NULL) {
+            canal->al_entregar(canal, ranura->datos, ranura->tam);
+        }
+        ranura->ocupada = 0;
+    }
+    enviar_ack_confiable(canal, secuencia);
+}
+
+/**
+ * Procesa un paquete recibido del otro extremo.
+ *
+ * @param canal canal
+ * @param paquete bytes recibidos
+ * @param tam_paquete número de bytes
+ *
+ * @return 0 en caso de éxito, -1 si el paquete no es válido
+ */
+int procesar_paquete_confiable(Canal_confiable *canal, const char *paquete,
+        size_t tam_paquete) {
+    uint16_t tam;
+    uint32_t secuencia, ack, sack;
+
+    if (tam_paquete < (size_t)kTamEncabezadoConfiable) {
+        return -1;
+    }
+    memcpy(&tam, paquete + 2, sizeof(uint16_t));
+    memcpy(&secuencia, paquete + 4, sizeof(uint32_t));
+    memcpy(&ack, paquete + 8, sizeof(uint32_t));
+    memcpy(&sack, paquete + 12, sizeof(uint32_t));
+    tam = ntohs(tam);
+    if (tam > kMaxDatosConfiable ||
+            kTamEncabezadoConfiable + (size_t)tam > tam_paquete) {
+        return -1;
+    }
+
+    switch (paquete[0]) {
+        case kPaqueteDatos:
+            procesar_datos_confiable(canal, ntohl(secuencia),
+                paquete + kTamEncabezadoConfiable, tam);
+            return 0;
+        case kPaqueteAck:
+            procesar_ack_confiable(canal, ntohl(secuencia), ntohl(ack),
+                ntohl(sack));
+            return 0;
+        case kPaqueteRechazo:
+            canal->rechazado = 1;
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/**
+ * Revisa el temporizador de retransmisión: si expiró se retransmite el mensaje
+ * más antiguo, se duplica el tiempo de retransmisión, la ventana vuelve a 1 y
+ * se entra en recuperación hasta confirmar lo enviado.
+ *
+ * @param canal canal
+ *
+ * @return milisegundos hasta la siguiente expiración, -1 si no hay mensajes
+ *         pendientes, -2 si el mensaje más antiguo expiró demasiadas veces
+ */
+int revisar_temporizador_confiable(Canal_confiable *canal) {
+    uint64_t ahora = obtener_ns_monotonicos();
+
+    if (canal->expiracion == 0) {
+        return -1;
+    }
+    if (ahora >= canal->expiracion) {
+        Ranura_envio *ranura = &canal->envio[canal->base % kVentanaConfiable];
+        if (++ranura->expiraciones > kMaxExpiraciones) {
+            return -2;
+        }
+        double en_vuelo = canal->siguiente - canal->base;
+        canal->ssthresh = en_vuelo/2 < 2 ? 2 : en_vuelo/2;
+        canal->cwnd = 1;
+        // los demás mensajes en vuelo se reparan con los ACKs siguientes
+        canal->en_recuperacion = 1;
+        canal->fin_recuperacion = canal->siguiente;
+        canal->acks_duplicados = 0;
+        canal->expiraciones++;
+        canal->rto = 2*canal->rto > kRtoMaximoNs ? kRtoMaximoNs : 2*canal->rto;
+        retransmitir_confiable(canal, ranura);
+        canal->expiracion = ahora + canal->rto;
+    }
+
+    return (int)((canal->expiracion - ahora + 999999)/1000000);
+}
+
+/**
+ * Espera paquetes del otro extremo hasta 'milisegundos', procesa todos los que
+ * hayan llegado y revisa el temporizador. El socket debe estar conectado al
+ * otro extremo.
+ *
+ * @param canal canal
+ * @param milisegundos tiempo máximo de espera, 0 para no esperar
+ *
+ * @return 0 en caso de éxito, -1 si el canal se abandonó(ETIMEDOUT), el otro
+ *         extremo lo rechazó(ECONNREFUSED) o hubo un error
+ */
+int atender_canal_confiable(Canal_confiable *canal, int milisegundos) {
+    char paquete[kTamEncabezadoConfiable + kMaxDatosConfiable];
+    ssize_t res;
+
+    if (esperar_descriptor(canal->descriptor, POLLIN, milisegundos) == 1) {
+        while ((res = recv(canal->descriptor, paquete, sizeof(paquete),
+                MSG_DONTWAIT)) >= 0 || errno == EINTR ||
+                errno == ECONNREFUSED) {
+            if (res >= 0) {
+                procesar_paquete_confiable(canal, paquete, res);
+            }
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            fprintf(stderr, "\nError al recibir datos(recv): %s\n",
+                strerror(errno));
+            return -1;
+        }
+    }
+    if (canal->rechazado) {
+        errno = ECONNREFUSED;
+        return -1;
+    }
+    if (revisar_temporizador_confiable(canal) == -2) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Envía un mensaje por el canal. Si la ventana está llena espera(atendiendo
+ * los ACKs) a que haya espacio.
+ *
+ * @param canal canal
+ * @param datos datos del mensaje
+ * @param tam longitud, a lo más 'kMaxDatosConfiable'
+ *
+ * @return número de bytes enviados, -1 en caso de error
+ */
+int enviar_confiable(Canal_confiable *canal, const char *datos, size_t tam) {
+    if (tam > kMaxDatosConfiable) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (atender_canal_confiable(canal, 0) == -1) {
+        return -1;
+    }
+    while (ventana_llena_confiable(canal)) {
+        int espera = revisar_temporizador_confiable(canal);
+        if (atender_canal_confiable(canal, espera < 0 ?
+                (int)(kRtoMaximoNs/1000000) : espera) == -1) {
+            return -1;
+        }
+    }
+
+    Ranura_envio *ranura = &canal->envio[canal->siguiente % kVentanaConfiable];
+    memset(ranura, 0, sizeof(Ranura_envio) - kMaxDatosConfiable);
+    ranura->ocupada = 1;
+    ranura->secuencia = canal->siguiente++;
+    ranura->tam = tam;
+    memcpy(ranura->datos, datos, tam);
+    ranura->enviado = obtener_ns_monotonicos();
+    if (canal->expiracion == 0) {
+        canal->expiracion = ranura->enviado + canal->rto;
+    }
+    canal->enviados++;
+    if (transmitir_paquete_confiable(canal, kPaqueteDatos, ranura->secuencia,
+            datos, tam, 0, 0) == -1) {
+        fprintf(stderr, "\nError al enviar datos(sendto): %s\n",
+            strerror(errno));
+        return -1;
+    }
+
+    return tam;
+}
+
+/**
+ * Espera a que el otro extremo confirme todos los mensajes enviados.
+ *
+ * @param canal canal
+ * @param limite_ms tiempo máximo de espera
+ *
+ * @return 0 si todo se confirmó, -1 en caso de error o si se agotó el tiempo
+ */
+int vaciar_canal_confiable(Canal_confiable *canal, int limite_ms) {
+    uint64_t limite = obtener_ns_monotonicos() + (uint64_t)limite_ms*1000000ull;
+
+    while (canal->base != canal->siguiente) {
+        uint64_t ahora = obtener_ns_monotonicos();
+        if (ahora >= limite) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        int espera = revisar_temporizador_confiable(canal);
+        int restante = (int)((limite - ahora)/1000000);
+        if (atender_canal_confiable(canal, espera < 0 || espera > restante ?
+                restante : espera) == -1) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Muestra los mensajes enviados y retransmitidos, el RTT estimado y la ventana
+ * de congestión de un canal.
+ *
+ * @param canal canal
+ */
+void mostrar_estadisticas_confiable(const Canal_confiable *canal) {
+    printf("%lu mensajes enviados, %lu retransmisiones(%lu por expiración, ",
+        canal->enviados, canal->retransmisiones, canal->expiraciones);
+    printf("%lu recuperaciones rápidas)\n", canal->recuperaciones);
+    printf("RTT estimado %.3f ms(variación %.3f ms), RTO %.3f ms, ventana %.1f\n",
+        canal->srtt/1e6, canal->rttvar/1e6, canal->rto/1e6, canal->cwnd);
+    if (canal->simulados > 0) {
+        printf("%lu paquetes descartados por la simulación de pérdidas\n",
+            canal->simulados);
+    }
+}
+
+#endif  // FUNCIONES_CONFIABLE_H_
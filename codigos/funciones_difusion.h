@@ -0,0 +1,479 @@
+/**
+ * Funciones para difundir mensajes a suscriptores(publicación/suscripción)
+ *
+ * Un cliente se suscribe enviando la trama "#suscribir" para recibir todos
+ * los mensajes, o "#suscribir <tema>" para recibir sólo los publicados con la
+ * trama "#tema <tema> <datos>"(puede suscribirse a varios temas). Cualquier
+ * otro mensaje que reciba el servidor se publica a los suscriptores que le
+ * corresponden, sin cambios y como trama, ver 'funciones_tramas.h'.
+ *
+ * Notas:
+ * - Cada mensaje publicado se copia una sola vez, con su encabezado de trama,
+ * 	a un 'Mensaje_difusion' con contador de referencias; las colas de los
+ * 	suscriptores guardan sólo apuntadores y el mensaje se libera cuando lo
+ * 	envió la última cola.
+ * - La cola de cada suscriptor es un anillo acotado. Los mensajes publicados
+ * 	al atender un bloque recibido se envían juntos al final con 'writev()'
+ * 	('vaciar_difusor()'). Si el socket del suscriptor se llena, la cola
+ * 	guarda los mensajes y se espera a que el socket tenga espacio(EPOLLOUT);
+ * 	si aun así se llena la cola, el suscriptor se desconecta para no
+ * 	detener a los demás.
+ * - El difusor se atiende desde un solo hilo(el del reactor), por eso los
+ * 	contadores de referencias no necesitan operaciones atómicas.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_DIFUSION_H_
+#define FUNCIONES_DIFUSION_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>  // para 'writev()'
+
+#include "funciones_epoll.h"
+#include "funciones_tramas.h"
+
+// mensajes pendientes por suscriptor antes de desconectarlo
+const uint32_t kMaxPendientesDifusion = 1024;
+// bytes pendientes por suscriptor antes de desconectarlo
+const size_t kMaxBytesDifusion = 64*1024*1024;
+// temas a los que puede suscribirse un cliente; las tramas de control y la
+// longitud de cada tema están en 'funciones_tramas.h'
+enum {kMaxTemasDifusion = 8};
+
+// mensaje publicado, se guarda una sola vez como trama lista para enviarse
+typedef struct Mensaje_difusion {
+    uint32_t referencias;  // colas que aún lo tienen
+    uint32_t tam_trama;  // encabezado más datos
+    char trama[];
+} Mensaje_difusion;
+
+typedef struct Suscriptor {
+    Conexion *conexion;
+    int indice;  // posición en 'difusor.suscriptores'
+    int todos;  // 1 si recibe todos los mensajes
+    char temas[kMaxTemasDifusion][kTamTemaDifusion];
+    int num_temas;
+    Mensaje_difusion **cola;  // anillo de 'difusor.max_pendientes' mensajes
+    uint32_t inicio;  // primer mensaje pendiente
+    uint32_t num_pendientes;
+    uint32_t enviados;  // bytes ya enviados del primer mensaje
+    size_t bytes_pendientes;
+    int sucio;  // 1 si tiene mensajes que aún no se intentan enviar
+    int bloqueado;  // 1 si espera a que el socket tenga espacio
+    unsigned long entregados;
+} Suscriptor;
+
+typedef struct Difusor {
+    Suscriptor **suscriptores;  // arreglo sin huecos
+    int num_suscriptores;
+    Suscriptor **por_descriptor;  // indexado por descriptor de la conexión
+    int max_conexiones;
+    uint32_t max_pendientes;
+    int sucio;  // 1 si algún suscriptor tiene mensajes sin intentar enviar
+    unsigned long publicados;  // mensajes recibidos para difundir
+    unsigned long encolados;  // copias lógicas(referencias) encoladas
+    unsigned long entregados;  // mensajes enviados completos
+    unsigned long escrituras;  // llamadas a 'writev()'
+    unsigned long desconectados;  // suscriptores lentos desconectados
+    uint32_t max_cola;  // mayor número de mensajes pendientes visto
+} Difusor;
+
+Difusor difusor;  // difusor del proceso
+
+/* Prototipos */
+
+int iniciar_difusor(int max_conexiones, uint32_t max_pendientes);
+int obtener_tema(const char *mensaje, uint32_t tam_mensaje, const char **tema);
+int agregar_suscripcion(Conexion *conexion, const char *mensaje,
+        uint32_t tam_mensaje);
+void quitar_suscriptor(Conexion *conexion);
+void soltar_mensaje_difusion(Mensaje_difusion *mensaje);
+int recibe_tema(const Suscriptor *suscriptor, const char *tema, int tam_tema);
+int publicar_mensaje_difusion(Reactor *reactor, const char *mensaje,
+        uint32_t tam_mensaje);
+int enviar_pendientes_suscriptor(Reactor *reactor, Suscriptor *suscriptor);
+int escribir_suscriptor(Reactor *reactor, Conexion *conexion);
+void vaciar_difusor(Reactor *reactor);
+void mostrar_estadisticas_difusor();
+void detener_difusor();
+
+/* Funciones */
+
+/**
+ * Inicializa el difusor del proceso.
+ *
+ * @param max_conexiones entradas de la tabla de conexiones del reactor
+ * @param max_pendientes mensajes pendientes por suscriptor antes de
+ *                       desconectarlo
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int iniciar_difusor(int max_conexiones, uint32_t max_pendientes) {
+    memset(&difusor, 0, sizeof(Difusor));
+    difusor.max_conexiones = max_conexiones;
+    difusor.max_pendientes = max_pendientes;
+    // como la tabla del reactor, las páginas sólo se ocupan al usarse
+    difusor.suscriptores = (Suscriptor**)calloc(max_conexiones,
+        sizeof(Suscriptor*));
+    difusor.por_descriptor = (Suscriptor**)calloc(max_conexiones,
+        sizeof(Suscriptor*));
+    if (difusor.suscriptores == NULL || difusor.por_descriptor == NULL) {
+        fprintf(stderr,"\nError al reservar memoria para el difusor\n");
+        detener_difusor();
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Obtiene el tema de un mensaje publicado con "#tema <tema> <datos>".
+ *
+ * @param mensaje datos de la trama
+ * @param tam_mensaje longitud de la trama
+ * @param tema donde se guarda el inicio del tema(sin fin de cadena)
+ *
+ * @return longitud del tema, 0 si el mensaje no tiene tema
+ */
+int obtener_tema(const char *mensaje, uint32_t tam_mensaje, const char **tema) {
+    size_t tam_prefijo = strlen(kPrefijoTema);
+    uint32_t fin = tam_prefijo;
+
+    if (tam_mensaje <= tam_prefijo ||
+            memcmp(mensaje, kPrefijoTema, tam_prefijo) != 0) {
+        return 0;
+    }
+    *tema = mensaje + tam_prefijo;
+    while (fin < tam_mensaje && mensaje[fin] != ' ') {
+        fin++;
+    }
+
+    return fin - tam_prefijo;
+}
+
+/**
+ * Revisa si un mensaje es una suscripción y, si lo es, agrega su conexión a
+ * los suscriptores(o el tema a los de un suscriptor existente).
+ *
+ * @param conexion conexión que envió el mensaje
+ * @param mensaje datos de la trama
+ * @param tam_mensaje longitud de la trama
+ *
+ * @return 1 si era una suscripción, 0 si no lo era, -1 en caso de error
+ */
+int agregar_suscripcion(Conexion *conexion, const char *mensaje,
+        uint32_t tam_mensaje) {
+    size_t tam_prefijo = strlen(kPrefijoSuscripcion);
+    Suscriptor *suscriptor;
+
+    if (tam_mensaje < tam_prefijo ||
+            memcmp(mensaje, kPrefijoSuscripcion, tam_prefijo) != 0 ||
+            (tam_mensaje > tam_prefijo && mensaje[tam_prefijo] != ' ')) {
+        return 0;
+    }
+    if (conexion->descriptor >= difusor.max_conexiones) {
+        return -1;
+    }
+
+    suscriptor = difusor.por_descriptor[conexion->descriptor];
+    if (suscriptor == NULL) {
+        suscriptor = (Suscriptor*)calloc(1, sizeof(Suscriptor));
+        if (suscriptor == NULL || (suscriptor->cola = (Mensaje_difusion**)
+                calloc(difusor.max_pendientes, sizeof(Mensaje_difusion*)))
+                == NULL) {
+            fprintf(stderr,"\nError al reservar memoria para el suscriptor\n");
+            free(suscriptor);
+            return -1;
+        }
+        suscriptor->conexion = conexion;
+        suscriptor->indice = difusor.num_suscriptores;
+        difusor.suscriptores[difusor.num_suscriptores++] = suscriptor;
+        difusor.por_descriptor[conexion->descriptor] = suscriptor;
+        conexion->escritor = escribir_suscriptor;
+    }
+
+    // "#suscribir" sin tema o con más temas de los que caben: todos
+    const char *tema = mensaje + tam_prefijo + 1;
+    int tam_tema = tam_mensaje > tam_prefijo + 1 ?
+        (int)(tam_mensaje - tam_prefijo - 1) : 0;
+    if (tam_tema == 0 || tam_tema >= kTamTemaDifusion ||
+            suscriptor->num_temas == kMaxTemasDifusion) {
+        suscriptor->todos = 1;
+    } else {
+        memcpy(suscriptor->temas[suscriptor->num_temas], tema, tam_tema);
+        suscriptor->temas[suscriptor->num_temas++][tam_tema] = '\0';
+    }
+
+    return 1;
+}
+
+/**
+ * Quita el suscriptor de una conexión que se cierra y suelta sus mensajes
+ * pendientes. Si la conexión no estaba suscrita no hace nada.
+ *
+ * @param conexion conexión que se cerrará
+ */
+void quitar_suscriptor(Conexion *conexion) {
+    Suscriptor *suscriptor;
+
+    if (difusor.por_descriptor == NULL ||
+            conexion->descriptor >= difusor.max_conexiones ||
+            (suscriptor = difusor.por_descriptor[conexion->descriptor])
+            == NULL) {
+        return;
+    }
+    while (suscriptor->num_pendientes > 0) {
+        soltar_mensaje_difusion(suscriptor->cola[suscriptor->inicio]);
+        suscriptor->inicio = (suscriptor->inicio + 1) % difusor.max_pendientes;
+        suscriptor->num_pendientes--;
+    }
+    // el último suscriptor ocupa el lugar del que se va
+    Suscriptor *ultimo = difusor.suscriptores[--difusor.num_suscriptores];
+    difusor.suscriptores[suscriptor->indice] = ultimo;
+    ultimo->indice = suscriptor->indice;
+    difusor.por_descriptor[conexion->descriptor] = NULL;
+    conexion->escritor = NULL;
+    free(suscriptor->cola);
+    free(suscriptor);
+}
+
+/**
+ * Suelta una referencia del mensaje y lo libera si era la última.
+ *
+ * @param mensaje mensaje publicado
+ */
+void soltar_mensaje_difusion(Mensaje_difusion *mensaje) {
+    if (--mensaje->referencias == 0) {
+        free(mensaje);
+    }
+}
+
+/**
+ * Indica si el suscriptor recibe los mensajes de un tema.
+ *
+ * @param suscriptor suscriptor a revisar
+ * @param tema tema del mensaje(sin fin de cadena)
+ * @param tam_tema longitud del tema, 0 si el mensaje no tiene tema
+ *
+ * @return 1 si lo recibe, 0 si no
+ */
+int recibe_tema(const Suscriptor *suscriptor, const char *tema, int tam_tema) {
+    int i;
+
+    if (suscriptor->todos) {
+        return 1;
+    }
+    for (i = 0; i < suscriptor->num_temas && tam_tema > 0; i++) {
+        if (strncmp(suscriptor->temas[i], tema, tam_tema) == 0 &&
+                suscriptor->temas[i][tam_tema] == '\0') {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Encola el mensaje en cada suscriptor que le corresponde. El mensaje se copia
+ * una sola vez, y sólo si algún suscriptor lo recibe. Los suscriptores con la
+ * cola llena se desconectan. El envío se hace en 'vaciar_difusor()'.
+ *
+ * @param reactor reactor que atiende a los suscriptores
+ * @param mensaje datos de la trama recibida
+ * @param tam_mensaje longitud de la trama
+ *
+ * @return número de suscriptores que recibirán el mensaje, -1 en caso de error
+ */
+int publicar_mensaje_difusion(Reactor *reactor, const char *mensaje,
+        uint32_t tam_mensaje) {
+    Mensaje_difusion *publicado = NULL;
+    const char *tema = NULL;
+    int tam_tema = obtener_tema(mensaje, tam_mensaje, &tema);
+    uint32_t tam_trama = kTamEncabezado + tam_mensaje;
+    int i, destinos = 0;
+
+    difusor.publicados++;
+    // se recorre al revés: al desconectar un suscriptor su lugar lo ocupa el
+    // último, que ya se revisó
+    for (i = difusor.num_suscriptores - 1; i >= 0; i--) {
+        Suscriptor *suscriptor = difusor.suscriptores[i];
+        if (!recibe_tema(suscriptor, tema, tam_tema)) {
+            continue;
+        }
+        if (suscriptor->num_pendientes == difusor.max_pendientes ||
+                suscriptor->bytes_pendientes + tam_trama > kMaxBytesDifusion) {
+            difusor.desconectados++;
+            cerrar_conexion(reactor, suscriptor->conexion);
+            continue;
+        }
+        if (publicado == NULL) {
+            publicado = (Mensaje_difusion*)malloc(sizeof(Mensaje_difusion) +
+                tam_trama);
+            if (publicado == NULL) {
+                fprintf(stderr,"\nError al reservar memoria para difundir\n");
+                return -1;
+            }
+            uint32_t encabezado = htonl(tam_mensaje);
+            memcpy(publicado->trama, &encabezado, kTamEncabezado);
+            memcpy(publicado->trama + kTamEncabezado, mensaje, tam_mensaje);
+            publicado->tam_trama = tam_trama;
+            publicado->referencias = 0;
+        }
+        publicado->referencias++;
+        suscriptor->cola[(suscriptor->inicio + suscriptor->num_pendientes) %
+            difusor.max_pendientes] = publicado;
+        suscriptor->num_pendientes++;
+        suscriptor->bytes_pendientes += tam_trama;
+        if (suscriptor->num_pendientes > difusor.max_cola) {
+            difusor.max_cola = suscriptor->num_pendientes;
+        }
+        suscriptor->sucio = 1;
+        difusor.sucio = 1;
+        difusor.encolados++;
+        destinos++;
+    }
+
+    return destinos;
+}
+
+/**
+ * Envía los mensajes pendientes del suscriptor con 'writev()', hasta
+ * 'kMaxTramasLote' por llamada. Si el socket se llena, la conexión se
+ * registra para escritura y el resto se envía en 'escribir_suscriptor()'.
+ *
+ * @param reactor reactor que atiende al suscriptor
+ * @param suscriptor suscriptor con mensajes pendientes
+ *
+ * @return 0 en caso de éxito, -1 en caso de error(se debe cerrar la conexión)
+ */
+int enviar_pendientes_suscriptor(Reactor *reactor, Suscriptor *suscriptor) {
+    struct iovec vectores[kMaxTramasLote];
+    Mensaje_difusion *mensaje;
+    int i, num_vectores;
+    ssize_t res;
+
+    suscriptor->sucio = 0;
+    while (suscriptor->num_pendientes > 0) {
+        num_vectores = suscriptor->num_pendientes < (uint32_t)kMaxTramasLote ?
+            (int)suscriptor->num_pendientes : kMaxTramasLote;
+        for (i = 0; i < num_vectores; i++) {
+            mensaje = suscriptor->cola[(suscriptor->inicio + i) %
+                difusor.max_pendientes];
+            vectores[i].iov_base = mensaje->trama;
+            vectores[i].iov_len = mensaje->tam_trama;
+        }
+        vectores[0].iov_base = (char*)vectores[0].iov_base +
+            suscriptor->enviados;
+        vectores[0].iov_len -= suscriptor->enviados;
+
+        uint64_t inicio = iniciar_medicion_socket();
+        res = writev(suscriptor->conexion->descriptor, vectores, num_vectores);
+        registrar_operacion_socket(kOpEnviarStream, res, -1, inicio);
+        reactor->llamadas_sistema++;
+        difusor.escrituras++;
+        if (res == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                suscriptor->bloqueado = 1;
+                return esperar_escritura(reactor, suscriptor->conexion);
+            }
+            fprintf(stderr, "\nError al enviar a suscriptor(writev): %s\n",
+                strerror(errno));
+            return -1;
+        }
+
+        // se sueltan los mensajes enviados completos
+        while (res > 0) {
+            mensaje = suscriptor->cola[suscriptor->inicio];
+            if ((size_t)res < mensaje->tam_trama - suscriptor->enviados) {
+                suscriptor->enviados += res;
+                break;
+            }
+            res -= mensaje->tam_trama - suscriptor->enviados;
+            suscriptor->enviados = 0;
+            suscriptor->bytes_pendientes -= mensaje->tam_trama;
+            suscriptor->inicio = (suscriptor->inicio + 1) %
+                difusor.max_pendientes;
+            suscriptor->num_pendientes--;
+            suscriptor->entregados++;
+            difusor.entregados++;
+            soltar_mensaje_difusion(mensaje);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Escritor de la conexión de un suscriptor: el socket volvió a tener espacio
+ * y se envían sus mensajes pendientes.
+ *
+ * @param reactor reactor que atiende al suscriptor
+ * @param conexion conexión del suscriptor
+ *
+ * @return 0 en caso de éxito, -1 para cerrar la conexión
+ */
+int escribir_suscriptor(Reactor *reactor, Conexion *conexion) {
+    Suscriptor *suscriptor = difusor.por_descriptor[conexion->descriptor];
+
+    if (suscriptor == NULL) {
+        return 0;
+    }
+    suscriptor->bloqueado = 0;
+    return enviar_pendientes_suscriptor(reactor, suscriptor);
+}
+
+/**
+ * Envía los mensajes publicados desde la última llamada a los suscriptores
+ * que no están esperando espacio en su socket. Se llama al terminar de
+ * atender un bloque recibido, así varios mensajes salen en un solo envío.
+ *
+ * @param reactor reactor que atiende a los suscriptores
+ */
+void vaciar_difusor(Reactor *reactor) {
+    int i;
+
+    if (!difusor.sucio) {
+        return;
+    }
+    difusor.sucio = 0;
+    for (i = difusor.num_suscriptores - 1; i >= 0; i--) {
+        Suscriptor *suscriptor = difusor.suscriptores[i];
+        if (suscriptor->sucio && !suscriptor->bloqueado &&
+                enviar_pendientes_suscriptor(reactor, suscriptor) == -1) {
+            cerrar_conexion(reactor, suscriptor->conexion);
+        }
+    }
+}
+
+/**
+ * Muestra los mensajes publicados, las copias entregadas, las llamadas a
+ * 'writev()' y los suscriptores desconectados por lentos.
+ */
+void mostrar_estadisticas_difusor() {
+    printf("Difusión: %lu mensajes publicados, %lu encolados, %lu entregados",
+        difusor.publicados, difusor.encolados, difusor.entregados);
+    printf(" en %lu llamadas(writev)\n", difusor.escrituras);
+    printf("\t%d suscriptores, %lu desconectados por lentos, cola máxima %u ",
+        difusor.num_suscriptores, difusor.desconectados, difusor.max_cola);
+    printf("de %u mensajes\n", difusor.max_pendientes);
+}
+
+/**
+ * Libera las tablas del difusor. Los suscriptores se quitan al cerrar sus
+ * conexiones('destruir_reactor()').
+ */
+void detener_difusor() {
+    free(difusor.suscriptores);
+    free(difusor.por_descriptor);
+    difusor.suscriptores = NULL;
+    difusor.por_descriptor = NULL;
+}
+
+#endif  // FUNCIONES_DIFUSION_H_
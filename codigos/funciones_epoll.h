@@ -0,0 +1,734 @@
+/**
+ * Funciones para multiplexar sockets con epoll
+ *
+ * Contiene un "reactor" de eventos que atiende desde un solo proceso a los
+ * sockets que escuchan y a todas las conexiones aceptadas, usando 'epoll' en modo
+ * disparado por flanco(EPOLLET) y sockets NO bloqueantes. De esta forma no es
+ * necesario un hilo por cliente.
+ *
+ * Notas:
+ * - El estado de cada conexión se guarda en una tabla preasignada e indexada
+ * 	por el descriptor del socket, por lo que no hay reservas de memoria al
+ * 	aceptar o atender una conexión. Si se asigna un caché de pool('cache'),
+ * 	los buffers de tramas de las conexiones también se toman del pool.
+ * - La tabla tiene tantas entradas como el límite suave de descriptores, que
+ * 	se eleva a lo más a 'max_descriptores', ver
+ * 	'ampliar_limite_descriptores()'. Cada reactor tiene su tabla, así que con
+ * 	varios hilos conviene no elevar 'max_descriptores' más de lo necesario;
+ * 	las conexiones cuyo descriptor no cabe se rechazan y se cuentan.
+ * - En modo disparado por flanco cada evento se notifica una sola vez, por lo
+ * 	que se debe leer hasta que la función regrese EAGAIN.
+ * - El socket que escucha se registra en modo por nivel: en cada despertar se
+ * 	aceptan a lo más 'kMaxAceptarLote' conexiones y, si quedan más, epoll lo
+ * 	vuelve a notificar después de atender los demás eventos. Así una ráfaga
+ * 	de conexiones no detiene a los clientes ya conectados.
+ * - Si el proceso se queda sin descriptores(EMFILE) se cierra un descriptor
+ * 	de reserva, se acepta la conexión pendiente y se cierra de inmediato; el
+ * 	cliente recibe el cierre en lugar de esperar en la cola y el servidor
+ * 	sigue atendiendo. Las conexiones rechazadas y abortadas se cuentan.
+ * - Un reactor puede tener varios sockets que escuchan(por ejemplo uno IPv4 y
+ * 	otro IPv6, ver 'inicializar_servidores()'); todos comparten la misma
+ * 	tabla de conexiones, el mismo buffer y el mismo caché.
+ * - Las conexiones sólo se registran para lectura. Una conexión con datos
+ * 	por enviar que no cupieron en el socket se registra también para
+ * 	escritura con 'esperar_escritura()' y su 'escritor' se llama cuando el
+ * 	socket vuelve a tener espacio.
+ * - Los manejadores nunca esperan a que un socket tenga espacio: con
+ * 	'enviar_tramas_conexion()' lo que no cabe se guarda en la salida de la
+ * 	conexión y se envía al llegar EPOLLOUT. Si un cliente no lee y su salida
+ * 	pasa de 'kMaxSalidaConexion' bytes la conexión se cierra, así un cliente
+ * 	lento no detiene a los demás clientes del mismo hilo.
+ *
+ * Para más información consultar 'man 7 epoll'.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_EPOLL_H_
+#define FUNCIONES_EPOLL_H_
+
+#include <signal.h>  // 'sig_atomic_t'
+#include <sys/epoll.h>
+#include <sys/resource.h>  // para 'getrlimit()'
+
+#include "funciones_sockets.h"
+#include "funciones_tramas.h"
+
+// número máximo de eventos que se obtienen en cada llamada a 'epoll_wait()'
+const int kMaxEventos = 256;
+// tamaño máximo por defecto de la tabla de conexiones
+const int kMaxDescriptores = 1 << 16;
+// conexiones que se aceptan en cada despertar del socket que escucha
+const int kMaxAceptarLote = 64;
+// bytes por enviar que puede acumular una conexión antes de cerrarla
+const size_t kMaxSalidaConexion = 4*1024*1024;
+
+struct Reactor;
+
+// entradas máximas de la tabla de conexiones de cada reactor, usado por
+// 'crear_reactor()'
+int max_descriptores = kMaxDescriptores;
+
+// estado de una conexión aceptada, se guarda en la posición de su descriptor
+typedef struct Conexion {
+    int activa;  // 1 si la entrada de la tabla está en uso
+    int escucha;  // 1 si el descriptor es un socket que escucha del reactor
+    int descriptor;
+    unsigned generacion;  // cambia cada vez que se reutiliza la entrada
+    struct sockaddr_storage direccion;  // dirección del cliente
+    unsigned long bytes_recibidos;
+    Buffer_tramas entrada;  // bytes recibidos aún no procesados
+    Buffer_tramas salida;  // bytes por enviar que no cupieron en el socket
+    // si no es 'NULL' se llama en lugar de 'recv()' cuando hay datos; regresa
+    // 0 si ya no hay datos, 1 para volver a la lectura normal y -1 para
+    // cerrar la conexión
+    int (*lector)(struct Reactor *reactor, struct Conexion *conexion);
+    // si no es 'NULL' se llama cuando el socket vuelve a permitir escribir,
+    // ver 'esperar_escritura()'; regresa -1 para cerrar la conexión
+    int (*escritor)(struct Reactor *reactor, struct Conexion *conexion);
+    int espera_escritura;  // 1 si ya está registrada con EPOLLOUT
+    void *datos;  // estado adicional del programa
+} Conexion;
+
+// función que se llama cada vez que se reciben datos de una conexión
+typedef void (*Manejador_datos)(struct Reactor *reactor, Conexion *conexion,
+        char *buffer, int bytes_recibidos);
+// función que se llama antes de cerrar una conexión
+typedef void (*Manejador_cierre)(struct Reactor *reactor, Conexion *conexion);
+
+typedef struct Reactor {
+    int descriptor_epoll;
+    int descriptores_escucha[kMaxEscucha];  // sockets que escuchan
+    int num_escucha;
+    int descriptor_reserva;  // se libera para rechazar conexiones con EMFILE
+    Conexion *conexiones;  // tabla indexada por descriptor
+    int max_conexiones;  // número de entradas de la tabla
+    int conexiones_activas;
+    unsigned long total_conexiones;  // conexiones aceptadas desde el inicio
+    unsigned long conexiones_rechazadas;  // cerradas por falta de descriptores
+    unsigned long conexiones_abortadas;  // el cliente abortó antes de aceptarse
+    unsigned long conexiones_lentas;  // cerradas por no leer lo que se envía
+    unsigned long lotes_aceptados;  // despertares del socket que escucha
+    unsigned long total_bytes;  // bytes recibidos desde el inicio
+    unsigned long llamadas_sistema;  // llamadas de E/S hechas por el reactor
+    struct epoll_event *eventos;
+    char *buffer;  // buffer de recepción compartido por todas las conexiones
+    int tam_buffer;  // bytes que se leen por llamada(el buffer tiene uno más)
+    volatile sig_atomic_t activo;  // 0 para terminar 'ejecutar_reactor()'
+    Manejador_datos manejador;
+    Manejador_cierre al_cerrar;  // opcional
+    Cache_pool *cache;  // opcional, memoria para los buffers de tramas
+    // opcional, motor de E/S distinto de epoll(ver 'ejecutar_reactor_uring()')
+    // y la función con la que 'esperar_escritura()' le pide enviar la salida
+    // de la conexión(o avisar cuando pueda escribir, si no hay salida)
+    void *motor;
+    int (*pedir_escritura)(struct Reactor *reactor, Conexion *conexion);
+    void *datos;  // datos adicionales para el manejador
+} Reactor;
+
+/* Prototipos */
+
+int ampliar_limite_descriptores(int maximo);
+int crear_reactor(Reactor *reactor, int descriptor_escucha, int tam_buffer,
+        Manejador_datos manejador);
+int agregar_escucha_reactor(Reactor *reactor, int descriptor_escucha);
+int registrar_descriptor(Reactor *reactor, int descriptor, uint32_t eventos);
+int esperar_escritura(Reactor *reactor, Conexion *conexion);
+int revisar_salida_conexion(Reactor *reactor, Conexion *conexion);
+int enviar_tramas_conexion(Reactor *reactor, Conexion *conexion, char **datos,
+        uint32_t *tam_datos, int num_tramas);
+int vaciar_salida_conexion(Reactor *reactor, Conexion *conexion);
+void atender_escritura(Reactor *reactor, Conexion *conexion);
+int rechazar_conexion_pendiente(Reactor *reactor, int descriptor_escucha);
+Conexion* abrir_conexion(Reactor *reactor, int descriptor,
+        const struct sockaddr_storage *direccion);
+void cerrar_conexion(Reactor *reactor, Conexion *conexion);
+void aceptar_conexiones(Reactor *reactor, int descriptor_escucha);
+void atender_conexion(Reactor *reactor, Conexion *conexion);
+int ejecutar_reactor(Reactor *reactor);
+void destruir_reactor(Reactor *reactor);
+
+/* Funciones */
+
+/**
+ * Eleva el límite suave de descriptores abiertos(RLIMIT_NOFILE) hasta 'maximo'
+ * (sin pasar del límite duro), para poder mantener miles de conexiones
+ * simultáneas. Un límite suave mayor no se reduce.
+ *
+ * Para más información consultar 'man 2 setrlimit'.
+ *
+ * @param maximo número de descriptores que se quieren usar
+ *
+ * @return límite de descriptores(a lo más 'maximo'), -1 en caso de error
+ */
+int ampliar_limite_descriptores(int maximo) {
+    struct rlimit limite;
+    if (getrlimit(RLIMIT_NOFILE, &limite) == -1) {
+        fprintf(stderr,"\nError al obtener límite de descriptores: %s\n",
+            strerror(errno));
+        return -1;
+    }
+    if (limite.rlim_cur < (rlim_t)maximo && limite.rlim_cur < limite.rlim_max) {
+        limite.rlim_cur = limite.rlim_max < (rlim_t)maximo ? limite.rlim_max :
+            (rlim_t)maximo;
+        if (setrlimit(RLIMIT_NOFILE, &limite) == -1) {
+            getrlimit(RLIMIT_NOFILE, &limite);  // se conserva el límite actual
+        }
+    }
+
+    return limite.rlim_cur > (rlim_t)maximo ? maximo : (int)limite.rlim_cur;
+}
+
+/**
+ * Inicializa el reactor: crea la instancia de epoll, la tabla de conexiones y
+ * registra el socket que escucha, el cual se configura como NO bloqueante.
+ *
+ * La tabla tiene una entrada por cada descriptor que el proceso puede abrir(a
+ * lo más 'max_descriptores'), así la búsqueda del estado de una conexión es un
+ * acceso directo por índice.
+ *
+ * @param reactor estructura a inicializar
+ * @param descriptor_escucha socket al que ya se le llamó 'escuchar()'; se
+ *                           pueden agregar más con 'agregar_escucha_reactor()'
+ * @param tam_buffer número máximo de bytes leídos por llamada a 'recv()'. Se
+ *                   reserva un byte adicional para que el manejador pueda
+ *                   agregar el fin de cadena
+ * @param manejador función que procesará los datos recibidos
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int crear_reactor(Reactor *reactor, int descriptor_escucha, int tam_buffer,
+        Manejador_datos manejador) {
+    memset(reactor, 0, sizeof(Reactor));
+    reactor->descriptor_reserva = -1;
+    reactor->tam_buffer = tam_buffer;
+    reactor->manejador = manejador;
+
+    reactor->max_conexiones = ampliar_limite_descriptores(max_descriptores);
+    if (reactor->max_conexiones == -1) {
+        return -1;
+    }
+
+    reactor->descriptor_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor->descriptor_epoll == -1) {
+        fprintf(stderr,"\nError al crear instancia de epoll: %s\n",
+            strerror(errno));
+        return -1;
+    }
+
+    // 'calloc()' deja la tabla en ceros(todas las entradas libres); las
+    // páginas sólo se ocupan al usar los descriptores correspondientes
+    reactor->conexiones = (Conexion*)calloc(reactor->max_conexiones,
+        sizeof(Conexion));
+    reactor->eventos = (struct epoll_event*)malloc(
+        sizeof(struct epoll_event)*kMaxEventos);
+    reactor->buffer = (char*)malloc(sizeof(char)*(tam_buffer + 1));
+    if (reactor->conexiones == NULL || reactor->eventos == NULL ||
+            reactor->buffer == NULL) {
+        fprintf(stderr,"\nError al reservar memoria para el reactor\n");
+        destruir_reactor(reactor);
+        return -1;
+    }
+
+    // descriptor de reserva para poder rechazar conexiones sin descriptores
+    reactor->descriptor_reserva = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (reactor->descriptor_reserva == -1) {
+        fprintf(stderr,"\nError al abrir descriptor de reserva: %s\n",
+            strerror(errno));
+        destruir_reactor(reactor);
+        return -1;
+    }
+
+    if (agregar_escucha_reactor(reactor, descriptor_escucha) == -1) {
+        destruir_reactor(reactor);
+        return -1;
+    }
+
+    reactor->activo = 1;
+    return 0;
+}
+
+/**
+ * Agrega un socket que escucha al reactor: lo configura como NO bloqueante, lo
+ * marca en la tabla de conexiones y lo registra en epoll en modo por nivel
+ * (sin EPOLLET), ver notas.
+ *
+ * @param reactor reactor inicializado con 'crear_reactor()'
+ * @param descriptor_escucha socket al que ya se le llamó 'escuchar()'
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int agregar_escucha_reactor(Reactor *reactor, int descriptor_escucha) {
+    struct epoll_event evento;
+
+    if (reactor->num_escucha == kMaxEscucha ||
+            descriptor_escucha >= reactor->max_conexiones) {
+        fprintf(stderr,"\nNo se pueden agregar más sockets que escuchan\n");
+        return -1;
+    }
+    memset(&evento, 0, sizeof(evento));
+    evento.events = EPOLLIN;
+    evento.data.fd = descriptor_escucha;
+    if (establecer_no_bloqueante(descriptor_escucha) == -1 ||
+            epoll_ctl(reactor->descriptor_epoll, EPOLL_CTL_ADD,
+                descriptor_escucha, &evento) == -1) {
+        fprintf(stderr,"\nError al registrar socket que escucha: %s\n",
+            strerror(errno));
+        return -1;
+    }
+    reactor->conexiones[descriptor_escucha].escucha = 1;
+    reactor->descriptores_escucha[reactor->num_escucha++] = descriptor_escucha;
+
+    return 0;
+}
+
+/**
+ * Agrega un descriptor a la instancia de epoll en modo disparado por flanco.
+ *
+ * Para más información consultar 'man 2 epoll_ctl'.
+ *
+ * @param reactor reactor donde se registrará
+ * @param descriptor identificador del socket
+ * @param eventos eventos de interés(EPOLLIN, EPOLLOUT, ...)
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int registrar_descriptor(Reactor *reactor, int descriptor, uint32_t eventos) {
+    struct epoll_event evento;
+    memset(&evento, 0, sizeof(evento));
+    evento.events = eventos | EPOLLET;
+    evento.data.fd = descriptor;
+    if (epoll_ctl(reactor->descriptor_epoll, EPOLL_CTL_ADD, descriptor, &evento)
+            == -1) {
+        fprintf(stderr,"\nError al registrar descriptor en epoll: %s\n",
+            strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Registra la conexión también para escritura(EPOLLOUT), así su salida se
+ * envía y su 'escritor' se llama cuando el socket tenga espacio. En modo
+ * disparado por flanco el evento sólo se notifica cuando un envío se quedó
+ * sin espacio, por lo que la conexión se queda registrada hasta cerrarse. Con
+ * otro motor de E/S se usa 'reactor->pedir_escritura', que envía la salida
+ * por su cuenta; 'espera_escritura' sigue en 1 mientras ese envío no termine.
+ *
+ * @param reactor reactor al que pertenece la conexión
+ * @param conexion conexión con datos que no cupieron en el socket
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int esperar_escritura(Reactor *reactor, Conexion *conexion) {
+    struct epoll_event evento;
+
+    if (conexion->espera_escritura) {
+        return 0;
+    }
+    if (reactor->pedir_escritura != NULL) {
+        if (reactor->pedir_escritura(reactor, conexion) == -1) {
+            return -1;
+        }
+        conexion->espera_escritura = 1;
+        return 0;
+    }
+    memset(&evento, 0, sizeof(evento));
+    evento.events = EPOLLIN | EPOLLRDHUP | EPOLLOUT | EPOLLET;
+    evento.data.fd = conexion->descriptor;
+    reactor->llamadas_sistema++;
+    if (epoll_ctl(reactor->descriptor_epoll, EPOLL_CTL_MOD,
+            conexion->descriptor, &evento) == -1) {
+        fprintf(stderr,"\nError al esperar escritura en epoll: %s\n",
+            strerror(errno));
+        return -1;
+    }
+    conexion->espera_escritura = 1;
+
+    return 0;
+}
+
+/**
+ * Revisa la salida de la conexión después de un envío: si quedaron bytes
+ * pendientes espera a que el socket tenga espacio, y si son demasiados(el
+ * cliente no lee) indica que la conexión debe cerrarse.
+ *
+ * @param reactor reactor al que pertenece la conexión
+ * @param conexion conexión que envió datos
+ *
+ * @return 0 si la conexión sigue, -1 si debe cerrarse
+ */
+int revisar_salida_conexion(Reactor *reactor, Conexion *conexion) {
+    size_t pendientes = conexion->salida.fin - conexion->salida.inicio;
+
+    if (pendientes == 0) {
+        return 0;
+    }
+    if (pendientes > kMaxSalidaConexion) {
+        reactor->conexiones_lentas++;
+        return -1;
+    }
+
+    return esperar_escritura(reactor, conexion);
+}
+
+/**
+ * Envía varias tramas a la conexión sin bloquear al reactor, ver
+ * 'enviar_tramas_sin_bloqueo()': lo que no cabe en el socket se guarda en la
+ * salida de la conexión y se envía cuando el socket tenga espacio. Con otro
+ * motor de E/S las tramas se copian completas a la salida y el motor las
+ * envía, ver 'esperar_escritura()'.
+ *
+ * @param reactor reactor al que pertenece la conexión
+ * @param conexion conexión destino
+ * @param datos arreglo con los datos de cada trama
+ * @param tam_datos longitud de cada trama
+ * @param num_tramas número de tramas, a lo más 'kMaxTramasLote'
+ *
+ * @return 0 en caso de éxito, -1 si la conexión debe cerrarse(error o
+ *         demasiados bytes pendientes)
+ */
+int enviar_tramas_conexion(Reactor *reactor, Conexion *conexion, char **datos,
+        uint32_t *tam_datos, int num_tramas) {
+    if (reactor->pedir_escritura != NULL) {
+        if (agregar_tramas(&conexion->salida, datos, tam_datos, num_tramas)
+                == -1) {
+            return -1;
+        }
+        return revisar_salida_conexion(reactor, conexion);
+    }
+    if (conexion->salida.fin == conexion->salida.inicio) {
+        reactor->llamadas_sistema++;
+    }
+    if (enviar_tramas_sin_bloqueo(conexion->descriptor, datos, tam_datos,
+            num_tramas, &conexion->salida) == -1) {
+        return -1;
+    }
+
+    return revisar_salida_conexion(reactor, conexion);
+}
+
+/**
+ * Envía lo que se pueda de la salida pendiente de la conexión.
+ *
+ * @param reactor reactor al que pertenece la conexión
+ * @param conexion conexión cuyo socket volvió a tener espacio
+ *
+ * @return 0 si la conexión sigue, -1 si debe cerrarse
+ */
+int vaciar_salida_conexion(Reactor *reactor, Conexion *conexion) {
+    if (conexion->salida.fin == conexion->salida.inicio) {
+        return 0;
+    }
+    reactor->llamadas_sistema++;
+    if (enviar_pendientes_stream(conexion->descriptor, &conexion->salida)
+            == -1) {
+        return -1;
+    }
+
+    return revisar_salida_conexion(reactor, conexion);
+}
+
+/**
+ * Atiende que el socket de una conexión volvió a tener espacio: primero se
+ * envía su salida pendiente y, cuando se vacía, se llama a su 'escritor'. Si
+ * algo falla la conexión se cierra.
+ *
+ * @param reactor reactor al que pertenece la conexión
+ * @param conexion conexión que puede escribir
+ */
+void atender_escritura(Reactor *reactor, Conexion *conexion) {
+    if (vaciar_salida_conexion(reactor, conexion) == -1) {
+        cerrar_conexion(reactor, conexion);
+        return;
+    }
+    // el escritor no puede intercalar sus bytes con una trama a medias
+    if (conexion->salida.fin == conexion->salida.inicio &&
+            conexion->escritor != NULL &&
+            conexion->escritor(reactor, conexion) == -1) {
+        cerrar_conexion(reactor, conexion);
+    }
+}
+
+/**
+ * Ocupa la entrada de la tabla correspondiente a un descriptor recién
+ * aceptado.
+ *
+ * @param reactor reactor al que pertenecerá la conexión
+ * @param descriptor socket de la conexión aceptada
+ * @param direccion dirección del cliente
+ *
+ * @return entrada de la tabla, 'NULL' si el descriptor no cabe en la tabla
+ */
+Conexion* abrir_conexion(Reactor *reactor, int descriptor,
+        const struct sockaddr_storage *direccion) {
+    if (descriptor >= reactor->max_conexiones) {
+        return NULL;
+    }
+
+    aplicar_ajustes_aceptado(descriptor);
+    Conexion *conexion = &reactor->conexiones[descriptor];
+    conexion->activa = 1;
+    conexion->escucha = 0;
+    conexion->descriptor = descriptor;
+    conexion->generacion++;
+    memcpy(&conexion->direccion, direccion, sizeof(struct sockaddr_storage));
+    conexion->bytes_recibidos = 0;
+    conexion->entrada.cache = reactor->cache;
+    conexion->salida.cache = reactor->cache;
+    conexion->lector = NULL;
+    conexion->escritor = NULL;
+    conexion->espera_escritura = 0;
+    conexion->datos = NULL;
+    reactor->conexiones_activas++;
+    reactor->total_conexiones++;
+
+    return conexion;
+}
+
+/**
+ * Cierra la conexión y libera su entrada en la tabla. Al cerrar el descriptor,
+ * epoll lo elimina automáticamente de su lista de interés.
+ *
+ * @param reactor reactor al que pertenece la conexión
+ * @param conexion conexión a cerrar
+ */
+void cerrar_conexion(Reactor *reactor, Conexion *conexion) {
+    if (!conexion->activa) {
+        return;
+    }
+    if (reactor->al_cerrar != NULL) {
+        reactor->al_cerrar(reactor, conexion);
+    }
+    // 'shutdown()' termina también las lecturas asíncronas pendientes(por
+    // ejemplo de io_uring), que mantienen abierto el socket después de 'close()'
+    shutdown(conexion->descriptor, SHUT_RDWR);
+    close(conexion->descriptor);
+    liberar_buffer_tramas(&conexion->entrada);
+    liberar_buffer_tramas(&conexion->salida);
+    conexion->activa = 0;
+    reactor->conexiones_activas--;
+}
+
+/**
+ * Rechaza la primera conexión pendiente cuando el proceso ya no tiene
+ * descriptores libres(EMFILE/ENFILE): cierra el descriptor de reserva para
+ * poder aceptarla, la cierra de inmediato y vuelve a abrir la reserva.
+ *
+ * Sin esto la conexión se queda en la cola del socket que escucha y, en modo
+ * por nivel, epoll notifica el mismo evento una y otra vez.
+ *
+ * @param reactor reactor con el socket que escucha
+ * @param descriptor_escucha socket con la conexión pendiente
+ *
+ * @return 0 si se rechazó una conexión, -1 si no había reserva o conexiones
+ */
+int rechazar_conexion_pendiente(Reactor *reactor, int descriptor_escucha) {
+    int descriptor_cliente;
+
+    if (reactor->descriptor_reserva == -1) {
+        // otro hilo pudo ocupar el descriptor liberado la última vez
+        reactor->descriptor_reserva = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (reactor->descriptor_reserva == -1) {
+            return -1;
+        }
+    }
+    close(reactor->descriptor_reserva);
+    reactor->llamadas_sistema++;
+    descriptor_cliente = accept4(descriptor_escucha, NULL, NULL,
+        SOCK_CLOEXEC);
+    if (descriptor_cliente != -1) {
+        close(descriptor_cliente);
+        reactor->conexiones_rechazadas++;
+    }
+    reactor->descriptor_reserva = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    return descriptor_cliente == -1 ? -1 : 0;
+}
+
+/**
+ * Acepta hasta 'kMaxAceptarLote' conexiones pendientes del socket que escucha;
+ * cada nuevo socket se crea NO bloqueante y se registra en epoll. Las fallas
+ * pasajeras no detienen al servidor: ECONNABORTED se cuenta y se sigue, y sin
+ * descriptores libres se rechaza la conexión con 'rechazar_conexion_pendiente()'.
+ *
+ * Para más información consultar 'man 2 accept4'.
+ *
+ * @param reactor reactor con el socket que escucha
+ * @param descriptor_escucha socket que notificó conexiones pendientes
+ */
+void aceptar_conexiones(Reactor *reactor, int descriptor_escucha) {
+    struct sockaddr_storage cliente;
+    socklen_t tam_dir;
+    int descriptor_cliente, intentos;
+
+    reactor->lotes_aceptados++;
+    for (intentos = 0; intentos < kMaxAceptarLote; intentos++) {
+        tam_dir = sizeof(struct sockaddr_storage);
+        reactor->llamadas_sistema++;
+        descriptor_cliente = accept4(descriptor_escucha,
+            (struct sockaddr*)&cliente, &tam_dir, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (descriptor_cliente == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ECONNABORTED || errno == EPROTO) {
+                reactor->conexiones_abortadas++;
+                continue;
+            }
+            if (errno == EMFILE || errno == ENFILE) {
+                if (rechazar_conexion_pendiente(reactor, descriptor_escucha)
+                        == 0) {
+                    continue;
+                }
+                return;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                fprintf(stderr,"\nError al aceptar(accept4) conexión: %s\n",
+                    strerror(errno));
+            }
+            return;  // ya no hay conexiones pendientes
+        }
+
+        if (descriptor_cliente >= reactor->max_conexiones ||
+                registrar_descriptor(reactor, descriptor_cliente, EPOLLIN |
+                    EPOLLRDHUP) == -1) {
+            close(descriptor_cliente);
+            reactor->conexiones_rechazadas++;
+            continue;
+        }
+
+        completar_direccion_unix(&cliente, tam_dir);
+        abrir_conexion(reactor, descriptor_cliente, &cliente);
+    }
+    // si quedan conexiones en la cola epoll vuelve a notificar al socket
+}
+
+/**
+ * Lee todos los datos disponibles en la conexión hasta que 'recv()' regrese
+ * EAGAIN, y entrega cada bloque leído al manejador del reactor. Si el cliente
+ * cerró la conexión o hubo un error, la conexión se cierra. Si la conexión
+ * tiene un lector propio(por ejemplo para 'splice()') se usa éste.
+ *
+ * @param reactor reactor al que pertenece la conexión
+ * @param conexion conexión con datos disponibles
+ */
+void atender_conexion(Reactor *reactor, Conexion *conexion) {
+    int bytes_recibidos, res;
+
+    while (conexion->activa) {
+        if (conexion->lector != NULL) {
+            res = conexion->lector(reactor, conexion);
+            if (res == -1) {
+                cerrar_conexion(reactor, conexion);
+            }
+            if (res != 1) {
+                return;
+            }
+            continue;
+        }
+
+        reactor->llamadas_sistema++;
+        bytes_recibidos = recibir_datos_stream(conexion->descriptor,
+            reactor->buffer, reactor->tam_buffer, MSG_DONTWAIT);
+        if (bytes_recibidos > 0) {
+            conexion->bytes_recibidos += bytes_recibidos;
+            reactor->total_bytes += bytes_recibidos;
+            reactor->manejador(reactor, conexion, reactor->buffer,
+                bytes_recibidos);
+        } else if (bytes_recibidos == 0) {
+            cerrar_conexion(reactor, conexion);  // el cliente cerró la conexión
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                fprintf(stderr,"\nError al recibir datos(recv): %s\n",
+                    strerror(errno));
+                cerrar_conexion(reactor, conexion);
+            }
+            return;  // no hay más datos por el momento
+        }
+    }
+}
+
+/**
+ * Ciclo principal del reactor: espera eventos con 'epoll_wait()' y los
+ * despacha al socket que escucha o a la conexión correspondiente, hasta que
+ * 'reactor->activo' sea 0(por ejemplo desde un manejador de señal).
+ *
+ * Para más información consultar 'man 2 epoll_wait'.
+ *
+ * @param reactor reactor inicializado con 'crear_reactor()'
+ *
+ * @return 0 al terminar normalmente, -1 en caso de error
+ */
+int ejecutar_reactor(Reactor *reactor) {
+    int num_eventos, i;
+
+    while (reactor->activo) {
+        reactor->llamadas_sistema++;
+        num_eventos = epoll_wait(reactor->descriptor_epoll, reactor->eventos,
+            kMaxEventos, -1);
+        if (num_eventos == -1) {
+            if (errno == EINTR) {
+                continue;  // interrumpido por una señal
+            }
+            fprintf(stderr,"\nError al esperar eventos(epoll_wait): %s\n",
+                strerror(errno));
+            return -1;
+        }
+
+        for (i = 0; i < num_eventos; i++) {
+            int descriptor = reactor->eventos[i].data.fd;
+            Conexion *conexion = &reactor->conexiones[descriptor];
+            if (conexion->escucha) {
+                aceptar_conexiones(reactor, descriptor);
+                continue;
+            }
+
+            // primero se leen los datos pendientes aunque el cliente ya haya
+            // cerrado, 'recv()' regresará 0 al terminar
+            if (reactor->eventos[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP |
+                    EPOLLERR)) {
+                atender_conexion(reactor, conexion);
+            }
+            if ((reactor->eventos[i].events & EPOLLOUT) && conexion->activa) {
+                atender_escritura(reactor, conexion);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Cierra todas las conexiones activas y libera los recursos del reactor. Los
+ * sockets que escuchan no se cierran.
+ *
+ * @param reactor reactor a destruir
+ */
+void destruir_reactor(Reactor *reactor) {
+    int i;
+    if (reactor->conexiones != NULL) {
+        for (i = 0; i < reactor->max_conexiones &&
+                reactor->conexiones_activas > 0; i++) {
+            cerrar_conexion(reactor, &reactor->conexiones[i]);
+        }
+    }
+    if (reactor->descriptor_epoll > 0) {
+        close(reactor->descriptor_epoll);
+    }
+    if (reactor->descriptor_reserva != -1) {
+        close(reactor->descriptor_reserva);
+        reactor->descriptor_reserva = -1;
+    }
+    free(reactor->conexiones);
+    free(reactor->eventos);
+    free(reactor->buffer);
+    reactor->conexiones = NULL;
+    reactor->eventos = NULL;
+    reactor->buffer = NULL;
+}
+
+#endif  // FUNCIONES_EPOLL_H_
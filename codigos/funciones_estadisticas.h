@@ -0,0 +1,362 @@
+/**
+ * Funciones para estadísticas de las operaciones de sockets
+ *
+ * Las funciones de envío y recepción de 'funciones_sockets.h'(y el envío de
+ * tramas) registran cada llamada: número de llamadas, bytes, envíos parciales,
+ * reintentos(EAGAIN/EINTR) y errores por cada valor de 'errno'. Opcionalmente
+ * miden la latencia de cada llamada con el contador de ciclos del procesador
+ * y la guardan en un histograma por operación, ver 'funciones_histograma.h'.
+ *
+ * Notas:
+ * - Cada hilo tiene sus propios contadores('__thread'), registrados en una
+ * 	lista global la primera vez que el hilo hace una operación. Registrar
+ * 	una llamada no usa candados ni instrucciones atómicas con prefijo 'lock':
+ * 	sólo el hilo dueño escribe y los demás leen con cargas atómicas relajadas.
+ * - Los totales se calculan al pedirlos, sumando los contadores de todos los
+ * 	hilos(incluso los que ya terminaron). Los histogramas se leen sin
+ * 	sincronización, por lo que un volcado hecho mientras los hilos trabajan
+ * 	puede estar desfasado por algunos valores.
+ * - La latencia se mide con 'rdtsc' en x86(y con CLOCK_MONOTONIC en otras
+ * 	arquitecturas) y se convierte a nanosegundos con un factor calibrado al
+ * 	habilitarla. En llamadas bloqueantes incluye el tiempo de espera.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_ESTADISTICAS_H_
+#define FUNCIONES_ESTADISTICAS_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>  // 'sleep()'
+#include <time.h>  // 'clock_gettime()'
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>  // '__rdtsc()'
+#endif
+
+#include "funciones_histograma.h"
+
+// operaciones que se registran
+typedef enum {kOpEnviarStream, kOpRecibirStream, kOpEnviarDgram,
+    kOpRecibirDgram, kOpEnviarLoteDgram, kOpRecibirLoteDgram,
+    kNumOperacionesSocket} Operacion_socket;
+
+const char *kNombresOperacion[] = {"enviar_stream", "recibir_stream",
+    "enviar_dgram", "recibir_dgram", "enviar_lote_dgram", "recibir_lote_dgram"};
+
+// valores de 'errno' que se cuentan por separado(los mayores van al último)
+enum {kMaxErrnoContado = 134};
+
+typedef struct Contadores_socket {
+    uint64_t llamadas;
+    uint64_t bytes;  // o mensajes en las operaciones de lote
+    uint64_t parciales;  // envíos que no enviaron todo lo solicitado
+    uint64_t reintentos;  // EAGAIN, EWOULDBLOCK o EINTR
+    uint64_t errores;
+    uint64_t errores_errno[kMaxErrnoContado + 1];
+} Contadores_socket;
+
+// estadísticas de un hilo
+typedef struct Estadisticas_socket {
+    Contadores_socket operaciones[kNumOperacionesSocket];
+    Histograma latencias[kNumOperacionesSocket];  // nanosegundos
+    struct Estadisticas_socket *siguiente;
+} Estadisticas_socket;
+
+Estadisticas_socket *lista_estadisticas = NULL;  // todos los hilos
+pthread_mutex_t candado_estadisticas = PTHREAD_MUTEX_INITIALIZER;
+__thread Estadisticas_socket *estadisticas_hilo = NULL;
+int medir_latencias_socket = 0;  // 1 para medir la latencia de cada llamada
+double ns_por_ciclo = 1.0;
+
+/* Prototipos */
+
+uint64_t leer_ciclos(void);
+int habilitar_latencias_socket(void);
+Estadisticas_socket* obtener_estadisticas_hilo(void);
+uint64_t iniciar_medicion_socket(void);
+void sumar_contador_socket(uint64_t *contador, uint64_t valor);
+void registrar_operacion_socket(Operacion_socket operacion, long resultado,
+        long esperado, uint64_t inicio);
+int sumar_estadisticas_socket(Contadores_socket *totales,
+        Histograma *latencias);
+void mostrar_estadisticas_socket(void);
+void* volcar_estadisticas_socket(void *argumento);
+int iniciar_volcado_estadisticas(int segundos);
+
+/* Funciones */
+
+/**
+ * Lee el contador de ciclos del procesador('rdtsc'). En otras arquitecturas
+ * regresa nanosegundos de CLOCK_MONOTONIC.
+ *
+ * @return ciclos(o nanosegundos) desde un instante arbitrario
+ */
+uint64_t leer_ciclos(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ahora;
+    clock_gettime(CLOCK_MONOTONIC, &ahora);
+    return (uint64_t)ahora.tv_sec*1000000000ull + ahora.tv_nsec;
+#endif
+}
+
+/**
+ * Calibra la duración de un ciclo contra CLOCK_MONOTONIC(durante ~20 ms) y
+ * habilita la medición de latencias. Debe llamarse antes de crear los hilos
+ * que hacen operaciones.
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int habilitar_latencias_socket(void) {
+    struct timespec inicio, fin, espera = {0, 20000000};
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    uint64_t ciclos = leer_ciclos();
+    nanosleep(&espera, NULL);
+    ciclos = leer_ciclos() - ciclos;
+    clock_gettime(CLOCK_MONOTONIC, &fin);
+    double ns = (fin.tv_sec - inicio.tv_sec)*1e9 +
+        (fin.tv_nsec - inicio.tv_nsec);
+    if (ciclos == 0) {
+        fprintf(stderr,"\nError al calibrar el contador de ciclos\n");
+        return -1;
+    }
+    ns_por_ciclo = ns/ciclos;
+    medir_latencias_socket = 1;
+
+    return 0;
+}
+
+/**
+ * Obtiene las estadísticas del hilo que llama; la primera vez las crea y las
+ * agrega a la lista global.
+ *
+ * @return estadísticas del hilo, NULL si no hay memoria
+ */
+Estadisticas_socket* obtener_estadisticas_hilo(void) {
+    int i;
+
+    if (estadisticas_hilo != NULL) {
+        return estadisticas_hilo;
+    }
+    Estadisticas_socket *estadisticas = (Estadisticas_socket*)calloc(1,
+        sizeof(Estadisticas_socket));
+    if (estadisticas == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < kNumOperacionesSocket && medir_latencias_socket; i++) {
+        crear_histograma(&estadisticas->latencias[i]);
+    }
+
+    pthread_mutex_lock(&candado_estadisticas);
+    estadisticas->siguiente = lista_estadisticas;
+    lista_estadisticas = estadisticas;
+    pthread_mutex_unlock(&candado_estadisticas);
+    estadisticas_hilo = estadisticas;
+
+    return estadisticas;
+}
+
+/**
+ * Toma el instante de inicio de una operación, si se miden latencias.
+ *
+ * @return ciclos al inicio, 0 si no se miden latencias
+ */
+uint64_t iniciar_medicion_socket(void) {
+    return medir_latencias_socket ? leer_ciclos() : 0;
+}
+
+/**
+ * Suma un valor a un contador del hilo. Sólo el hilo dueño escribe, así que
+ * basta una carga y un almacenamiento atómicos relajados(sin 'lock').
+ *
+ * @param contador contador del hilo que llama
+ * @param valor cantidad a sumar
+ */
+void sumar_contador_socket(uint64_t *contador, uint64_t valor) {
+    __atomic_store_n(contador, __atomic_load_n(contador, __ATOMIC_RELAXED) +
+        valor, __ATOMIC_RELAXED);
+}
+
+/**
+ * Registra el resultado de una operación en las estadísticas del hilo. Debe
+ * llamarse justo después de la llamada al sistema; conserva 'errno'.
+ *
+ * @param operacion operación realizada
+ * @param resultado valor que regresó la llamada(bytes o mensajes, -1 en caso
+ *                  de error)
+ * @param esperado bytes(o mensajes) solicitados en un envío, -1 en una
+ *                 recepción
+ * @param inicio valor de 'iniciar_medicion_socket()'
+ */
+void registrar_operacion_socket(Operacion_socket operacion, long resultado,
+        long esperado, uint64_t inicio) {
+    int error = errno;
+    uint64_t fin = inicio != 0 ? leer_ciclos() : 0;
+    Estadisticas_socket *estadisticas = obtener_estadisticas_hilo();
+
+    if (estadisticas == NULL) {
+        errno = error;
+        return;
+    }
+    Contadores_socket *contadores = &estadisticas->operaciones[operacion];
+    sumar_contador_socket(&contadores->llamadas, 1);
+    if (resultado >= 0) {
+        sumar_contador_socket(&contadores->bytes, resultado);
+        if (esperado >= 0 && resultado < esperado) {
+            sumar_contador_socket(&contadores->parciales, 1);
+        }
+    } else if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR) {
+        sumar_contador_socket(&contadores->reintentos, 1);
+    } else {
+        sumar_contador_socket(&contadores->errores, 1);
+        sumar_contador_socket(&contadores->errores_errno[error > 0 &&
+            error < kMaxErrnoContado ? error : kMaxErrnoContado], 1);
+    }
+    // el hilo pudo crearse antes de habilitar las latencias
+    if (inicio != 0 && estadisticas->latencias[operacion].cuentas != NULL) {
+        registrar_valor_histograma(&estadisticas->latencias[operacion],
+            (uint64_t)((fin - inicio)*ns_por_ciclo));
+    }
+
+    errno = error;
+}
+
+/**
+ * Suma las estadísticas de todos los hilos.
+ *
+ * @param totales arreglo de 'kNumOperacionesSocket' contadores
+ * @param latencias arreglo de 'kNumOperacionesSocket' histogramas creados, o
+ *                  NULL para no sumar latencias
+ *
+ * @return número de hilos con estadísticas
+ */
+int sumar_estadisticas_socket(Contadores_socket *totales,
+        Histograma *latencias) {
+    Estadisticas_socket *estadisticas;
+    int i, j, num_hilos = 0;
+
+    memset(totales, 0, sizeof(Contadores_socket)*kNumOperacionesSocket);
+    pthread_mutex_lock(&candado_estadisticas);
+    for (estadisticas = lista_estadisticas; estadisticas != NULL;
+            estadisticas = estadisticas->siguiente) {
+        num_hilos++;
+        for (i = 0; i < kNumOperacionesSocket; i++) {
+            // se leen como arreglo de contadores de 64 bits
+            uint64_t *origen = (uint64_t*)&estadisticas->operaciones[i];
+            uint64_t *destino = (uint64_t*)&totales[i];
+            for (j = 0; j < (int)(sizeof(Contadores_socket)/sizeof(uint64_t));
+                    j++) {
+                destino[j] += __atomic_load_n(&origen[j], __ATOMIC_RELAXED);
+            }
+            if (latencias != NULL &&
+                    estadisticas->latencias[i].cuentas != NULL) {
+                combinar_histogramas(&latencias[i],
+                    &estadisticas->latencias[i]);
+            }
+        }
+    }
+    pthread_mutex_unlock(&candado_estadisticas);
+
+    return num_hilos;
+}
+
+/**
+ * Muestra los totales de cada operación realizada, sus errores por 'errno' y,
+ * si se miden, sus latencias.
+ */
+void mostrar_estadisticas_socket(void) {
+    Contadores_socket totales[kNumOperacionesSocket];
+    Histograma latencias[kNumOperacionesSocket];
+    char titulo[64];
+    int i, j, con_latencias = medir_latencias_socket;
+
+    for (i = 0; i < kNumOperacionesSocket && con_latencias; i++) {
+        if (crear_histograma(&latencias[i]) == -1) {
+            for (j = 0; j < i; j++) {
+                destruir_histograma(&latencias[j]);
+            }
+            con_latencias = 0;
+        }
+    }
+    int num_hilos = sumar_estadisticas_socket(totales, con_latencias ?
+        latencias : NULL);
+
+    printf("Estadísticas de sockets(%d hilos):\n", num_hilos);
+    for (i = 0; i < kNumOperacionesSocket; i++) {
+        Contadores_socket *contadores = &totales[i];
+        if (contadores->llamadas == 0) {
+            continue;
+        }
+        printf("\t%s: %llu llamadas, %llu %s, %llu parciales, ",
+            kNombresOperacion[i], (unsigned long long)contadores->llamadas,
+            (unsigned long long)contadores->bytes,
+            i >= kOpEnviarLoteDgram ? "mensajes" : "bytes",
+            (unsigned long long)contadores->parciales);
+        printf("%llu reintentos, %llu errores\n",
+            (unsigned long long)contadores->reintentos,
+            (unsigned long long)contadores->errores);
+        for (j = 0; j <= kMaxErrnoContado; j++) {
+            if (contadores->errores_errno[j] > 0) {
+                printf("\t\t%s: %llu\n", j == kMaxErrnoContado ? "otros" :
+                    strerror(j), (unsigned long long)contadores->errores_errno[j]);
+            }
+        }
+        if (con_latencias) {
+            snprintf(titulo, sizeof(titulo), "\t\tlatencia de %s",
+                kNombresOperacion[i]);
+            mostrar_histograma(&latencias[i], titulo);
+        }
+    }
+    for (i = 0; i < kNumOperacionesSocket && con_latencias; i++) {
+        destruir_histograma(&latencias[i]);
+    }
+    fflush(stdout);
+}
+
+/**
+ * Función del hilo de volcado: muestra las estadísticas cada cierto tiempo.
+ *
+ * @param argumento apuntador a los segundos entre volcados
+ *
+ * @return NULL(no termina)
+ */
+void* volcar_estadisticas_socket(void *argumento) {
+    int segundos = *(int*)argumento;
+
+    while (1) {
+        sleep(segundos);
+        printf("\n");
+        mostrar_estadisticas_socket();
+    }
+    return NULL;
+}
+
+/**
+ * Crea un hilo que muestra las estadísticas cada 'segundos' segundos.
+ *
+ * @param segundos segundos entre volcados
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int iniciar_volcado_estadisticas(int segundos) {
+    static int periodo;
+    pthread_t hilo;
+
+    periodo = segundos;
+    if (pthread_create(&hilo, NULL, volcar_estadisticas_socket, &periodo) != 0) {
+        fprintf(stderr,"\nError al crear el hilo de estadísticas\n");
+        return -1;
+    }
+    pthread_detach(hilo);
+
+    return 0;
+}
+
+#endif  // FUNCIONES_ESTADISTICAS_H_
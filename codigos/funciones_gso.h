@@ -0,0 +1,224 @@
+/**
+ * Funciones para segmentación(GSO) y agregación(GRO) de datagramas UDP
+ *
+ * Cada datagrama cruza toda la pila del kernel por separado, así que a tasas
+ * altas el costo por paquete limita el número de datagramas por segundo.
+ *
+ * - Con GSO(UDP_SEGMENT) se entrega al kernel un buffer con varios mensajes
+ * 	del mismo tamaño en una sola llamada; la pila lo recorre una vez y lo
+ * 	corta en datagramas de 'tam_segmento' bytes lo más tarde posible(en la
+ * 	tarjeta de red si lo soporta).
+ * - Con GRO(UDP_GRO) el kernel puede juntar datagramas consecutivos del mismo
+ * 	origen en un solo buffer; el tamaño de cada segmento llega en un mensaje
+ * 	de control y el programa debe volver a separarlos.
+ *
+ * Notas:
+ * - El último segmento de un buffer puede ser más corto que los demás.
+ * - Un buffer GSO no puede pasar de 'kMaxSegmentosGso' segmentos ni del
+ * 	tamaño máximo de un datagrama('kMaxTamGso').
+ * - Ambas opciones requieren Linux 4.18(GSO) y 5.0(GRO); si el kernel no las
+ * 	soporta se usa el envío y la recepción de un datagrama por llamada.
+ *
+ * Para más información consultar 'man 7 udp'.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_GSO_H_
+#define FUNCIONES_GSO_H_
+
+#include <stdint.h>
+#include <netinet/udp.h>  // 'UDP_SEGMENT', 'UDP_GRO'
+
+#include "funciones_sockets.h"
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+
+// segmentos máximos en un envío con GSO(UDP_MAX_SEGMENTS del kernel)
+const int kMaxSegmentosGso = 64;
+// bytes máximos de un envío con GSO(datagrama UDP sobre IPv4)
+const int kMaxTamGso = 65507;
+// tamaño del buffer de recepción para datagramas agregados con GRO
+const int kTamBufferGro = 65536;
+
+/* Prototipos */
+
+int habilitar_gso(int descriptor, int tam_segmento);
+int habilitar_gro(int descriptor);
+int enviar_segmentos_gso(int descriptor, char *buffer, int tam_buffer,
+        int tam_segmento, const struct sockaddr_storage *destino);
+int recibir_gro(int descriptor, char *buffer, int tam_buffer,
+        int *tam_segmento, struct sockaddr_storage *origen, int bandera);
+int contar_segmentos_udp(int tam_buffer, int tam_segmento);
+
+/* Funciones */
+
+/**
+ * Fija el tamaño de segmento por defecto del socket: cada 'send()' de más de
+ * 'tam_segmento' bytes se corta en datagramas de ese tamaño.
+ *
+ * @param descriptor identificador del socket UDP
+ * @param tam_segmento bytes de cada datagrama
+ *
+ * @return 0 si se habilitó, -1 si el kernel no soporta UDP_SEGMENT
+ */
+int habilitar_gso(int descriptor, int tam_segmento) {
+    if (establecer_opcion_socket(descriptor, SOL_UDP, UDP_SEGMENT,
+            tam_segmento) == -1) {
+        fprintf(stderr, "Se enviará un datagrama por llamada(sin GSO)\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Permite que el kernel entregue datagramas agregados al socket; deben
+ * recibirse con 'recibir_gro()'.
+ *
+ * @param descriptor identificador del socket UDP
+ *
+ * @return 0 si se habilitó, -1 si el kernel no soporta UDP_GRO
+ */
+int habilitar_gro(int descriptor) {
+    if (establecer_opcion_socket(descriptor, SOL_UDP, UDP_GRO, 1) == -1) {
+        fprintf(stderr, "Se recibirá un datagrama por llamada(sin GRO)\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Envía un buffer como varios datagramas de 'tam_segmento' bytes en una sola
+ * llamada('sendmsg()' con UDP_SEGMENT en un mensaje de control).
+ *
+ * @param descriptor identificador del socket UDP
+ * @param buffer segmentos a enviar, uno tras otro
+ * @param tam_buffer número total de bytes
+ * @param tam_segmento bytes de cada datagrama
+ * @param destino dirección del destino, NULL si el socket está conectado
+ *
+ * @return número de bytes enviados, -1 en caso de error
+ */
+int enviar_segmentos_gso(int descriptor, char *buffer, int tam_buffer,
+        int tam_segmento, const struct sockaddr_storage *destino) {
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+    struct iovec vector = {buffer, tam_buffer};
+    struct msghdr mensaje;
+    ssize_t res;
+
+    memset(&mensaje, 0, sizeof(mensaje));
+    mensaje.msg_iov = &vector;
+    mensaje.msg_iovlen = 1;
+    if (destino != NULL) {
+        mensaje.msg_name = (void*)destino;
+        mensaje.msg_namelen = obtener_tam_sockaddr((struct sockaddr*)destino);
+    }
+    // con un solo segmento se envía un datagrama normal
+    if (tam_buffer > tam_segmento) {
+        uint16_t segmento = tam_segmento;
+        memset(control, 0, sizeof(control));
+        mensaje.msg_control = control;
+        mensaje.msg_controllen = sizeof(control);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&mensaje);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        memcpy(CMSG_DATA(cmsg), &segmento, sizeof(uint16_t));
+    }
+
+    do {
+        uint64_t inicio = iniciar_medicion_socket();
+        res = sendmsg(descriptor, &mensaje, 0);
+        registrar_operacion_socket(kOpEnviarDgram, res, tam_buffer, inicio);
+    } while (res == -1 && errno == EINTR);
+    if (res == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        fprintf(stderr, "\nError al enviar datos(sendmsg, GSO): %s\n",
+            strerror(errno));
+    }
+
+    return res;
+}
+
+/**
+ * Recibe un datagrama, o varios agregados por GRO, y el tamaño de sus
+ * segmentos.
+ *
+ * @param descriptor identificador del socket UDP
+ * @param buffer donde se guardan los datos(al menos 'kTamBufferGro' bytes
+ *               para no truncar un buffer agregado)
+ * @param tam_buffer tamaño del buffer
+ * @param tam_segmento donde se guarda el tamaño de cada segmento; si no hubo
+ *                     agregación es el número de bytes recibidos(1 si el
+ *                     datagrama está vacío)
+ * @param origen donde se guarda la dirección de quien envió los datos
+ * @param bandera banderas de 'recvmsg()'
+ *
+ * @return número de bytes recibidos, -1 en caso de error
+ */
+int recibir_gro(int descriptor, char *buffer, int tam_buffer,
+        int *tam_segmento, struct sockaddr_storage *origen, int bandera) {
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec vector = {buffer, tam_buffer};
+    struct msghdr mensaje;
+    struct cmsghdr *cmsg;
+    ssize_t res;
+
+    memset(&mensaje, 0, sizeof(mensaje));
+    mensaje.msg_iov = &vector;
+    mensaje.msg_iovlen = 1;
+    mensaje.msg_name = origen;
+    mensaje.msg_namelen = sizeof(struct sockaddr_storage);
+    mensaje.msg_control = control;
+    mensaje.msg_controllen = sizeof(control);
+
+    do {
+        uint64_t inicio = iniciar_medicion_socket();
+        res = recvmsg(descriptor, &mensaje, bandera);
+        registrar_operacion_socket(kOpRecibirDgram, res, -1, inicio);
+    } while (res == -1 && errno == EINTR);
+    if (res == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            fprintf(stderr, "\nError al recibir datos(recvmsg, GRO): %s\n",
+                strerror(errno));
+        }
+        return -1;
+    }
+
+    completar_direccion_unix(origen, mensaje.msg_namelen);
+    *tam_segmento = res;
+    for (cmsg = CMSG_FIRSTHDR(&mensaje); cmsg != NULL;
+            cmsg = CMSG_NXTHDR(&mensaje, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            memcpy(tam_segmento, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    if (*tam_segmento <= 0) {
+        // un datagrama vacío es un segmento de 0 bytes; al menos 1 para que
+        // quien recorra los segmentos avance
+        *tam_segmento = res > 0 ? res : 1;
+    }
+
+    return res;
+}
+
+/**
+ * Calcula cuántos datagramas hay en un buffer recibido con 'recibir_gro()' o
+ * enviado con GSO.
+ *
+ * @param tam_buffer bytes recibidos
+ * @param tam_segmento tamaño de cada segmento
+ *
+ * @return número de datagramas(al menos 1)
+ */
+int contar_segmentos_udp(int tam_buffer, int tam_segmento) {
+    if (tam_buffer == 0 || tam_segmento <= 0) {
+        return 1;
+    }
+    return (tam_buffer + tam_segmento - 1)/tam_segmento;
+}
+
+#endif  // FUNCIONES_GSO_H_
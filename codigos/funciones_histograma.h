@@ -0,0 +1,222 @@
+/**
+ * Funciones para histogramas de latencia
+ *
+ * Guarda valores(por ejemplo latencias en nanosegundos) en cubetas de ancho
+ * logarítmico-lineal, como HdrHistogram: cada potencia de 2 se divide en 64
+ * sub-cubetas, así el error relativo de cada valor es menor a 1/64(~1.6%)
+ * desde 1 ns hasta horas, con memoria fija y registro en tiempo constante.
+ *
+ * Notas:
+ * - Los valores menores a 128 se guardan exactos.
+ * - Los percentiles se reportan con el valor más alto de su cubeta.
+ * - Un histograma no se protege con candado: cada hilo usa el suyo y al final
+ * 	se combinan con 'combinar_histogramas()'.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_HISTOGRAMA_H_
+#define FUNCIONES_HISTOGRAMA_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+// bits de las sub-cubetas: 2^7 = 128 valores exactos, 64 por potencia de 2
+const int kBitsSubcubetas = 7;
+// número total de cubetas para valores de 64 bits
+const int kNumCubetasHistograma = (64 - 7 + 1)*64 + 64;
+
+typedef struct Histograma {
+    uint64_t *cuentas;
+    uint64_t total;
+    uint64_t minimo;
+    uint64_t maximo;
+    double suma;
+} Histograma;
+
+/* Prototipos */
+
+int crear_histograma(Histograma *histograma);
+void destruir_histograma(Histograma *histograma);
+void reiniciar_histograma(Histograma *histograma);
+int obtener_cubeta_histograma(uint64_t valor);
+uint64_t obtener_valor_cubeta(int cubeta);
+void registrar_valor_histograma(Histograma *histograma, uint64_t valor);
+void combinar_histogramas(Histograma *destino, const Histograma *origen);
+uint64_t obtener_percentil_histograma(const Histograma *histograma,
+        double percentil);
+void mostrar_histograma(const Histograma *histograma, const char *titulo);
+
+/* Funciones */
+
+/**
+ * Inicializa un histograma vacío.
+ *
+ * @param histograma histograma a inicializar
+ *
+ * @return 0 en caso de éxito, -1 si no hay memoria
+ */
+int crear_histograma(Histograma *histograma) {
+    memset(histograma, 0, sizeof(Histograma));
+    histograma->cuentas = (uint64_t*)calloc(kNumCubetasHistograma,
+        sizeof(uint64_t));
+    if (histograma->cuentas == NULL) {
+        fprintf(stderr,"\nError al reservar memoria para el histograma\n");
+        return -1;
+    }
+    histograma->minimo = UINT64_MAX;
+
+    return 0;
+}
+
+/**
+ * Libera la memoria del histograma.
+ *
+ * @param histograma histograma a destruir
+ */
+void destruir_histograma(Histograma *histograma) {
+    free(histograma->cuentas);
+    histograma->cuentas = NULL;
+}
+
+/**
+ * Deja el histograma vacío, sin liberar su memoria.
+ *
+ * @param histograma histograma a reiniciar
+ */
+void reiniciar_histograma(Histograma *histograma) {
+    memset(histograma->cuentas, 0, sizeof(uint64_t)*kNumCubetasHistograma);
+    histograma->total = 0;
+    histograma->minimo = UINT64_MAX;
+    histograma->maximo = 0;
+    histograma->suma = 0;
+}
+
+/**
+ * Obtiene la cubeta de un valor. Los valores menores a 128 tienen su propia
+ * cubeta; para los demás se toman los 7 bits más significativos y el
+ * número de bits descartados('corrimiento').
+ *
+ * @param valor valor a registrar
+ *
+ * @return índice de la cubeta
+ */
+int obtener_cubeta_histograma(uint64_t valor) {
+    if (valor < (1u << kBitsSubcubetas)) {
+        return (int)valor;
+    }
+    int corrimiento = 63 - __builtin_clzll(valor) - (kBitsSubcubetas - 1);
+    return corrimiento*64 + (int)(valor >> corrimiento);
+}
+
+/**
+ * Obtiene el valor más alto que corresponde a una cubeta.
+ *
+ * @param cubeta índice de la cubeta
+ *
+ * @return valor más alto de la cubeta
+ */
+uint64_t obtener_valor_cubeta(int cubeta) {
+    if (cubeta < (1 << kBitsSubcubetas)) {
+        return cubeta;
+    }
+    int corrimiento = cubeta/64 - 1;
+    uint64_t base = (uint64_t)(cubeta - corrimiento*64);
+    return ((base + 1) << corrimiento) - 1;
+}
+
+/**
+ * Registra un valor en el histograma.
+ *
+ * @param histograma histograma
+ * @param valor valor a registrar
+ */
+void registrar_valor_histograma(Histograma *histograma, uint64_t valor) {
+    histograma->cuentas[obtener_cubeta_histograma(valor)]++;
+    histograma->total++;
+    histograma->suma += valor;
+    if (valor < histograma->minimo) {
+        histograma->minimo = valor;
+    }
+    if (valor > histograma->maximo) {
+        histograma->maximo = valor;
+    }
+}
+
+/**
+ * Suma los valores de un histograma a otro.
+ *
+ * @param destino histograma donde se acumula
+ * @param origen histograma a sumar
+ */
+void combinar_histogramas(Histograma *destino, const Histograma *origen) {
+    int i;
+    for (i = 0; i < kNumCubetasHistograma; i++) {
+        destino->cuentas[i] += origen->cuentas[i];
+    }
+    destino->total += origen->total;
+    destino->suma += origen->suma;
+    if (origen->minimo < destino->minimo) {
+        destino->minimo = origen->minimo;
+    }
+    if (origen->maximo > destino->maximo) {
+        destino->maximo = origen->maximo;
+    }
+}
+
+/**
+ * Obtiene el valor bajo el cual está el porcentaje indicado de los valores.
+ *
+ * @param histograma histograma
+ * @param percentil porcentaje entre 0 y 100(por ejemplo 99.9)
+ *
+ * @return valor del percentil, 0 si el histograma está vacío
+ */
+uint64_t obtener_percentil_histograma(const Histograma *histograma,
+        double percentil) {
+    uint64_t acumulado = 0, objetivo;
+    int i;
+
+    if (histograma->total == 0) {
+        return 0;
+    }
+    objetivo = (uint64_t)(percentil/100.0*histograma->total + 0.5);
+    objetivo = objetivo == 0 ? 1 : objetivo;
+    for (i = 0; i < kNumCubetasHistograma; i++) {
+        acumulado += histograma->cuentas[i];
+        if (acumulado >= objetivo) {
+            uint64_t valor = obtener_valor_cubeta(i);
+            return valor > histograma->maximo ? histograma->maximo : valor;
+        }
+    }
+
+    return histograma->maximo;
+}
+
+/**
+ * Muestra el número de valores, el mínimo, el promedio, los percentiles 50,
+ * 90, 99 y 99.9 y el máximo de un histograma de nanosegundos, en
+ * microsegundos.
+ *
+ * @param histograma histograma con valores en nanosegundos
+ * @param titulo nombre de lo que se midió
+ */
+void mostrar_histograma(const Histograma *histograma, const char *titulo) {
+    printf("%s(%llu valores, microsegundos):\n", titulo,
+        (unsigned long long)histograma->total);
+    if (histograma->total == 0) {
+        return;
+    }
+    printf("\tmín %.1f  prom %.1f  p50 %.1f  p90 %.1f  p99 %.1f  ",
+        histograma->minimo/1e3, histograma->suma/histograma->total/1e3,
+        obtener_percentil_histograma(histograma, 50)/1e3,
+        obtener_percentil_histograma(histograma, 90)/1e3,
+        obtener_percentil_histograma(histograma, 99)/1e3);
+    printf("p99.9 %.1f  máx %.1f\n",
+        obtener_percentil_histograma(histograma, 99.9)/1e3,
+        histograma->maximo/1e3);
+}
+
+#endif  // FUNCIONES_HISTOGRAMA_H_
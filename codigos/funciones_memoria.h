@@ -0,0 +1,338 @@
+/**
+ * Funciones para un pool de buffers de tamaño fijo
+ *
+ * Reservar y liberar memoria con 'malloc()' por cada mensaje tiene un costo y
+ * fragmenta el heap. El pool reserva la memoria en losas(bloques grandes) que
+ * se dividen en buffers de tamaño fijo; los buffers libres se encadenan en una
+ * lista, así obtener o devolver un buffer es sacar o meter un apuntador.
+ *
+ * Notas:
+ * - La lista del pool está protegida por un candado. Cada hilo puede tener un
+ * 	caché propio('Cache_pool') del que obtiene y al que devuelve buffers sin
+ * 	candado; el caché intercambia lotes de buffers con el pool.
+ * - La memoria de las losas sólo se devuelve al sistema al destruir el pool.
+ * - Si se compila con '-DCONTAR_RESERVAS' se reemplazan 'malloc()', 'calloc()',
+ * 	'realloc()' y 'free()' por versiones que cuentan las llamadas, para
+ * 	comprobar que una sección de código no reserva memoria del heap.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_MEMORIA_H_
+#define FUNCIONES_MEMORIA_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// número de buffers que el caché de un hilo intercambia con el pool
+const int kLoteCachePool = 32;
+// número de buffers de cada losa
+const int kBuffersPorLosa = 64;
+
+// buffer libre: el inicio del propio buffer guarda el enlace al siguiente
+typedef struct Buffer_libre {
+    struct Buffer_libre *siguiente;
+} Buffer_libre;
+
+// losa reservada al sistema, se encadenan para liberarlas al final
+typedef struct Losa_pool {
+    struct Losa_pool *siguiente;
+} Losa_pool;
+
+typedef struct Pool_buffers {
+    size_t tam_buffer;
+    size_t tam_real;  // tamaño alineado de cada buffer dentro de la losa
+    Buffer_libre *libres;
+    Losa_pool *losas;
+    pthread_mutex_t candado;
+    unsigned long num_losas;  // reservas hechas al sistema
+    unsigned long num_libres;
+} Pool_buffers;
+
+// caché de buffers de un solo hilo
+typedef struct Cache_pool {
+    Pool_buffers *pool;
+    Buffer_libre *libres;
+    int num_libres;
+    unsigned long obtenidos;  // buffers entregados por el caché
+} Cache_pool;
+
+/* Prototipos */
+
+int crear_pool(Pool_buffers *pool, size_t tam_buffer, int buffers_iniciales);
+void destruir_pool(Pool_buffers *pool);
+int ampliar_pool(Pool_buffers *pool);
+void* obtener_buffer_pool(Pool_buffers *pool);
+void devolver_buffer_pool(Pool_buffers *pool, void *buffer);
+void inicializar_cache_pool(Cache_pool *cache, Pool_buffers *pool);
+void vaciar_cache_pool(Cache_pool *cache);
+void* obtener_buffer_cache(Cache_pool *cache);
+void devolver_buffer_cache(Cache_pool *cache, void *buffer);
+unsigned long obtener_reservas_heap();
+
+/* Funciones */
+
+/**
+ * Inicializa el pool y reserva las losas necesarias para tener al menos
+ * 'buffers_iniciales' buffers libres.
+ *
+ * @param pool pool a inicializar
+ * @param tam_buffer tamaño de cada buffer
+ * @param buffers_iniciales buffers a reservar desde el inicio
+ *
+ * @return 0 en caso de éxito, -1 si no hay memoria
+ */
+int crear_pool(Pool_buffers *pool, size_t tam_buffer, int buffers_iniciales) {
+    memset(pool, 0, sizeof(Pool_buffers));
+    pool->tam_buffer = tam_buffer;
+    // cada buffer conserva la alineación de 'malloc()'(16 bytes)
+    pool->tam_real = ((tam_buffer < sizeof(Buffer_libre) ?
+        sizeof(Buffer_libre) : tam_buffer) + 15) & ~(size_t)15;
+    pthread_mutex_init(&pool->candado, NULL);
+
+    while (pool->num_libres < (unsigned long)buffers_iniciales) {
+        if (ampliar_pool(pool) == -1) {
+            destruir_pool(pool);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Libera todas las losas del pool. Los buffers que aún estén en uso(o en
+ * algún caché) dejan de ser válidos.
+ *
+ * @param pool pool a destruir
+ */
+void destruir_pool(Pool_buffers *pool) {
+    Losa_pool *losa = pool->losas, *siguiente;
+    while (losa != NULL) {
+        siguiente = losa->siguiente;
+        free(losa);
+        losa = siguiente;
+    }
+    pthread_mutex_destroy(&pool->candado);
+    pool->losas = NULL;
+    pool->libres = NULL;
+    pool->num_libres = 0;
+}
+
+/**
+ * Reserva una losa nueva y agrega sus buffers a la lista de libres. Debe
+ * llamarse con el candado tomado(o antes de compartir el pool).
+ *
+ * @param pool pool a ampliar
+ *
+ * @return 0 en caso de éxito, -1 si no hay memoria
+ */
+int ampliar_pool(Pool_buffers *pool) {
+    // el encabezado de la losa ocupa el espacio de un buffer para conservar
+    // la alineación
+    char *memoria = (char*)malloc(pool->tam_real*(kBuffersPorLosa + 1));
+    int i;
+    if (memoria == NULL) {
+        fprintf(stderr,"\nError al reservar memoria para el pool\n");
+        return -1;
+    }
+
+    Losa_pool *losa = (Losa_pool*)memoria;
+    losa->siguiente = pool->losas;
+    pool->losas = losa;
+    for (i = kBuffersPorLosa; i > 0; i--) {
+        Buffer_libre *buffer = (Buffer_libre*)(memoria + i*pool->tam_real);
+        buffer->siguiente = pool->libres;
+        pool->libres = buffer;
+    }
+    pool->num_libres += kBuffersPorLosa;
+    pool->num_losas++;
+
+    return 0;
+}
+
+/**
+ * Obtiene un buffer libre del pool, ampliándolo si no hay.
+ *
+ * @param pool pool de buffers
+ *
+ * @return buffer de 'tam_buffer' bytes, 'NULL' si no hay memoria
+ */
+void* obtener_buffer_pool(Pool_buffers *pool) {
+    Buffer_libre *buffer = NULL;
+
+    pthread_mutex_lock(&pool->candado);
+    if (pool->libres != NULL || ampliar_pool(pool) == 0) {
+        buffer = pool->libres;
+        pool->libres = buffer->siguiente;
+        pool->num_libres--;
+    }
+    pthread_mutex_unlock(&pool->candado);
+
+    return buffer;
+}
+
+/**
+ * Devuelve un buffer al pool.
+ *
+ * @param pool pool de donde se obtuvo el buffer
+ * @param buffer buffer a devolver
+ */
+void devolver_buffer_pool(Pool_buffers *pool, void *buffer) {
+    Buffer_libre *libre = (Buffer_libre*)buffer;
+
+    pthread_mutex_lock(&pool->candado);
+    libre->siguiente = pool->libres;
+    pool->libres = libre;
+    pool->num_libres++;
+    pthread_mutex_unlock(&pool->candado);
+}
+
+/**
+ * Inicializa un caché vacío asociado a un pool.
+ *
+ * @param cache caché a inicializar
+ * @param pool pool del que se obtendrán los buffers
+ */
+void inicializar_cache_pool(Cache_pool *cache, Pool_buffers *pool) {
+    memset(cache, 0, sizeof(Cache_pool));
+    cache->pool = pool;
+}
+
+/**
+ * Devuelve al pool todos los buffers del caché.
+ *
+ * @param cache caché a vaciar
+ */
+void vaciar_cache_pool(Cache_pool *cache) {
+    Buffer_libre *buffer;
+
+    if (cache->libres == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&cache->pool->candado);
+    while ((buffer = cache->libres) != NULL) {
+        cache->libres = buffer->siguiente;
+        buffer->siguiente = cache->pool->libres;
+        cache->pool->libres = buffer;
+        cache->pool->num_libres++;
+    }
+    pthread_mutex_unlock(&cache->pool->candado);
+    cache->num_libres = 0;
+}
+
+/**
+ * Obtiene un buffer del caché del hilo. Si está vacío, primero toma un lote
+ * de 'kLoteCachePool' buffers del pool con una sola toma del candado.
+ *
+ * @param cache caché del hilo
+ *
+ * @return buffer de 'tam_buffer' bytes, 'NULL' si no hay memoria
+ */
+void* obtener_buffer_cache(Cache_pool *cache) {
+    Pool_buffers *pool = cache->pool;
+    Buffer_libre *buffer;
+
+    if (cache->libres == NULL) {
+        pthread_mutex_lock(&pool->candado);
+        while (cache->num_libres < kLoteCachePool &&
+                (pool->libres != NULL || ampliar_pool(pool) == 0)) {
+            buffer = pool->libres;
+            pool->libres = buffer->siguiente;
+            pool->num_libres--;
+            buffer->siguiente = cache->libres;
+            cache->libres = buffer;
+            cache->num_libres++;
+        }
+        pthread_mutex_unlock(&pool->candado);
+        if (cache->libres == NULL) {
+            return NULL;
+        }
+    }
+
+    buffer = cache->libres;
+    cache->libres = buffer->siguiente;
+    cache->num_libres--;
+    cache->obtenidos++;
+
+    return buffer;
+}
+
+/**
+ * Devuelve un buffer al caché del hilo. Si el caché acumula el doble del
+ * lote, regresa un lote al pool para que lo usen otros hilos.
+ *
+ * @param cache caché del hilo
+ * @param buffer buffer a devolver(pudo obtenerse desde otro hilo)
+ */
+void devolver_buffer_cache(Cache_pool *cache, void *buffer) {
+    Buffer_libre *libre = (Buffer_libre*)buffer;
+
+    libre->siguiente = cache->libres;
+    cache->libres = libre;
+    cache->num_libres++;
+
+    if (cache->num_libres >= 2*kLoteCachePool) {
+        Pool_buffers *pool = cache->pool;
+        pthread_mutex_lock(&pool->candado);
+        while (cache->num_libres > kLoteCachePool) {
+            libre = cache->libres;
+            cache->libres = libre->siguiente;
+            cache->num_libres--;
+            libre->siguiente = pool->libres;
+            pool->libres = libre;
+            pool->num_libres++;
+        }
+        pthread_mutex_unlock(&pool->candado);
+    }
+}
+
+#ifdef CONTAR_RESERVAS
+
+// funciones originales de la biblioteca de C
+extern void *__libc_malloc(size_t tam);
+extern void *__libc_calloc(size_t num, size_t tam);
+extern void *__libc_realloc(void *memoria, size_t tam);
+extern void __libc_free(void *memoria);
+
+// número de reservas hechas al heap desde el inicio del programa
+unsigned long reservas_heap = 0;
+
+void* malloc(size_t tam) {
+    __atomic_fetch_add(&reservas_heap, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(tam);
+}
+
+void* calloc(size_t num, size_t tam) {
+    __atomic_fetch_add(&reservas_heap, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(num, tam);
+}
+
+void* realloc(void *memoria, size_t tam) {
+    __atomic_fetch_add(&reservas_heap, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(memoria, tam);
+}
+
+void free(void *memoria) {
+    __libc_free(memoria);
+}
+
+#endif  // CONTAR_RESERVAS
+
+/**
+ * Obtiene el número de reservas('malloc()', 'calloc()' y 'realloc()') hechas
+ * al heap desde el inicio del programa.
+ *
+ * @return número de reservas, 0 si no se compiló con '-DCONTAR_RESERVAS'
+ */
+unsigned long obtener_reservas_heap() {
+#ifdef CONTAR_RESERVAS
+    return __atomic_load_n(&reservas_heap, __ATOMIC_RELAXED);
+#else
+    return 0;
+#endif
+}
+
+#endif  // FUNCIONES_MEMORIA_H_
@@ -0,0 +1,707 @@
+/**
+ * Funciones para un canal de memoria compartida entre dos procesos
+ *
+ * Entre procesos del mismo equipo incluso un socket Unix cuesta una llamada al
+ * sistema y una copia en el kernel por mensaje. El canal es un segmento de
+ * memoria compartida('shm_open()' y 'mmap()') con dos anillos de un solo
+ * productor y un solo consumidor, uno por sentido: el cliente escribe en el
+ * primero y el servidor en el segundo. Cada mensaje es un registro de
+ * longitud variable:
+ *
+ * 	+----------------------+-----------------+-------------------+
+ * 	| longitud(4 bytes)    | datos(longitud) | relleno(hasta 8)  |
+ * 	+----------------------+-----------------+-------------------+
+ *
+ * Notas:
+ * - 'cabeza'(sólo la escribe el productor) y 'cola'(sólo la escribe el
+ * 	consumidor) están en líneas de caché distintas, así un lado no invalida
+ * 	la del otro en cada mensaje; además cada lado recuerda la última posición
+ * 	que leyó del otro y sólo la vuelve a leer cuando parece no haber espacio
+ * 	o datos.
+ * - Un registro que no cabe al final del anillo se escribe al inicio; el
+ * 	espacio que queda al final se marca con 'kRellenoMemoria'.
+ * - Sin datos, el consumidor revisa el anillo 'kGirosMemoria' veces y después
+ * 	se duerme en un futex; el productor sólo llama a FUTEX_WAKE si el
+ * 	consumidor está dormido, así con tráfico continuo no hay llamadas al
+ * 	sistema. Lo mismo aplica al productor que encuentra el anillo lleno.
+ * - 'enviar_datos_memoria()' y 'recibir_datos_memoria()' tienen la forma de
+ * 	'enviar_datos_stream()' y 'recibir_datos_stream()'. Un mensaje de hasta
+ * 	'max_registro' bytes ocupa un registro y se recibe completo(si el buffer
+ * 	alcanza); uno mayor se divide y se recibe como un flujo de bytes.
+ * - El servidor atiende a un cliente a la vez: el cliente marca el segmento
+ * 	como conectado y, cuando se va(o su proceso ya no existe), el servidor
+ * 	reinicia los anillos para el siguiente.
+ * - Un segmento cuyo servidor ya no existe se reemplaza al crear el canal,
+ * 	igual que los sockets Unix abandonados.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_MEMORIA_COMPARTIDA_H_
+#define FUNCIONES_MEMORIA_COMPARTIDA_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>  // 'O_CREAT'
+#include <signal.h>  // 'kill()'
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>  // 'shm_open()', 'mmap()'
+#include <sys/stat.h>
+#include <sys/socket.h>  // 'MSG_DONTWAIT'
+#include <sys/syscall.h>  // 'SYS_futex'
+#include <linux/futex.h>
+
+// bytes de datos de cada anillo(potencia de 2)
+const uint32_t kCapacidadMemoria = 1 << 20;
+// tamaño de una línea de caché, separa los campos de cada lado del anillo
+enum {kLineaCache = 64};
+// bytes del encabezado de un registro y alineación de los registros
+enum {kEncabezadoMemoria = 4, kAlineacionMemoria = 8};
+// longitud que marca el espacio sin usar al final del anillo
+const uint32_t kRellenoMemoria = UINT32_MAX;
+// veces que se revisa el anillo antes de dormir en el futex
+const int kGirosMemoria = 2000;
+// tiempo máximo dormido antes de revisar que el otro proceso siga vivo
+const int kEsperaVidaMemoriaMs = 1000;
+// identifica un segmento creado por 'crear_canal_memoria()'
+const uint32_t kMagicoMemoria = 0x4d454d31;  // "MEM1"
+
+// estado de la conexión del segmento
+enum {kMemoriaLibre, kMemoriaConectada, kMemoriaCerrada};
+
+typedef struct Anillo_memoria {
+    // lado del productor
+    uint64_t cabeza __attribute__((aligned(kLineaCache)));  // bytes escritos
+    uint32_t productor_dormido;  // futex, 1 si espera espacio
+    // lado del consumidor
+    uint64_t cola __attribute__((aligned(kLineaCache)));  // bytes leídos
+    uint32_t consumidor_dormido;  // futex, 1 si espera datos
+} Anillo_memoria;
+
+// inicio del segmento, después siguen los datos de ambos anillos
+typedef struct Segmento_memoria {
+    uint32_t magico;
+    uint32_t capacidad;  // bytes de datos de cada anillo
+    pid_t servidor;  // proceso que creó el segmento
+    pid_t cliente;  // proceso conectado
+    uint32_t servidor_activo;  // 0 cuando el servidor cerró el canal
+    uint32_t estado;  // kMemoriaLibre, kMemoriaConectada o kMemoriaCerrada
+    Anillo_memoria anillos[2];  // 0: del cliente al servidor, 1: al revés
+} Segmento_memoria;
+
+// extremo de un canal en un proceso
+typedef struct Canal_memoria {
+    Segmento_memoria *segmento;
+    size_t tam_segmento;
+    char nombre[256];  // nombre del segmento, empieza con '/'
+    int es_servidor;
+    Anillo_memoria *envio;  // anillo donde escribe este extremo
+    Anillo_memoria *recepcion;  // anillo de donde lee este extremo
+    char *datos_envio;
+    char *datos_recepcion;
+    uint32_t mascara;
+    uint32_t max_registro;  // bytes máximos de datos de un registro
+    int giros;  // revisiones antes de dormir, 0 con un solo CPU
+    uint64_t cola_vista;  // última cola leída del anillo de envío
+    uint64_t cabeza_vista;  // última cabeza leída del anillo de recepción
+    uint32_t entregados;  // bytes ya entregados del registro actual
+    unsigned long mensajes_enviados;  // registros escritos
+    unsigned long mensajes_recibidos;  // registros leídos
+    unsigned long despertares;  // llamadas a FUTEX_WAKE
+    unsigned long esperas;  // llamadas a FUTEX_WAIT
+} Canal_memoria;
+
+/* Prototipos */
+
+void relajar_cpu(void);
+int esperar_futex(uint32_t *direccion, uint32_t valor, int milisegundos);
+void despertar_futex(Canal_memoria *canal, uint32_t *dormido);
+int proceso_terminado(pid_t pid);
+int eliminar_segmento_abandonado(const char *nombre);
+void asignar_anillos_memoria(Canal_memoria *canal);
+int crear_canal_memoria(Canal_memoria *canal, const char *nombre,
+        uint32_t capacidad);
+int conectar_canal_memoria(Canal_memoria *canal, const char *nombre);
+int extremo_cerrado_memoria(Canal_memoria *canal);
+void comprobar_extremo_memoria(Canal_memoria *canal);
+int dormir_memoria(Canal_memoria *canal, uint32_t *dormido, uint64_t *posicion,
+        uint64_t vista, int milisegundos);
+int esperar_datos_memoria(Canal_memoria *canal, int milisegundos);
+int enviar_datos_memoria(Canal_memoria *canal, char *buffer, int tam_buffer,
+        int bandera);
+int recibir_datos_memoria(Canal_memoria *canal, char *buffer, int tam_buffer,
+        int bandera);
+void reiniciar_canal_memoria(Canal_memoria *canal);
+void cerrar_canal_memoria(Canal_memoria *canal);
+void mostrar_estadisticas_memoria(const Canal_memoria *canal);
+
+/* Funciones */
+
+/**
+ * Indica al procesador que se está esperando en un ciclo('pause' en x86),
+ * así el ciclo consume menos y no retrasa al otro hilo del núcleo.
+ */
+void relajar_cpu(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+/**
+ * Duerme mientras '*direccion' valga 'valor'. El futex no es privado: el otro
+ * proceso lo despierta desde su propio mapeo del segmento.
+ *
+ * Para más información consulte 'man 2 futex'.
+ *
+ * @param direccion palabra del segmento
+ * @param valor valor con el que se duerme
+ * @param milisegundos tiempo máximo de espera, -1 para esperar sin límite
+ *
+ * @return 0 al despertar, -1 si expiró, cambió el valor o llegó una señal
+ */
+int esperar_futex(uint32_t *direccion, uint32_t valor, int milisegundos) {
+    struct timespec limite;
+    limite.tv_sec = milisegundos/1000;
+    limite.tv_nsec = (milisegundos%1000)*1000000L;
+    return syscall(SYS_futex, direccion, FUTEX_WAIT, valor,
+        milisegundos < 0 ? NULL : &limite, NULL, 0) == -1 ? -1 : 0;
+}
+
+/**
+ * Despierta al otro extremo si está dormido en 'dormido'. Debe llamarse
+ * después de publicar la nueva posición del anillo.
+ *
+ * @param canal extremo que avanzó
+ * @param dormido futex del otro extremo
+ */
+void despertar_futex(Canal_memoria *canal, uint32_t *dormido) {
+    // ordena la publicación de la posición antes de leer 'dormido', el otro
+    // extremo hace lo contrario antes de dormir
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(dormido, __ATOMIC_RELAXED)) {
+        __atomic_store_n(dormido, 0, __ATOMIC_RELAXED);
+        syscall(SYS_futex, dormido, FUTEX_WAKE, 1, NULL, NULL, 0);
+        canal->despertares++;
+    }
+}
+
+/**
+ * Indica si un proceso ya terminó. Un proceso zombi(terminó pero su padre no
+ * lo ha esperado) todavía recibe 'kill(pid, 0)', por eso se revisa su estado
+ * en '/proc'.
+ *
+ * @param pid proceso a revisar
+ *
+ * @return 1 si el proceso terminó, 0 en otro caso
+ */
+int proceso_terminado(pid_t pid) {
+    char ruta[64], linea[256];
+    char *estado;
+    int terminado = 0;
+
+    if (kill(pid, 0) == -1 && errno == ESRCH) {
+        return 1;
+    }
+    snprintf(ruta, sizeof(ruta), "/proc/%d/stat", (int)pid);
+    FILE *archivo = fopen(ruta, "r");
+    if (archivo == NULL) {
+        return 0;
+    }
+    // el estado va después del nombre del programa, que está entre paréntesis
+    if (fgets(linea, sizeof(linea), archivo) != NULL &&
+            (estado = strrchr(linea, ')')) != NULL) {
+        terminado = estado[1] == ' ' && estado[2] == 'Z';
+    }
+    fclose(archivo);
+
+    return terminado;
+}
+
+/**
+ * Elimina un segmento que dejó un servidor que ya no existe, para poder
+ * volver a crearlo. Si su servidor sigue activo el segmento se conserva.
+ *
+ * @param nombre nombre del segmento
+ *
+ * @return 1 si se eliminó, 0 en otro caso
+ */
+int eliminar_segmento_abandonado(const char *nombre) {
+    int descriptor = shm_open(nombre, O_RDONLY | O_CLOEXEC, 0);
+    struct stat estado;
+    int abandonado = 0;
+
+    if (descriptor == -1) {
+        return 0;
+    }
+    if (fstat(descriptor, &estado) == 0 &&
+            estado.st_size >= (off_t)sizeof(Segmento_memoria)) {
+        Segmento_memoria *segmento = (Segmento_memoria*)mmap(NULL,
+            sizeof(Segmento_memoria), PROT_READ, MAP_SHARED, descriptor, 0);
+        if (segmento != MAP_FAILED) {
+            abandonado = segmento->magico != kMagicoMemoria ||
+                !segmento->servidor_activo ||
+                proceso_terminado(segmento->servidor);
+            munmap(segmento, sizeof(Segmento_memoria));
+        }
+    }
+    close(descriptor);
+    if (abandonado && shm_unlink(nombre) == 0) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Apunta los anillos del extremo según su papel: el cliente escribe en el
+ * anillo 0 y el servidor en el 1.
+ *
+ * @param canal extremo con el segmento ya mapeado
+ */
+void asignar_anillos_memoria(Canal_memoria *canal) {
+    Segmento_memoria *segmento = canal->segmento;
+    char *datos = (char*)segmento + sizeof(Segmento_memoria);
+    int envio = canal->es_servidor ? 1 : 0;
+
+    canal->envio = &segmento->anillos[envio];
+    canal->recepcion = &segmento->anillos[1 - envio];
+    canal->datos_envio = datos + (size_t)envio*segmento->capacidad;
+    canal->datos_recepcion = datos + (size_t)(1 - envio)*segmento->capacidad;
+    canal->mascara = segmento->capacidad - 1;
+    // con la mitad del anillo siempre cabe un registro y su relleno
+    canal->max_registro = segmento->capacidad/2 - kEncabezadoMemoria;
+    canal->cola_vista = __atomic_load_n(&canal->envio->cola, __ATOMIC_ACQUIRE);
+    canal->cabeza_vista = __atomic_load_n(&canal->recepcion->cabeza,
+        __ATOMIC_ACQUIRE);
+    canal->entregados = 0;
+    // con un solo CPU el otro extremo no avanza mientras se revisa el anillo
+    canal->giros = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? kGirosMemoria : 0;
+}
+
+/**
+ * Crea el segmento de un canal(lado del servidor). Si ya existe uno de un
+ * servidor que terminó, se reemplaza.
+ *
+ * @param canal extremo del servidor
+ * @param nombre nombre del segmento, por ejemplo "/canal"
+ * @param capacidad bytes de cada anillo, potencia de 2 de al menos 4096
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int crear_canal_memoria(Canal_memoria *canal, const char *nombre,
+        uint32_t capacidad) {
+    memset(canal, 0, sizeof(Canal_memoria));
+    if (capacidad < 4096 || (capacidad & (capacidad - 1)) != 0) {
+        fprintf(stderr,"\nCapacidad inválida del canal: %u\n", capacidad);
+        return -1;
+    }
+    int descriptor = shm_open(nombre, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+        0600);
+    if (descriptor == -1 && errno == EEXIST &&
+            eliminar_segmento_abandonado(nombre)) {
+        descriptor = shm_open(nombre, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+            0600);
+    }
+    if (descriptor == -1) {
+        fprintf(stderr,"\nError al crear el segmento %s(shm_open): %s\n",
+            nombre, strerror(errno));
+        return -1;
+    }
+    canal->tam_segmento = sizeof(Segmento_memoria) + 2*(size_t)capacidad;
+    if (ftruncate(descriptor, canal->tam_segmento) == -1) {
+        fprintf(stderr,"\nError al dimensionar el segmento(ftruncate): %s\n",
+            strerror(errno));
+        close(descriptor);
+        shm_unlink(nombre);
+        return -1;
+    }
+    canal->segmento = (Segmento_memoria*)mmap(NULL, canal->tam_segmento,
+        PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    close(descriptor);
+    if (canal->segmento == MAP_FAILED) {
+        fprintf(stderr,"\nError al mapear el segmento(mmap): %s\n",
+            strerror(errno));
+        shm_unlink(nombre);
+        return -1;
+    }
+
+    // 'ftruncate()' deja el segmento en ceros
+    canal->segmento->capacidad = capacidad;
+    canal->segmento->servidor = getpid();
+    canal->segmento->servidor_activo = 1;
+    canal->segmento->estado = kMemoriaLibre;
+    __atomic_store_n(&canal->segmento->magico, kMagicoMemoria,
+        __ATOMIC_RELEASE);
+    snprintf(canal->nombre, sizeof(canal->nombre), "%s", nombre);
+    canal->es_servidor = 1;
+    asignar_anillos_memoria(canal);
+
+    return 0;
+}
+
+/**
+ * Se conecta al canal de un servidor(lado del cliente).
+ *
+ * @param canal extremo del cliente
+ * @param nombre nombre del segmento que creó el servidor
+ *
+ * @return 0 en caso de éxito, -1 en caso de error(EBUSY si el servidor ya
+ *         atiende a otro cliente)
+ */
+int conectar_canal_memoria(Canal_memoria *canal, const char *nombre) {
+    struct stat estado;
+    uint32_t libre = kMemoriaLibre;
+
+    memset(canal, 0, sizeof(Canal_memoria));
+    int descriptor = shm_open(nombre, O_RDWR | O_CLOEXEC, 0);
+    if (descriptor == -1) {
+        fprintf(stderr,"\nError al abrir el segmento %s(shm_open): %s\n",
+            nombre, strerror(errno));
+        return -1;
+    }
+    if (fstat(descriptor, &estado) == -1 ||
+            estado.st_size < (off_t)sizeof(Segmento_memoria)) {
+        fprintf(stderr,"\nEl segmento %s no es un canal\n", nombre);
+        close(descriptor);
+        return -1;
+    }
+    canal->tam_segmento = estado.st_size;
+    canal->segmento = (Segmento_memoria*)mmap(NULL, canal->tam_segmento,
+        PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    close(descriptor);
+    if (canal->segmento == MAP_FAILED) {
+        fprintf(stderr,"\nError al mapear el segmento(mmap): %s\n",
+            strerror(errno));
+        return -1;
+    }
+    Segmento_memoria *segmento = canal->segmento;
+    if (__atomic_load_n(&segmento->magico, __ATOMIC_ACQUIRE) != kMagicoMemoria
+            || canal->tam_segmento != sizeof(Segmento_memoria) +
+            2*(size_t)segmento->capacidad || !segmento->servidor_activo) {
+        fprintf(stderr,"\nEl segmento %s no es un canal activo\n", nombre);
+        munmap(segmento, canal->tam_segmento);
+        return -1;
+    }
+    if (!__atomic_compare_exchange_n(&segmento->estado, &libre,
+            kMemoriaConectada, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        fprintf(stderr,"\nEl canal %s ya tiene un cliente\n", nombre);
+        munmap(segmento, canal->tam_segmento);
+        errno = EBUSY;
+        return -1;
+    }
+    segmento->cliente = getpid();
+    snprintf(canal->nombre, sizeof(canal->nombre), "%s", nombre);
+    asignar_anillos_memoria(canal);
+
+    return 0;
+}
+
+/**
+ * Indica si el otro extremo cerró el canal.
+ *
+ * @param canal extremo local
+ *
+ * @return 1 si el otro extremo se fue, 0 en otro caso
+ */
+int extremo_cerrado_memoria(Canal_memoria *canal) {
+    Segmento_memoria *segmento = canal->segmento;
+    if (!canal->es_servidor) {
+        return !__atomic_load_n(&segmento->servidor_activo, __ATOMIC_ACQUIRE);
+    }
+    return __atomic_load_n(&segmento->estado, __ATOMIC_ACQUIRE) ==
+        kMemoriaCerrada;
+}
+
+/**
+ * Marca el canal como cerrado si el proceso del otro extremo ya no existe
+ * (terminó sin cerrar el canal), así quien lo espera no se queda dormido.
+ *
+ * @param canal extremo local
+ */
+void comprobar_extremo_memoria(Canal_memoria *canal) {
+    Segmento_memoria *segmento = canal->segmento;
+    pid_t otro = canal->es_servidor ? segmento->cliente : segmento->servidor;
+    uint32_t conectada = kMemoriaConectada;
+
+    if (otro == 0 || !proceso_terminado(otro)) {
+        return;
+    }
+    if (canal->es_servidor) {
+        __atomic_compare_exchange_n(&segmento->estado, &conectada,
+            kMemoriaCerrada, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    } else {
+        __atomic_store_n(&segmento->servidor_activo, 0, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * Espera a que '*posicion'(escrita por el otro extremo) deje de valer 'vista':
+ * primero revisa 'canal->giros' veces y después duerme en el futex
+ * 'dormido', que el otro extremo despierta al avanzar.
+ *
+ * @param canal extremo local
+ * @param dormido futex de este extremo en el anillo
+ * @param posicion cabeza o cola que escribe el otro extremo
+ * @param vista valor con el que no se puede continuar
+ * @param milisegundos tiempo máximo dormido, -1 para esperar sin límite
+ *
+ * @return 1 si la posición avanzó o el otro extremo se fue, 0 si no
+ */
+int dormir_memoria(Canal_memoria *canal, uint32_t *dormido, uint64_t *posicion,
+        uint64_t vista, int milisegundos) {
+    int i;
+
+    for (i = 0; i < canal->giros; i++) {
+        if (__atomic_load_n(posicion, __ATOMIC_ACQUIRE) != vista) {
+            return 1;
+        }
+        relajar_cpu();
+    }
+    // se anuncia que se duerme y se revisa otra vez, así un avance publicado
+    // entre ambos pasos no se pierde
+    __atomic_store_n(dormido, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(posicion, __ATOMIC_SEQ_CST) == vista &&
+            !extremo_cerrado_memoria(canal)) {
+        canal->esperas++;
+        esperar_futex(dormido, 1, milisegundos);
+    }
+    __atomic_store_n(dormido, 0, __ATOMIC_RELAXED);
+
+    return __atomic_load_n(posicion, __ATOMIC_ACQUIRE) != vista ||
+        extremo_cerrado_memoria(canal);
+}
+
+/**
+ * Espera a que haya datos por recibir, igual que 'esperar_descriptor()' con
+ * POLLIN. Si expira el tiempo se revisa que el otro proceso siga vivo.
+ *
+ * @param canal extremo local
+ * @param milisegundos tiempo máximo de espera, -1 para esperar sin límite
+ *
+ * @return 1 si hay datos o el otro extremo se fue, 0 si expiró el tiempo
+ */
+int esperar_datos_memoria(Canal_memoria *canal, int milisegundos) {
+    Anillo_memoria *anillo = canal->recepcion;
+    uint64_t cola = anillo->cola;
+
+    if (cola != canal->cabeza_vista || extremo_cerrado_memoria(canal)) {
+        return 1;
+    }
+    if (dormir_memoria(canal, &anillo->consumidor_dormido, &anillo->cabeza,
+            cola, milisegundos)) {
+        return 1;
+    }
+    comprobar_extremo_memoria(canal);
+
+    return extremo_cerrado_memoria(canal);
+}
+
+/**
+ * Envía los bytes del buffer al otro extremo, en un registro(o en varios si
+ * exceden 'max_registro'). Si el anillo está lleno se espera a que el otro
+ * extremo lea, salvo con MSG_DONTWAIT.
+ *
+ * @param canal extremo local
+ * @param buffer bytes a enviar
+ * @param tam_buffer número de bytes
+ * @param bandera 0 o MSG_DONTWAIT
+ *
+ * @return número de bytes enviados, -1 en caso de error(EPIPE si el otro
+ *         extremo se fue, EAGAIN si no hay espacio con MSG_DONTWAIT)
+ */
+int enviar_datos_memoria(Canal_memoria *canal, char *buffer, int tam_buffer,
+        int bandera) {
+    Anillo_memoria *anillo = canal->envio;
+    uint32_t capacidad = canal->mascara + 1;
+    uint32_t tam_datos, tam_registro, al_final, relleno;
+    uint64_t cabeza;
+    int enviados = 0;
+
+    if (extremo_cerrado_memoria(canal)) {
+        errno = EPIPE;
+        return -1;
+    }
+    while (enviados < tam_buffer) {
+        tam_datos = tam_buffer - enviados < (int)canal->max_registro ?
+            (uint32_t)(tam_buffer - enviados) : canal->max_registro;
+        tam_registro = (kEncabezadoMemoria + tam_datos +
+            kAlineacionMemoria - 1) & ~(kAlineacionMemoria - 1);
+        cabeza = anillo->cabeza;
+        al_final = capacidad - (uint32_t)(cabeza & canal->mascara);
+        relleno = al_final < tam_registro ? al_final : 0;
+
+        // sólo se vuelve a leer la cola si no alcanza con la última vista
+        if (cabeza + relleno + tam_registro - canal->cola_vista > capacidad) {
+            canal->cola_vista = __atomic_load_n(&anillo->cola,
+                __ATOMIC_ACQUIRE);
+        }
+        if (cabeza + relleno + tam_registro - canal->cola_vista > capacidad) {
+            if (extremo_cerrado_memoria(canal)) {
+                errno = EPIPE;
+                return enviados > 0 ? enviados : -1;
+            }
+            if (bandera & MSG_DONTWAIT) {
+                errno = EAGAIN;
+                return enviados > 0 ? enviados : -1;
+            }
+            if (!dormir_memoria(canal, &anillo->productor_dormido,
+                    &anillo->cola, canal->cola_vista, kEsperaVidaMemoriaMs)) {
+                comprobar_extremo_memoria(canal);
+            }
+            continue;
+        }
+
+        if (relleno > 0) {
+            memcpy(canal->datos_envio + (cabeza & canal->mascara),
+                &kRellenoMemoria, kEncabezadoMemoria);
+            cabeza += relleno;
+        }
+        char *registro = canal->datos_envio + (cabeza & canal->mascara);
+        memcpy(registro, &tam_datos, kEncabezadoMemoria);
+        memcpy(registro + kEncabezadoMemoria, buffer + enviados, tam_datos);
+        __atomic_store_n(&anillo->cabeza, cabeza + tam_registro,
+            __ATOMIC_RELEASE);
+        despertar_futex(canal, &anillo->consumidor_dormido);
+        enviados += tam_datos;
+        canal->mensajes_enviados++;
+    }
+
+    return enviados;
+}
+
+/**
+ * Recibe los bytes del siguiente registro. Si el buffer es menor que el
+ * registro se entrega una parte y el resto en las siguientes llamadas, igual
+ * que en un socket de flujo.
+ *
+ * @param canal extremo local
+ * @param buffer buffer donde se copian los bytes
+ * @param tam_buffer tamaño del buffer
+ * @param bandera 0 o MSG_DONTWAIT
+ *
+ * @return número de bytes recibidos, 0 si el otro extremo se fue y ya no hay
+ *         datos, -1 en caso de error(EAGAIN si no hay datos con MSG_DONTWAIT)
+ */
+int recibir_datos_memoria(Canal_memoria *canal, char *buffer, int tam_buffer,
+        int bandera) {
+    Anillo_memoria *anillo = canal->recepcion;
+    uint64_t cola = anillo->cola;
+    uint32_t tam_registro, copiados;
+    char *registro;
+
+    while (1) {
+        if (cola == canal->cabeza_vista) {
+            canal->cabeza_vista = __atomic_load_n(&anillo->cabeza,
+                __ATOMIC_ACQUIRE);
+        }
+        if (cola == canal->cabeza_vista) {
+            if (extremo_cerrado_memoria(canal)) {
+                // lo que escribió antes de irse se entrega primero
+                canal->cabeza_vista = __atomic_load_n(&anillo->cabeza,
+                    __ATOMIC_ACQUIRE);
+                if (cola != canal->cabeza_vista) {
+                    continue;
+                }
+                return 0;
+            }
+            if (bandera & MSG_DONTWAIT) {
+                errno = EAGAIN;
+                return -1;
+            }
+            esperar_datos_memoria(canal, kEsperaVidaMemoriaMs);
+            continue;
+        }
+
+        registro = canal->datos_recepcion + (cola & canal->mascara);
+        memcpy(&tam_registro, registro, kEncabezadoMemoria);
+        if (tam_registro != kRellenoMemoria) {
+            break;
+        }
+        // el registro siguiente está al inicio del anillo
+        cola = (cola | canal->mascara) + 1;
+        __atomic_store_n(&anillo->cola, cola, __ATOMIC_RELEASE);
+    }
+
+    copiados = tam_registro - canal->entregados;
+    if (copiados > (uint32_t)tam_buffer) {
+        copiados = tam_buffer;
+    }
+    memcpy(buffer, registro + kEncabezadoMemoria + canal->entregados,
+        copiados);
+    canal->entregados += copiados;
+    if (canal->entregados == tam_registro) {
+        canal->entregados = 0;
+        cola += (kEncabezadoMemoria + tam_registro + kAlineacionMemoria - 1) &
+            ~(kAlineacionMemoria - 1);
+        __atomic_store_n(&anillo->cola, cola, __ATOMIC_RELEASE);
+        despertar_futex(canal, &anillo->productor_dormido);
+        canal->mensajes_recibidos++;
+    }
+
+    return copiados;
+}
+
+/**
+ * Deja el canal listo para el siguiente cliente(lado del servidor), después
+ * de que 'recibir_datos_memoria()' regresó 0.
+ *
+ * @param canal extremo del servidor
+ */
+void reiniciar_canal_memoria(Canal_memoria *canal) {
+    Segmento_memoria *segmento = canal->segmento;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        segmento->anillos[i].cabeza = 0;
+        segmento->anillos[i].cola = 0;
+        segmento->anillos[i].productor_dormido = 0;
+        segmento->anillos[i].consumidor_dormido = 0;
+    }
+    segmento->cliente = 0;
+    asignar_anillos_memoria(canal);
+    __atomic_store_n(&segmento->estado, kMemoriaLibre, __ATOMIC_RELEASE);
+}
+
+/**
+ * Cierra el extremo local y despierta al otro extremo si está dormido. El
+ * servidor además elimina el segmento.
+ *
+ * @param canal extremo local
+ */
+void cerrar_canal_memoria(Canal_memoria *canal) {
+    Segmento_memoria *segmento = canal->segmento;
+
+    if (canal->es_servidor) {
+        __atomic_store_n(&segmento->servidor_activo, 0, __ATOMIC_RELEASE);
+    } else {
+        __atomic_store_n(&segmento->estado, kMemoriaCerrada, __ATOMIC_RELEASE);
+    }
+    despertar_futex(canal, &canal->envio->consumidor_dormido);
+    despertar_futex(canal, &canal->recepcion->productor_dormido);
+    munmap(segmento, canal->tam_segmento);
+    if (canal->es_servidor) {
+        shm_unlink(canal->nombre);
+    }
+    canal->segmento = NULL;
+}
+
+/**
+ * Muestra los registros enviados y recibidos, y cuántas veces se durmió o se
+ * despertó al otro extremo(las únicas llamadas al sistema del canal).
+ *
+ * @param canal extremo local
+ */
+void mostrar_estadisticas_memoria(const Canal_memoria *canal) {
+    printf("Memoria compartida(%s): %lu mensajes enviados, %lu recibidos, ",
+        canal->nombre, canal->mensajes_enviados, canal->mensajes_recibidos);
+    printf("%lu FUTEX_WAKE, %lu FUTEX_WAIT\n", canal->despertares,
+        canal->esperas);
+}
+
+#endif  // FUNCIONES_MEMORIA_COMPARTIDA_H_
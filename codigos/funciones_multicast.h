@@ -0,0 +1,272 @@
+/**
+ * Funciones para multicast IPv4 e IPv6
+ *
+ * Enviar el mismo datagrama a N receptores con N llamadas a 'sendto()' cuesta
+ * N veces el envío. Con multicast el emisor envía una sola vez a una dirección
+ * de grupo(224.0.0.0/4 en IPv4, ff00::/8 en IPv6) y la red(o el propio kernel
+ * en el mismo equipo) entrega una copia a cada socket que se unió al grupo.
+ *
+ * Notas:
+ * - El receptor se asocia al puerto con SO_REUSEADDR, así varios procesos del
+ * 	mismo equipo reciben cada uno su copia, y a la dirección del grupo, así
+ * 	no recibe datagramas de otros grupos del mismo puerto.
+ * - El emisor no necesita unirse al grupo; con 'configurar_envio_multicast()'
+ * 	elige los saltos(TTL o hop limit, 1 para no salir de la red local), si
+ * 	sus propios datagramas regresan a los receptores del mismo equipo
+ * 	(IP_MULTICAST_LOOP) y la interfaz de salida.
+ * - La interfaz se indica por nombre("lo", "eth0"); sin interfaz el kernel usa
+ * 	la de la ruta al grupo. Para probar en un solo equipo se usa "lo" en
+ * 	ambos extremos.
+ * - Las direcciones IPv6 de alcance de enlace(ff02::/16) necesitan la
+ * 	interfaz; si no se indica con "%lo" se toma la del parámetro.
+ *
+ * Para más información consultar 'man 7 ip' y 'man 7 ipv6'.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_MULTICAST_H_
+#define FUNCIONES_MULTICAST_H_
+
+#include <net/if.h>  // 'if_nametoindex()'
+#include <netinet/in.h>
+
+#include "funciones_sockets.h"
+
+/* Prototipos */
+
+int es_direccion_multicast(const struct sockaddr *sa);
+int obtener_indice_interfaz(const char *interfaz);
+int cambiar_membresia_multicast(int descriptor, const struct sockaddr *grupo,
+        int indice_interfaz, int unirse);
+int unirse_grupo_multicast(int descriptor, const struct sockaddr *grupo,
+        int indice_interfaz);
+int dejar_grupo_multicast(int descriptor, const struct sockaddr *grupo,
+        int indice_interfaz);
+int configurar_envio_multicast(int descriptor, int familia, int saltos,
+        int bucle, int indice_interfaz);
+int inicializar_receptor_multicast(const char *grupo, const char *puerto,
+        int indice_interfaz, struct sockaddr_storage *direccion_grupo);
+
+/* Funciones */
+
+/**
+ * Indica si una dirección es de un grupo multicast.
+ *
+ * @param sa dirección a revisar
+ *
+ * @return 1 si es multicast(IPv4 o IPv6), 0 en otro caso
+ */
+int es_direccion_multicast(const struct sockaddr *sa) {
+    if (sa->sa_family == AF_INET) {
+        return IN_MULTICAST(ntohl(((struct sockaddr_in*)sa)->sin_addr.s_addr));
+    }
+    if (sa->sa_family == AF_INET6) {
+        return IN6_IS_ADDR_MULTICAST(&((struct sockaddr_in6*)sa)->sin6_addr);
+    }
+
+    return 0;
+}
+
+/**
+ * Obtiene el índice de una interfaz de red a partir de su nombre.
+ *
+ * Para más información consultar 'man 3 if_nametoindex'.
+ *
+ * @param interfaz nombre de la interfaz("lo", "eth0"), 'NULL' para ninguna
+ *
+ * @return índice de la interfaz, 0 si 'interfaz' es 'NULL', -1 si no existe
+ */
+int obtener_indice_interfaz(const char *interfaz) {
+    if (interfaz == NULL) {
+        return 0;
+    }
+    unsigned indice = if_nametoindex(interfaz);
+    if (indice == 0) {
+        fprintf(stderr,"\nInterfaz inválida(%s): %s\n", interfaz,
+            strerror(errno));
+        return -1;
+    }
+
+    return (int)indice;
+}
+
+/**
+ * Une al socket a un grupo multicast o lo saca de él, en la interfaz
+ * indicada(IP_ADD_MEMBERSHIP/IP_DROP_MEMBERSHIP en IPv4,
+ * IPV6_JOIN_GROUP/IPV6_LEAVE_GROUP en IPv6).
+ *
+ * @param descriptor socket de datagramas de la familia del grupo
+ * @param grupo dirección del grupo
+ * @param indice_interfaz interfaz donde se recibe, 0 para la que elija el
+ *                        kernel
+ * @param unirse 1 para unirse, 0 para salir
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int cambiar_membresia_multicast(int descriptor, const struct sockaddr *grupo,
+        int indice_interfaz, int unirse) {
+    int res;
+
+    if (grupo->sa_family == AF_INET) {
+        struct ip_mreqn solicitud;
+        memset(&solicitud, 0, sizeof(solicitud));
+        solicitud.imr_multiaddr = ((struct sockaddr_in*)grupo)->sin_addr;
+        solicitud.imr_address.s_addr = htonl(INADDR_ANY);
+        solicitud.imr_ifindex = indice_interfaz;
+        res = setsockopt(descriptor, IPPROTO_IP, unirse ? IP_ADD_MEMBERSHIP :
+            IP_DROP_MEMBERSHIP, &solicitud, sizeof(solicitud));
+    } else {
+        struct ipv6_mreq solicitud;
+        memset(&solicitud, 0, sizeof(solicitud));
+        solicitud.ipv6mr_multiaddr = ((struct sockaddr_in6*)grupo)->sin6_addr;
+        solicitud.ipv6mr_interface = indice_interfaz;
+        res = setsockopt(descriptor, IPPROTO_IPV6, unirse ? IPV6_JOIN_GROUP :
+            IPV6_LEAVE_GROUP, &solicitud, sizeof(solicitud));
+    }
+    if (res == -1) {
+        char ip[INET6_ADDRSTRLEN];
+        fprintf(stderr,"\nError al %s el grupo %s: %s\n", unirse ?
+            "unirse a" : "dejar", escribir_direccion_imprimible(grupo, ip,
+            sizeof(ip)), strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Une al socket a un grupo multicast, ver 'cambiar_membresia_multicast()'.
+ *
+ * @param descriptor socket de datagramas de la familia del grupo
+ * @param grupo dirección del grupo
+ * @param indice_interfaz interfaz donde se recibe, 0 para cualquiera
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int unirse_grupo_multicast(int descriptor, const struct sockaddr *grupo,
+        int indice_interfaz) {
+    return cambiar_membresia_multicast(descriptor, grupo, indice_interfaz, 1);
+}
+
+/**
+ * Saca al socket de un grupo multicast, ver 'cambiar_membresia_multicast()'.
+ * Al cerrar el socket el kernel lo saca de todos sus grupos.
+ *
+ * @param descriptor socket unido al grupo
+ * @param grupo dirección del grupo
+ * @param indice_interfaz interfaz con la que se unió
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int dejar_grupo_multicast(int descriptor, const struct sockaddr *grupo,
+        int indice_interfaz) {
+    return cambiar_membresia_multicast(descriptor, grupo, indice_interfaz, 0);
+}
+
+/**
+ * Configura el envío de datagramas multicast del socket: saltos(TTL en IPv4,
+ * hop limit en IPv6), si los datagramas regresan a los receptores del mismo
+ * equipo y la interfaz de salida.
+ *
+ * @param descriptor socket de datagramas
+ * @param familia AF_INET o AF_INET6
+ * @param saltos routers que puede cruzar cada datagrama(0 a 255)
+ * @param bucle 1 para entregar también a los receptores del mismo equipo
+ * @param indice_interfaz interfaz de salida, 0 para la de la ruta al grupo
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int configurar_envio_multicast(int descriptor, int familia, int saltos,
+        int bucle, int indice_interfaz) {
+    if (familia == AF_INET) {
+        // IP_MULTICAST_TTL e IP_MULTICAST_LOOP también aceptan un entero
+        if (establecer_opcion_socket(descriptor, IPPROTO_IP, IP_MULTICAST_TTL,
+                saltos) == -1 || establecer_opcion_socket(descriptor,
+                IPPROTO_IP, IP_MULTICAST_LOOP, bucle) == -1) {
+            return -1;
+        }
+        if (indice_interfaz > 0) {
+            struct ip_mreqn interfaz;
+            memset(&interfaz, 0, sizeof(interfaz));
+            interfaz.imr_ifindex = indice_interfaz;
+            if (setsockopt(descriptor, IPPROTO_IP, IP_MULTICAST_IF, &interfaz,
+                    sizeof(interfaz)) == -1) {
+                fprintf(stderr,"\nError al elegir interfaz multicast: %s\n",
+                    strerror(errno));
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    if (establecer_opcion_socket(descriptor, IPPROTO_IPV6,
+            IPV6_MULTICAST_HOPS, saltos) == -1 || establecer_opcion_socket(
+            descriptor, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, bucle) == -1 ||
+            (indice_interfaz > 0 && establecer_opcion_socket(descriptor,
+            IPPROTO_IPV6, IPV6_MULTICAST_IF, indice_interfaz) == -1)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Inicializa un receptor de un grupo multicast: crea el socket de la familia
+ * del grupo, establece SO_REUSEADDR(para que otros receptores del mismo
+ * equipo usen el puerto), lo asocia al grupo y al puerto y se une al grupo.
+ *
+ * @param grupo dirección del grupo, por ejemplo "239.1.2.3" o "ff02::1234%lo"
+ * @param puerto puerto donde se reciben los datagramas
+ * @param indice_interfaz interfaz donde se recibe, 0 para cualquiera
+ * @param direccion_grupo donde se guarda la dirección del grupo, para
+ *                        'dejar_grupo_multicast()'
+ *
+ * @return descriptor del socket, -1 en caso de error
+ */
+int inicializar_receptor_multicast(const char *grupo, const char *puerto,
+        int indice_interfaz, struct sockaddr_storage *direccion_grupo) {
+    struct addrinfo referencia;
+    struct addrinfo *info_grupo;
+
+    llenar_estructura_referencia(&referencia, SOCK_DGRAM);
+    referencia.ai_family = AF_UNSPEC;  // la familia la decide el grupo
+    referencia.ai_flags = AI_NUMERICHOST;
+    info_grupo = obtener_direccion(grupo, puerto, &referencia);
+    if (info_grupo == NULL) {
+        return -1;
+    }
+    if (!es_direccion_multicast(info_grupo->ai_addr)) {
+        fprintf(stderr,"\n%s no es una dirección multicast\n", grupo);
+        freeaddrinfo(info_grupo);
+        return -1;
+    }
+    // el alcance de enlace necesita la interfaz para asociar y unirse
+    struct sockaddr_in6 *grupo_ipv6 = (struct sockaddr_in6*)info_grupo->ai_addr;
+    if (info_grupo->ai_family == AF_INET6 && grupo_ipv6->sin6_scope_id == 0 &&
+            IN6_IS_ADDR_MC_LINKLOCAL(&grupo_ipv6->sin6_addr)) {
+        grupo_ipv6->sin6_scope_id = indice_interfaz;
+    }
+    if (info_grupo->ai_family == AF_INET6 && indice_interfaz == 0) {
+        indice_interfaz = grupo_ipv6->sin6_scope_id;
+    }
+
+    int descriptor = crear_socket(info_grupo);
+    if (descriptor == -1 || establecer_opcion_socket(descriptor, SOL_SOCKET,
+            SO_REUSEADDR, 1) == -1 || asociar_socket(descriptor, info_grupo)
+            == -1 || unirse_grupo_multicast(descriptor, info_grupo->ai_addr,
+            indice_interfaz) == -1) {
+        if (descriptor != -1) {
+            close(descriptor);
+        }
+        freeaddrinfo(info_grupo);
+        return -1;
+    }
+    memset(direccion_grupo, 0, sizeof(struct sockaddr_storage));
+    memcpy(direccion_grupo, info_grupo->ai_addr, info_grupo->ai_addrlen);
+
+    freeaddrinfo(info_grupo);
+    return descriptor;
+}
+
+#endif  // FUNCIONES_MULTICAST_H_
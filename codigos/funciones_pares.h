@@ -0,0 +1,355 @@
+/**
+ * Funciones para una tabla de pares(clientes) de datagramas
+ *
+ * Un servidor de datagramas recibe muchos paquetes de pocos clientes. La tabla
+ * guarda por cada dirección(familia, dirección y puerto, o la ruta de un
+ * socket Unix) su forma imprimible y contadores de paquetes, bytes y último
+ * paquete recibido, así 'inet_ntop()' se llama una vez por cliente y no una
+ * vez por paquete.
+ *
+ * Notas:
+ * - Es una tabla hash de direccionamiento abierto con sondeo lineal, con
+ * 	capacidad fija(potencia de 2) reservada al crearla; buscar o registrar un
+ * 	paquete no reserva memoria.
+ * - Al llegar a 3/4 de su capacidad se quitan los pares sin paquetes en los
+ * 	últimos 'inactividad' segundos(a lo más una revisión por segundo) y, si
+ * 	el programa asoció datos a un par('datos'), se liberan con 'al_expirar'.
+ * 	Si aún no hay lugar el par nuevo no se agrega; sus paquetes se cuentan
+ * 	en 'sin_espacio' y el llamador debe formatear la dirección por su cuenta.
+ * - Los pares se quitan recorriendo hacia atrás a los que siguen en su
+ * 	sondeo(sin marcas de borrado), por eso un par puede cambiar de posición
+ * 	al expirar otros y los apuntadores a pares sólo son válidos hasta la
+ * 	siguiente búsqueda.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_PARES_H_
+#define FUNCIONES_PARES_H_
+
+#include <stdint.h>
+#include <time.h>  // 'time()'
+
+#include "funciones_sockets.h"
+
+// capacidad por defecto de la tabla de pares
+const int kMaxPares = 1024;
+// segundos sin paquetes tras los cuales un par puede quitarse de la tabla
+const int kInactividadPar = 60;
+
+// información de un par, la clave es 'direccion'
+typedef struct Par_dgram {
+    int ocupado;
+    uint32_t hash;
+    struct sockaddr_storage direccion;
+    char ip[INET6_ADDRSTRLEN];  // dirección imprimible
+    int puerto;
+    unsigned long paquetes;
+    unsigned long bytes;
+    time_t ultimo_paquete;
+    void *datos;  // datos del programa asociados al par, o 'NULL'
+} Par_dgram;
+
+typedef struct Tabla_pares {
+    Par_dgram *pares;
+    int capacidad;  // potencia de 2
+    int num_pares;
+    int inactividad;  // segundos, 'kInactividadPar' por defecto
+    time_t ultima_revision;  // última búsqueda de pares inactivos
+    // opcional, libera los 'datos' de un par antes de quitarlo
+    void (*al_expirar)(Par_dgram *par);
+    unsigned long expirados;  // pares quitados por inactividad
+    unsigned long sin_espacio;  // paquetes de pares que no cupieron
+} Tabla_pares;
+
+/* Prototipos */
+
+int crear_tabla_pares(Tabla_pares *tabla, int capacidad);
+void destruir_tabla_pares(Tabla_pares *tabla);
+uint32_t calcular_hash_direccion(const struct sockaddr *sa);
+int comparar_direcciones(const struct sockaddr *a, const struct sockaddr *b);
+void quitar_par(Tabla_pares *tabla, int indice);
+int expirar_pares(Tabla_pares *tabla, time_t ahora);
+Par_dgram* buscar_par(Tabla_pares *tabla, const struct sockaddr *sa);
+Par_dgram* registrar_paquete_par(Tabla_pares *tabla, const struct sockaddr *sa,
+        int bytes);
+void mostrar_tabla_pares(const Tabla_pares *tabla);
+
+/* Funciones */
+
+/**
+ * Inicializa una tabla vacía. La capacidad se redondea a la siguiente
+ * potencia de 2.
+ *
+ * @param tabla tabla a inicializar
+ * @param capacidad número de entradas de la tabla
+ *
+ * @return 0 en caso de éxito, -1 si no hay memoria
+ */
+int crear_tabla_pares(Tabla_pares *tabla, int capacidad) {
+    memset(tabla, 0, sizeof(Tabla_pares));
+    tabla->inactividad = kInactividadPar;
+    tabla->capacidad = 1;
+    while (tabla->capacidad < capacidad) {
+        tabla->capacidad <<= 1;
+    }
+    tabla->pares = (Par_dgram*)calloc(tabla->capacidad, sizeof(Par_dgram));
+    if (tabla->pares == NULL) {
+        fprintf(stderr,"\nError al reservar memoria para la tabla de pares\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Libera la memoria de la tabla y, con 'al_expirar', los datos de sus pares.
+ *
+ * @param tabla tabla a destruir
+ */
+void destruir_tabla_pares(Tabla_pares *tabla) {
+    int i;
+    for (i = 0; tabla->pares != NULL && i < tabla->capacidad; i++) {
+        if (tabla->pares[i].ocupado && tabla->al_expirar != NULL) {
+            tabla->al_expirar(&tabla->pares[i]);
+        }
+    }
+    free(tabla->pares);
+    tabla->pares = NULL;
+    tabla->num_pares = 0;
+}
+
+/**
+ * Calcula el hash(FNV-1a) de la familia, dirección y puerto de una dirección.
+ * El resto de la estructura 'sockaddr' no se toma en cuenta.
+ *
+ * @param sa dirección IPv4, IPv6 o Unix
+ *
+ * @return valor hash
+ */
+uint32_t calcular_hash_direccion(const struct sockaddr *sa) {
+    const unsigned char *bytes = (const unsigned char*)
+        extraer_direccion_sockaddr(sa);
+    size_t tam = sa->sa_family == AF_INET ? sizeof(struct in_addr) :
+        sizeof(struct in6_addr);
+    uint16_t puerto = sa->sa_family == AF_INET ?
+        ((const struct sockaddr_in*)sa)->sin_port :
+        ((const struct sockaddr_in6*)sa)->sin6_port;
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    // en sockets Unix la clave es el nombre, no hay puerto
+    if (sa->sa_family == AF_UNIX) {
+        bytes = (const unsigned char*)((const struct sockaddr_un*)sa)->sun_path;
+        tam = obtener_tam_sockaddr(sa) - offsetof(struct sockaddr_un, sun_path);
+        puerto = 0;
+    }
+
+    hash = (hash ^ sa->sa_family) * 16777619u;
+    hash = (hash ^ (puerto & 0xff)) * 16777619u;
+    hash = (hash ^ (puerto >> 8)) * 16777619u;
+    for (i = 0; i < tam; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * Compara la familia, dirección y puerto de dos direcciones.
+ *
+ * @param a primera dirección
+ * @param b segunda dirección
+ *
+ * @return 1 si son iguales, 0 en otro caso
+ */
+int comparar_direcciones(const struct sockaddr *a, const struct sockaddr *b) {
+    if (a->sa_family != b->sa_family) {
+        return 0;
+    }
+    if (a->sa_family == AF_UNIX) {
+        socklen_t tam = obtener_tam_sockaddr(a);
+        return tam == obtener_tam_sockaddr(b) && memcmp(a, b, tam) == 0;
+    }
+    if (a->sa_family == AF_INET) {
+        const struct sockaddr_in *a4 = (const struct sockaddr_in*)a;
+        const struct sockaddr_in *b4 = (const struct sockaddr_in*)b;
+        return a4->sin_port == b4->sin_port &&
+            a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+    }
+    const struct sockaddr_in6 *a6 = (const struct sockaddr_in6*)a;
+    const struct sockaddr_in6 *b6 = (const struct sockaddr_in6*)b;
+    return a6->sin6_port == b6->sin6_port &&
+        memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(struct in6_addr)) == 0;
+}
+
+/**
+ * Quita un par de la tabla(sin llamar a 'al_expirar'). Los pares siguientes
+ * de la misma cadena de sondeo que ya no se encontrarían se recorren al hueco,
+ * así no se necesitan marcas de borrado.
+ *
+ * @param tabla tabla de pares
+ * @param indice posición del par a quitar
+ */
+void quitar_par(Tabla_pares *tabla, int indice) {
+    int mascara = tabla->capacidad - 1;
+    int hueco = indice, i = indice, inicio;
+
+    for (;;) {
+        i = (i + 1) & mascara;
+        if (!tabla->pares[i].ocupado) {
+            break;
+        }
+        // el par puede llenar el hueco si su posición inicial no está entre
+        // el hueco(exclusivo) y su posición actual(inclusivo), cíclicamente
+        inicio = tabla->pares[i].hash & mascara;
+        if ((i > hueco && (inicio <= hueco || inicio > i)) ||
+                (i < hueco && inicio <= hueco && inicio > i)) {
+            tabla->pares[hueco] = tabla->pares[i];
+            hueco = i;
+        }
+    }
+    memset(&tabla->pares[hueco], 0, sizeof(Par_dgram));
+    tabla->num_pares--;
+}
+
+/**
+ * Quita los pares que no han enviado paquetes en los últimos
+ * 'tabla->inactividad' segundos, liberando sus datos con 'al_expirar'.
+ *
+ * @param tabla tabla de pares
+ * @param ahora tiempo actual('time()')
+ *
+ * @return número de pares quitados
+ */
+int expirar_pares(Tabla_pares *tabla, time_t ahora) {
+    int i = 0, quitados = 0;
+
+    tabla->ultima_revision = ahora;
+    while (i < tabla->capacidad) {
+        Par_dgram *par = &tabla->pares[i];
+        if (!par->ocupado || ahora - par->ultimo_paquete < tabla->inactividad) {
+            i++;
+            continue;
+        }
+        if (tabla->al_expirar != NULL) {
+            tabla->al_expirar(par);
+        }
+        // otro par pudo recorrerse a esta posición, se revisa de nuevo
+        quitar_par(tabla, i);
+        quitados++;
+    }
+    tabla->expirados += quitados;
+
+    return quitados;
+}
+
+/**
+ * Busca el par de una dirección y, si no existe y hay espacio, lo agrega y
+ * formatea su dirección. Si la tabla está llena primero se quitan los pares
+ * inactivos, ver 'expirar_pares()'.
+ *
+ * @param tabla tabla de pares
+ * @param sa dirección del par(IPv4 o IPv6)
+ *
+ * @return par encontrado o agregado, 'NULL' si la tabla está llena
+ */
+Par_dgram* buscar_par(Tabla_pares *tabla, const struct sockaddr *sa) {
+    uint32_t hash = calcular_hash_direccion(sa);
+    int mascara = tabla->capacidad - 1;
+    int i = hash & mascara;
+    Par_dgram *par;
+
+    while (tabla->pares[i].ocupado) {
+        par = &tabla->pares[i];
+        if (par->hash == hash &&
+                comparar_direcciones((struct sockaddr*)&par->direccion, sa)) {
+            return par;
+        }
+        i = (i + 1) & mascara;
+    }
+
+    // se deja al menos 1/4 de la tabla libre para que el sondeo sea corto
+    if (4*(tabla->num_pares + 1) > 3*tabla->capacidad) {
+        time_t ahora = time(NULL);
+        if (ahora == tabla->ultima_revision ||
+                expirar_pares(tabla, ahora) == 0) {
+            return NULL;
+        }
+        // la cadena de sondeo pudo cambiar, se busca de nuevo el hueco
+        i = hash & mascara;
+        while (tabla->pares[i].ocupado) {
+            i = (i + 1) & mascara;
+        }
+    }
+    par = &tabla->pares[i];
+    memset(par, 0, sizeof(Par_dgram));
+    par->ocupado = 1;
+    par->hash = hash;
+    memcpy(&par->direccion, sa, obtener_tam_sockaddr(sa));
+    escribir_direccion_imprimible(sa, par->ip, sizeof(par->ip));
+    par->puerto = sa->sa_family == AF_UNIX ? 0 : ntohs(
+        sa->sa_family == AF_INET ? ((const struct sockaddr_in*)sa)->sin_port :
+        ((const struct sockaddr_in6*)sa)->sin6_port);
+    tabla->num_pares++;
+
+    return par;
+}
+
+/**
+ * Actualiza los contadores del par que envió un paquete.
+ *
+ * @param tabla tabla de pares
+ * @param sa dirección de quien envió el paquete
+ * @param bytes tamaño del paquete
+ *
+ * @return par del paquete, 'NULL' si no cupo en la tabla
+ */
+Par_dgram* registrar_paquete_par(Tabla_pares *tabla, const struct sockaddr *sa,
+        int bytes) {
+    Par_dgram *par = buscar_par(tabla, sa);
+    if (par == NULL) {
+        tabla->sin_espacio++;
+        return NULL;
+    }
+    par->paquetes++;
+    par->bytes += bytes;
+    par->ultimo_paquete = time(NULL);
+
+    return par;
+}
+
+/**
+ * Muestra los contadores de cada par de la tabla.
+ *
+ * @param tabla tabla de pares
+ */
+void mostrar_tabla_pares(const Tabla_pares *tabla) {
+    char fecha[32];
+    int i;
+
+    printf("\nClientes(%d):\n", tabla->num_pares);
+    for (i = 0; i < tabla->capacidad; i++) {
+        const Par_dgram *par = &tabla->pares[i];
+        if (!par->ocupado) {
+            continue;
+        }
+        strftime(fecha, sizeof(fecha), "%H:%M:%S",
+            localtime(&par->ultimo_paquete));
+        printf("\t%s", par->ip);
+        if (par->direccion.ss_family != AF_UNIX) {
+            printf(" puerto %d", par->puerto);
+        }
+        printf(": %lu paquetes, %lu bytes, último a las %s\n", par->paquetes,
+            par->bytes, fecha);
+    }
+    if (tabla->expirados > 0) {
+        printf("\t%lu clientes quitados por inactividad\n", tabla->expirados);
+    }
+    if (tabla->sin_espacio > 0) {
+        printf("\t%lu paquetes de clientes que no cupieron en la tabla\n",
+            tabla->sin_espacio);
+    }
+}
+
+#endif  // FUNCIONES_PARES_H_
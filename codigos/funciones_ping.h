@@ -0,0 +1,318 @@
+/**
+ * Funciones para medir el tiempo de ida y vuelta(RTT) contra un servidor eco
+ *
+ * Cada ping lleva al inicio un número de secuencia y la marca de tiempo
+ * monótona del envío(ambos de 64 bits, en orden de red); el resto del mensaje
+ * es relleno. El servidor(con '--eco') regresa el mensaje sin cambios y al
+ * recibirlo se calcula el RTT con el reloj del propio cliente, así no se
+ * necesitan relojes sincronizados.
+ *
+ * 	+----------------+----------------+-------------------+
+ * 	| secuencia(8)   | marca(8, ns)   | relleno           |
+ * 	+----------------+----------------+-------------------+
+ *
+ * Notas:
+ * - Con un intervalo mayor a 0 los pings se envían a ritmo fijo, sin esperar
+ * 	los ecos. Con intervalo 0(ping-pong) cada ping se envía al recibir el eco
+ * 	del anterior, o tras 'kEsperaEcoMs' si se perdió.
+ * - Un eco con secuencia menor a la mayor recibida cuenta como desordenado; un
+ * 	eco repetido cuenta como duplicado y no se vuelve a medir.
+ * - Los ecos que no llegan 'kEsperaEcoMs' después del último envío se cuentan
+ * 	como perdidos.
+ * - En sockets de flujo los pings son tramas, ver 'funciones_tramas.h'.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_PING_H_
+#define FUNCIONES_PING_H_
+
+#include <stdint.h>
+#include <endian.h>  // 'htobe64()'
+
+#include "funciones_sockets.h"
+#include "funciones_tramas.h"
+#include "funciones_histograma.h"
+#include "funciones_carga.h"  // 'obtener_ns_monotonicos()'
+
+// bytes de la secuencia y la marca de tiempo
+const int kTamPing = 16;
+// tiempo que se espera un eco antes de darlo por perdido
+const int kEsperaEcoMs = 1000;
+
+typedef struct Estadisticas_ping {
+    unsigned long enviados;
+    unsigned long recibidos;
+    unsigned long desordenados;
+    unsigned long duplicados;
+    unsigned long invalidos;  // ecos con secuencia desconocida
+    unsigned long mayor_secuencia;  // mayor secuencia recibida
+    unsigned char *vistos;  // un bit por secuencia, para los duplicados
+    Histograma rtt;  // nanosegundos
+} Estadisticas_ping;
+
+/* Prototipos */
+
+int crear_estadisticas_ping(Estadisticas_ping *estadisticas, long num_pings);
+void destruir_estadisticas_ping(Estadisticas_ping *estadisticas);
+void escribir_ping(char *mensaje, uint64_t secuencia, uint64_t marca);
+int registrar_eco_ping(Estadisticas_ping *estadisticas, const char *eco,
+        size_t tam_eco, int mostrar);
+int recibir_ecos_ping(int descriptor, int tipo_socket, Buffer_tramas *entrada,
+        char *buffer, size_t tam_buffer, Estadisticas_ping *estadisticas,
+        int mostrar);
+int ejecutar_ping(int descriptor, int tipo_socket, long num_pings,
+        int intervalo_ms, size_t tam_ping, Estadisticas_ping *estadisticas);
+void mostrar_estadisticas_ping(const Estadisticas_ping *estadisticas);
+
+/* Funciones */
+
+/**
+ * Inicializa las estadísticas para 'num_pings' pings.
+ *
+ * @param estadisticas estadísticas a inicializar
+ * @param num_pings número de pings que se enviarán
+ *
+ * @return 0 en caso de éxito, -1 si no hay memoria
+ */
+int crear_estadisticas_ping(Estadisticas_ping *estadisticas, long num_pings) {
+    memset(estadisticas, 0, sizeof(Estadisticas_ping));
+    estadisticas->vistos = (unsigned char*)calloc(num_pings/8 + 1, 1);
+    if (estadisticas->vistos == NULL ||
+            crear_histograma(&estadisticas->rtt) == -1) {
+        fprintf(stderr,"\nError al reservar memoria para el ping\n");
+        free(estadisticas->vistos);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Libera la memoria de las estadísticas.
+ *
+ * @param estadisticas estadísticas a destruir
+ */
+void destruir_estadisticas_ping(Estadisticas_ping *estadisticas) {
+    free(estadisticas->vistos);
+    estadisticas->vistos = NULL;
+    destruir_histograma(&estadisticas->rtt);
+}
+
+/**
+ * Escribe la secuencia y la marca de tiempo al inicio de un ping.
+ *
+ * @param mensaje buffer de al menos 'kTamPing' bytes
+ * @param secuencia número de secuencia
+ * @param marca instante del envío en nanosegundos
+ */
+void escribir_ping(char *mensaje, uint64_t secuencia, uint64_t marca) {
+    secuencia = htobe64(secuencia);
+    marca = htobe64(marca);
+    memcpy(mensaje, &secuencia, sizeof(uint64_t));
+    memcpy(mensaje + sizeof(uint64_t), &marca, sizeof(uint64_t));
+}
+
+/**
+ * Registra un eco recibido: calcula su RTT y revisa si llegó desordenado o
+ * duplicado.
+ *
+ * @param estadisticas estadísticas del ping
+ * @param eco mensaje recibido
+ * @param tam_eco longitud del mensaje
+ * @param mostrar 1 para mostrar el RTT del eco
+ *
+ * @return secuencia del eco, -1 si el eco no es válido o es duplicado
+ */
+int registrar_eco_ping(Estadisticas_ping *estadisticas, const char *eco,
+        size_t tam_eco, int mostrar) {
+    uint64_t secuencia, marca;
+    uint64_t ahora = obtener_ns_monotonicos();
+
+    if (tam_eco < (size_t)kTamPing) {
+        estadisticas->invalidos++;
+        return -1;
+    }
+    memcpy(&secuencia, eco, sizeof(uint64_t));
+    memcpy(&marca, eco + sizeof(uint64_t), sizeof(uint64_t));
+    secuencia = be64toh(secuencia);
+    marca = be64toh(marca);
+    if (secuencia >= estadisticas->enviados || marca > ahora) {
+        estadisticas->invalidos++;
+        return -1;
+    }
+    if (estadisticas->vistos[secuencia/8] & (1 << (secuencia%8))) {
+        estadisticas->duplicados++;
+        return -1;
+    }
+    estadisticas->vistos[secuencia/8] |= 1 << (secuencia%8);
+
+    if (estadisticas->recibidos > 0 &&
+            secuencia < estadisticas->mayor_secuencia) {
+        estadisticas->desordenados++;
+    } else {
+        estadisticas->mayor_secuencia = secuencia;
+    }
+    estadisticas->recibidos++;
+    registrar_valor_histograma(&estadisticas->rtt, ahora - marca);
+    if (mostrar) {
+        printf("%zu bytes de eco: secuencia=%lu rtt=%.3f ms\n", tam_eco,
+            (unsigned long)secuencia, (ahora - marca)/1e6);
+    }
+
+    return (int)secuencia;
+}
+
+/**
+ * Recibe, sin bloquear, todos los ecos que ya llegaron.
+ *
+ * @param descriptor socket conectado al servidor
+ * @param tipo_socket SOCK_STREAM o SOCK_DGRAM
+ * @param entrada buffer de tramas(sólo sockets de flujo)
+ * @param buffer buffer para un datagrama(sólo sockets de datagramas)
+ * @param tam_buffer tamaño del buffer
+ * @param estadisticas estadísticas del ping
+ * @param mostrar 1 para mostrar el RTT de cada eco
+ *
+ * @return mayor secuencia recibida en esta llamada, -1 si no se recibió
+ *         ninguna, -2 si el servidor cerró la conexión o hubo un error
+ */
+int recibir_ecos_ping(int descriptor, int tipo_socket, Buffer_tramas *entrada,
+        char *buffer, size_t tam_buffer, Estadisticas_ping *estadisticas,
+        int mostrar) {
+    char *trama;
+    uint32_t tam_trama;
+    int res, secuencia, mayor = -1;
+
+    while (1) {
+        if (tipo_socket == SOCK_STREAM) {
+            res = recibir_tramas_stream(descriptor, entrada, MSG_DONTWAIT);
+            if (res == 0) {
+                return -2;
+            }
+            while (extraer_trama(entrada, &trama, &tam_trama) == 1) {
+                secuencia = registrar_eco_ping(estadisticas, trama, tam_trama,
+                    mostrar);
+                mayor = secuencia > mayor ? secuencia : mayor;
+            }
+        } else {
+            res = recv(descriptor, buffer, tam_buffer, MSG_DONTWAIT);
+            if (res >= 0) {
+                secuencia = registrar_eco_ping(estadisticas, buffer, res,
+                    mostrar);
+                mayor = secuencia > mayor ? secuencia : mayor;
+            }
+        }
+        if (res == -1) {
+            // un datagrama rechazado(ECONNREFUSED) no cierra el socket
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ||
+                    (tipo_socket == SOCK_DGRAM && errno == ECONNREFUSED)) {
+                return mayor;
+            }
+            return -2;
+        }
+    }
+}
+
+/**
+ * Envía 'num_pings' pings y recibe sus ecos.
+ *
+ * @param descriptor socket conectado al servidor(de datagramas conectado con
+ *                   'connect()')
+ * @param tipo_socket SOCK_STREAM o SOCK_DGRAM
+ * @param num_pings número de pings
+ * @param intervalo_ms milisegundos entre pings, 0 para ping-pong
+ * @param tam_ping tamaño de cada ping, al menos 'kTamPing'
+ * @param estadisticas estadísticas creadas con 'crear_estadisticas_ping()'
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int ejecutar_ping(int descriptor, int tipo_socket, long num_pings,
+        int intervalo_ms, size_t tam_ping, Estadisticas_ping *estadisticas) {
+    Buffer_tramas entrada;
+    uint64_t intervalo = (uint64_t)intervalo_ms*1000000ull;
+    uint64_t espera_eco = (uint64_t)kEsperaEcoMs*1000000ull;
+    uint64_t ahora, proximo, limite = 0;
+    int res = 0, mostrar = intervalo_ms > 0;
+
+    tam_ping = tam_ping < (size_t)kTamPing ? (size_t)kTamPing : tam_ping;
+    // el buffer de ecos de datagramas va después del mensaje
+    char *mensaje = (char*)malloc(2*tam_ping + 1);
+    if (mensaje == NULL) {
+        fprintf(stderr,"\nError al reservar memoria para el ping\n");
+        return -1;
+    }
+    memset(mensaje, 'x', tam_ping);
+    inicializar_buffer_tramas(&entrada);
+
+    proximo = obtener_ns_monotonicos();
+    while (1) {
+        ahora = obtener_ns_monotonicos();
+        if ((long)estadisticas->enviados < num_pings && ahora >= proximo) {
+            escribir_ping(mensaje, estadisticas->enviados, ahora);
+            res = tipo_socket == SOCK_STREAM ?
+                enviar_trama_stream(descriptor, mensaje, tam_ping) :
+                send(descriptor, mensaje, tam_ping, 0);
+            if (res == -1 && (tipo_socket == SOCK_STREAM ||
+                    errno != ECONNREFUSED)) {
+                fprintf(stderr, "\nError al enviar ping: %s\n",
+                    strerror(errno));
+                break;
+            }
+            estadisticas->enviados++;
+            proximo = ahora + (intervalo > 0 ? intervalo : espera_eco);
+            limite = ahora + espera_eco;
+        }
+        if ((long)estadisticas->enviados == num_pings &&
+                (ahora >= limite ||
+                estadisticas->recibidos == estadisticas->enviados)) {
+            res = 0;
+            break;
+        }
+
+        uint64_t hasta = (long)estadisticas->enviados < num_pings ?
+            proximo : limite;
+        int espera = hasta > ahora ? (int)((hasta - ahora + 999999)/1000000) :
+            0;
+        res = esperar_descriptor(descriptor, POLLIN, espera);
+        if (res == 1) {
+            int secuencia = recibir_ecos_ping(descriptor, tipo_socket,
+                &entrada, mensaje + tam_ping, tam_ping + 1, estadisticas,
+                mostrar);
+            if (secuencia == -2) {
+                fprintf(stderr, "\nEl servidor cerró la conexión\n");
+                res = -1;
+                break;
+            }
+            // en ping-pong el siguiente ping sale al recibir el eco del último
+            if (intervalo == 0 && secuencia == (int)estadisticas->enviados - 1) {
+                proximo = 0;
+            }
+        }
+    }
+
+    liberar_buffer_tramas(&entrada);
+    free(mensaje);
+    return res == -1 ? -1 : 0;
+}
+
+/**
+ * Muestra los pings enviados, recibidos, perdidos, desordenados y duplicados,
+ * y los percentiles del RTT.
+ *
+ * @param estadisticas estadísticas del ping
+ */
+void mostrar_estadisticas_ping(const Estadisticas_ping *estadisticas) {
+    unsigned long perdidos = estadisticas->enviados - estadisticas->recibidos;
+
+    printf("\n%lu pings enviados, %lu ecos recibidos, %lu perdidos(%.2f%%)\n",
+        estadisticas->enviados, estadisticas->recibidos, perdidos,
+        estadisticas->enviados == 0 ? 0.0 :
+            100.0*perdidos/estadisticas->enviados);
+    printf("%lu desordenados, %lu duplicados, %lu inválidos\n",
+        estadisticas->desordenados, estadisticas->duplicados,
+        estadisticas->invalidos);
+    mostrar_histograma(&estadisticas->rtt, "RTT");
+}
+
+#endif  // FUNCIONES_PING_H_
@@ -0,0 +1,307 @@
+/**
+ * Funciones para un pool de conexiones de cliente
+ *
+ * Un cliente que hace muchas peticiones cortas al mismo servidor paga en cada
+ * una la resolución del nombre y el saludo de tres vías de TCP. El pool
+ * conserva las conexiones que el cliente devuelve y las entrega de nuevo en
+ * la siguiente petición al mismo destino.
+ *
+ * Notas:
+ * - Las conexiones nuevas se establecen con 'conectar_happy_eyeballs()', con
+ * 	un tiempo límite, y el nombre se resuelve con un resolutor con caché.
+ * - Antes de entregar una conexión inactiva se revisa que siga sana: que el
+ * 	servidor no la haya cerrado, que no tenga datos pendientes y que no haya
+ * 	excedido el tiempo máximo de inactividad.
+ * - Cada destino puede tener a lo más 'max_por_destino' conexiones(en uso o
+ * 	inactivas); al llegar al límite 'tomar_conexion()' falla con EAGAIN.
+ * - El pool puede usarse desde varios hilos.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_POOL_CONEXIONES_H_
+#define FUNCIONES_POOL_CONEXIONES_H_
+
+#include <pthread.h>
+
+#include "funciones_sockets.h"
+#include "funciones_resolucion.h"
+#include "funciones_conexion.h"
+
+// conexiones por destino por defecto
+const int kMaxPorDestino = 8;
+// tiempo máximo que una conexión puede estar inactiva en el pool
+const int kMaxInactivaMs = 30000;
+
+typedef struct Conexion_pool {
+    int ocupada;  // 1 si la entrada tiene una conexión(o se está creando)
+    int en_uso;  // 1 si la tiene un usuario del pool
+    int descriptor;  // -1 mientras se conecta
+    char host[256];
+    char puerto[32];
+    struct timespec ultimo_uso;
+    unsigned long usos;
+} Conexion_pool;
+
+typedef struct Pool_conexiones {
+    Conexion_pool *conexiones;
+    int capacidad;
+    int max_por_destino;
+    int limite_conexion_ms;  // tiempo máximo para establecer una conexión
+    int max_inactiva_ms;
+    Resolutor_dns *resolutor;
+    pthread_mutex_t candado;
+    unsigned long nuevas;  // conexiones establecidas
+    unsigned long reutilizadas;  // entregas de conexiones existentes
+    unsigned long descartadas;  // conexiones inactivas que no estaban sanas
+    unsigned long fallidas;  // conexiones que no se pudieron establecer
+} Pool_conexiones;
+
+/* Prototipos */
+
+int crear_pool_conexiones(Pool_conexiones *pool, int capacidad,
+        int max_por_destino, int limite_conexion_ms, Resolutor_dns *resolutor);
+void destruir_pool_conexiones(Pool_conexiones *pool);
+int revisar_conexion_inactiva(Pool_conexiones *pool, Conexion_pool *conexion);
+void descartar_conexion_pool(Conexion_pool *conexion);
+int tomar_conexion(Pool_conexiones *pool, const char *host, const char *puerto);
+void devolver_conexion(Pool_conexiones *pool, int descriptor, int reutilizable);
+void limpiar_pool_conexiones(Pool_conexiones *pool);
+
+/* Funciones */
+
+/**
+ * Inicializa un pool vacío.
+ *
+ * @param pool pool a inicializar
+ * @param capacidad número máximo de conexiones del pool(todos los destinos)
+ * @param max_por_destino número máximo de conexiones por destino
+ * @param limite_conexion_ms tiempo máximo para establecer una conexión
+ * @param resolutor resolutor para los nombres de los destinos
+ *
+ * @return 0 en caso de éxito, -1 si no hay memoria
+ */
+int crear_pool_conexiones(Pool_conexiones *pool, int capacidad,
+        int max_por_destino, int limite_conexion_ms, Resolutor_dns *resolutor) {
+    int i;
+
+    memset(pool, 0, sizeof(Pool_conexiones));
+    pool->conexiones = (Conexion_pool*)calloc(capacidad, sizeof(Conexion_pool));
+    if (pool->conexiones == NULL) {
+        fprintf(stderr,"\nError al reservar memoria para el pool de conexiones\n");
+        return -1;
+    }
+    for (i = 0; i < capacidad; i++) {
+        pool->conexiones[i].descriptor = -1;
+    }
+    pool->capacidad = capacidad;
+    pool->max_por_destino = max_por_destino;
+    pool->limite_conexion_ms = limite_conexion_ms;
+    pool->max_inactiva_ms = kMaxInactivaMs;
+    pool->resolutor = resolutor;
+    pthread_mutex_init(&pool->candado, NULL);
+
+    return 0;
+}
+
+/**
+ * Cierra todas las conexiones del pool, incluso las que están en uso, y
+ * libera su memoria.
+ *
+ * @param pool pool a destruir
+ */
+void destruir_pool_conexiones(Pool_conexiones *pool) {
+    int i;
+    for (i = 0; i < pool->capacidad; i++) {
+        descartar_conexion_pool(&pool->conexiones[i]);
+    }
+    free(pool->conexiones);
+    pool->conexiones = NULL;
+    pool->capacidad = 0;
+    pthread_mutex_destroy(&pool->candado);
+}
+
+/**
+ * Revisa, sin bloquear, que una conexión inactiva pueda reutilizarse: no debe
+ * haber excedido el tiempo de inactividad, ni tener errores, ni haber sido
+ * cerrada por el servidor, ni tener datos sin leer(que pertenecerían a una
+ * petición anterior).
+ *
+ * @param pool pool de la conexión
+ * @param conexion conexión inactiva
+ *
+ * @return 1 si está sana, 0 si debe descartarse
+ */
+int revisar_conexion_inactiva(Pool_conexiones *pool, Conexion_pool *conexion) {
+    char byte;
+
+    if (calcular_ms_transcurridos(&conexion->ultimo_uso) >
+            pool->max_inactiva_ms) {
+        return 0;
+    }
+    int res = esperar_descriptor(conexion->descriptor, POLLIN, 0);
+    if (res == 0) {
+        return 1;
+    }
+    // legible: el servidor cerró(0), hay un error(-1) o datos inesperados
+    return res == 1 && recv(conexion->descriptor, &byte, 1,
+        MSG_PEEK | MSG_DONTWAIT) == -1 && (errno == EAGAIN ||
+        errno == EWOULDBLOCK);
+}
+
+/**
+ * Cierra la conexión de una entrada y la deja libre.
+ *
+ * @param conexion entrada del pool
+ */
+void descartar_conexion_pool(Conexion_pool *conexion) {
+    if (conexion->descriptor != -1) {
+        close(conexion->descriptor);
+    }
+    memset(conexion, 0, sizeof(Conexion_pool));
+    conexion->descriptor = -1;
+}
+
+/**
+ * Obtiene una conexión con el destino: reutiliza una inactiva sana o, si no
+ * hay y no se ha llegado al límite del destino, establece una nueva. La
+ * conexión debe regresarse con 'devolver_conexion()'.
+ *
+ * @param pool pool de conexiones
+ * @param host nombre o dirección del servidor
+ * @param puerto número o nombre del servicio
+ *
+ * @return descriptor del socket conectado(bloqueante), -1 en caso de error
+ *         (EAGAIN si se llegó al límite del destino o del pool, ETIMEDOUT si
+ *         no se conectó a tiempo)
+ */
+int tomar_conexion(Pool_conexiones *pool, const char *host,
+        const char *puerto) {
+    Intento_conexion intentos[kMaxIntentosConexion];
+    struct addrinfo *direcciones;
+    Conexion_pool *libre = NULL, *conexion;
+    int i, num_destino = 0, num_intentos, error;
+
+    if (strlen(host) >= sizeof(libre->host) ||
+            strlen(puerto) >= sizeof(libre->puerto)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&pool->candado);
+    for (i = 0; i < pool->capacidad; i++) {
+        conexion = &pool->conexiones[i];
+        if (!conexion->ocupada) {
+            libre = libre == NULL ? conexion : libre;
+            continue;
+        }
+        if (strcmp(conexion->host, host) != 0 ||
+                strcmp(conexion->puerto, puerto) != 0) {
+            continue;
+        }
+        if (!conexion->en_uso && conexion->descriptor != -1) {
+            if (revisar_conexion_inactiva(pool, conexion)) {
+                conexion->en_uso = 1;
+                conexion->usos++;
+                pool->reutilizadas++;
+                pthread_mutex_unlock(&pool->candado);
+                return conexion->descriptor;
+            }
+            descartar_conexion_pool(conexion);
+            pool->descartadas++;
+            libre = libre == NULL ? conexion : libre;
+            continue;
+        }
+        num_destino++;
+    }
+    if (libre == NULL || num_destino >= pool->max_por_destino) {
+        pthread_mutex_unlock(&pool->candado);
+        errno = EAGAIN;
+        return -1;
+    }
+    // la entrada se reserva y la conexión se establece sin el candado
+    libre->ocupada = 1;
+    libre->en_uso = 1;
+    strcpy(libre->host, host);
+    strcpy(libre->puerto, puerto);
+    pthread_mutex_unlock(&pool->candado);
+
+    int descriptor = -1;
+    error = resolver_direccion(pool->resolutor, host, puerto, SOCK_STREAM,
+        &direcciones);
+    if (error == 0) {
+        descriptor = conectar_happy_eyeballs(direcciones,
+            pool->limite_conexion_ms, intentos, &num_intentos);
+        error = errno;
+        soltar_direccion(pool->resolutor, direcciones);
+    } else {
+        error = EHOSTUNREACH;
+    }
+
+    pthread_mutex_lock(&pool->candado);
+    if (descriptor == -1) {
+        descartar_conexion_pool(libre);
+        pool->fallidas++;
+    } else {
+        libre->descriptor = descriptor;
+        libre->usos = 1;
+        pool->nuevas++;
+    }
+    pthread_mutex_unlock(&pool->candado);
+
+    errno = error;
+    return descriptor;
+}
+
+/**
+ * Regresa al pool una conexión obtenida con 'tomar_conexion()'.
+ *
+ * @param pool pool de conexiones
+ * @param descriptor socket de la conexión
+ * @param reutilizable 1 si la conexión quedó lista para otra petición, 0 si
+ *                     debe cerrarse(por ejemplo tras un error)
+ */
+void devolver_conexion(Pool_conexiones *pool, int descriptor,
+        int reutilizable) {
+    int i;
+
+    pthread_mutex_lock(&pool->candado);
+    for (i = 0; i < pool->capacidad; i++) {
+        Conexion_pool *conexion = &pool->conexiones[i];
+        if (conexion->ocupada && conexion->en_uso &&
+                conexion->descriptor == descriptor) {
+            if (reutilizable) {
+                conexion->en_uso = 0;
+                clock_gettime(CLOCK_MONOTONIC, &conexion->ultimo_uso);
+            } else {
+                descartar_conexion_pool(conexion);
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool->candado);
+}
+
+/**
+ * Cierra las conexiones inactivas que ya no están sanas. Puede llamarse
+ * periódicamente para no mantener sockets que el servidor ya cerró.
+ *
+ * @param pool pool de conexiones
+ */
+void limpiar_pool_conexiones(Pool_conexiones *pool) {
+    int i;
+
+    pthread_mutex_lock(&pool->candado);
+    for (i = 0; i < pool->capacidad; i++) {
+        Conexion_pool *conexion = &pool->conexiones[i];
+        if (conexion->ocupada && !conexion->en_uso &&
+                conexion->descriptor != -1 &&
+                !revisar_conexion_inactiva(pool, conexion)) {
+            descartar_conexion_pool(conexion);
+            pool->descartadas++;
+        }
+    }
+    pthread_mutex_unlock(&pool->candado);
+}
+
+#endif  // FUNCIONES_POOL_CONEXIONES_H_
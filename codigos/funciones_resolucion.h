@@ -0,0 +1,555 @@
+/**
+ * Funciones para resolver nombres con caché y de forma asíncrona
+ *
+ * 'getaddrinfo()' bloquea al proceso mientras consulta al DNS. Un 'resolutor'
+ * guarda los resultados en un caché con tiempo de vida(TTL), de modo que los
+ * clientes que se conectan muchas veces al mismo nombre sólo lo resuelven una
+ * vez, y puede resolver en un hilo propio notificando el resultado con una
+ * función('callback').
+ *
+ * Notas:
+ * - Las listas de direcciones que entrega el resolutor pertenecen al caché:
+ * 	no se liberan con 'freeaddrinfo()' sino con 'soltar_direccion()'. Una
+ * 	entrada vencida se libera cuando nadie la usa.
+ * - 'getaddrinfo()' no informa el TTL de los registros, por lo que se usa
+ * 	'kTtlDns'. Los errores también se guardan('kTtlDnsNegativo'), así un
+ * 	nombre inexistente no se consulta en cada intento.
+ * - La función que resuelve es configurable. 'resolver_con_archivo_hosts()'
+ * 	busca los nombres en un archivo con el formato de '/etc/hosts', sin
+ * 	consultar la red, para pruebas sin conexión.
+ *
+ * Para más información consultar 'man 3 getaddrinfo' y 'man 5 hosts'.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_RESOLUCION_H_
+#define FUNCIONES_RESOLUCION_H_
+
+#include <pthread.h>
+#include <strings.h>  // 'strcasecmp()'
+#include <time.h>  // 'clock_gettime()'
+
+#include "funciones_sockets.h"
+
+// número de entradas del caché
+const int kMaxEntradasDns = 64;
+// segundos que se conserva un resultado exitoso
+const int kTtlDns = 60;
+// segundos que se conserva un error
+const int kTtlDnsNegativo = 5;
+// solicitudes asíncronas que pueden esperar en cola
+const int kMaxSolicitudesDns = 64;
+
+// función que resuelve un nombre, con la misma firma que 'getaddrinfo()'
+typedef int (*Funcion_resolucion)(const char *host, const char *puerto,
+        const struct addrinfo *referencia, struct addrinfo **resultado);
+
+// función que recibe el resultado de una resolución asíncrona. Se llama desde
+// el hilo del resolutor; si 'error' es 0 debe llamar a 'soltar_direccion()'
+typedef void (*Al_resolver)(int error, struct addrinfo *direcciones,
+        void *datos);
+
+typedef struct Entrada_dns {
+    int ocupada;
+    int vencida;  // ya no se entrega, se libera al quedar sin referencias
+    char host[256];
+    char puerto[32];
+    int familia;
+    int tipo_socket;
+    struct addrinfo *direcciones;  // 'NULL' si la resolución falló
+    int error;  // código de 'getaddrinfo()', 0 en caso de éxito
+    int referencias;  // usuarios que aún no llaman a 'soltar_direccion()'
+    time_t expira;  // segundos del reloj monotónico
+    unsigned long ultimo_uso;
+} Entrada_dns;
+
+typedef struct Solicitud_dns {
+    char host[256];
+    char puerto[32];
+    int tipo_socket;
+    Al_resolver al_resolver;
+    void *datos;
+} Solicitud_dns;
+
+typedef struct Resolutor_dns {
+    Funcion_resolucion resolver;
+    Entrada_dns *entradas;
+    Solicitud_dns *solicitudes;  // cola circular
+    int inicio;
+    int num_solicitudes;
+    pthread_mutex_t candado;
+    pthread_cond_t condicion;
+    pthread_t hilo;
+    int hilo_activo;
+    int activo;  // 0 para terminar el hilo
+    unsigned long reloj;  // contador para elegir la entrada menos usada
+    unsigned long aciertos;
+    unsigned long fallos;
+} Resolutor_dns;
+
+// archivo con formato '/etc/hosts' usado por 'resolver_con_archivo_hosts()'
+const char *archivo_hosts = "/etc/hosts";
+
+/* Prototipos */
+
+int crear_resolutor(Resolutor_dns *resolutor, Funcion_resolucion resolver,
+        int asincrono);
+void destruir_resolutor(Resolutor_dns *resolutor);
+time_t obtener_segundos_monotonicos();
+Entrada_dns* buscar_entrada_dns(Resolutor_dns *resolutor, const char *host,
+        const char *puerto, int familia, int tipo_socket);
+Entrada_dns* guardar_entrada_dns(Resolutor_dns *resolutor, const char *host,
+        const char *puerto, int familia, int tipo_socket,
+        struct addrinfo *direcciones, int error);
+int resolver_direccion(Resolutor_dns *resolutor, const char *host,
+        const char *puerto, int tipo_socket, struct addrinfo **direcciones);
+void soltar_direccion(Resolutor_dns *resolutor, struct addrinfo *direcciones);
+int resolver_direccion_async(Resolutor_dns *resolutor, const char *host,
+        const char *puerto, int tipo_socket, Al_resolver al_resolver,
+        void *datos);
+void* ejecutar_resolutor(void *argumento);
+int resolver_con_archivo_hosts(const char *host, const char *puerto,
+        const struct addrinfo *referencia, struct addrinfo **resultado);
+
+/* Funciones */
+
+/**
+ * Inicializa un resolutor con el caché vacío.
+ *
+ * @param resolutor resolutor a inicializar
+ * @param resolver función que resuelve los nombres, 'NULL' para usar
+ *                 'getaddrinfo()'
+ * @param asincrono 1 para crear el hilo que atiende
+ *                  'resolver_direccion_async()'
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int crear_resolutor(Resolutor_dns *resolutor, Funcion_resolucion resolver,
+        int asincrono) {
+    memset(resolutor, 0, sizeof(Resolutor_dns));
+    resolutor->resolver = resolver != NULL ? resolver : getaddrinfo;
+    resolutor->entradas = (Entrada_dns*)calloc(kMaxEntradasDns,
+        sizeof(Entrada_dns));
+    resolutor->solicitudes = (Solicitud_dns*)calloc(kMaxSolicitudesDns,
+        sizeof(Solicitud_dns));
+    if (resolutor->entradas == NULL || resolutor->solicitudes == NULL) {
+        fprintf(stderr,"\nError al reservar memoria para el resolutor\n");
+        free(resolutor->entradas);
+        free(resolutor->solicitudes);
+        return -1;
+    }
+    pthread_mutex_init(&resolutor->candado, NULL);
+    pthread_cond_init(&resolutor->condicion, NULL);
+
+    resolutor->activo = 1;
+    if (asincrono) {
+        if (pthread_create(&resolutor->hilo, NULL, ejecutar_resolutor,
+                resolutor) != 0) {
+            fprintf(stderr,"\nError al crear hilo del resolutor\n");
+            destruir_resolutor(resolutor);
+            return -1;
+        }
+        resolutor->hilo_activo = 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Termina el hilo del resolutor(las solicitudes en cola se descartan) y
+ * libera el caché. Las direcciones entregadas dejan de ser válidas.
+ *
+ * @param resolutor resolutor a destruir
+ */
+void destruir_resolutor(Resolutor_dns *resolutor) {
+    int i;
+
+    if (resolutor->hilo_activo) {
+        pthread_mutex_lock(&resolutor->candado);
+        resolutor->activo = 0;
+        pthread_cond_signal(&resolutor->condicion);
+        pthread_mutex_unlock(&resolutor->candado);
+        pthread_join(resolutor->hilo, NULL);
+        resolutor->hilo_activo = 0;
+    }
+    if (resolutor->entradas != NULL) {
+        for (i = 0; i < kMaxEntradasDns; i++) {
+            if (resolutor->entradas[i].direcciones != NULL) {
+                freeaddrinfo(resolutor->entradas[i].direcciones);
+            }
+        }
+    }
+    free(resolutor->entradas);
+    free(resolutor->solicitudes);
+    resolutor->entradas = NULL;
+    resolutor->solicitudes = NULL;
+    pthread_cond_destroy(&resolutor->condicion);
+    pthread_mutex_destroy(&resolutor->candado);
+}
+
+/**
+ * Obtiene los segundos del reloj monotónico, que no cambia si se ajusta la
+ * hora del sistema.
+ *
+ * @return segundos desde un punto arbitrario
+ */
+time_t obtener_segundos_monotonicos() {
+    struct timespec ahora;
+    clock_gettime(CLOCK_MONOTONIC, &ahora);
+    return ahora.tv_sec;
+}
+
+/**
+ * Busca una entrada vigente del caché. Las entradas vencidas encontradas se
+ * marcan y, si nadie las usa, se liberan. Debe llamarse con el candado
+ * tomado.
+ *
+ * @param resolutor resolutor con el caché
+ * @param host nombre o dirección
+ * @param puerto número o nombre del servicio
+ * @param familia AF_INET o AF_INET6
+ * @param tipo_socket SOCK_STREAM o SOCK_DGRAM
+ *
+ * @return entrada vigente, 'NULL' si no existe
+ */
+Entrada_dns* buscar_entrada_dns(Resolutor_dns *resolutor, const char *host,
+        const char *puerto, int familia, int tipo_socket) {
+    time_t ahora = obtener_segundos_monotonicos();
+    int i;
+
+    for (i = 0; i < kMaxEntradasDns; i++) {
+        Entrada_dns *entrada = &resolutor->entradas[i];
+        if (!entrada->ocupada || entrada->vencida ||
+                entrada->familia != familia ||
+                entrada->tipo_socket != tipo_socket ||
+                strcmp(entrada->host, host) != 0 ||
+                strcmp(entrada->puerto, puerto) != 0) {
+            continue;
+        }
+        if (ahora < entrada->expira) {
+            entrada->ultimo_uso = ++resolutor->reloj;
+            return entrada;
+        }
+        entrada->vencida = 1;
+        if (entrada->referencias == 0) {
+            if (entrada->direcciones != NULL) {
+                freeaddrinfo(entrada->direcciones);
+            }
+            memset(entrada, 0, sizeof(Entrada_dns));
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Guarda el resultado de una resolución en una entrada libre o, si no hay, en
+ * la menos usada recientemente que nadie esté usando. Debe llamarse con el
+ * candado tomado.
+ *
+ * @param resolutor resolutor con el caché
+ * @param host nombre o dirección
+ * @param puerto número o nombre del servicio
+ * @param familia AF_INET o AF_INET6
+ * @param tipo_socket SOCK_STREAM o SOCK_DGRAM
+ * @param direcciones resultado de la resolución, 'NULL' en caso de error
+ * @param error código de 'getaddrinfo()'
+ *
+ * @return entrada guardada, 'NULL' si el caché está lleno de entradas en uso
+ *         o el nombre es demasiado largo
+ */
+Entrada_dns* guardar_entrada_dns(Resolutor_dns *resolutor, const char *host,
+        const char *puerto, int familia, int tipo_socket,
+        struct addrinfo *direcciones, int error) {
+    Entrada_dns *elegida = NULL;
+    int i;
+
+    if (strlen(host) >= sizeof(elegida->host) ||
+            strlen(puerto) >= sizeof(elegida->puerto)) {
+        return NULL;
+    }
+    for (i = 0; i < kMaxEntradasDns; i++) {
+        Entrada_dns *entrada = &resolutor->entradas[i];
+        if (!entrada->ocupada) {
+            elegida = entrada;
+            break;
+        }
+        if (entrada->referencias == 0 && (elegida == NULL ||
+                entrada->ultimo_uso < elegida->ultimo_uso)) {
+            elegida = entrada;
+        }
+    }
+    if (elegida == NULL) {
+        return NULL;
+    }
+    if (elegida->direcciones != NULL) {
+        freeaddrinfo(elegida->direcciones);
+    }
+
+    memset(elegida, 0, sizeof(Entrada_dns));
+    elegida->ocupada = 1;
+    strcpy(elegida->host, host);
+    strcpy(elegida->puerto, puerto);
+    elegida->familia = familia;
+    elegida->tipo_socket = tipo_socket;
+    elegida->direcciones = direcciones;
+    elegida->error = error;
+    elegida->expira = obtener_segundos_monotonicos() +
+        (error == 0 ? kTtlDns : kTtlDnsNegativo);
+    elegida->ultimo_uso = ++resolutor->reloj;
+
+    return elegida;
+}
+
+/**
+ * Resuelve un nombre usando el caché; si no está, lo resuelve(bloqueando) y
+ * guarda el resultado. Las restricciones son las de
+ * 'crear_estructura_referencia()'.
+ *
+ * Igual que en 'obtener_direccion()', un host "unix:/ruta" no se resuelve: se
+ * crea la dirección del socket de dominio Unix sin usar el caché.
+ *
+ * @param resolutor resolutor con el caché
+ * @param host nombre o dirección del host
+ * @param puerto número o nombre del servicio
+ * @param tipo_socket SOCK_STREAM o SOCK_DGRAM
+ * @param direcciones donde se guarda la lista de direcciones, que debe
+ *                    liberarse con 'soltar_direccion()'
+ *
+ * @return 0 en caso de éxito, código de error de 'getaddrinfo()'(ver
+ *         'gai_strerror()') en otro caso
+ */
+int resolver_direccion(Resolutor_dns *resolutor, const char *host,
+        const char *puerto, int tipo_socket, struct addrinfo **direcciones) {
+    struct addrinfo referencia;
+    Entrada_dns *entrada;
+    int error;
+
+    llenar_estructura_referencia(&referencia, tipo_socket);
+    *direcciones = NULL;
+
+    // la lista no queda en el caché, 'soltar_direccion()' la libera
+    if (es_direccion_unix(host)) {
+        *direcciones = crear_direccion_unix(host, tipo_socket);
+        return *direcciones == NULL ? EAI_SYSTEM : 0;
+    }
+
+    pthread_mutex_lock(&resolutor->candado);
+    entrada = buscar_entrada_dns(resolutor, host, puerto, referencia.ai_family,
+        tipo_socket);
+    if (entrada != NULL) {
+        resolutor->aciertos++;
+        error = entrada->error;
+        if (error == 0) {
+            entrada->referencias++;
+            *direcciones = entrada->direcciones;
+        }
+        pthread_mutex_unlock(&resolutor->candado);
+        return error;
+    }
+    resolutor->fallos++;
+    pthread_mutex_unlock(&resolutor->candado);
+
+    // la consulta se hace sin el candado, así no bloquea a otros hilos
+    error = resolutor->resolver(host, puerto, &referencia, direcciones);
+    if (error != 0) {
+        *direcciones = NULL;
+    }
+
+    pthread_mutex_lock(&resolutor->candado);
+    entrada = buscar_entrada_dns(resolutor, host, puerto, referencia.ai_family,
+        tipo_socket);
+    if (entrada != NULL) {
+        // otro hilo resolvió el mismo nombre mientras tanto
+        if (*direcciones != NULL) {
+            freeaddrinfo(*direcciones);
+        }
+        *direcciones = NULL;
+        error = entrada->error;
+    } else {
+        entrada = guardar_entrada_dns(resolutor, host, puerto,
+            referencia.ai_family, tipo_socket, *direcciones, error);
+    }
+    if (entrada != NULL && error == 0) {
+        entrada->referencias++;
+        *direcciones = entrada->direcciones;
+    }
+    pthread_mutex_unlock(&resolutor->candado);
+
+    // si no cupo en el caché la lista es sólo del llamador, y
+    // 'soltar_direccion()' la liberará
+    return error;
+}
+
+/**
+ * Indica que ya no se usa una lista de direcciones obtenida del resolutor.
+ *
+ * @param resolutor resolutor que entregó la lista
+ * @param direcciones lista de direcciones
+ */
+void soltar_direccion(Resolutor_dns *resolutor, struct addrinfo *direcciones) {
+    int i;
+
+    if (direcciones == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&resolutor->candado);
+    for (i = 0; i < kMaxEntradasDns; i++) {
+        Entrada_dns *entrada = &resolutor->entradas[i];
+        if (entrada->ocupada && entrada->direcciones == direcciones) {
+            entrada->referencias--;
+            if (entrada->vencida && entrada->referencias == 0) {
+                freeaddrinfo(entrada->direcciones);
+                memset(entrada, 0, sizeof(Entrada_dns));
+            }
+            pthread_mutex_unlock(&resolutor->candado);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&resolutor->candado);
+    freeaddrinfo(direcciones);
+}
+
+/**
+ * Agrega una solicitud de resolución a la cola del hilo del resolutor. Al
+ * terminar se llama a 'al_resolver' desde ese hilo.
+ *
+ * @param resolutor resolutor creado con 'asincrono' igual a 1
+ * @param host nombre o dirección del host
+ * @param puerto número o nombre del servicio
+ * @param tipo_socket SOCK_STREAM o SOCK_DGRAM
+ * @param al_resolver función que recibirá el resultado
+ * @param datos apuntador que se pasa a 'al_resolver'
+ *
+ * @return 0 si se agregó la solicitud, -1 si la cola está llena, el nombre es
+ *         demasiado largo o el resolutor no es asíncrono
+ */
+int resolver_direccion_async(Resolutor_dns *resolutor, const char *host,
+        const char *puerto, int tipo_socket, Al_resolver al_resolver,
+        void *datos) {
+    Solicitud_dns *solicitud;
+
+    if (!resolutor->hilo_activo || strlen(host) >= sizeof(solicitud->host) ||
+            strlen(puerto) >= sizeof(solicitud->puerto)) {
+        return -1;
+    }
+    pthread_mutex_lock(&resolutor->candado);
+    if (resolutor->num_solicitudes == kMaxSolicitudesDns) {
+        pthread_mutex_unlock(&resolutor->candado);
+        return -1;
+    }
+    solicitud = &resolutor->solicitudes[(resolutor->inicio +
+        resolutor->num_solicitudes) % kMaxSolicitudesDns];
+    strcpy(solicitud->host, host);
+    strcpy(solicitud->puerto, puerto);
+    solicitud->tipo_socket = tipo_socket;
+    solicitud->al_resolver = al_resolver;
+    solicitud->datos = datos;
+    resolutor->num_solicitudes++;
+    pthread_cond_signal(&resolutor->condicion);
+    pthread_mutex_unlock(&resolutor->candado);
+
+    return 0;
+}
+
+/**
+ * Función del hilo del resolutor: atiende las solicitudes de la cola en orden
+ * hasta que se destruye el resolutor.
+ *
+ * @param argumento resolutor
+ */
+void* ejecutar_resolutor(void *argumento) {
+    Resolutor_dns *resolutor = (Resolutor_dns*)argumento;
+    Solicitud_dns solicitud;
+    struct addrinfo *direcciones;
+    int error;
+
+    pthread_mutex_lock(&resolutor->candado);
+    while (resolutor->activo) {
+        if (resolutor->num_solicitudes == 0) {
+            pthread_cond_wait(&resolutor->condicion, &resolutor->candado);
+            continue;
+        }
+        solicitud = resolutor->solicitudes[resolutor->inicio];
+        resolutor->inicio = (resolutor->inicio + 1) % kMaxSolicitudesDns;
+        resolutor->num_solicitudes--;
+        pthread_mutex_unlock(&resolutor->candado);
+
+        error = resolver_direccion(resolutor, solicitud.host, solicitud.puerto,
+            solicitud.tipo_socket, &direcciones);
+        solicitud.al_resolver(error, direcciones, solicitud.datos);
+
+        pthread_mutex_lock(&resolutor->candado);
+    }
+    pthread_mutex_unlock(&resolutor->candado);
+
+    return NULL;
+}
+
+/**
+ * Resuelve un nombre buscándolo en 'archivo_hosts'(formato de '/etc/hosts':
+ * una dirección seguida de sus nombres por línea, '#' inicia un comentario),
+ * sin consultar la red. Las direcciones numéricas se convierten directamente.
+ * Si el nombre aparece en varias líneas se regresan todas sus direcciones.
+ * Tiene la misma firma que 'getaddrinfo()' para usarse como resolver de
+ * 'crear_resolutor()'.
+ *
+ * @param host nombre a buscar
+ * @param puerto número o nombre del servicio
+ * @param referencia restricciones, como en 'getaddrinfo()'
+ * @param resultado donde se guarda la lista de direcciones
+ *
+ * @return 0 en caso de éxito, código de error de 'getaddrinfo()' en otro caso
+ */
+int resolver_con_archivo_hosts(const char *host, const char *puerto,
+        const struct addrinfo *referencia, struct addrinfo **resultado) {
+    struct addrinfo numerica = *referencia;
+    char linea[1024];
+    char *guardado, *ip, *nombre;
+    struct addrinfo *nuevas, **ultima = resultado;
+    int error = EAI_NONAME;
+
+    // sólo se aceptan direcciones numéricas, así nunca se consulta al DNS
+    numerica.ai_flags |= AI_NUMERICHOST;
+    if (host == NULL) {
+        return getaddrinfo(NULL, puerto, &numerica, resultado);
+    }
+    if (getaddrinfo(host, puerto, &numerica, resultado) == 0) {
+        return 0;
+    }
+
+    FILE *archivo = fopen(archivo_hosts, "r");
+    if (archivo == NULL) {
+        return EAI_SYSTEM;
+    }
+    *resultado = NULL;
+    while (fgets(linea, sizeof(linea), archivo) != NULL) {
+        linea[strcspn(linea, "#\r\n")] = '\0';  // descarta el comentario
+        if ((ip = strtok_r(linea, " \t", &guardado)) == NULL) {
+            continue;
+        }
+        while ((nombre = strtok_r(NULL, " \t", &guardado)) != NULL) {
+            if (strcasecmp(nombre, host) != 0) {
+                continue;
+            }
+            // el nombre puede aparecer en varias líneas(por ejemplo una por
+            // familia): las direcciones de todas se encadenan en orden.
+            // 'freeaddrinfo()' libera cada elemento de la lista por separado
+            if (getaddrinfo(ip, puerto, &numerica, &nuevas) == 0) {
+                *ultima = nuevas;
+                while (nuevas->ai_next != NULL) {
+                    nuevas = nuevas->ai_next;
+                }
+                ultima = &nuevas->ai_next;
+                error = 0;
+            }
+            break;
+        }
+    }
+    fclose(archivo);
+
+    return error;
+}
+
+#endif  // FUNCIONES_RESOLUCION_H_
@@ -7,6 +7,24 @@
  * Notas:
  * - Para especificar la familia de direcciones a utilizar, se indica AF_INET
  * 	para IPv4 o AF_INET6 para IPv6
+ * - Las funciones de envío y recepción registran sus llamadas, bytes,
+ * 	errores y(opcionalmente) latencias por hilo, ver
+ * 	'funciones_estadisticas.h'.
+ * - 'crear_socket()' aplica al socket los ajustes del proceso(perfil y
+ * 	opciones como TCP_NODELAY o SO_SNDBUF), ver 'funciones_ajustes.h'.
+ * - Con 'kAMBAS' un servidor puede atender ambas familias de dos formas: un
+ * 	socket por cada dirección propia('inicializar_servidores()', IPv6 con
+ * 	IPV6_V6ONLY) o un solo socket IPv6 que también recibe IPv4 como
+ * 	direcciones mapeadas ::ffff:a.b.c.d('inicializar_servidor()').
+ * - Una dirección "unix:/ruta"(o "unix:@nombre" en el espacio abstracto) en
+ * 	lugar de host(cliente) o de puerto(servidor) usa un socket de dominio
+ * 	Unix(AF_UNIX) del mismo tipo: SOCK_STREAM, SOCK_DGRAM o SOCK_SEQPACKET.
+ * 	'obtener_direccion()' regresa un 'addrinfo' como el de 'getaddrinfo()',
+ * 	así el resto de las funciones(crear, asociar, conectar, enviar, recibir)
+ * 	se usan sin cambios. Los clientes de datagramas deben llamar a
+ * 	'asociar_unix_automatico()' para poder recibir respuestas.
+ * - Ninguna función termina el proceso: en caso de error muestran el motivo
+ * 	y regresan -1(o 'NULL'); el programa decide si termina o reintenta.
  * - Para construir esta libería se usó como referencia el documento:
  * "Beej's Guide to Network Programming"
  *
@@ -17,23 +35,48 @@
 #ifndef FUNCIONES_SOCKETS_H_
 #define FUNCIONES_SOCKETS_H_
 
+// habilita 'accept4()', 'recvmmsg()', etc. Si el programa incluye antes otros
+// encabezados del sistema debe definirla al inicio de su código fuente
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>  // variable error
 #include <sys/types.h>
+#include <stddef.h>  // 'offsetof()'
 #include <sys/socket.h>
+#include <sys/un.h>  // 'sockaddr_un'
+#include <sys/stat.h>  // 'stat()'
 #include <arpa/inet.h>  // nuevas funciones e IPv6
 #include <netdb.h>  // para 'getaddrinfo()'
 #include <unistd.h>  // para 'close()'
+#include <fcntl.h>  // para 'fcntl()'
+#include <poll.h>  // para 'poll()'
+
+#include "funciones_estadisticas.h"
+#include "funciones_ajustes.h"
 
 
 // 'mensaje' usado para mostrar en salida el tipo de dirección
 const char *kMensajeIPV4 = "IPv4";
 const char *kMensajeIPV6 = "IPv6";
+const char *kMensajeAmbas = "IPv4 e IPv6";
+const char *kMensajeUnix = "Unix";
+
+// prefijo de las direcciones de sockets de dominio Unix
+const char *kPrefijoUnix = "unix:";
+
+// número máximo de datagramas que se reciben o envían en una sola llamada
+const int kMaxLote = 64;
+// número máximo de sockets que escuchan en un servidor(uno por dirección)
+enum {kMaxEscucha = 8};
 
 // 'códigos' que indican la familia de direcciones a usar para la comunicación
-typedef enum {kIPV4, kIPV6} Familia_direcciones;
+// 'kAMBAS'(AF_UNSPEC) obtiene direcciones de las dos familias
+typedef enum {kIPV4, kIPV6, kAMBAS} Familia_direcciones;
 // familia de direcciones que se usará por defecto
 Familia_direcciones familia_direcciones =  kIPV4;
 
@@ -42,18 +85,42 @@ Familia_direcciones familia_direcciones =  kIPV4;
 extern inline void clear_buffer();
 void* extraer_direccion_sockaddr(const struct sockaddr *sa);
 const char* obtener_direccion_imprimible(const struct sockaddr *sa);
+const char* escribir_direccion_imprimible(const struct sockaddr *sa, char *ip,
+        size_t tam_ip);
+int es_direccion_unix(const char *direccion);
+struct addrinfo* crear_direccion_unix(const char *direccion, int tipo_socket);
+int asociar_unix_automatico(int descriptor);
+void completar_direccion_unix(struct sockaddr_storage *direccion,
+        socklen_t tam_direccion);
+int eliminar_socket_unix_abandonado(const struct addrinfo *info_direccion);
+int cerrar_socket_servidor(int descriptor);
 struct addrinfo* crear_estructura_referencia(int tipo_socket);
+void llenar_estructura_referencia(struct addrinfo *referencia, int tipo_socket);
 struct addrinfo* obtener_direccion(const char *ip_host, const char *puerto,
         const struct addrinfo *referencia);
 int crear_socket(const struct addrinfo *info_direccion);
 int asociar_socket(int descriptor, const struct addrinfo *info_direccion);
 int inicializar_cliente(const char *ip_destino, const char *puerto,
         int tipo_socket, struct addrinfo **info_destino);
+int establecer_opcion_socket(int descriptor, int nivel, int opcion, int valor);
+int crear_socket_servidor(const struct addrinfo *info_direccion,
+        int compartido, int solo_ipv6);
 int inicializar_servidor(const char *puerto, int tipo_socket);
+int inicializar_servidor_compartido(const char *puerto, int tipo_socket);
+int inicializar_servidores(const char *puerto, int tipo_socket, int compartido,
+        int *descriptores, int max_descriptores);
+int establecer_no_bloqueante(int descriptor);
+int esperar_descriptor(int descriptor, short eventos, int milisegundos);
 int recibir_datos_dgram(int descriptor, char *buffer, int tam_buffer, int bandera,
        struct sockaddr *info_origen);
 int enviar_datos_dgram(int descriptor, struct addrinfo *info_destino,
        char *buffer, int tam_buffer, int bandera);
+socklen_t obtener_tam_sockaddr(const struct sockaddr *sa);
+int recibir_lote_dgram(int descriptor, char **buffers, int tam_buffer,
+       int *bytes_recibidos, struct sockaddr_storage *origenes,
+       int max_mensajes, int bandera);
+int enviar_lote_dgram(int descriptor, char **buffers, int *tam_buffers,
+       struct sockaddr_storage *destinos, int num_mensajes, int bandera);
 int conectar(int descriptor, struct addrinfo *info_direccion);
 int escuchar(int descriptor, int reserva);
 int aceptar(int descriptor, struct sockaddr *info_origen);
@@ -96,17 +163,228 @@ void* extraer_direccion_sockaddr(const struct sockaddr *sa) {
  *
  * Para más información consultar 'man 3 inet_ntop'.
  *
+ * La cadena se reserva con 'malloc()' y debe liberarse con 'free()'; para no
+ * reservar memoria por cada mensaje use 'escribir_direccion_imprimible()'.
+ *
  * @param sa estructura sockaddr con la información de la dirección
  *
- * @return cadena con la dirección ip
+ * @return cadena con la dirección ip, 'NULL' si no hay memoria o la dirección
+ *         es de otra familia
  */
 const char* obtener_direccion_imprimible(const struct sockaddr *sa) {
     char *ip = (char*)malloc(INET6_ADDRSTRLEN);
-    inet_ntop(sa->sa_family, extraer_direccion_sockaddr(&(*sa)), ip,
-        INET6_ADDRSTRLEN);
+    if (ip == NULL) {
+        fprintf(stderr, "\nError al reservar memoria para la dirección\n");
+        return NULL;
+    }
+    if (escribir_direccion_imprimible(sa, ip, INET6_ADDRSTRLEN) != ip) {
+        free(ip);  // se obtuvo "?", que no se puede liberar
+        return NULL;
+    }
     return ip;
 }
 
+/**
+ * Igual que 'obtener_direccion_imprimible()', pero escribe la dirección en un
+ * buffer del llamador(usualmente en la pila) en lugar de reservar memoria.
+ *
+ * @param sa estructura sockaddr con la información de la dirección
+ * @param ip buffer donde se escribe la cadena
+ * @param tam_ip tamaño del buffer, INET6_ADDRSTRLEN alcanza para ambas familias
+ *
+ * En sockets de dominio Unix se escribe "unix:/ruta", "unix:@nombre" o
+ * "unix:(sin nombre)"; una ruta larga se recorta al tamaño del buffer. Una
+ * dirección AF_UNSPEC(mensajes que no llegaron por la red, por ejemplo por
+ * memoria compartida) se escribe como "(local)".
+ *
+ * @return 'ip', o "?" si la dirección no cabe o es de otra familia
+ */
+const char* escribir_direccion_imprimible(const struct sockaddr *sa, char *ip,
+        size_t tam_ip) {
+    if (sa->sa_family == AF_UNIX) {
+        const char *ruta = ((const struct sockaddr_un*)sa)->sun_path;
+        if (ruta[0] != '\0') {
+            snprintf(ip, tam_ip, "%s%s", kPrefijoUnix, ruta);
+        } else if (ruta[1] != '\0') {
+            snprintf(ip, tam_ip, "%s@%s", kPrefijoUnix, ruta + 1);
+        } else {
+            snprintf(ip, tam_ip, "%s(sin nombre)", kPrefijoUnix);
+        }
+        return ip;
+    }
+    if (sa->sa_family == AF_UNSPEC) {
+        snprintf(ip, tam_ip, "(local)");
+        return ip;
+    }
+    if (inet_ntop(sa->sa_family, extraer_direccion_sockaddr(sa), ip, tam_ip)
+            == NULL) {
+        return "?";
+    }
+    return ip;
+}
+
+/**
+ * Indica si una dirección es de un socket de dominio Unix("unix:...").
+ *
+ * @param direccion host o puerto(puede ser 'NULL')
+ *
+ * @return 1 si empieza con 'kPrefijoUnix', 0 en otro caso
+ */
+int es_direccion_unix(const char *direccion) {
+    return direccion != NULL &&
+        strncmp(direccion, kPrefijoUnix, strlen(kPrefijoUnix)) == 0;
+}
+
+/**
+ * Crea una lista 'addrinfo'(de un solo nodo) para un socket de dominio Unix, a
+ * partir de "unix:/ruta" o "unix:@nombre"(espacio abstracto: no crea archivo
+ * y desaparece al cerrar el socket).
+ *
+ * El nodo y su 'sockaddr_un' se reservan en un solo bloque, igual que los de
+ * 'getaddrinfo()' en glibc, así la lista se libera con 'freeaddrinfo()' y
+ * puede guardarse en el caché del resolutor.
+ *
+ * Para más información consulte 'man 7 unix'.
+ *
+ * @param direccion dirección con el prefijo 'kPrefijoUnix'
+ * @param tipo_socket SOCK_STREAM, SOCK_DGRAM o SOCK_SEQPACKET
+ *
+ * @return lista con la dirección, 'NULL' si la ruta no cabe en 'sun_path'
+ *         (ENAMETOOLONG) o no hay memoria
+ */
+struct addrinfo* crear_direccion_unix(const char *direccion, int tipo_socket) {
+    const char *ruta = direccion + strlen(kPrefijoUnix);
+    int abstracta = ruta[0] == '@';
+    size_t tam_ruta = strlen(ruta);
+    struct addrinfo *info;
+    struct sockaddr_un *sa;
+
+    // la ruta necesita el fin de cadena, el nombre abstracto no
+    if (tam_ruta == 0 || tam_ruta + !abstracta > sizeof(sa->sun_path)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    info = (struct addrinfo*)calloc(1, sizeof(struct addrinfo) +
+        sizeof(struct sockaddr_un));
+    if (info == NULL) {
+        return NULL;
+    }
+    sa = (struct sockaddr_un*)(info + 1);
+    sa->sun_family = AF_UNIX;
+    memcpy(sa->sun_path, ruta, tam_ruta);
+    if (abstracta) {
+        sa->sun_path[0] = '\0';
+    }
+    info->ai_family = AF_UNIX;
+    info->ai_socktype = tipo_socket;
+    info->ai_addr = (struct sockaddr*)sa;
+    info->ai_addrlen = offsetof(struct sockaddr_un, sun_path) + tam_ruta +
+        !abstracta;
+
+    return info;
+}
+
+/**
+ * Asocia un socket de dominio Unix a un nombre abstracto elegido por el
+ * kernel(autobind). Un cliente de datagramas necesita una dirección para que
+ * el servidor pueda responderle, y así no se crea ningún archivo.
+ *
+ * @param descriptor socket AF_UNIX aún sin asociar
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int asociar_unix_automatico(int descriptor) {
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    // con sólo la familia el kernel asigna un nombre abstracto único
+    if (bind(descriptor, (struct sockaddr*)&sa, sizeof(sa_family_t)) == -1) {
+        fprintf(stderr,"\nError al asociar(bind) socket Unix: %s\n",
+            strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Limpia los bytes de una dirección Unix recibida que el kernel no escribió,
+ * para que 'obtener_tam_sockaddr()' pueda calcular la longitud de un nombre
+ * abstracto(que no termina en '\0'). En otras familias no hace nada.
+ *
+ * Un datagrama de un socket Unix sin nombre llega con longitud 0(ni siquiera
+ * se escribe la familia), se deja como dirección Unix sin nombre.
+ *
+ * @param direccion dirección llenada por 'recvfrom()', 'recvmsg()', etc.
+ * @param tam_direccion bytes que escribió el kernel
+ */
+void completar_direccion_unix(struct sockaddr_storage *direccion,
+        socklen_t tam_direccion) {
+    if (tam_direccion == 0) {
+        memset(direccion, 0, sizeof(struct sockaddr_storage));
+        direccion->ss_family = AF_UNIX;
+    } else if (direccion->ss_family == AF_UNIX &&
+            tam_direccion < sizeof(struct sockaddr_storage)) {
+        memset((char*)direccion + tam_direccion, 0,
+            sizeof(struct sockaddr_storage) - tam_direccion);
+    }
+}
+
+/**
+ * Elimina el archivo de un socket de dominio Unix que dejó un servidor que ya
+ * no existe, para poder volver a asociar la ruta. Si otro proceso atiende en
+ * esa ruta el archivo se conserva('bind()' fallará con EADDRINUSE).
+ *
+ * @param info_direccion dirección del servidor
+ *
+ * @return 1 si se eliminó, 0 si no había nada que eliminar
+ */
+int eliminar_socket_unix_abandonado(const struct addrinfo *info_direccion) {
+    const struct sockaddr_un *sa = (const struct sockaddr_un*)
+        info_direccion->ai_addr;
+    struct stat estado;
+
+    if (info_direccion->ai_family != AF_UNIX || sa->sun_path[0] == '\0' ||
+            stat(sa->sun_path, &estado) == -1 || !S_ISSOCK(estado.st_mode)) {
+        return 0;
+    }
+    // si nadie atiende, la conexión se rechaza de inmediato
+    int descriptor = socket(AF_UNIX, info_direccion->ai_socktype |
+        SOCK_CLOEXEC, 0);
+    if (descriptor == -1) {
+        return 0;
+    }
+    int abandonado = connect(descriptor, info_direccion->ai_addr,
+        info_direccion->ai_addrlen) == -1 && errno == ECONNREFUSED;
+    close(descriptor);
+    if (abandonado && unlink(sa->sun_path) == 0) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Cierra el socket de un servidor; si es de dominio Unix con ruta, también
+ * elimina su archivo.
+ *
+ * @param descriptor socket creado con 'inicializar_servidor()' o similares
+ *
+ * @return valor que regresa 'close()'
+ */
+int cerrar_socket_servidor(int descriptor) {
+    struct sockaddr_un sa;
+    socklen_t tam = sizeof(sa);
+
+    if (getsockname(descriptor, (struct sockaddr*)&sa, &tam) == 0 &&
+            sa.sun_family == AF_UNIX && tam > offsetof(struct sockaddr_un,
+            sun_path) && sa.sun_path[0] != '\0') {
+        unlink(sa.sun_path);
+    }
+
+    return close(descriptor);
+}
+
 /**
  * Crea una estructura 'addrinfo', la cuál servirá como parámetro para la
  * función 'gettaddrinfo()'.
@@ -117,19 +395,42 @@ const char* obtener_direccion_imprimible(const struct sockaddr *sa) {
  *
  * Para más información consultar 'man 3 gettaddrinfo'.
  *
+ * La estructura se reserva con 'malloc()' y debe liberarse con 'free()'; para
+ * usar una estructura del llamador use 'llenar_estructura_referencia()'.
+ *
  * @param tipo_socket socket que se usará: SOCK_STREAM o SOCK_DGRAM
  *
- * @return apuntador a estructura addrinfo con "parámetros" establecidos
+ * @return apuntador a estructura addrinfo con "parámetros" establecidos,
+ *         'NULL' si no hay memoria
  */
 struct addrinfo* crear_estructura_referencia(int tipo_socket) {
-    struct addrinfo *referencia = (struct addrinfo*)malloc(sizeof(struct addrinfo));
+    struct addrinfo *referencia = (struct addrinfo*)malloc(
+        sizeof(struct addrinfo));
+    if (referencia == NULL) {
+        fprintf(stderr, "\nError al reservar memoria para la referencia\n");
+        return NULL;
+    }
+
+    llenar_estructura_referencia(referencia, tipo_socket);
+    return referencia;
+}
 
+/**
+ * Llena una estructura 'addrinfo' del llamador con las restricciones descritas
+ * en 'crear_estructura_referencia()'.
+ *
+ * @param referencia estructura a llenar
+ * @param tipo_socket socket que se usará: SOCK_STREAM o SOCK_DGRAM
+ */
+void llenar_estructura_referencia(struct addrinfo *referencia, int tipo_socket) {
     memset(referencia, 0, sizeof(struct addrinfo));
-    // es posible especificar 'AF_UNSPEC' para obtener direcciones IPv4 y/o IPv6
+    // con 'AF_UNSPEC' se obtienen direcciones IPv4 y/o IPv6
     if (familia_direcciones == kIPV4) {
         referencia->ai_family = AF_INET;
-    } else {
+    } else if (familia_direcciones == kIPV6) {
         referencia->ai_family = AF_INET6;
+    } else {
+        referencia->ai_family = AF_UNSPEC;
     }
     referencia->ai_socktype = tipo_socket;
     // Se especifica la bandera 'AI_PASSIVE', entonces se eligirá la dirección
@@ -139,8 +440,6 @@ struct addrinfo* crear_estructura_referencia(int tipo_socket) {
     // Esta bandera será ignorada en caso de fungir como cliente y que al llamar
     // la función 'getaddrinfo()' se indique una ip para un host.
     referencia->ai_flags = AI_PASSIVE;
-
-    return referencia;
 }
 
 /**
@@ -156,10 +455,13 @@ struct addrinfo* crear_estructura_referencia(int tipo_socket) {
  *                 automáticamente al DNS por la dirección de este.
  *                 En caso de fungir como un servidor se indica 'NULL' para que
  *                 sea usada la dirección propia.
+ *                 Con "unix:/ruta" se usa un socket de dominio Unix(el puerto
+ *                 no se toma en cuenta).
  * @param  puerto cadena con el número o nombre(servicio) de puerto en donde se
  *                conectará(si se funge como cliente) o brindará servicio(si se
  *                funge como servidor).
  *                Si se especifica como "0" tomará un puerto aleatorio disponible.
+ *                Si 'ip_host' es 'NULL' puede ser "unix:/ruta".
  * @param  referencia estructura 'addrinfo' la cual debió de ser llenada
  *                    previamente con las restricciones para la búsqueda de
  *                    direcciones. Para este parámetro puede usarse la función
@@ -167,23 +469,31 @@ struct addrinfo* crear_estructura_referencia(int tipo_socket) {
  *                    Es posible especificar como 'NULL' (consulte manual).
  *
  * @return estructura addrinfo que contiene un lista de direcciones que se hayan
- *                    ajustado a los parámetros especificados.
+ *                    ajustado a los parámetros especificados, 'NULL' en caso
+ *                    de error
  */
 struct addrinfo* obtener_direccion(const char *ip_host, const char *puerto,
         const struct addrinfo *referencia) {
     struct addrinfo *direcciones;
+    const char *local = ip_host != NULL ? ip_host : puerto;
     int res;
+    if (es_direccion_unix(local)) {
+        direcciones = crear_direccion_unix(local, referencia != NULL ?
+            referencia->ai_socktype : SOCK_STREAM);
+        if (direcciones == NULL) {
+            fprintf(stderr, "\nDirección Unix inválida(%s): %s\n", local,
+                strerror(errno));
+        }
+        return direcciones;
+    }
     if ((res = getaddrinfo(ip_host, puerto, referencia, &direcciones)) != 0) {
         fprintf(stderr, "\nError al obtener información con getaddrinfo: %s\n",
             gai_strerror(res));
-        fprintf(stderr, "%s\n", strerror(errno));
-        exit(EXIT_FAILURE);
-    } /*
-    if (direcciones == NULL) {
-        fprintf(stderr,"\nNo se pudo obtener el tipo de dirección solicitado\n");
-        freeaddrinfo(direcciones);
-        exit(EXIT_FAILURE);
-    }*/
+        if (res == EAI_SYSTEM) {
+            fprintf(stderr, "%s\n", strerror(errno));
+        }
+        return NULL;
+    }
 
     return direcciones;
 }
@@ -197,15 +507,16 @@ struct addrinfo* obtener_direccion(const char *ip_host, const char *puerto,
  *
  * @param info_direccion estructura con la información para crear el socket
  *
- * @return descriptor identificador del socket creado
+ * @return descriptor identificador del socket creado, -1 en caso de error
  */
 int crear_socket(const struct addrinfo *info_direccion) {
     int descriptor = socket(info_direccion->ai_family,
         info_direccion->ai_socktype, info_direccion->ai_protocol);
     if (descriptor == -1) {
         fprintf(stderr,"\nError al crear socket: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
+        return -1;
     }
+    aplicar_ajustes_socket(descriptor, info_direccion->ai_socktype);
 
     return descriptor;
 }
@@ -220,20 +531,79 @@ int crear_socket(const struct addrinfo *info_direccion) {
  * @param descriptor identificador del socket
  * @param info_direccion estructura con la información de la dirección
  *
- * return valor que regresa la función 'bind'
+ * return valor que regresa la función 'bind'(-1 en caso de error, el socket
+ *        no se cierra)
  */
 int asociar_socket(int descriptor, const struct addrinfo *info_direccion) {
     int valor_retorno = bind(descriptor, info_direccion->ai_addr,
         info_direccion->ai_addrlen);
     if (valor_retorno == -1) {
-        close(descriptor);
         fprintf(stderr,"\nError al asociar(bind) socket: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
     }
 
     return valor_retorno;
 }
 
+/**
+ * Establece una opción entera de un socket(por ejemplo SO_REUSEADDR). En caso
+ * de error no se cierra el socket.
+ *
+ * Para más información consulte 'man setsockopt'.
+ *
+ * @param descriptor identificador del socket
+ * @param nivel nivel de la opción: SOL_SOCKET, IPPROTO_TCP, ...
+ * @param opcion opción a establecer
+ * @param valor valor de la opción
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int establecer_opcion_socket(int descriptor, int nivel, int opcion, int valor) {
+    if (setsockopt(descriptor, nivel, opcion, &valor, sizeof(int)) == -1) {
+        fprintf(stderr,"\nError al establecer operación(setsockopt) a socket: %s\n",
+            strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Crea el socket de un servidor para una de sus direcciones propias: establece
+ * SO_REUSEADDR(y SO_REUSEPORT si es compartido) y lo asocia a la dirección.
+ *
+ * @param info_direccion dirección propia(de 'obtener_direccion(NULL, ...)')
+ * @param compartido 1 para permitir que otros sockets usen el mismo puerto
+ *                   (SO_REUSEPORT), ver 'inicializar_servidor_compartido()'
+ * @param solo_ipv6 valor de IPV6_V6ONLY para direcciones IPv6: 1 para atender
+ *                  sólo IPv6, 0 para atender también IPv4, -1 para dejar el
+ *                  valor del sistema. Se ignora en IPv4
+ *
+ * @return descriptor del socket, -1 en caso de error(el socket se cierra)
+ */
+int crear_socket_servidor(const struct addrinfo *info_direccion,
+        int compartido, int solo_ipv6) {
+    eliminar_socket_unix_abandonado(info_direccion);
+    int descriptor = crear_socket(info_direccion);
+    if (descriptor == -1) {
+        return -1;
+    }
+
+    // permite reutilizar el puerto y dirección(no aplica a sockets Unix)
+    if ((info_direccion->ai_family != AF_UNIX && establecer_opcion_socket(
+            descriptor, SOL_SOCKET, SO_REUSEADDR, 1) == -1) ||
+            (compartido && establecer_opcion_socket(descriptor, SOL_SOCKET,
+            SO_REUSEPORT, 1) == -1) ||
+            (info_direccion->ai_family == AF_INET6 && solo_ipv6 != -1 &&
+            establecer_opcion_socket(descriptor, IPPROTO_IPV6, IPV6_V6ONLY,
+            solo_ipv6) == -1) ||
+            asociar_socket(descriptor, info_direccion) == -1) {
+        close(descriptor);
+        return -1;
+    }
+
+    return descriptor;
+}
+
 /**
  * Inicializa un host como un servidor, que escuchará en el puerto indicado.
  *
@@ -241,39 +611,114 @@ int asociar_socket(int descriptor, const struct addrinfo *info_direccion) {
  * asocia con la dirección propia y con el puerto indicado para poder fungir
  * como servidor.
  *
+ * Con 'kAMBAS' se usa la dirección IPv6 con IPV6_V6ONLY en 0, así el mismo
+ * socket recibe también a los clientes IPv4. Si no hay dirección IPv6 se usa
+ * la primera que se obtenga.
+ *
  * @param  puerto que se asociará al socket de la dirección. Por lo tanto será
  *                el puerto donde se brindará servicio.
  * @param tipo_socket tipo de socket a usar para la comunicación
  *
- * @return descriptor del socket
+ * @return descriptor del socket, -1 en caso de error
  */
 int inicializar_servidor(const char *puerto, int tipo_socket) {
 
     struct addrinfo *info_servidor; // guardará mi información como servidor
+    struct addrinfo *direccion;
+    struct addrinfo referencia;
 
     // se indica 'NULL' ya que no se comunicará con un dirección en específico
     // y se usará la propia dirección para brindar servicio
-    info_servidor = obtener_direccion(NULL, puerto,
-            crear_estructura_referencia(tipo_socket));
+    llenar_estructura_referencia(&referencia, tipo_socket);
+    info_servidor = obtener_direccion(NULL, puerto, &referencia);
+    if (info_servidor == NULL) {
+        return -1;
+    }
 
-    int descriptor = crear_socket(info_servidor);
+    direccion = info_servidor;
+    if (familia_direcciones == kAMBAS) {
+        while (direccion != NULL && direccion->ai_family != AF_INET6) {
+            direccion = direccion->ai_next;
+        }
+        if (direccion == NULL) {
+            direccion = info_servidor;
+        }
+    }
+    int descriptor = crear_socket_servidor(direccion, 0,
+        familia_direcciones == kAMBAS ? 0 : -1);
 
-    // permite reutilizar el puerto y dirección
-    int yes=1;
-    if (setsockopt(descriptor, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int))
-            == -1) {
-        close(descriptor);
-        fprintf(stderr,"\nError al establecer operación(setsockopt) a socket: %s\n",
-            strerror(errno));
-        exit(EXIT_FAILURE);
+    freeaddrinfo(info_servidor);
+    return descriptor;
+}
+
+/**
+ * Inicializa un servidor igual que 'inicializar_servidor()', pero además
+ * establece SO_REUSEPORT antes de asociar el socket. Así varios sockets(uno por
+ * hilo o proceso) pueden asociarse al mismo puerto y el kernel reparte entre
+ * ellos las conexiones o datagramas entrantes, sin un candado compartido.
+ *
+ * Para más información consulte 'man 7 socket'.
+ *
+ * @param  puerto donde se brindará servicio
+ * @param tipo_socket tipo de socket a usar para la comunicación
+ *
+ * @return descriptor del socket, -1 en caso de error
+ */
+int inicializar_servidor_compartido(const char *puerto, int tipo_socket) {
+    struct addrinfo referencia;
+    llenar_estructura_referencia(&referencia, tipo_socket);
+    struct addrinfo *info_servidor = obtener_direccion(NULL, puerto,
+            &referencia);
+    if (info_servidor == NULL) {
+        return -1;
     }
 
-    asociar_socket(descriptor, info_servidor);
+    int descriptor = crear_socket_servidor(info_servidor, 1, -1);
 
     freeaddrinfo(info_servidor);
     return descriptor;
 }
 
+/**
+ * Inicializa un socket de servidor por cada dirección propia que se obtenga
+ * (toda la lista 'ai_next'), por ejemplo 0.0.0.0 y :: con 'kAMBAS'. Los
+ * sockets IPv6 se crean con IPV6_V6ONLY para que no choquen con el IPv4 en el
+ * mismo puerto. Una dirección que no se pueda asociar(por ejemplo IPv6
+ * deshabilitado) se omite.
+ *
+ * @param puerto donde se brindará servicio
+ * @param tipo_socket tipo de socket a usar para la comunicación
+ * @param compartido 1 para establecer SO_REUSEPORT en cada socket
+ * @param descriptores arreglo donde se guardan los sockets creados
+ * @param max_descriptores tamaño del arreglo, usualmente 'kMaxEscucha'
+ *
+ * @return número de sockets creados, -1 si no se pudo crear ninguno
+ */
+int inicializar_servidores(const char *puerto, int tipo_socket, int compartido,
+        int *descriptores, int max_descriptores) {
+    struct addrinfo referencia;
+    struct addrinfo *direccion;
+    int num = 0;
+
+    llenar_estructura_referencia(&referencia, tipo_socket);
+    struct addrinfo *info_servidor = obtener_direccion(NULL, puerto,
+            &referencia);
+    if (info_servidor == NULL) {
+        return -1;
+    }
+
+    for (direccion = info_servidor; direccion != NULL && num < max_descriptores;
+            direccion = direccion->ai_next) {
+        int descriptor = crear_socket_servidor(direccion, compartido, 1);
+        if (descriptor != -1) {
+            descriptores[num++] = descriptor;
+        }
+    }
+
+    freeaddrinfo(info_servidor);
+    return num == 0 ? -1 : num;
+}
+
 /**
 * Inicializar el host como un cliente para comunicarse a otro host destino
 * (usualmente un servidor).
@@ -287,17 +732,73 @@ int inicializar_servidor(const char *puerto, int tipo_socket) {
 * @param info_destino Estructura donde se almacenará la información del destino
 *                     (dirección)
 *
-* @return descriptor del socket
+* @return descriptor del socket, -1 en caso de error
 */
 int inicializar_cliente(const char *ip_destino, const char *puerto,
         int tipo_socket, struct addrinfo **info_destino) {
-    *info_destino = obtener_direccion(ip_destino, puerto,
-        crear_estructura_referencia(tipo_socket));
+    struct addrinfo referencia;
+    llenar_estructura_referencia(&referencia, tipo_socket);
+    *info_destino = obtener_direccion(ip_destino, puerto, &referencia);
+    if (*info_destino == NULL) {
+        return -1;
+    }
     int descriptor = crear_socket(*info_destino);
 
     return descriptor;
 }
 
+/**
+ * Configura un socket como NO bloqueante, de modo que las funciones de envío,
+ * recepción y aceptación regresen -1 con 'errno' igual a EAGAIN/EWOULDBLOCK en
+ * lugar de esperar.
+ *
+ * Para más información consulte 'man 2 fcntl'.
+ *
+ * @param descriptor identificador del socket
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int establecer_no_bloqueante(int descriptor) {
+    int banderas = fcntl(descriptor, F_GETFL, 0);
+    if (banderas == -1 || fcntl(descriptor, F_SETFL, banderas | O_NONBLOCK) == -1) {
+        fprintf(stderr,"\nError al configurar socket no bloqueante(fcntl): %s\n",
+            strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Espera a que un socket(usualmente NO bloqueante) esté listo para leer
+ * (POLLIN) o escribir(POLLOUT).
+ *
+ * Para más información consulte 'man 2 poll'.
+ *
+ * @param descriptor identificador del socket
+ * @param eventos eventos a esperar: POLLIN, POLLOUT
+ * @param milisegundos tiempo máximo de espera, -1 para esperar indefinidamente
+ *
+ * @return 1 si el socket está listo, 0 si se agotó el tiempo, -1 en caso de
+ *         error
+ */
+int esperar_descriptor(int descriptor, short eventos, int milisegundos) {
+    struct pollfd espera;
+    int res;
+    espera.fd = descriptor;
+    espera.events = eventos;
+    espera.revents = 0;
+    do {
+        res = poll(&espera, 1, milisegundos);
+    } while (res == -1 && errno == EINTR);
+    if (res == -1) {
+        fprintf(stderr,"\nError al esperar socket(poll): %s\n",
+            strerror(errno));
+    }
+
+    return res;
+}
+
 // ---------------------------------------------------------
 // STREAM - Funciones para sockets de flujo
 // ---------------------------------------------------------
@@ -310,16 +811,15 @@ int inicializar_cliente(const char *ip_destino, const char *puerto,
  * @param descriptor identificador del socket
  * @param info_direccion estructura con la información de la dirección
  *
- * return valor que regresa la función 'connect'
+ * return valor que regresa la función 'connect'(-1 en caso de error, el socket
+ *        no se cierra)
  */
  int conectar(int descriptor, struct addrinfo *info_direccion) {
      int valor_retorno = connect(descriptor, info_direccion->ai_addr,
         info_direccion->ai_addrlen);
      if (valor_retorno == -1) {
-         close(descriptor);
          fprintf(stderr,"\nError al conectar(connect): %s\n",
             strerror(errno));
-         exit(EXIT_FAILURE);
      }
 
      return valor_retorno;
@@ -335,15 +835,14 @@ int inicializar_cliente(const char *ip_destino, const char *puerto,
  * @param reserva el número máximo de conexiones en la cola de espera.
  *                (Varios sistemas limitan este número a 20)
  *
- * return valor que regresa la función 'listen'
+ * return valor que regresa la función 'listen'(-1 en caso de error, el socket
+ *        no se cierra)
  */
 int escuchar(int descriptor, int reserva) {
     int valor_retorno = listen(descriptor, reserva);
     if (valor_retorno == -1) {
-        close(descriptor);
-        fprintf(stderr,"\nError al escuchar(connect) con socket: %s\n",
+        fprintf(stderr,"\nError al escuchar(listen) con socket: %s\n",
             strerror(errno));
-        exit(EXIT_FAILURE);
     }
 
     return valor_retorno;
@@ -356,26 +855,41 @@ int escuchar(int descriptor, int reserva) {
  * Llama a la función 'accept()' para aceptar la conexión pendiente y regrese
  * un nuevo descriptor de socket para usar las funciones 'send()' y 'recv()'
  * con esta conexión específica.
- * El socket original permanece escuchando más peticiones.
+ * El socket original permanece escuchando más peticiones, aun en caso de error:
+ * fallas como ECONNABORTED(el cliente abortó antes de aceptarse) o EMFILE(no
+ * quedan descriptores) son pasajeras y el llamador puede volver a intentar.
+ * El nuevo socket se crea con SOCK_CLOEXEC para no heredarse a otros procesos.
  *
- * Para más información consulte 'man accept'.
+ * Para más información consulte 'man accept4'.
  *
  * @param descriptor identificador del socket que escucha('listen()')
  * @param info_origen estructura donde se guarda la información de la conexión
  *                    entrante(cliente). De preferencia deberá ser una estructura
  *                    'sockaddr_storage', la cuál sirve para ipv4 e ipv6
  *
- * return descriptor del nuevo socket creado para la conexión entrante(cliente)
+ * return descriptor del nuevo socket creado para la conexión entrante(cliente),
+ *        -1 en caso de error('errno' indica el motivo)
  */
 int aceptar(int descriptor, struct sockaddr *info_origen) {
-    socklen_t tam_dir = sizeof(struct sockaddr_storage);  // tamaño para ipv4,ipv6
-    int descriptor_cliente = accept(descriptor, info_origen, &tam_dir);
+    socklen_t tam_dir;
+    int descriptor_cliente;
+    do {
+        tam_dir = sizeof(struct sockaddr_storage);  // tamaño para ipv4,ipv6
+        descriptor_cliente = accept4(descriptor, info_origen, &tam_dir,
+            SOCK_CLOEXEC);
+    } while (descriptor_cliente == -1 && errno == EINTR);
     if (descriptor_cliente == -1) {
-        close(descriptor);
-        fprintf(stderr,"\nError al aceptar(accept) conexión: %s\n",
-            strerror(errno));
-        exit(EXIT_FAILURE);
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            fprintf(stderr,"\nError al aceptar(accept4) conexión: %s\n",
+                strerror(errno));
+        }
+        return -1;
+    }
+    if (info_origen != NULL) {
+        completar_direccion_unix((struct sockaddr_storage*)info_origen,
+            tam_dir);
     }
+    aplicar_ajustes_aceptado(descriptor_cliente);
 
     return descriptor_cliente;
 }
@@ -396,7 +910,10 @@ int aceptar(int descriptor, struct sockaddr *info_origen) {
  */
 int enviar_datos_stream(int descriptor, char *buffer, int tam_buffer,
         int bandera) {
+    uint64_t inicio = iniciar_medicion_socket();
     int bytes_enviados = send(descriptor, buffer, tam_buffer, bandera);
+    registrar_operacion_socket(kOpEnviarStream, bytes_enviados, tam_buffer,
+        inicio);
     if (bytes_enviados == -1) {
         fprintf(stderr, "\nError al enviar datos(send): %s\n", strerror(errno));
     }
@@ -420,7 +937,9 @@ int enviar_datos_stream(int descriptor, char *buffer, int tam_buffer,
  */
 int recibir_datos_stream(int descriptor, char *buffer, int tam_buffer,
         int bandera) {
+    uint64_t inicio = iniciar_medicion_socket();
     int bytes_recibidos = recv(descriptor, buffer, tam_buffer, bandera);
+    registrar_operacion_socket(kOpRecibirStream, bytes_recibidos, -1, inicio);
     if (bytes_recibidos == -1) {
         if(bandera != MSG_DONTWAIT) { // si es socket bloqueante
             fprintf(stderr,"\nError al recibir datos(recvfrom): %s\n",
@@ -464,8 +983,14 @@ int recibir_datos_stream(int descriptor, char *buffer, int tam_buffer,
 int recibir_datos_dgram(int descriptor, char *buffer, int tam_buffer, int bandera,
         struct sockaddr *info_origen) {
     socklen_t tam_dir = sizeof(struct sockaddr_storage);  // tamaño para ipv4, ipv6
+    uint64_t inicio = iniciar_medicion_socket();
     int bytes_recibidos = recvfrom(descriptor, buffer, tam_buffer, bandera,
             info_origen, &tam_dir);
+    registrar_operacion_socket(kOpRecibirDgram, bytes_recibidos, -1, inicio);
+    if (bytes_recibidos >= 0 && info_origen != NULL) {
+        completar_direccion_unix((struct sockaddr_storage*)info_origen,
+            tam_dir);
+    }
     if (bytes_recibidos == -1) {
         if(bandera != MSG_DONTWAIT) { // si es socket bloqueante
             fprintf(stderr,"\nError al recibir datos(recvfrom): %s\n",
@@ -496,8 +1021,11 @@ int recibir_datos_dgram(int descriptor, char *buffer, int tam_buffer, int bander
  */
 int enviar_datos_dgram(int descriptor, struct addrinfo *info_destino,
         char *buffer, int tam_buffer, int bandera) {
+    uint64_t inicio = iniciar_medicion_socket();
     int bytes_enviados = sendto(descriptor, buffer, tam_buffer, bandera,
             info_destino->ai_addr, info_destino->ai_addrlen);
+    registrar_operacion_socket(kOpEnviarDgram, bytes_enviados, tam_buffer,
+        inicio);
     if (bytes_enviados == -1) {
         fprintf(stderr, "\nError al enviar datos(sendto): %s\n", strerror(errno));
     }
@@ -505,6 +1033,157 @@ int enviar_datos_dgram(int descriptor, struct addrinfo *info_destino,
     return bytes_enviados;
 }
 
+/**
+ * Obtiene el tamaño de la estructura de dirección según su familia, necesario
+ * para enviar a una dirección guardada en una estructura 'sockaddr_storage'.
+ *
+ * @param sa estructura sockaddr con la información de la dirección
+ *
+ * En sockets de dominio Unix la longitud depende del nombre: con una ruta
+ * basta la estructura completa, pero un nombre abstracto se compara con su
+ * longitud exacta(la dirección recibida debe pasar por
+ * 'completar_direccion_unix()').
+ *
+ * @return tamaño de 'sockaddr_in', 'sockaddr_in6' o de la dirección Unix
+ */
+socklen_t obtener_tam_sockaddr(const struct sockaddr *sa) {
+    if (sa->sa_family == AF_INET) {
+        return sizeof(struct sockaddr_in);
+    }
+    if (sa->sa_family == AF_UNIX) {
+        const char *ruta = ((const struct sockaddr_un*)sa)->sun_path;
+        if (ruta[0] != '\0') {
+            return sizeof(struct sockaddr_un);
+        }
+        return offsetof(struct sockaddr_un, sun_path) + 1 +
+            strnlen(ruta + 1, sizeof(((struct sockaddr_un*)0)->sun_path) - 1);
+    }
+    return sizeof(struct sockaddr_in6);
+}
+
+/**
+ * Recibe hasta 'max_mensajes' datagramas con una sola llamada al sistema
+ * ('recvmmsg()'), guardando cada uno en su buffer junto con la información de
+ * quien lo envió.
+ *
+ * Si en 'bandera' se indica MSG_WAITFORONE, la función espera al primer
+ * datagrama y después toma, sin bloquear, los que ya estén en la cola del
+ * socket.
+ *
+ * Para más información consulte 'man recvmmsg'.
+ *
+ * @param descriptor identificador del socket abierto
+ * @param buffers arreglo de 'max_mensajes' buffers(con memoria reservada)
+ * @param tam_buffer tamaño de cada buffer
+ * @param bytes_recibidos arreglo donde se guarda el número de bytes recibidos
+ *                        en cada buffer
+ * @param origenes arreglo donde se guarda quién envió cada datagrama
+ * @param max_mensajes número de buffers, a lo más 'kMaxLote'
+ * @param bandera opción para indicar cierta funcionalidad al socket para
+ *                recibir los datos. Usualmente es MSG_WAITFORONE
+ *
+ * @return número de datagramas recibidos, -1 en caso de error
+ */
+int recibir_lote_dgram(int descriptor, char **buffers, int tam_buffer,
+        int *bytes_recibidos, struct sockaddr_storage *origenes,
+        int max_mensajes, int bandera) {
+    struct mmsghdr mensajes[kMaxLote];
+    struct iovec vectores[kMaxLote];
+    int i;
+
+    if (max_mensajes > kMaxLote) {
+        max_mensajes = kMaxLote;
+    }
+    memset(mensajes, 0, sizeof(struct mmsghdr)*max_mensajes);
+    for (i = 0; i < max_mensajes; i++) {
+        vectores[i].iov_base = buffers[i];
+        vectores[i].iov_len = tam_buffer;
+        mensajes[i].msg_hdr.msg_iov = &vectores[i];
+        mensajes[i].msg_hdr.msg_iovlen = 1;
+        mensajes[i].msg_hdr.msg_name = &origenes[i];
+        mensajes[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    }
+
+    uint64_t inicio = iniciar_medicion_socket();
+    int num_recibidos = recvmmsg(descriptor, mensajes, max_mensajes, bandera,
+        NULL);
+    registrar_operacion_socket(kOpRecibirLoteDgram, num_recibidos, -1, inicio);
+    if (num_recibidos == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            fprintf(stderr,"\nError al recibir datos(recvmmsg): %s\n",
+                strerror(errno));
+        }
+        return -1;
+    }
+    for (i = 0; i < num_recibidos; i++) {
+        bytes_recibidos[i] = mensajes[i].msg_len;
+        completar_direccion_unix(&origenes[i], mensajes[i].msg_hdr.msg_namelen);
+    }
+
+    return num_recibidos;
+}
+
+/**
+ * Envía varios datagramas con una sola llamada al sistema('sendmmsg()'). Si el
+ * kernel acepta sólo una parte del lote se vuelve a llamar con el resto.
+ *
+ * Para más información consulte 'man sendmmsg'.
+ *
+ * @param descriptor identificador del socket abierto
+ * @param buffers arreglo con los datos de cada datagrama
+ * @param tam_buffers tamaño de cada buffer
+ * @param destinos dirección destino de cada datagrama. Puede ser 'NULL' si el
+ *                 socket está conectado('connect()')
+ * @param num_mensajes número de datagramas, a lo más 'kMaxLote'
+ * @param bandera opción para indicar cierta funcionalidad al socket para
+ *                el envio de los datos. Usualmente es 0
+ *
+ * @return número de datagramas enviados, -1 si no se envió ninguno
+ */
+int enviar_lote_dgram(int descriptor, char **buffers, int *tam_buffers,
+        struct sockaddr_storage *destinos, int num_mensajes, int bandera) {
+    struct mmsghdr mensajes[kMaxLote];
+    struct iovec vectores[kMaxLote];
+    int i, enviados = 0, res;
+
+    if (num_mensajes > kMaxLote) {
+        num_mensajes = kMaxLote;
+    }
+    memset(mensajes, 0, sizeof(struct mmsghdr)*num_mensajes);
+    for (i = 0; i < num_mensajes; i++) {
+        vectores[i].iov_base = buffers[i];
+        vectores[i].iov_len = tam_buffers[i];
+        mensajes[i].msg_hdr.msg_iov = &vectores[i];
+        mensajes[i].msg_hdr.msg_iovlen = 1;
+        if (destinos != NULL) {
+            mensajes[i].msg_hdr.msg_name = &destinos[i];
+            mensajes[i].msg_hdr.msg_namelen =
+                obtener_tam_sockaddr((struct sockaddr*)&destinos[i]);
+        }
+    }
+
+    while (enviados < num_mensajes) {
+        uint64_t inicio = iniciar_medicion_socket();
+        res = sendmmsg(descriptor, &mensajes[enviados], num_mensajes - enviados,
+            bandera);
+        registrar_operacion_socket(kOpEnviarLoteDgram, res,
+            num_mensajes - enviados, inicio);
+        if (res == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                fprintf(stderr, "\nError al enviar datos(sendmmsg): %s\n",
+                    strerror(errno));
+            }
+            break;
+        }
+        enviados += res;
+    }
+
+    return enviados == 0 ? -1 : enviados;
+}
+
 
 #endif  // FUNCIONES_SOCKETS_H_
 
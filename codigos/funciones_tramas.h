@@ -0,0 +1,540 @@
+/**
+ * Funciones para tramas de longitud prefijada
+ *
+ * TCP es un flujo de bytes: un 'send()' puede enviarse en varios segmentos y
+ * varios 'send()' pueden llegar juntos en un solo 'recv()'. Para delimitar los
+ * mensajes cada uno se envía como una trama:
+ *
+ * 	+---------------------------+---------------------+
+ * 	| longitud(4 bytes, red)    | datos(longitud)     |
+ * 	+---------------------------+---------------------+
+ *
+ * El envío continúa tras escrituras parciales y usa 'writev()' para enviar
+ * encabezado y datos(de una o varias tramas) en una sola llamada. Con
+ * 'enviar_tramas_sin_bloqueo()' lo que no cabe en el socket se guarda en un
+ * buffer de pendientes en lugar de esperar, para usarse desde un reactor. La
+ * recepción acumula los bytes en un buffer que crece según se necesite y de
+ * donde se extraen las tramas completas, así un solo 'recv()' puede entregar
+ * muchas.
+ *
+ * Si el buffer tiene un caché de pool(ver 'funciones_memoria.h'), su memoria
+ * se toma del pool y se devuelve en cuanto queda vacío, así atender mensajes
+ * no reserva memoria del heap; sólo las tramas mayores al buffer del pool
+ * usan 'malloc()'.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_TRAMAS_H_
+#define FUNCIONES_TRAMAS_H_
+
+#include <stdint.h>
+#include <limits.h>  // 'IOV_MAX'
+#include <sys/uio.h>  // para 'writev()'
+
+#include "funciones_sockets.h"
+#include "funciones_memoria.h"
+
+// tamaño del encabezado con la longitud de la trama
+const int kTamEncabezado = 4;
+// longitud máxima aceptada para una trama, protege contra encabezados inválidos
+const uint32_t kMaxTrama = 16*1024*1024;
+// espacio libre mínimo que se solicita antes de cada 'recv()'
+const size_t kTamLecturaTramas = 4096;
+// número máximo de tramas enviadas en una llamada a 'writev()'
+const int kMaxTramasLote = IOV_MAX/2;
+// tramas de control de la difusión y longitud máxima de un tema, compartidas
+// por el cliente y el servidor, ver 'funciones_difusion.h'
+enum {kTamTemaDifusion = 64};
+const char *kPrefijoSuscripcion = "#suscribir";
+const char *kPrefijoTema = "#tema ";
+
+// buffer de recepción de una conexión: los bytes entre 'inicio' y 'fin' aún no
+// se han procesado
+typedef struct Buffer_tramas {
+    char *datos;
+    size_t capacidad;
+    size_t inicio;
+    size_t fin;
+    Cache_pool *cache;  // opcional, de donde se toma la memoria
+    int de_pool;  // 1 si 'datos' pertenece al pool
+} Buffer_tramas;
+
+/* Prototipos */
+
+void inicializar_buffer_tramas(Buffer_tramas *buffer);
+void liberar_buffer_tramas(Buffer_tramas *buffer);
+void soltar_buffer_tramas(Buffer_tramas *buffer);
+int reservar_espacio_tramas(Buffer_tramas *buffer, size_t tam);
+int agregar_datos_tramas(Buffer_tramas *buffer, const char *datos, size_t tam);
+int agregar_tramas(Buffer_tramas *buffer, char **datos, uint32_t *tam_datos,
+        int num_tramas);
+int extraer_trama(Buffer_tramas *buffer, char **trama, uint32_t *tam_trama);
+int recibir_tramas_stream(int descriptor, Buffer_tramas *buffer, int bandera);
+int recibir_trama_stream(int descriptor, Buffer_tramas *buffer, char **trama,
+        uint32_t *tam_trama);
+int preparar_vectores_tramas(char **datos, uint32_t *tam_datos,
+        int num_tramas, uint32_t *encabezados, struct iovec *vectores);
+void avanzar_vectores_tramas(struct iovec *vectores, int num_vectores,
+        int *indice, size_t enviados);
+int enviar_tramas_stream(int descriptor, char **datos, uint32_t *tam_datos,
+        int num_tramas);
+int enviar_trama_stream(int descriptor, char *datos, uint32_t tam_datos);
+int enviar_tramas_sin_bloqueo(int descriptor, char **datos,
+        uint32_t *tam_datos, int num_tramas, Buffer_tramas *pendientes);
+int enviar_pendientes_stream(int descriptor, Buffer_tramas *pendientes);
+
+/* Funciones */
+
+/**
+ * Deja el buffer vacío y sin memoria reservada.
+ *
+ * @param buffer buffer a inicializar
+ */
+void inicializar_buffer_tramas(Buffer_tramas *buffer) {
+    memset(buffer, 0, sizeof(Buffer_tramas));
+}
+
+/**
+ * Libera la memoria del buffer(o la devuelve al pool) y lo deja vacío. Se
+ * conserva el caché del buffer.
+ *
+ * @param buffer buffer a liberar
+ */
+void liberar_buffer_tramas(Buffer_tramas *buffer) {
+    Cache_pool *cache = buffer->cache;
+
+    if (buffer->de_pool) {
+        devolver_buffer_cache(cache, buffer->datos);
+    } else {
+        free(buffer->datos);
+    }
+    inicializar_buffer_tramas(buffer);
+    buffer->cache = cache;
+}
+
+/**
+ * Devuelve al pool la memoria de un buffer que ya no tiene bytes pendientes.
+ * Debe llamarse cuando ya no se usan las tramas extraídas de él. Los buffers
+ * reservados con 'malloc()' se conservan para las siguientes tramas grandes.
+ *
+ * @param buffer buffer de tramas
+ */
+void soltar_buffer_tramas(Buffer_tramas *buffer) {
+    if (buffer->de_pool && buffer->inicio == buffer->fin) {
+        liberar_buffer_tramas(buffer);
+    }
+}
+
+/**
+ * Garantiza que haya al menos 'tam' bytes libres después de 'fin'. Primero se
+ * recorren al inicio los bytes pendientes; si aún no alcanza, la capacidad se
+ * duplica.
+ *
+ * @param buffer buffer de tramas
+ * @param tam número de bytes libres requeridos
+ *
+ * @return 0 en caso de éxito, -1 si no hay memoria
+ */
+int reservar_espacio_tramas(Buffer_tramas *buffer, size_t tam) {
+    if (buffer->capacidad - buffer->fin >= tam) {
+        return 0;
+    }
+    if (buffer->datos == NULL && buffer->cache != NULL &&
+            tam <= buffer->cache->pool->tam_buffer) {
+        buffer->datos = (char*)obtener_buffer_cache(buffer->cache);
+        if (buffer->datos == NULL) {
+            return -1;
+        }
+        buffer->capacidad = buffer->cache->pool->tam_buffer;
+        buffer->inicio = buffer->fin = 0;
+        buffer->de_pool = 1;
+        return 0;
+    }
+
+    size_t pendientes = buffer->fin - buffer->inicio;
+    if (buffer->inicio > 0) {
+        memmove(buffer->datos, buffer->datos + buffer->inicio, pendientes);
+        buffer->inicio = 0;
+        buffer->fin = pendientes;
+        if (buffer->capacidad - buffer->fin >= tam) {
+            return 0;
+        }
+    }
+
+    size_t capacidad = buffer->capacidad == 0 ? kTamLecturaTramas :
+        buffer->capacidad;
+    while (capacidad - pendientes < tam) {
+        capacidad *= 2;
+    }
+    // la memoria del pool no puede crecer: los bytes pendientes se copian a
+    // memoria propia
+    char *datos = (char*)(buffer->de_pool ? malloc(capacidad) :
+        realloc(buffer->datos, capacidad));
+    if (datos == NULL) {
+        fprintf(stderr,"\nError al reservar memoria para tramas\n");
+        return -1;
+    }
+    if (buffer->de_pool) {
+        memcpy(datos, buffer->datos, pendientes);
+        devolver_buffer_cache(buffer->cache, buffer->datos);
+        buffer->de_pool = 0;
+    }
+    buffer->datos = datos;
+    buffer->capacidad = capacidad;
+
+    return 0;
+}
+
+/**
+ * Copia al final del buffer bytes recibidos por otro medio(por ejemplo el
+ * buffer compartido de un reactor).
+ *
+ * @param buffer buffer de tramas
+ * @param datos bytes recibidos
+ * @param tam número de bytes
+ *
+ * @return 0 en caso de éxito, -1 si no hay memoria
+ */
+int agregar_datos_tramas(Buffer_tramas *buffer, const char *datos, size_t tam) {
+    if (reservar_espacio_tramas(buffer, tam) == -1) {
+        return -1;
+    }
+    memcpy(buffer->datos + buffer->fin, datos, tam);
+    buffer->fin += tam;
+
+    return 0;
+}
+
+/**
+ * Copia al final del buffer varias tramas(encabezado y datos) sin enviarlas,
+ * para que otro medio las envíe después(por ejemplo el motor io_uring de un
+ * reactor).
+ *
+ * @param buffer buffer de tramas
+ * @param datos arreglo con los datos de cada trama
+ * @param tam_datos longitud de cada trama
+ * @param num_tramas número de tramas
+ *
+ * @return 0 en caso de éxito, -1 si no hay memoria
+ */
+int agregar_tramas(Buffer_tramas *buffer, char **datos, uint32_t *tam_datos,
+        int num_tramas) {
+    uint32_t encabezado;
+    size_t total = 0;
+    int i;
+
+    for (i = 0; i < num_tramas; i++) {
+        total += kTamEncabezado + tam_datos[i];
+    }
+    if (reservar_espacio_tramas(buffer, total) == -1) {
+        return -1;
+    }
+    for (i = 0; i < num_tramas; i++) {
+        encabezado = htonl(tam_datos[i]);
+        memcpy(buffer->datos + buffer->fin, &encabezado, kTamEncabezado);
+        memcpy(buffer->datos + buffer->fin + kTamEncabezado, datos[i],
+            tam_datos[i]);
+        buffer->fin += kTamEncabezado + tam_datos[i];
+    }
+
+    return 0;
+}
+
+/**
+ * Extrae la siguiente trama completa del buffer. Los datos de la trama se
+ * quedan en el buffer y sólo son válidos hasta la siguiente operación sobre él.
+ *
+ * @param buffer buffer de tramas
+ * @param trama apuntador donde se guarda la dirección de los datos
+ * @param tam_trama donde se guarda la longitud de los datos
+ *
+ * @return 1 si se extrajo una trama, 0 si aún no hay una trama completa, -1 si
+ *         la longitud del encabezado es inválida
+ */
+int extraer_trama(Buffer_tramas *buffer, char **trama, uint32_t *tam_trama) {
+    size_t pendientes = buffer->fin - buffer->inicio;
+    uint32_t longitud;
+
+    if (pendientes < (size_t)kTamEncabezado) {
+        return 0;
+    }
+    memcpy(&longitud, buffer->datos + buffer->inicio, kTamEncabezado);
+    longitud = ntohl(longitud);
+    if (longitud > kMaxTrama) {
+        fprintf(stderr,"\nTrama inválida: longitud %u\n", longitud);
+        return -1;
+    }
+    if (pendientes < kTamEncabezado + (size_t)longitud) {
+        return 0;
+    }
+
+    *trama = buffer->datos + buffer->inicio + kTamEncabezado;
+    *tam_trama = longitud;
+    buffer->inicio += kTamEncabezado + longitud;
+    if (buffer->inicio == buffer->fin) {
+        // sin bytes pendientes, la siguiente lectura empieza al inicio
+        buffer->inicio = buffer->fin = 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Recibe directamente en el espacio libre del buffer todos los bytes que
+ * quepan(al menos 'kTamLecturaTramas'), sin copias intermedias.
+ *
+ * @param descriptor identificador del socket abierto
+ * @param buffer buffer de tramas de la conexión
+ * @param bandera opción para 'recv()'. Usualmente es 0
+ *
+ * @return número de bytes recibidos, 0 si el otro extremo cerró la conexión,
+ *         -1 en caso de error(EAGAIN en sockets NO bloqueantes)
+ */
+int recibir_tramas_stream(int descriptor, Buffer_tramas *buffer, int bandera) {
+    if (reservar_espacio_tramas(buffer, kTamLecturaTramas) == -1) {
+        return -1;
+    }
+    int bytes_recibidos = recibir_datos_stream(descriptor,
+        buffer->datos + buffer->fin, buffer->capacidad - buffer->fin, bandera);
+    if (bytes_recibidos > 0) {
+        buffer->fin += bytes_recibidos;
+    }
+
+    return bytes_recibidos;
+}
+
+/**
+ * Recibe hasta completar una trama(socket bloqueante).
+ *
+ * @param descriptor identificador del socket abierto
+ * @param buffer buffer de tramas de la conexión
+ * @param trama apuntador donde se guarda la dirección de los datos
+ * @param tam_trama donde se guarda la longitud de los datos
+ *
+ * @return 1 si se recibió una trama, 0 si se cerró la conexión, -1 en caso de
+ *         error
+ */
+int recibir_trama_stream(int descriptor, Buffer_tramas *buffer, char **trama,
+        uint32_t *tam_trama) {
+    int res;
+    while ((res = extraer_trama(buffer, trama, tam_trama)) == 0) {
+        res = recibir_tramas_stream(descriptor, buffer, 0);
+        if (res <= 0) {
+            return res;
+        }
+    }
+
+    return res;
+}
+
+/**
+ * Arma los vectores de 'writev()' de varias tramas: encabezado y datos de cada
+ * trama forman un vector.
+ *
+ * @param datos arreglo con los datos de cada trama
+ * @param tam_datos longitud de cada trama
+ * @param num_tramas número de tramas, a lo más 'kMaxTramasLote'
+ * @param encabezados donde se guardan los encabezados(uno por trama)
+ * @param vectores donde se guardan los vectores(dos por trama)
+ *
+ * @return número de vectores
+ */
+int preparar_vectores_tramas(char **datos, uint32_t *tam_datos,
+        int num_tramas, uint32_t *encabezados, struct iovec *vectores) {
+    int i;
+    for (i = 0; i < num_tramas; i++) {
+        encabezados[i] = htonl(tam_datos[i]);
+        vectores[2*i].iov_base = &encabezados[i];
+        vectores[2*i].iov_len = kTamEncabezado;
+        vectores[2*i + 1].iov_base = datos[i];
+        vectores[2*i + 1].iov_len = tam_datos[i];
+    }
+
+    return 2*num_tramas;
+}
+
+/**
+ * Descarta los vectores enviados completos y ajusta el parcial.
+ *
+ * @param vectores vectores de 'preparar_vectores_tramas()'
+ * @param num_vectores número de vectores
+ * @param indice primer vector pendiente, se actualiza
+ * @param enviados bytes que envió la última llamada
+ */
+void avanzar_vectores_tramas(struct iovec *vectores, int num_vectores,
+        int *indice, size_t enviados) {
+    while (*indice < num_vectores && enviados >= vectores[*indice].iov_len) {
+        enviados -= vectores[*indice].iov_len;
+        (*indice)++;
+    }
+    if (*indice < num_vectores) {
+        vectores[*indice].iov_base = (char*)vectores[*indice].iov_base +
+            enviados;
+        vectores[*indice].iov_len -= enviados;
+    }
+}
+
+/**
+ * Envía varias tramas con 'writev()': encabezado y datos de cada trama forman
+ * un vector, así todas pueden salir en una sola llamada al sistema. Si la
+ * escritura es parcial se continúa desde el byte donde se quedó; en sockets NO
+ * bloqueantes se espera a que el socket permita escribir(desde un reactor use
+ * 'enviar_tramas_sin_bloqueo()').
+ *
+ * Para más información consulte 'man writev'.
+ *
+ * @param descriptor identificador del socket abierto
+ * @param datos arreglo con los datos de cada trama
+ * @param tam_datos longitud de cada trama
+ * @param num_tramas número de tramas, a lo más 'kMaxTramasLote'
+ *
+ * @return número total de bytes enviados(incluyendo encabezados), -1 en caso
+ *         de error
+ */
+int enviar_tramas_stream(int descriptor, char **datos, uint32_t *tam_datos,
+        int num_tramas) {
+    uint32_t encabezados[kMaxTramasLote];
+    struct iovec vectores[2*kMaxTramasLote];
+    int indice = 0, num_vectores;
+    ssize_t res, total = 0;
+
+    if (num_tramas > kMaxTramasLote) {
+        num_tramas = kMaxTramasLote;
+    }
+    num_vectores = preparar_vectores_tramas(datos, tam_datos, num_tramas,
+        encabezados, vectores);
+
+    while (indice < num_vectores) {
+        uint64_t inicio = iniciar_medicion_socket();
+        res = writev(descriptor, &vectores[indice], num_vectores - indice);
+        registrar_operacion_socket(kOpEnviarStream, res, -1, inicio);
+        if (res == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) &&
+                    esperar_descriptor(descriptor, POLLOUT, -1) == 1) {
+                continue;
+            }
+            fprintf(stderr, "\nError al enviar tramas(writev): %s\n",
+                strerror(errno));
+            return -1;
+        }
+        total += res;
+        avanzar_vectores_tramas(vectores, num_vectores, &indice, res);
+    }
+
+    return total;
+}
+
+/**
+ * Envía una sola trama, ver 'enviar_tramas_stream()'.
+ *
+ * @param descriptor identificador del socket abierto
+ * @param datos bytes a enviar
+ * @param tam_datos número de bytes
+ *
+ * @return número total de bytes enviados(incluyendo encabezado), -1 en caso de
+ *         error
+ */
+int enviar_trama_stream(int descriptor, char *datos, uint32_t tam_datos) {
+    return enviar_tramas_stream(descriptor, &datos, &tam_datos, 1);
+}
+
+/**
+ * Envía varias tramas sin esperar a que el socket(NO bloqueante) tenga
+ * espacio: los bytes que no caben se copian al final de 'pendientes' para
+ * enviarse después con 'enviar_pendientes_stream()'. Si 'pendientes' ya tiene
+ * bytes, las tramas se copian detrás de ellos sin intentar enviarlas, así se
+ * conserva el orden.
+ *
+ * @param descriptor identificador del socket abierto
+ * @param datos arreglo con los datos de cada trama
+ * @param tam_datos longitud de cada trama
+ * @param num_tramas número de tramas, a lo más 'kMaxTramasLote'
+ * @param pendientes buffer con los bytes que aún no se envían
+ *
+ * @return número de bytes enviados ahora(incluyendo encabezados), -1 en caso
+ *         de error
+ */
+int enviar_tramas_sin_bloqueo(int descriptor, char **datos,
+        uint32_t *tam_datos, int num_tramas, Buffer_tramas *pendientes) {
+    uint32_t encabezados[kMaxTramasLote];
+    struct iovec vectores[2*kMaxTramasLote];
+    int indice = 0, num_vectores;
+    ssize_t res, total = 0;
+
+    if (num_tramas > kMaxTramasLote) {
+        num_tramas = kMaxTramasLote;
+    }
+    num_vectores = preparar_vectores_tramas(datos, tam_datos, num_tramas,
+        encabezados, vectores);
+
+    while (pendientes->fin == pendientes->inicio && indice < num_vectores) {
+        uint64_t inicio = iniciar_medicion_socket();
+        res = writev(descriptor, &vectores[indice], num_vectores - indice);
+        registrar_operacion_socket(kOpEnviarStream, res, -1, inicio);
+        if (res == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            fprintf(stderr, "\nError al enviar tramas(writev): %s\n",
+                strerror(errno));
+            return -1;
+        }
+        total += res;
+        avanzar_vectores_tramas(vectores, num_vectores, &indice, res);
+    }
+    for (; indice < num_vectores; indice++) {
+        if (agregar_datos_tramas(pendientes, vectores[indice].iov_base,
+                vectores[indice].iov_len) == -1) {
+            return -1;
+        }
+    }
+
+    return total;
+}
+
+/**
+ * Envía sin esperar los bytes guardados por 'enviar_tramas_sin_bloqueo()'. Si
+ * se envían todos, la memoria del buffer se libera.
+ *
+ * @param descriptor identificador del socket abierto(NO bloqueante)
+ * @param pendientes buffer con los bytes que aún no se envían
+ *
+ * @return número de bytes enviados, -1 en caso de error
+ */
+int enviar_pendientes_stream(int descriptor, Buffer_tramas *pendientes) {
+    ssize_t res, total = 0;
+
+    while (pendientes->inicio < pendientes->fin) {
+        uint64_t inicio = iniciar_medicion_socket();
+        res = send(descriptor, pendientes->datos + pendientes->inicio,
+            pendientes->fin - pendientes->inicio, MSG_DONTWAIT | MSG_NOSIGNAL);
+        registrar_operacion_socket(kOpEnviarStream, res, -1, inicio);
+        if (res == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            fprintf(stderr, "\nError al enviar datos pendientes(send): %s\n",
+                strerror(errno));
+            return -1;
+        }
+        pendientes->inicio += res;
+        total += res;
+    }
+    if (pendientes->inicio == pendientes->fin) {
+        liberar_buffer_tramas(pendientes);
+    }
+
+    return total;
+}
+
+#endif  // FUNCIONES_TRAMAS_H_
@@ -0,0 +1,353 @@
+/**
+ * Funciones para transferencia de archivos sin copias
+ *
+ * Contiene funciones para enviar un archivo por un socket de flujo con
+ * 'sendfile()' y para escribirlo en disco con 'splice()' a través de una
+ * tubería, de modo que los datos nunca pasan por memoria del proceso. También
+ * se incluye la versión con copias('read()'/'send()' y 'recv()'/'write()')
+ * para comparar el rendimiento.
+ *
+ * Notas:
+ * - Antes de los bytes del archivo se envía una trama de anuncio con el
+ * 	formato "#archivo <bytes> <nombre>", ver 'funciones_tramas.h'. Los bytes
+ * 	del archivo se envían sin tramas.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_TRANSFERENCIA_H_
+#define FUNCIONES_TRANSFERENCIA_H_
+
+#include <time.h>  // para 'clock_gettime()'
+#include <sys/stat.h>  // para 'fstat()'
+#include <sys/sendfile.h>
+
+#include "funciones_sockets.h"
+#include "funciones_tramas.h"
+
+// prefijo de la trama que anuncia un archivo
+const char *kPrefijoArchivo = "#archivo ";
+// bytes que se mueven en cada llamada a 'sendfile()', 'splice()' o 'read()'
+const size_t kTamBloqueArchivo = 1024*1024;
+
+/* Prototipos */
+
+int anunciar_archivo(int descriptor, long long tam_archivo, const char *nombre);
+int interpretar_anuncio_archivo(const char *mensaje, uint32_t tam_mensaje,
+        long long *tam_archivo, char *nombre, int tam_nombre);
+long long enviar_archivo_sendfile(int descriptor, int descriptor_archivo,
+        long long tam_archivo);
+long long enviar_archivo_copia(int descriptor, int descriptor_archivo,
+        long long tam_archivo);
+int crear_tuberia_splice(int tuberia[2]);
+int recibir_archivo_splice(int descriptor, int tuberia[2],
+        int descriptor_archivo, long long *pendientes);
+int recibir_archivo_copia(int descriptor, int descriptor_archivo,
+        long long *pendientes, char *buffer, int tam_buffer);
+double calcular_mb_por_segundo(long long bytes, const struct timespec *inicio);
+
+/* Funciones */
+
+/**
+ * Envía la trama que anuncia un archivo: su tamaño y su nombre.
+ *
+ * @param descriptor identificador del socket abierto
+ * @param tam_archivo tamaño del archivo en bytes
+ * @param nombre nombre del archivo(sin directorios)
+ *
+ * @return número de bytes enviados, -1 en caso de error
+ */
+int anunciar_archivo(int descriptor, long long tam_archivo, const char *nombre) {
+    char anuncio[512];
+    int tam_anuncio = snprintf(anuncio, sizeof(anuncio), "%s%lld %s",
+        kPrefijoArchivo, tam_archivo, nombre);
+    if (tam_anuncio < 0 || tam_anuncio >= (int)sizeof(anuncio)) {
+        fprintf(stderr, "\nNombre de archivo demasiado largo\n");
+        return -1;
+    }
+
+    return enviar_trama_stream(descriptor, anuncio, tam_anuncio);
+}
+
+/**
+ * Revisa si un mensaje es un anuncio de archivo y obtiene sus datos. Del
+ * nombre sólo se conserva la parte posterior a la última '/'.
+ *
+ * @param mensaje datos de la trama
+ * @param tam_mensaje longitud de la trama
+ * @param tam_archivo donde se guarda el tamaño del archivo
+ * @param nombre donde se guarda el nombre del archivo
+ * @param tam_nombre tamaño del buffer 'nombre'
+ *
+ * @return 1 si es un anuncio válido, 0 en otro caso
+ */
+int interpretar_anuncio_archivo(const char *mensaje, uint32_t tam_mensaje,
+        long long *tam_archivo, char *nombre, int tam_nombre) {
+    char anuncio[512];
+    size_t tam_prefijo = strlen(kPrefijoArchivo);
+    char *resto, *separador;
+
+    if (tam_mensaje <= tam_prefijo || tam_mensaje >= sizeof(anuncio) ||
+            memcmp(mensaje, kPrefijoArchivo, tam_prefijo) != 0) {
+        return 0;
+    }
+    memcpy(anuncio, mensaje, tam_mensaje);
+    anuncio[tam_mensaje] = '\0';
+
+    *tam_archivo = strtoll(anuncio + tam_prefijo, &resto, 10);
+    if (*tam_archivo < 0 || *resto != ' ' || resto[1] == '\0') {
+        return 0;
+    }
+    resto++;
+    separador = strrchr(resto, '/');
+    if (separador != NULL) {
+        resto = separador + 1;
+    }
+    if (*resto == '\0' || strcmp(resto, ".") == 0 || strcmp(resto, "..") == 0) {
+        return 0;
+    }
+    snprintf(nombre, tam_nombre, "%s", resto);
+
+    return 1;
+}
+
+/**
+ * Envía un archivo con 'sendfile()': el kernel copia las páginas del archivo
+ * directamente al socket.
+ *
+ * Para más información consulte 'man sendfile'.
+ *
+ * @param descriptor identificador del socket abierto
+ * @param descriptor_archivo archivo abierto para lectura
+ * @param tam_archivo número de bytes a enviar
+ *
+ * @return número de bytes enviados, -1 en caso de error
+ */
+long long enviar_archivo_sendfile(int descriptor, int descriptor_archivo,
+        long long tam_archivo) {
+    off_t posicion = 0;
+    ssize_t res;
+
+    while (posicion < tam_archivo) {
+        size_t bloque = tam_archivo - posicion < (long long)kTamBloqueArchivo ?
+            (size_t)(tam_archivo - posicion) : kTamBloqueArchivo;
+        res = sendfile(descriptor, descriptor_archivo, &posicion, bloque);
+        if (res == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) &&
+                    esperar_descriptor(descriptor, POLLOUT, -1) == 1) {
+                continue;
+            }
+            fprintf(stderr, "\nError al enviar archivo(sendfile): %s\n",
+                strerror(errno));
+            return -1;
+        }
+        if (res == 0) {
+            break;  // el archivo se truncó
+        }
+    }
+
+    return posicion;
+}
+
+/**
+ * Envía un archivo leyéndolo por bloques en memoria del proceso y enviando
+ * cada bloque con 'send()'. Sirve como referencia para comparar con
+ * 'enviar_archivo_sendfile()'.
+ *
+ * @param descriptor identificador del socket abierto
+ * @param descriptor_archivo archivo abierto para lectura
+ * @param tam_archivo número de bytes a enviar
+ *
+ * @return número de bytes enviados, -1 en caso de error
+ */
+long long enviar_archivo_copia(int descriptor, int descriptor_archivo,
+        long long tam_archivo) {
+    char *buffer = (char*)malloc(kTamBloqueArchivo);
+    long long enviados = 0;
+    ssize_t leidos, res, escritos;
+
+    if (buffer == NULL) {
+        fprintf(stderr, "\nError al reservar memoria para la copia\n");
+        return -1;
+    }
+    while (enviados < tam_archivo) {
+        leidos = read(descriptor_archivo, buffer, kTamBloqueArchivo);
+        if (leidos <= 0) {
+            if (leidos == -1 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (escritos = 0; escritos < leidos; escritos += res) {
+            res = send(descriptor, buffer + escritos, leidos - escritos,
+                MSG_NOSIGNAL);
+            if (res == -1) {
+                if (errno == EINTR) {
+                    res = 0;
+                    continue;
+                }
+                fprintf(stderr, "\nError al enviar archivo(send): %s\n",
+                    strerror(errno));
+                free(buffer);
+                return -1;
+            }
+        }
+        enviados += leidos;
+    }
+
+    free(buffer);
+    return enviados;
+}
+
+/**
+ * Crea la tubería NO bloqueante que usa 'recibir_archivo_splice()' y agranda
+ * su capacidad para mover bloques de 'kTamBloqueArchivo'.
+ *
+ * @param tuberia arreglo donde se guardan los extremos de lectura y escritura
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int crear_tuberia_splice(int tuberia[2]) {
+    if (pipe2(tuberia, O_NONBLOCK | O_CLOEXEC) == -1) {
+        fprintf(stderr, "\nError al crear tubería(pipe2): %s\n",
+            strerror(errno));
+        return -1;
+    }
+    // si no se permite agrandar se usa la capacidad por defecto
+    fcntl(tuberia[1], F_SETPIPE_SZ, (int)kTamBloqueArchivo);
+
+    return 0;
+}
+
+/**
+ * Mueve al archivo los bytes disponibles en el socket usando 'splice()':
+ * socket -> tubería -> archivo, siempre dentro del kernel. Se detiene cuando
+ * el socket NO bloqueante ya no tiene datos(EAGAIN) o al completar el archivo,
+ * por lo que puede llamarse en cada evento de lectura del reactor.
+ *
+ * Para más información consulte 'man splice'.
+ *
+ * @param descriptor identificador del socket(NO bloqueante)
+ * @param tuberia tubería creada con 'crear_tuberia_splice()'
+ * @param descriptor_archivo archivo abierto para escritura
+ * @param pendientes bytes que faltan por recibir, se actualiza
+ *
+ * @return 0 si no hay más datos por ahora o ya se completó, -1 en caso de
+ *         error o si la conexión se cerró antes de completar
+ */
+int recibir_archivo_splice(int descriptor, int tuberia[2],
+        int descriptor_archivo, long long *pendientes) {
+    ssize_t en_tuberia, res;
+
+    while (*pendientes > 0) {
+        size_t bloque = *pendientes < (long long)kTamBloqueArchivo ?
+            (size_t)*pendientes : kTamBloqueArchivo;
+        en_tuberia = splice(descriptor, NULL, tuberia[1], NULL, bloque,
+            SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (en_tuberia == 0) {
+            fprintf(stderr, "\nConexión cerrada antes de completar archivo\n");
+            return -1;
+        }
+        if (en_tuberia == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            fprintf(stderr, "\nError al recibir archivo(splice): %s\n",
+                strerror(errno));
+            return -1;
+        }
+
+        // todo lo que entró a la tubería se pasa al archivo
+        while (en_tuberia > 0) {
+            res = splice(tuberia[0], NULL, descriptor_archivo, NULL, en_tuberia,
+                SPLICE_F_MOVE);
+            if (res == -1) {
+                if (errno == EINTR || errno == EAGAIN) {
+                    continue;
+                }
+                fprintf(stderr, "\nError al escribir archivo(splice): %s\n",
+                    strerror(errno));
+                return -1;
+            }
+            en_tuberia -= res;
+            *pendientes -= res;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Versión con copias de 'recibir_archivo_splice()': recibe en un buffer del
+ * proceso y lo escribe con 'write()'.
+ *
+ * @param descriptor identificador del socket(NO bloqueante)
+ * @param descriptor_archivo archivo abierto para escritura
+ * @param pendientes bytes que faltan por recibir, se actualiza
+ * @param buffer buffer de trabajo
+ * @param tam_buffer tamaño del buffer
+ *
+ * @return 0 si no hay más datos por ahora o ya se completó, -1 en caso de
+ *         error o si la conexión se cerró antes de completar
+ */
+int recibir_archivo_copia(int descriptor, int descriptor_archivo,
+        long long *pendientes, char *buffer, int tam_buffer) {
+    ssize_t recibidos;
+
+    while (*pendientes > 0) {
+        size_t bloque = *pendientes < tam_buffer ? (size_t)*pendientes :
+            (size_t)tam_buffer;
+        recibidos = recv(descriptor, buffer, bloque, 0);
+        if (recibidos == 0) {
+            fprintf(stderr, "\nConexión cerrada antes de completar archivo\n");
+            return -1;
+        }
+        if (recibidos == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            fprintf(stderr, "\nError al recibir archivo(recv): %s\n",
+                strerror(errno));
+            return -1;
+        }
+        if (write(descriptor_archivo, buffer, recibidos) != recibidos) {
+            fprintf(stderr, "\nError al escribir archivo(write): %s\n",
+                strerror(errno));
+            return -1;
+        }
+        *pendientes -= recibidos;
+    }
+
+    return 0;
+}
+
+/**
+ * Calcula la tasa de transferencia desde un instante dado hasta ahora.
+ *
+ * @param bytes número de bytes transferidos
+ * @param inicio instante de inicio(CLOCK_MONOTONIC)
+ *
+ * @return megabytes(10^6 bytes) por segundo
+ */
+double calcular_mb_por_segundo(long long bytes, const struct timespec *inicio) {
+    struct timespec fin;
+    clock_gettime(CLOCK_MONOTONIC, &fin);
+    double segundos = (fin.tv_sec - inicio->tv_sec) +
+        (fin.tv_nsec - inicio->tv_nsec)/1e9;
+    if (segundos <= 0) {
+        return 0;
+    }
+
+    return bytes/1e6/segundos;
+}
+
+#endif  // FUNCIONES_TRANSFERENCIA_H_
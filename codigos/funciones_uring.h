@@ -0,0 +1,1091 @@
+/**
+ * Funciones para E/S asíncrona con io_uring
+ *
+ * Contiene un motor de E/S basado en io_uring que se usa directamente con las
+ * llamadas al sistema('io_uring_setup()', 'io_uring_enter()' y
+ * 'io_uring_register()'), sin depender de liburing. Las operaciones(accept,
+ * recv, recvmsg, send, sendmsg y poll) se colocan en la cola de envío(SQ) y
+ * sus resultados se leen de la cola de completados(CQ), así con una sola
+ * llamada al sistema se envían y recogen muchas operaciones.
+ *
+ * Notas:
+ * - Si el kernel no soporta io_uring(o está deshabilitado) 'crear_anillo_uring()'
+ * 	regresa -1 y el programa debe usar las funciones de 'funciones_sockets.h'.
+ * - Los buffers "provistos" se registran en el kernel y se usan con las
+ * 	operaciones multishot(una sola solicitud genera varios completados). Si el
+ * 	kernel no soporta multishot se usan solicitudes sencillas.
+ * - La salida de las conexiones de un reactor que cabe en una ranura se copia
+ * 	a memoria registrada(IORING_REGISTER_BUFFERS). El kernel sólo acepta
+ * 	buffers registrados en el envío sin copia(IORING_OP_SEND_ZC), que se usa
+ * 	a partir de 'kMinEnvioFijoUring' bytes; los envíos menores, o si el
+ * 	kernel o el socket no lo soportan, salen con 'send()' desde las mismas
+ * 	ranuras. Una salida mayor se envía desde su propio buffer.
+ *
+ * Para más información consultar 'man 7 io_uring'.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_URING_H_
+#define FUNCIONES_URING_H_
+
+#include <stdint.h>
+#include <sys/mman.h>  // para 'mmap()'
+#include <sys/syscall.h>  // para 'syscall()'
+#include <linux/io_uring.h>
+
+#include "funciones_sockets.h"
+#include "funciones_epoll.h"
+
+// número de entradas de la cola de envío
+const unsigned kEntradasUring = 256;
+// identificador del grupo de buffers provistos
+const int kGrupoBuffersUring = 0;
+// número de buffers provistos(debe ser potencia de 2)
+const unsigned kNumBuffersUring = 256;
+// número de envíos en curso a la vez y bytes de la ranura de cada uno
+const unsigned kNumEnviosUring = 256;
+const unsigned kTamEnvioUring = 16*1024;
+// bytes mínimos para enviar sin copia, en envíos menores fijar las páginas
+// cuesta más que copiarlas
+const unsigned kMinEnvioFijoUring = 4096;
+
+// tipo de operación, se guarda en los 8 bits altos de 'user_data'
+typedef enum {kUringAceptar = 1, kUringRecibir, kUringRecibirMensaje,
+    kUringEsperar, kUringEscribir, kUringEnviar, kUringEnviarMensaje}
+    Operacion_uring;
+
+// envío en curso de la salida de una conexión: los bytes de 'datos' entre
+// 'inicio' y 'fin' aún no salen
+typedef struct Envio_uring {
+    int descriptor;  // -1 si el envío terminó
+    unsigned generacion;  // generación de la conexión al pedir el envío
+    char *datos;  // la ranura, o los datos de 'cedida'
+    size_t inicio;
+    size_t fin;
+    // salida que la conexión cedió completa porque no cabía en la ranura
+    Buffer_tramas cedida;
+    // avisos del envío sin copia que aún no llegan: hasta entonces el kernel
+    // puede leer la ranura
+    unsigned notificaciones;
+} Envio_uring;
+
+typedef struct Anillo_uring {
+    int descriptor;
+    unsigned entradas;
+    // cola de envío(SQ), compartida con el kernel
+    unsigned *sq_cabeza;
+    unsigned *sq_cola;
+    unsigned *sq_mascara;
+    unsigned *sq_arreglo;
+    struct io_uring_sqe *sqes;
+    unsigned sq_cola_local;  // solicitudes preparadas aún no publicadas
+    // cola de completados(CQ), compartida con el kernel
+    unsigned *cq_cabeza;
+    unsigned *cq_cola;
+    unsigned *cq_mascara;
+    struct io_uring_cqe *cqes;
+    // regiones mapeadas
+    void *sq_memoria;
+    size_t sq_tam;
+    void *cq_memoria;
+    size_t cq_tam;
+    size_t sqes_tam;
+    // anillo de buffers provistos
+    struct io_uring_buf_ring *anillo_buffers;
+    size_t anillo_buffers_tam;
+    char *memoria_buffers;
+    unsigned num_buffers;
+    unsigned tam_buffer;  // bytes que el kernel puede llenar en cada buffer
+    unsigned short cola_buffers;
+    int multishot;  // 1 mientras el kernel acepte operaciones multishot
+    // envíos de la salida de las conexiones, la memoria de sus ranuras es el
+    // buffer registrado 0
+    char *memoria_envios;
+    Envio_uring *envios;
+    unsigned *envios_libres;  // pila de envíos que no están en curso
+    unsigned num_envios;
+    unsigned num_envios_libres;
+    unsigned tam_envio;
+    int envio_fijo;  // 1 mientras se pueda enviar sin copia desde el registro
+    unsigned long llamadas_sistema;  // llamadas a 'io_uring_enter()'
+    unsigned long completados;
+} Anillo_uring;
+
+/* Prototipos */
+
+int crear_anillo_uring(Anillo_uring *anillo, unsigned entradas);
+void destruir_anillo_uring(Anillo_uring *anillo);
+uint64_t codificar_datos_uring(Operacion_uring operacion, unsigned generacion,
+        int descriptor);
+struct io_uring_sqe* obtener_sqe_uring(Anillo_uring *anillo);
+int enviar_solicitudes_uring(Anillo_uring *anillo, unsigned esperar);
+int obtener_completado_uring(Anillo_uring *anillo, struct io_uring_cqe *cqe);
+int registrar_buffers_provistos_uring(Anillo_uring *anillo,
+        unsigned num_buffers, unsigned tam_buffer);
+char* obtener_buffer_provisto_uring(Anillo_uring *anillo, unsigned id);
+void devolver_buffer_provisto_uring(Anillo_uring *anillo, unsigned id);
+int registrar_buffers_fijos_uring(Anillo_uring *anillo,
+        struct iovec *buffers, unsigned num_buffers);
+int registrar_envios_uring(Anillo_uring *anillo, unsigned num_envios,
+        unsigned tam_envio);
+int preparar_aceptar_uring(Anillo_uring *anillo, int descriptor,
+        uint64_t datos);
+int preparar_recibir_provisto_uring(Anillo_uring *anillo, int descriptor,
+        uint64_t datos);
+int preparar_recibir_mensaje_uring(Anillo_uring *anillo, int descriptor,
+        struct msghdr *mensaje, uint64_t datos);
+int preparar_esperar_uring(Anillo_uring *anillo, int descriptor,
+        unsigned eventos, uint64_t datos);
+int preparar_enviar_uring(Anillo_uring *anillo, int descriptor,
+        char *buffer, unsigned tam, uint64_t datos);
+int preparar_enviar_fijo_uring(Anillo_uring *anillo, int descriptor,
+        char *buffer, unsigned tam, unsigned indice, uint64_t datos);
+int preparar_enviar_mensaje_uring(Anillo_uring *anillo, int descriptor,
+        struct msghdr *mensaje, uint64_t datos);
+int continuar_envio_uring(Anillo_uring *anillo, unsigned id);
+void marcar_por_aceptar_uring(Reactor *reactor, int *por_aceptar,
+        int descriptor);
+int pedir_escritura_uring(Reactor *reactor, Conexion *conexion);
+void atender_envio_uring(Reactor *reactor, Anillo_uring *anillo,
+        struct io_uring_cqe *cqe);
+int ejecutar_reactor_uring(Reactor *reactor, Anillo_uring *anillo);
+
+/* Funciones */
+
+/**
+ * Crea la instancia de io_uring y mapea sus colas de envío y completados en
+ * memoria del proceso.
+ *
+ * Para más información consultar 'man 2 io_uring_setup'.
+ *
+ * @param anillo estructura a inicializar
+ * @param entradas número de entradas de la cola de envío
+ *
+ * @return 0 en caso de éxito, -1 si io_uring no está disponible
+ */
+int crear_anillo_uring(Anillo_uring *anillo, unsigned entradas) {
+    struct io_uring_params parametros;
+    memset(anillo, 0, sizeof(Anillo_uring));
+    memset(&parametros, 0, sizeof(parametros));
+
+    anillo->descriptor = syscall(__NR_io_uring_setup, entradas, &parametros);
+    if (anillo->descriptor == -1) {
+        fprintf(stderr,"\nio_uring no disponible(io_uring_setup): %s\n",
+            strerror(errno));
+        return -1;
+    }
+    anillo->entradas = parametros.sq_entries;
+
+    anillo->sq_tam = parametros.sq_off.array +
+        parametros.sq_entries*sizeof(unsigned);
+    anillo->cq_tam = parametros.cq_off.cqes +
+        parametros.cq_entries*sizeof(struct io_uring_cqe);
+    // con IORING_FEAT_SINGLE_MMAP ambas colas están en la misma región
+    if (parametros.features & IORING_FEAT_SINGLE_MMAP) {
+        if (anillo->cq_tam > anillo->sq_tam) {
+            anillo->sq_tam = anillo->cq_tam;
+        }
+        anillo->cq_tam = 0;
+    }
+
+    anillo->sq_memoria = mmap(NULL, anillo->sq_tam, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, anillo->descriptor, IORING_OFF_SQ_RING);
+    if (anillo->sq_memoria == MAP_FAILED) {
+        anillo->sq_memoria = NULL;
+        fprintf(stderr,"\nError al mapear cola de envío: %s\n", strerror(errno));
+        destruir_anillo_uring(anillo);
+        return -1;
+    }
+    if (anillo->cq_tam == 0) {
+        anillo->cq_memoria = anillo->sq_memoria;
+    } else {
+        anillo->cq_memoria = mmap(NULL, anillo->cq_tam, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, anillo->descriptor, IORING_OFF_CQ_RING);
+        if (anillo->cq_memoria == MAP_FAILED) {
+            anillo->cq_memoria = NULL;
+            fprintf(stderr,"\nError al mapear cola de completados: %s\n",
+                strerror(errno));
+            destruir_anillo_uring(anillo);
+            return -1;
+        }
+    }
+    anillo->sqes_tam = parametros.sq_entries*sizeof(struct io_uring_sqe);
+    anillo->sqes = (struct io_uring_sqe*)mmap(NULL, anillo->sqes_tam,
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, anillo->descriptor,
+        IORING_OFF_SQES);
+    if (anillo->sqes == MAP_FAILED) {
+        anillo->sqes = NULL;
+        fprintf(stderr,"\nError al mapear solicitudes: %s\n", strerror(errno));
+        destruir_anillo_uring(anillo);
+        return -1;
+    }
+
+    char *sq = (char*)anillo->sq_memoria;
+    char *cq = (char*)anillo->cq_memoria;
+    anillo->sq_cabeza = (unsigned*)(sq + parametros.sq_off.head);
+    anillo->sq_cola = (unsigned*)(sq + parametros.sq_off.tail);
+    anillo->sq_mascara = (unsigned*)(sq + parametros.sq_off.ring_mask);
+    anillo->sq_arreglo = (unsigned*)(sq + parametros.sq_off.array);
+    anillo->sq_cola_local = *anillo->sq_cola;
+    anillo->cq_cabeza = (unsigned*)(cq + parametros.cq_off.head);
+    anillo->cq_cola = (unsigned*)(cq + parametros.cq_off.tail);
+    anillo->cq_mascara = (unsigned*)(cq + parametros.cq_off.ring_mask);
+    anillo->cqes = (struct io_uring_cqe*)(cq + parametros.cq_off.cqes);
+    anillo->multishot = 1;
+
+    return 0;
+}
+
+/**
+ * Libera las regiones mapeadas, los buffers y cierra la instancia de
+ * io_uring(lo que cancela las operaciones pendientes).
+ *
+ * @param anillo anillo a destruir
+ */
+void destruir_anillo_uring(Anillo_uring *anillo) {
+    unsigned i;
+
+    if (anillo->sqes != NULL) {
+        munmap(anillo->sqes, anillo->sqes_tam);
+    }
+    if (anillo->cq_memoria != NULL && anillo->cq_memoria != anillo->sq_memoria) {
+        munmap(anillo->cq_memoria, anillo->cq_tam);
+    }
+    if (anillo->sq_memoria != NULL) {
+        munmap(anillo->sq_memoria, anillo->sq_tam);
+    }
+    if (anillo->descriptor > 0) {
+        close(anillo->descriptor);
+    }
+    if (anillo->anillo_buffers != NULL) {
+        munmap(anillo->anillo_buffers, anillo->anillo_buffers_tam);
+    }
+    free(anillo->memoria_buffers);
+    // el kernel ya no usa la salida cedida por los envíos que no terminaron
+    for (i = 0; i < anillo->num_envios; i++) {
+        liberar_buffer_tramas(&anillo->envios[i].cedida);
+    }
+    free(anillo->memoria_envios);
+    free(anillo->envios);
+    free(anillo->envios_libres);
+    memset(anillo, 0, sizeof(Anillo_uring));
+}
+
+/**
+ * Construye el valor 'user_data' de una solicitud, el cual el kernel regresa
+ * sin cambios en su completado: operación, generación de la conexión y
+ * descriptor.
+ *
+ * @param operacion tipo de operación
+ * @param generacion generación de la entrada de la tabla de conexiones, sirve
+ *                   para descartar completados de una conexión ya cerrada
+ * @param descriptor identificador del socket
+ *
+ * @return valor para 'user_data'
+ */
+uint64_t codificar_datos_uring(Operacion_uring operacion, unsigned generacion,
+        int descriptor) {
+    return ((uint64_t)operacion << 56) |
+        ((uint64_t)(generacion & 0xffffff) << 32) | (uint32_t)descriptor;
+}
+
+/**
+ * Obtiene la siguiente entrada libre de la cola de envío, en ceros. Si la cola
+ * está llena se envían primero las solicitudes pendientes.
+ *
+ * @param anillo anillo de io_uring
+ *
+ * @return entrada a llenar, 'NULL' si no hay espacio
+ */
+struct io_uring_sqe* obtener_sqe_uring(Anillo_uring *anillo) {
+    unsigned cabeza = __atomic_load_n(anillo->sq_cabeza, __ATOMIC_ACQUIRE);
+    if (anillo->sq_cola_local - cabeza >= anillo->entradas) {
+        enviar_solicitudes_uring(anillo, 0);
+        cabeza = __atomic_load_n(anillo->sq_cabeza, __ATOMIC_ACQUIRE);
+        if (anillo->sq_cola_local - cabeza >= anillo->entradas) {
+            fprintf(stderr,"\nCola de envío de io_uring llena\n");
+            return NULL;
+        }
+    }
+
+    unsigned indice = anillo->sq_cola_local & *anillo->sq_mascara;
+    struct io_uring_sqe *sqe = &anillo->sqes[indice];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    anillo->sq_arreglo[indice] = indice;
+    anillo->sq_cola_local++;
+
+    return sqe;
+}
+
+/**
+ * Publica las solicitudes preparadas y las envía al kernel con
+ * 'io_uring_enter()'. Opcionalmente espera a que haya completados.
+ *
+ * Para más información consultar 'man 2 io_uring_enter'.
+ *
+ * @param anillo anillo de io_uring
+ * @param esperar número mínimo de completados a esperar(0 para no esperar)
+ *
+ * @return número de solicitudes enviadas, -1 en caso de error(EINTR si la
+ *         espera fue interrumpida por una señal)
+ */
+int enviar_solicitudes_uring(Anillo_uring *anillo, unsigned esperar) {
+    unsigned por_enviar = anillo->sq_cola_local - *anillo->sq_cola;
+    if (por_enviar == 0 && esperar == 0) {
+        return 0;
+    }
+    __atomic_store_n(anillo->sq_cola, anillo->sq_cola_local, __ATOMIC_RELEASE);
+
+    anillo->llamadas_sistema++;
+    int res = syscall(__NR_io_uring_enter, anillo->descriptor, por_enviar,
+        esperar, esperar > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (res == -1 && errno != EINTR) {
+        fprintf(stderr,"\nError al enviar solicitudes(io_uring_enter): %s\n",
+            strerror(errno));
+    }
+
+    return res;
+}
+
+/**
+ * Toma el siguiente completado de la cola, si lo hay.
+ *
+ * @param anillo anillo de io_uring
+ * @param cqe estructura donde se copia el completado
+ *
+ * @return 1 si se obtuvo un completado, 0 si la cola está vacía
+ */
+int obtener_completado_uring(Anillo_uring *anillo, struct io_uring_cqe *cqe) {
+    unsigned cabeza = *anillo->cq_cabeza;
+    if (cabeza == __atomic_load_n(anillo->cq_cola, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    *cqe = anillo->cqes[cabeza & *anillo->cq_mascara];
+    __atomic_store_n(anillo->cq_cabeza, cabeza + 1, __ATOMIC_RELEASE);
+    anillo->completados++;
+
+    return 1;
+}
+
+/**
+ * Registra en el kernel un anillo de buffers "provistos". Las operaciones con
+ * IOSQE_BUFFER_SELECT toman un buffer libre de este anillo en el momento en
+ * que llegan los datos, así no es necesario reservar un buffer por conexión.
+ *
+ * @param anillo anillo de io_uring
+ * @param num_buffers número de buffers(potencia de 2)
+ * @param tam_buffer bytes que el kernel puede llenar en cada buffer. Se
+ *                   reserva un byte adicional por buffer para que se pueda
+ *                   agregar el fin de cadena
+ *
+ * @return 0 en caso de éxito, -1 si el kernel no lo soporta
+ */
+int registrar_buffers_provistos_uring(Anillo_uring *anillo,
+        unsigned num_buffers, unsigned tam_buffer) {
+    struct io_uring_buf_reg registro;
+    unsigned i;
+
+    anillo->anillo_buffers_tam = num_buffers*sizeof(struct io_uring_buf);
+    // el anillo debe estar alineado a página, 'mmap()' lo garantiza
+    anillo->anillo_buffers = (struct io_uring_buf_ring*)mmap(NULL,
+        anillo->anillo_buffers_tam, PROT_READ | PROT_WRITE,
+        MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (anillo->anillo_buffers == MAP_FAILED) {
+        anillo->anillo_buffers = NULL;
+        fprintf(stderr,"\nError al reservar anillo de buffers: %s\n",
+            strerror(errno));
+        return -1;
+    }
+
+    memset(&registro, 0, sizeof(registro));
+    registro.ring_addr = (uint64_t)(uintptr_t)anillo->anillo_buffers;
+    registro.ring_entries = num_buffers;
+    registro.bgid = kGrupoBuffersUring;
+    if (syscall(__NR_io_uring_register, anillo->descriptor,
+            IORING_REGISTER_PBUF_RING, &registro, 1) == -1) {
+        fprintf(stderr,"\nio_uring sin buffers provistos(PBUF_RING): %s\n",
+            strerror(errno));
+        munmap(anillo->anillo_buffers, anillo->anillo_buffers_tam);
+        anillo->anillo_buffers = NULL;
+        return -1;
+    }
+
+    anillo->memoria_buffers = (char*)malloc(sizeof(char)*num_buffers*
+        (tam_buffer + 1));
+    if (anillo->memoria_buffers == NULL) {
+        fprintf(stderr,"\nError al reservar memoria para buffers\n");
+        return -1;
+    }
+    anillo->num_buffers = num_buffers;
+    anillo->tam_buffer = tam_buffer;
+    anillo->cola_buffers = 0;
+    for (i = 0; i < num_buffers; i++) {
+        devolver_buffer_provisto_uring(anillo, i);
+    }
+
+    return 0;
+}
+
+/**
+ * Obtiene la dirección del buffer provisto con el identificador indicado en
+ * las banderas del completado(cqe->flags >> IORING_CQE_BUFFER_SHIFT).
+ *
+ * @param anillo anillo de io_uring
+ * @param id identificador del buffer
+ *
+ * @return dirección del buffer
+ */
+char* obtener_buffer_provisto_uring(Anillo_uring *anillo, unsigned id) {
+    return anillo->memoria_buffers + (size_t)id*(anillo->tam_buffer + 1);
+}
+
+/**
+ * Regresa un buffer provisto al anillo para que el kernel lo vuelva a usar.
+ *
+ * @param anillo anillo de io_uring
+ * @param id identificador del buffer
+ */
+void devolver_buffer_provisto_uring(Anillo_uring *anillo, unsigned id) {
+    struct io_uring_buf *buffer = &anillo->anillo_buffers->bufs[
+        anillo->cola_buffers & (anillo->num_buffers - 1)];
+    buffer->addr = (uint64_t)(uintptr_t)obtener_buffer_provisto_uring(anillo, id);
+    buffer->len = anillo->tam_buffer;
+    buffer->bid = id;
+    anillo->cola_buffers++;
+    __atomic_store_n(&anillo->anillo_buffers->tail, anillo->cola_buffers,
+        __ATOMIC_RELEASE);
+}
+
+/**
+ * Registra buffers "fijos" en el kernel: sus páginas se fijan una sola vez y
+ * las operaciones con buffer registrado los indican por su posición en el
+ * arreglo.
+ *
+ * Para más información consultar 'man 2 io_uring_register'.
+ *
+ * @param anillo anillo de io_uring
+ * @param buffers dirección y longitud de cada buffer
+ * @param num_buffers número de buffers
+ *
+ * @return 0 en caso de éxito, -1 si el kernel no lo permite(por ejemplo por
+ *         el límite de memoria fija, RLIMIT_MEMLOCK)
+ */
+int registrar_buffers_fijos_uring(Anillo_uring *anillo,
+        struct iovec *buffers, unsigned num_buffers) {
+    if (syscall(__NR_io_uring_register, anillo->descriptor,
+            IORING_REGISTER_BUFFERS, buffers, num_buffers) == -1) {
+        fprintf(stderr,"\nio_uring sin buffers registrados(BUFFERS): %s\n",
+            strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Reserva los envíos de un reactor con sus ranuras y registra la memoria de
+ * las ranuras como el buffer fijo 0. La salida de una conexión que cabe en una
+ * ranura se copia a ella y se envía desde ahí; una salida mayor se cede
+ * completa al envío. En ambos casos la conexión puede seguir acumulando salida
+ * mientras el envío está en curso. Si el registro falla las ranuras se usan
+ * sin registrar.
+ *
+ * @param anillo anillo de io_uring
+ * @param num_envios número de envíos en curso a la vez
+ * @param tam_envio bytes de cada ranura
+ *
+ * @return 0 en caso de éxito, -1 si no hay memoria
+ */
+int registrar_envios_uring(Anillo_uring *anillo, unsigned num_envios,
+        unsigned tam_envio) {
+    struct iovec registro;
+    unsigned i;
+
+    anillo->memoria_envios = (char*)malloc(sizeof(char)*num_envios*tam_envio);
+    anillo->envios = (Envio_uring*)calloc(num_envios, sizeof(Envio_uring));
+    anillo->envios_libres = (unsigned*)malloc(sizeof(unsigned)*num_envios);
+    if (anillo->memoria_envios == NULL || anillo->envios == NULL ||
+            anillo->envios_libres == NULL) {
+        fprintf(stderr,"\nError al reservar memoria para envíos\n");
+        return -1;
+    }
+    anillo->num_envios = num_envios;
+    anillo->tam_envio = tam_envio;
+    // los primeros envíos quedan al tope de la pila
+    for (i = 0; i < num_envios; i++) {
+        anillo->envios[i].descriptor = -1;
+        anillo->envios_libres[i] = num_envios - 1 - i;
+    }
+    anillo->num_envios_libres = num_envios;
+
+    registro.iov_base = anillo->memoria_envios;
+    registro.iov_len = (size_t)num_envios*tam_envio;
+    anillo->envio_fijo = registrar_buffers_fijos_uring(anillo, &registro, 1)
+        == 0;
+
+    return 0;
+}
+
+/**
+ * Prepara una aceptación de conexiones. Si el kernel lo soporta es multishot:
+ * cada conexión entrante genera un completado con su descriptor.
+ *
+ * @param anillo anillo de io_uring
+ * @param descriptor socket que escucha
+ * @param datos valor 'user_data' del completado
+ *
+ * @return 0 en caso de éxito, -1 si la cola está llena
+ */
+int preparar_aceptar_uring(Anillo_uring *anillo, int descriptor,
+        uint64_t datos) {
+    struct io_uring_sqe *sqe = obtener_sqe_uring(anillo);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = descriptor;
+    // NO bloqueante, así los envíos del manejador nunca detienen al anillo
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    if (anillo->multishot) {
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    }
+    sqe->user_data = datos;
+
+    return 0;
+}
+
+/**
+ * Prepara una recepción que toma su buffer del anillo de buffers provistos.
+ * Si el kernel lo soporta es multishot: la solicitud sigue activa y genera un
+ * completado(con IORING_CQE_F_MORE) cada vez que llegan datos.
+ *
+ * @param anillo anillo de io_uring con buffers provistos registrados
+ * @param descriptor identificador del socket
+ * @param datos valor 'user_data' del completado
+ *
+ * @return 0 en caso de éxito, -1 si la cola está llena
+ */
+int preparar_recibir_provisto_uring(Anillo_uring *anillo, int descriptor,
+        uint64_t datos) {
+    struct io_uring_sqe *sqe = obtener_sqe_uring(anillo);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = descriptor;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kGrupoBuffersUring;
+    if (anillo->multishot) {
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+    }
+    sqe->user_data = datos;
+
+    return 0;
+}
+
+/**
+ * Prepara una recepción con 'recvmsg()', usada con sockets de datagramas para
+ * obtener también la dirección de origen.
+ *
+ * @param anillo anillo de io_uring
+ * @param descriptor identificador del socket
+ * @param mensaje estructura con buffers y espacio para la dirección, debe
+ *                permanecer válida hasta el completado
+ * @param datos valor 'user_data' del completado
+ *
+ * @return 0 en caso de éxito, -1 si la cola está llena
+ */
+int preparar_recibir_mensaje_uring(Anillo_uring *anillo, int descriptor,
+        struct msghdr *mensaje, uint64_t datos) {
+    struct io_uring_sqe *sqe = obtener_sqe_uring(anillo);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = descriptor;
+    sqe->addr = (uint64_t)(uintptr_t)mensaje;
+    sqe->len = 1;
+    sqe->user_data = datos;
+
+    return 0;
+}
+
+/**
+ * Prepara una espera(como 'poll()') a que un descriptor tenga alguno de los
+ * eventos indicados. Genera un solo completado.
+ *
+ * @param anillo anillo de io_uring
+ * @param descriptor identificador del socket
+ * @param eventos eventos a esperar: POLLIN, POLLOUT
+ * @param datos valor 'user_data' del completado
+ *
+ * @return 0 en caso de éxito, -1 si la cola está llena
+ */
+int preparar_esperar_uring(Anillo_uring *anillo, int descriptor,
+        unsigned eventos, uint64_t datos) {
+    struct io_uring_sqe *sqe = obtener_sqe_uring(anillo);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = descriptor;
+    sqe->poll32_events = eventos;
+    sqe->user_data = datos;
+
+    return 0;
+}
+
+/**
+ * Prepara un envío con 'send()'(IORING_OP_SEND). MSG_NOSIGNAL evita SIGPIPE
+ * si el cliente ya cerró.
+ *
+ * @param anillo anillo de io_uring
+ * @param descriptor identificador del socket
+ * @param buffer datos a enviar, deben permanecer válidos hasta el completado
+ * @param tam número de bytes
+ * @param datos valor 'user_data' del completado
+ *
+ * @return 0 en caso de éxito, -1 si la cola está llena
+ */
+int preparar_enviar_uring(Anillo_uring *anillo, int descriptor,
+        char *buffer, unsigned tam, uint64_t datos) {
+    struct io_uring_sqe *sqe = obtener_sqe_uring(anillo);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = descriptor;
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = tam;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = datos;
+
+    return 0;
+}
+
+/**
+ * Prepara un envío sin copia(IORING_OP_SEND_ZC) desde un buffer registrado con
+ * 'registrar_buffers_fijos_uring()'(IORING_RECVSEND_FIXED_BUF). Genera dos
+ * completados: el resultado(con IORING_CQE_F_MORE) y después el aviso
+ * (IORING_CQE_F_NOTIF) de que el kernel ya no usa el buffer. Si el kernel no
+ * lo soporta el resultado es -EINVAL, y -EOPNOTSUPP si el socket no lo permite
+ * (por ejemplo de dominio Unix).
+ *
+ * @param anillo anillo de io_uring
+ * @param descriptor identificador del socket
+ * @param buffer datos a enviar, dentro del buffer registrado
+ * @param tam número de bytes
+ * @param indice posición del buffer registrado
+ * @param datos valor 'user_data' del completado
+ *
+ * @return 0 en caso de éxito, -1 si la cola está llena
+ */
+int preparar_enviar_fijo_uring(Anillo_uring *anillo, int descriptor,
+        char *buffer, unsigned tam, unsigned indice, uint64_t datos) {
+    if (preparar_enviar_uring(anillo, descriptor, buffer, tam, datos) == -1) {
+        return -1;
+    }
+    struct io_uring_sqe *sqe = &anillo->sqes[(anillo->sq_cola_local - 1) &
+        *anillo->sq_mascara];
+    sqe->opcode = IORING_OP_SEND_ZC;
+    sqe->ioprio = IORING_RECVSEND_FIXED_BUF;
+    sqe->buf_index = indice;
+
+    return 0;
+}
+
+/**
+ * Prepara un envío con 'sendmsg()', usado con sockets de datagramas para
+ * indicar la dirección destino.
+ *
+ * @param anillo anillo de io_uring
+ * @param descriptor identificador del socket
+ * @param mensaje estructura con buffers y dirección destino, debe permanecer
+ *                válida hasta el completado
+ * @param datos valor 'user_data' del completado
+ *
+ * @return 0 en caso de éxito, -1 si la cola está llena
+ */
+int preparar_enviar_mensaje_uring(Anillo_uring *anillo, int descriptor,
+        struct msghdr *mensaje, uint64_t datos) {
+    struct io_uring_sqe *sqe = obtener_sqe_uring(anillo);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = descriptor;
+    sqe->addr = (uint64_t)(uintptr_t)mensaje;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = datos;
+
+    return 0;
+}
+
+/**
+ * Prepara el envío de los bytes pendientes de un envío. Desde una ranura se
+ * envía sin copia(buffer registrado) si son al menos 'kMinEnvioFijoUring' y
+ * el kernel lo permite. En 'user_data' va el envío.
+ *
+ * @param anillo anillo con envíos registrados
+ * @param id envío
+ *
+ * @return 0 en caso de éxito, -1 si la cola está llena
+ */
+int continuar_envio_uring(Anillo_uring *anillo, unsigned id) {
+    Envio_uring *envio = &anillo->envios[id];
+    char *buffer = envio->datos + envio->inicio;
+    // 'len' es de 32 bits, la salida de una conexión se cierra antes de
+    // llegar ahí('kMaxSalidaConexion')
+    unsigned tam = (unsigned)(envio->fin - envio->inicio);
+    uint64_t datos = codificar_datos_uring(kUringEnviar, 0, id);
+
+    if (anillo->envio_fijo && envio->cedida.datos == NULL &&
+            tam >= kMinEnvioFijoUring) {
+        return preparar_enviar_fijo_uring(anillo, envio->descriptor, buffer,
+            tam, 0, datos);
+    }
+    return preparar_enviar_uring(anillo, envio->descriptor, buffer, tam, datos);
+}
+
+/**
+ * Marca a un socket que escucha para que 'ejecutar_reactor_uring()' vuelva a
+ * preparar su aceptación, cuando no cupo en la cola de envío.
+ *
+ * @param reactor reactor con los sockets que escuchan
+ * @param por_aceptar marcas de cada socket que escucha
+ * @param descriptor socket que escucha sin aceptación pendiente
+ */
+void marcar_por_aceptar_uring(Reactor *reactor, int *por_aceptar,
+        int descriptor) {
+    int i;
+    for (i = 0; i < reactor->num_escucha; i++) {
+        if (reactor->descriptores_escucha[i] == descriptor) {
+            por_aceptar[i] = 1;
+        }
+    }
+}
+
+/**
+ * Envía la salida de la conexión desde el anillo del reactor; es el
+ * 'pedir_escritura' del reactor mientras lo atiende 'ejecutar_reactor_uring()'.
+ * La salida pasa a un envío libre(copiada a su ranura si cabe, o cedida
+ * completa) y la conexión empieza una salida nueva, que espera a que termine
+ * ese envío('atender_envio_uring()').
+ *
+ * Sin salida(un escritor espera al socket) o sin envíos libres se pide avisar
+ * cuando la conexión pueda escribir(POLLOUT), y 'atender_escritura()' envía
+ * directamente.
+ *
+ * @param reactor reactor con el anillo en 'motor'
+ * @param conexion conexión con salida pendiente
+ *
+ * @return 0 en caso de éxito, -1 si la cola está llena
+ */
+int pedir_escritura_uring(Reactor *reactor, Conexion *conexion) {
+    Anillo_uring *anillo = (Anillo_uring*)reactor->motor;
+    Buffer_tramas *salida = &conexion->salida;
+    size_t pendientes = salida->fin - salida->inicio;
+    Envio_uring *envio;
+    unsigned id;
+
+    if (pendientes == 0 || anillo->num_envios_libres == 0) {
+        return preparar_esperar_uring(anillo, conexion->descriptor, POLLOUT,
+            codificar_datos_uring(kUringEscribir, conexion->generacion,
+                conexion->descriptor));
+    }
+
+    id = anillo->envios_libres[anillo->num_envios_libres - 1];
+    envio = &anillo->envios[id];
+    envio->descriptor = conexion->descriptor;
+    envio->generacion = conexion->generacion;
+    envio->notificaciones = 0;
+    if (pendientes <= anillo->tam_envio) {
+        envio->datos = anillo->memoria_envios + (size_t)id*anillo->tam_envio;
+        envio->inicio = 0;
+        envio->fin = pendientes;
+        memcpy(envio->datos, salida->datos + salida->inicio, pendientes);
+    } else {
+        envio->cedida = *salida;
+        envio->datos = salida->datos;
+        envio->inicio = salida->inicio;
+        envio->fin = salida->fin;
+    }
+    if (continuar_envio_uring(anillo, id) == -1) {
+        inicializar_buffer_tramas(&envio->cedida);
+        envio->descriptor = -1;
+        return -1;
+    }
+    anillo->num_envios_libres--;
+    if (envio->cedida.datos != NULL) {
+        inicializar_buffer_tramas(salida);
+        salida->cache = envio->cedida.cache;
+    } else {
+        liberar_buffer_tramas(salida);
+    }
+
+    return 0;
+}
+
+/**
+ * Atiende el completado de un envío: si fue parcial se envía el resto, y al
+ * terminar se continúa con la salida que la conexión acumuló mientras tanto;
+ * sin salida se llama a su escritor, como en 'atender_escritura()'. El envío
+ * vuelve a estar libre cuando además llegaron los avisos de sus envíos sin
+ * copia.
+ *
+ * @param reactor reactor con el anillo en 'motor'
+ * @param anillo anillo con envíos registrados
+ * @param cqe completado con el envío en 'user_data'
+ */
+void atender_envio_uring(Reactor *reactor, Anillo_uring *anillo,
+        struct io_uring_cqe *cqe) {
+    unsigned id = (unsigned)(cqe->user_data & 0xffffffff);
+    Envio_uring *envio = &anillo->envios[id];
+    Conexion *conexion;
+    int vigente;
+
+    // el kernel ya no lee la ranura; si el envío terminó queda libre
+    if (cqe->flags & IORING_CQE_F_NOTIF) {
+        envio->notificaciones--;
+        if (envio->notificaciones == 0 && envio->descriptor == -1) {
+            anillo->envios_libres[anillo->num_envios_libres++] = id;
+        }
+        return;
+    }
+    if (cqe->flags & IORING_CQE_F_MORE) {
+        envio->notificaciones++;
+    }
+    conexion = &reactor->conexiones[envio->descriptor];
+    // la conexión pudo cerrarse(y su entrada reutilizarse) durante el envío
+    vigente = conexion->activa && conexion->generacion == envio->generacion;
+
+    // sólo un envío sin copia tiene aviso(IORING_CQE_F_MORE); si el kernel o
+    // el socket no lo soportan se repite con 'send()'
+    if (vigente && (cqe->flags & IORING_CQE_F_MORE) &&
+            (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP)) {
+        anillo->envio_fijo = 0;
+    } else if (vigente && cqe->res > 0) {
+        envio->inicio += cqe->res;
+    } else if (vigente && cqe->res != -EAGAIN && cqe->res != -EINTR) {
+        vigente = 0;
+        if (cqe->res < 0) {
+            fprintf(stderr,"\nError al enviar(io_uring): %s\n",
+                strerror(-cqe->res));
+        }
+        cerrar_conexion(reactor, conexion);
+    }
+    if (vigente && envio->inicio < envio->fin) {
+        if (continuar_envio_uring(anillo, id) == 0) {
+            return;
+        }
+        vigente = 0;
+        cerrar_conexion(reactor, conexion);
+    }
+    envio->descriptor = -1;
+    liberar_buffer_tramas(&envio->cedida);
+    if (envio->notificaciones == 0) {
+        anillo->envios_libres[anillo->num_envios_libres++] = id;
+    }
+    if (!vigente) {
+        return;
+    }
+
+    conexion->espera_escritura = 0;
+    if (revisar_salida_conexion(reactor, conexion) == -1 ||
+            (conexion->salida.fin == conexion->salida.inicio &&
+                conexion->escritor != NULL &&
+                conexion->escritor(reactor, conexion) == -1)) {
+        cerrar_conexion(reactor, conexion);
+    }
+}
+
+/**
+ * Ciclo principal equivalente a 'ejecutar_reactor()', pero con io_uring como
+ * motor de E/S: una aceptación multishot en cada socket que escucha y una
+ * recepción multishot con buffers provistos por conexión. Se usan la misma
+ * tabla de conexiones, el mismo manejador y los mismos contadores del reactor.
+ *
+ * Los buffers provistos deben registrarse con 'reactor->tam_buffer' bytes.
+ *
+ * La salida de las conexiones(por ejemplo los ecos) se envía desde el mismo
+ * anillo('pedir_escritura_uring()'), los envíos deben registrarse
+ * con 'registrar_envios_uring()'.
+ *
+ * Sin descriptores libres la aceptación falla de inmediato aunque no haya
+ * conexiones pendientes; en ese caso se espera(POLLIN) a la siguiente
+ * conexión antes de volver a preparar la aceptación, para no girar en vacío.
+ *
+ * Cada vuelta atiende a lo más 'anillo->entradas' completados antes de enviar
+ * las solicitudes preparadas, aunque la cola de completados no se vacíe.
+ *
+ * Si una solicitud no cabe en la cola de envío(por ejemplo porque el kernel
+ * no la vació mientras la cola de completados estaba llena), la aceptación de
+ * un socket que escucha se vuelve a preparar en la siguiente vuelta y una
+ * conexión que se quedaría sin recepción se cierra.
+ *
+ * @param reactor reactor inicializado con 'crear_reactor()'
+ * @param anillo anillo con buffers provistos y envíos registrados
+ *
+ * @return 0 al terminar normalmente, -1 en caso de error
+ */
+int ejecutar_reactor_uring(Reactor *reactor, Anillo_uring *anillo) {
+    struct io_uring_cqe cqe;
+    struct sockaddr_storage cliente;
+    socklen_t tam_dir;
+    int descriptor;
+    unsigned generacion, id_buffer;
+    unsigned long llamadas_previas = anillo->llamadas_sistema;
+    Conexion *conexion;
+    int i, sin_aceptar, num_completados;
+    // 1 si el socket que escucha de esa posición no tiene una aceptación
+    // ni una espera pendiente
+    int por_aceptar[kMaxEscucha];
+
+    for (i = 0; i < reactor->num_escucha; i++) {
+        por_aceptar[i] = 1;
+    }
+    reactor->motor = anillo;
+    reactor->pedir_escritura = pedir_escritura_uring;
+
+    while (reactor->activo) {
+        // una aceptación por cada socket que escucha, el descriptor va en
+        // 'user_data'
+        sin_aceptar = 0;
+        for (i = 0; i < reactor->num_escucha; i++) {
+            if (por_aceptar[i] && preparar_aceptar_uring(anillo,
+                    reactor->descriptores_escucha[i], codificar_datos_uring(
+                        kUringAceptar, 0, reactor->descriptores_escucha[i]))
+                    == 0) {
+                por_aceptar[i] = 0;
+            }
+            sin_aceptar |= por_aceptar[i];
+        }
+        // sin esperar, para reintentar en cuanto el kernel vacíe la cola
+        if (enviar_solicitudes_uring(anillo, sin_aceptar ? 0 : 1) == -1 &&
+                errno != EINTR && errno != EBUSY) {
+            return -1;
+        }
+
+        // las recepciones multishot siguen generando completados mientras
+        // llegan datos; se atienden a lo más 'entradas' por vuelta para que
+        // las solicitudes preparadas(por ejemplo los envíos) salgan
+        num_completados = 0;
+        while (num_completados++ < (int)anillo->entradas &&
+                obtener_completado_uring(anillo, &cqe)) {
+            Operacion_uring operacion = (Operacion_uring)(cqe.user_data >> 56);
+            descriptor = (int)(cqe.user_data & 0xffffffff);
+            generacion = (unsigned)(cqe.user_data >> 32) & 0xffffff;
+
+            if (operacion == kUringAceptar) {
+                if (cqe.res >= 0) {
+                    tam_dir = sizeof(struct sockaddr_storage);
+                    memset(&cliente, 0, sizeof(cliente));
+                    getpeername(cqe.res, (struct sockaddr*)&cliente, &tam_dir);
+                    conexion = abrir_conexion(reactor, cqe.res, &cliente);
+                    if (conexion == NULL) {
+                        close(cqe.res);
+                        reactor->conexiones_rechazadas++;
+                    } else if (preparar_recibir_provisto_uring(anillo, cqe.res,
+                            codificar_datos_uring(kUringRecibir,
+                                conexion->generacion, cqe.res)) == -1) {
+                        cerrar_conexion(reactor, conexion);
+                        reactor->conexiones_rechazadas++;
+                    }
+                } else if (cqe.res == -EINVAL && anillo->multishot) {
+                    anillo->multishot = 0;  // kernel sin soporte multishot
+                } else if (cqe.res == -ECONNABORTED || cqe.res == -EPROTO) {
+                    reactor->conexiones_abortadas++;
+                } else if (cqe.res == -EMFILE || cqe.res == -ENFILE) {
+                    // el socket que escucha es NO bloqueante('crear_reactor()')
+                    if (rechazar_conexion_pendiente(reactor, descriptor) == -1 &&
+                            !(cqe.flags & IORING_CQE_F_MORE) &&
+                            preparar_esperar_uring(anillo, descriptor, POLLIN,
+                                codificar_datos_uring(kUringEsperar, 0,
+                                    descriptor)) == 0) {
+                        continue;
+                    }
+                } else {
+                    fprintf(stderr,"\nError al aceptar(io_uring) conexión: %s\n",
+                        strerror(-cqe.res));
+                }
+                if (!(cqe.flags & IORING_CQE_F_MORE) &&
+                        preparar_aceptar_uring(anillo, descriptor,
+                            cqe.user_data) == -1) {
+                    marcar_por_aceptar_uring(reactor, por_aceptar, descriptor);
+                }
+                continue;
+            }
+
+            if (operacion == kUringEsperar) {
+                // llegó una conexión mientras no había descriptores libres
+                if (preparar_aceptar_uring(anillo, descriptor,
+                        codificar_datos_uring(kUringAceptar, 0, descriptor))
+                        == -1) {
+                    marcar_por_aceptar_uring(reactor, por_aceptar, descriptor);
+                }
+                continue;
+            }
+            if (operacion == kUringEnviar) {
+                atender_envio_uring(reactor, anillo, &cqe);
+                continue;
+            }
+            if (operacion == kUringEscribir) {
+                conexion = &reactor->conexiones[descriptor];
+                if (conexion->activa &&
+                        (conexion->generacion & 0xffffff) == generacion) {
+                    conexion->espera_escritura = 0;
+                    atender_escritura(reactor, conexion);
+                }
+                continue;
+            }
+            if (operacion != kUringRecibir) {
+                continue;
+            }
+
+            conexion = &reactor->conexiones[descriptor];
+            // la conexión pudo cerrarse(y su entrada reutilizarse) mientras la
+            // recepción estaba pendiente
+            int vigente = conexion->activa &&
+                (conexion->generacion & 0xffffff) == generacion;
+
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                id_buffer = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                if (cqe.res > 0 && vigente) {
+                    conexion->bytes_recibidos += cqe.res;
+                    reactor->total_bytes += cqe.res;
+                    reactor->manejador(reactor, conexion,
+                        obtener_buffer_provisto_uring(anillo, id_buffer), cqe.res);
+                }
+                devolver_buffer_provisto_uring(anillo, id_buffer);
+            }
+
+            if (!vigente) {
+                continue;
+            }
+            if (cqe.res == 0 || (cqe.res < 0 && cqe.res != -ENOBUFS &&
+                    cqe.res != -EINVAL && cqe.res != -EAGAIN)) {
+                cerrar_conexion(reactor, conexion);
+                continue;
+            }
+            if (cqe.res == -EINVAL && anillo->multishot) {
+                anillo->multishot = 0;
+            }
+            // la recepción terminó(sencilla o sin buffers), se vuelve a pedir;
+            // sin lugar en la cola la conexión se quedaría sin recibir
+            if (conexion->activa && !(cqe.flags & IORING_CQE_F_MORE) &&
+                    preparar_recibir_provisto_uring(anillo, descriptor,
+                        cqe.user_data) == -1) {
+                cerrar_conexion(reactor, conexion);
+            }
+        }
+    }
+
+    reactor->llamadas_sistema += anillo->llamadas_sistema - llamadas_previas;
+    reactor->motor = NULL;
+    reactor->pedir_escritura = NULL;
+    return 0;
+}
+
+#endif  // FUNCIONES_URING_H_
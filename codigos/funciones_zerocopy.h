@@ -0,0 +1,297 @@
+/**
+ * Funciones para envío sin copias(MSG_ZEROCOPY)
+ *
+ * Con MSG_ZEROCOPY el kernel no copia los datos a sus buffers al llamar a
+ * 'send()': fija las páginas del buffer del proceso y las envía directamente.
+ * A cambio, el buffer no debe modificarse ni liberarse hasta que el kernel
+ * notifique, por la cola de errores del socket(MSG_ERRQUEUE), que ya no lo
+ * usa.
+ *
+ * Notas:
+ * - Cada llamada a 'sendmsg()' con MSG_ZEROCOPY recibe un identificador
+ * 	consecutivo(desde 0); las notificaciones indican rangos de identificadores
+ * 	completados.
+ * - Fijar páginas tiene un costo, por lo que sólo conviene con envíos grandes;
+ * 	debajo de un umbral se usa el envío con copia normal.
+ * - Si el kernel tuvo que copiar de todos modos(por ejemplo en loopback) lo
+ * 	indica con SO_EE_CODE_ZEROCOPY_COPIED.
+ *
+ * Para más información consultar la documentación del kernel
+ * 'Documentation/networking/msg_zerocopy.rst'.
+ *
+ * @version 1.0 - 16/10/26
+ */
+
+#ifndef FUNCIONES_ZEROCOPY_H_
+#define FUNCIONES_ZEROCOPY_H_
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <netinet/in.h>  // 'IP_RECVERR'
+#include <linux/errqueue.h>  // 'sock_extended_err'
+
+#include "funciones_sockets.h"
+#include "funciones_tramas.h"
+
+// tamaño mínimo de un envío para usar MSG_ZEROCOPY
+const size_t kUmbralZerocopy = 32*1024;
+// envíos sin copia pendientes de notificación antes de esperar al kernel
+const uint32_t kMaxPendientesZerocopy = 64;
+
+// estado de los envíos sin copia de un socket
+typedef struct Envio_zerocopy {
+    int descriptor;
+    int habilitado;  // 1 si el socket acepta MSG_ZEROCOPY
+    size_t umbral;
+    uint32_t siguiente_id;  // identificador del siguiente envío sin copia
+    uint32_t completados;  // envíos sin copia ya liberados por el kernel
+    unsigned long envios_zerocopy;
+    unsigned long envios_copiados;  // el kernel copió pese a MSG_ZEROCOPY
+    unsigned long envios_normales;  // debajo del umbral
+} Envio_zerocopy;
+
+/* Prototipos */
+
+int habilitar_zerocopy(Envio_zerocopy *envio, int descriptor, size_t umbral);
+int procesar_completados_zerocopy(Envio_zerocopy *envio);
+int esperar_completados_zerocopy(Envio_zerocopy *envio, uint32_t id);
+long enviar_vectores_zerocopy(Envio_zerocopy *envio, struct iovec *vectores,
+        int num_vectores);
+long enviar_trama_zerocopy(Envio_zerocopy *envio, char *datos,
+        uint32_t tam_datos);
+
+/* Funciones */
+
+/**
+ * Habilita SO_ZEROCOPY en un socket de flujo conectado. Si el kernel no lo
+ * soporta los envíos se hacen con copia normal.
+ *
+ * @param envio estado a inicializar
+ * @param descriptor identificador del socket
+ * @param umbral tamaño mínimo de un envío para usar MSG_ZEROCOPY
+ *
+ * @return 0 si se habilitó, -1 si se usará el envío con copia
+ */
+int habilitar_zerocopy(Envio_zerocopy *envio, int descriptor, size_t umbral) {
+    memset(envio, 0, sizeof(Envio_zerocopy));
+    envio->descriptor = descriptor;
+    envio->umbral = umbral;
+    if (establecer_opcion_socket(descriptor, SOL_SOCKET, SO_ZEROCOPY, 1) == -1) {
+        fprintf(stderr, "Se usará el envío con copia\n");
+        return -1;
+    }
+    envio->habilitado = 1;
+
+    return 0;
+}
+
+/**
+ * Lee, sin bloquear, las notificaciones de la cola de errores del socket y
+ * actualiza el número de envíos sin copia completados.
+ *
+ * Se asume que los rangos llegan en orden, lo cual ocurre con TCP.
+ *
+ * @param envio estado de los envíos sin copia
+ *
+ * @return número de notificaciones leídas, -1 en caso de error
+ */
+int procesar_completados_zerocopy(Envio_zerocopy *envio) {
+    char control[128];
+    struct msghdr mensaje;
+    struct cmsghdr *cmsg;
+    struct sock_extended_err *error;
+    int notificaciones = 0;
+
+    while (1) {
+        memset(&mensaje, 0, sizeof(mensaje));
+        mensaje.msg_control = control;
+        mensaje.msg_controllen = sizeof(control);
+        if (recvmsg(envio->descriptor, &mensaje, MSG_ERRQUEUE | MSG_DONTWAIT)
+                == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return notificaciones;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "\nError al leer notificaciones(MSG_ERRQUEUE): %s\n",
+                strerror(errno));
+            return -1;
+        }
+
+        for (cmsg = CMSG_FIRSTHDR(&mensaje); cmsg != NULL;
+                cmsg = CMSG_NXTHDR(&mensaje, cmsg)) {
+            if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                    (cmsg->cmsg_level == SOL_IPV6 &&
+                    cmsg->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            error = (struct sock_extended_err*)CMSG_DATA(cmsg);
+            if (error->ee_errno != 0 ||
+                    error->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            // 'ee_info' y 'ee_data' son el primer y último identificador
+            envio->completados += error->ee_data - error->ee_info + 1;
+            if (error->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                envio->envios_copiados += error->ee_data - error->ee_info + 1;
+            }
+            notificaciones++;
+        }
+    }
+}
+
+/**
+ * Espera a que el kernel libere todos los envíos sin copia con identificador
+ * menor a 'id'. Después de esto los buffers correspondientes pueden
+ * modificarse o liberarse.
+ *
+ * @param envio estado de los envíos sin copia
+ * @param id identificador hasta el cual esperar(usualmente 'siguiente_id')
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int esperar_completados_zerocopy(Envio_zerocopy *envio, uint32_t id) {
+    while ((int32_t)(id - envio->completados) > 0) {
+        if (procesar_completados_zerocopy(envio) == -1) {
+            return -1;
+        }
+        if ((int32_t)(id - envio->completados) <= 0) {
+            break;
+        }
+        // la cola de errores se notifica con POLLERR
+        if (esperar_descriptor(envio->descriptor, 0, -1) == -1) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Envía todos los bytes de los vectores con 'sendmsg()'. Si el total alcanza
+ * el umbral se usa MSG_ZEROCOPY: los buffers no deben modificarse hasta que
+ * 'esperar_completados_zerocopy()' confirme que el kernel los liberó.
+ *
+ * Si hay demasiados envíos pendientes de notificación, o el kernel no tiene
+ * memoria para fijar más páginas(ENOBUFS), primero se espera a que se liberen.
+ *
+ * @param envio estado de los envíos sin copia
+ * @param vectores buffers a enviar(se modifican al avanzar)
+ * @param num_vectores número de vectores
+ *
+ * @return número de bytes enviados, -1 en caso de error
+ */
+long enviar_vectores_zerocopy(Envio_zerocopy *envio, struct iovec *vectores,
+        int num_vectores) {
+    struct msghdr mensaje;
+    size_t total = 0;
+    long enviados = 0;
+    ssize_t res;
+    int i, indice = 0, bandera;
+
+    for (i = 0; i < num_vectores; i++) {
+        total += vectores[i].iov_len;
+    }
+    bandera = envio->habilitado && total >= envio->umbral ? MSG_ZEROCOPY : 0;
+
+    while (indice < num_vectores) {
+        if (bandera && envio->siguiente_id - envio->completados >=
+                kMaxPendientesZerocopy) {
+            procesar_completados_zerocopy(envio);
+            if (envio->siguiente_id - envio->completados >=
+                    kMaxPendientesZerocopy &&
+                    esperar_completados_zerocopy(envio, envio->siguiente_id -
+                        kMaxPendientesZerocopy/2) == -1) {
+                return -1;
+            }
+        }
+
+        memset(&mensaje, 0, sizeof(mensaje));
+        mensaje.msg_iov = &vectores[indice];
+        mensaje.msg_iovlen = num_vectores - indice;
+        res = sendmsg(envio->descriptor, &mensaje, bandera | MSG_NOSIGNAL);
+        if (res == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ENOBUFS && bandera) {
+                // sin memoria para fijar páginas: se espera a las pendientes
+                if (envio->siguiente_id == envio->completados) {
+                    bandera = 0;
+                } else if (esperar_completados_zerocopy(envio,
+                        envio->siguiente_id) == -1) {
+                    return -1;
+                }
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) &&
+                    esperar_descriptor(envio->descriptor, POLLOUT, -1) == 1) {
+                continue;
+            }
+            fprintf(stderr, "\nError al enviar datos(sendmsg): %s\n",
+                strerror(errno));
+            return -1;
+        }
+
+        if (bandera) {
+            envio->siguiente_id++;  // cada llamada exitosa consume un id
+            envio->envios_zerocopy++;
+        } else {
+            envio->envios_normales++;
+        }
+        enviados += res;
+        while (indice < num_vectores && res >= (ssize_t)vectores[indice].iov_len) {
+            res -= vectores[indice].iov_len;
+            indice++;
+        }
+        if (indice < num_vectores) {
+            vectores[indice].iov_base = (char*)vectores[indice].iov_base + res;
+            vectores[indice].iov_len -= res;
+        }
+    }
+
+    return enviados;
+}
+
+/**
+ * Envía una trama(ver 'funciones_tramas.h') usando MSG_ZEROCOPY si su tamaño
+ * alcanza el umbral. En ese caso el encabezado se envía antes con copia, así
+ * sólo los datos deben conservarse hasta su notificación.
+ *
+ * @param envio estado de los envíos sin copia
+ * @param datos bytes a enviar, no deben modificarse hasta su notificación
+ * @param tam_datos número de bytes
+ *
+ * @return número de bytes enviados(incluyendo encabezado), -1 en caso de
+ *         error
+ */
+long enviar_trama_zerocopy(Envio_zerocopy *envio, char *datos,
+        uint32_t tam_datos) {
+    uint32_t encabezado = htonl(tam_datos);
+    struct iovec vectores[2];
+    long res;
+
+    if (!envio->habilitado || tam_datos < envio->umbral) {
+        vectores[0].iov_base = &encabezado;
+        vectores[0].iov_len = kTamEncabezado;
+        vectores[1].iov_base = datos;
+        vectores[1].iov_len = tam_datos;
+        return enviar_vectores_zerocopy(envio, vectores, 2);
+    }
+
+    vectores[0].iov_base = &encabezado;
+    vectores[0].iov_len = kTamEncabezado;
+    if ((res = enviar_vectores_zerocopy(envio, vectores, 1)) == -1) {
+        return -1;
+    }
+    vectores[1].iov_base = datos;
+    vectores[1].iov_len = tam_datos;
+    if (enviar_vectores_zerocopy(envio, &vectores[1], 1) == -1) {
+        return -1;
+    }
+
+    return res + tam_datos;
+}
+
+#endif  // FUNCIONES_ZEROCOPY_H_
@@ -4,11 +4,63 @@
  * Servidor para atender peticiones que usan protocolo UDP, y sockets de
  * datagramas(DGRAM).
  *
- * Compilación: gcc servidor_dgram.c -Wall -o servidor_dgram
+ * Los datagramas se reciben en lotes de hasta 'kMaxLote' mensajes por llamada
+ * ('recvmmsg()'), para reducir el número de llamadas al sistema. Con '--uring'
+ * se usa io_uring(si el kernel lo soporta), ver 'funciones_uring.h'. Los
+ * buffers se toman de un pool y la dirección del cliente se escribe en la pila,
+ * así atender un datagrama no reserva memoria. Compilado con
+ * '-DCONTAR_RESERVAS' el servidor lo comprueba: si al atender hubo reservas
+ * (sin '--confiable', que reserva el canal de cada cliente) termina con
+ * EXIT_FAILURE.
+ *
+ * Los datagramas recibidos se muestran por medio de una bitácora asíncrona(ver
+ * 'funciones_bitacora.h'), así la salida estándar no detiene la recepción.
+ * Con '--muestreo N' se muestra uno de cada N datagramas y con '--silencioso'
+ * ninguno.
+ *
+ * La dirección imprimible y los contadores de cada cliente se guardan en una
+ * tabla de pares(ver 'funciones_pares.h'); al terminar se muestran.
+ *
+ * Con '--eco' cada datagrama se regresa sin cambios a quien lo envió(ver
+ * 'funciones_ping.h'); los ecos de un lote se envían con un solo 'sendmmsg()',
+ * o con '--uring' desde el mismo anillo('sendmsg()').
+ *
+ * Con '--confiable' los datagramas siguen el protocolo de entrega confiable y
+ * ordenada de 'funciones_confiable.h': cada cliente tiene un canal(ligado a su
+ * entrada en la tabla de pares) que confirma los mensajes y los entrega en
+ * orden a la bitácora; '--perdida P' descarta al azar el P% de los ACKs. Si la
+ * tabla se llena los canales de los clientes inactivos se liberan y, si aún no
+ * hay lugar, al cliente nuevo se le responde con un rechazo.
+ *
+ * Con '--gro' el kernel puede entregar varios datagramas del mismo cliente
+ * agregados en un solo buffer(UDP_GRO); se separan en mensajes antes de
+ * procesarlos y sus ecos se envían en una llamada con GSO, ver
+ * 'funciones_gso.h'.
+ *
+ * Con '--ambas' un solo socket IPv6 atiende también a los clientes IPv4(con
+ * IPV6_V6ONLY en 0 sus direcciones se muestran como ::ffff:a.b.c.d).
+ *
+ * Con '--puerto unix:/ruta'(o 'unix:@nombre', en el espacio abstracto) se
+ * atiende en un socket de dominio Unix en lugar de UDP; los clientes del mismo
+ * equipo se ahorran la pila de red(ver 'funciones_sockets.h').
+ *
+ * Con '--grupo GRUPO' el servidor se une a un grupo multicast(IPv4 o IPv6) en
+ * el puerto de servicio y recibe lo que se publica al grupo; varios servidores
+ * del mismo equipo pueden unirse al mismo grupo y cada uno recibe su copia.
+ * '--interfaz' elige la interfaz donde se recibe("lo" para probar en un solo
+ * equipo), ver 'funciones_multicast.h'.
+ *
+ * Con '--estadisticas SEG' se muestran cada SEG segundos(y al terminar) las
+ * llamadas, bytes y errores de las operaciones de los sockets; con
+ * '--latencias' también sus latencias, ver 'funciones_estadisticas.h'.
+ *
+ * Compilación: gcc servidor_dgram.c -Wall -pthread -o servidor_dgram
  *
  * @version 2.0 - 08/03/16
  */
 
+#define _GNU_SOURCE  // 'recvmmsg()'
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>  // memset
@@ -16,12 +68,42 @@
 #include <getopt.h>  // 'getopt()'
 
 #include "funciones_sockets.h"
+#include "funciones_uring.h"
+#include "funciones_memoria.h"
+#include "funciones_pares.h"
+#include "funciones_bitacora.h"
+#include "funciones_confiable.h"
+#include "funciones_gso.h"
+#include "funciones_multicast.h"
 
 // constantes
 const char *kPuerto = "6666";  // puerto de servicio
 const int kMaxBuffer = 100;
 const char *kMsjSalida = "exit"; // Mensaje para salir del programa
 
+const char *puerto_servicio = NULL;  // puerto o 'unix:/ruta', 'kPuerto' si no
+
+// 1 para recibir y responder con io_uring en lugar de 'recvmmsg()'
+int usar_uring = 0;
+int silencioso = 0;  // 1 para no mostrar cada mensaje recibido
+int muestreo = 1;  // mostrar uno de cada N mensajes recibidos
+int eco = 0;  // 1 para regresar cada datagrama a quien lo envió
+int segundos_estadisticas = 0;  // periodo de volcado, 0 para no mostrar
+int medir_latencias = 0;  // 1 para medir la latencia de cada operación
+int confiable = 0;  // 1 para usar el protocolo de entrega confiable
+int usar_gro = 0;  // 1 para recibir datagramas agregados con UDP_GRO
+const char *grupo_multicast = NULL;  // grupo al que se une, 'NULL' si ninguno
+const char *interfaz_multicast = NULL;  // interfaz del grupo, 'NULL' cualquiera
+double perdida_simulada = 0;  // fracción de ACKs descartados
+int tam_datagrama;  // bytes de cada buffer de recepción
+int salida_confiable = 0;  // 1 si un canal entregó el mensaje de salida
+unsigned long mensajes_recibidos = 0;
+Tabla_pares tabla_pares;  // clientes que han enviado datagramas
+// contadores de los canales ya liberados
+unsigned long entregados_confiables = 0, duplicados_confiables = 0;
+unsigned long simulados_confiables = 0;
+time_t ultimo_rechazo = 0;  // último aviso de tabla llena
+
 /**
  * Analiza los argumentos introducidos por linea de comandos al ejecutar el
  * programa.
@@ -36,6 +118,21 @@ void analizar_argumentos(int argc, char *argv[]) {
             {"help", no_argument, 0, 'h'},
             {"ipv4", no_argument, 0, '4'},
             {"ipv6", no_argument, 0, '6'},
+            {"ambas", no_argument, 0, 'b'},
+            {"puerto", required_argument, 0, 'p'},
+            {"uring", no_argument, 0, 'u'},
+            {"silencioso", no_argument, 0, 'q'},
+            {"muestreo", required_argument, 0, 'm'},
+            {"eco", no_argument, 0, 'e'},
+            {"estadisticas", required_argument, 0, 'S'},
+            {"latencias", no_argument, 0, 'L'},
+            {"confiable", no_argument, 0, 'R'},
+            {"perdida", required_argument, 0, 'x'},
+            {"gro", no_argument, 0, 'G'},
+            {"grupo", required_argument, 0, 'g'},
+            {"interfaz", required_argument, 0, 'I'},
+            {"perfil", required_argument, 0, 'T'},
+            {"ajuste", required_argument, 0, 'O'},
             {0, 0, 0, 0}
         };
     int referencia = 0;  // variable usada para las opciones de los argumentos
@@ -45,7 +142,7 @@ void analizar_argumentos(int argc, char *argv[]) {
 
     // si un argumento es obligatorio se colocan dos puntos después de la
     // 'opción'(corta) elegida
-    while ((opcion = getopt_long(argc, argv,"ha46",
+    while ((opcion = getopt_long(argc, argv,"ha46bp:uqm:eS:LRx:Gg:I:T:O:",
                    opciones_largas, &referencia)) != -1) {
         switch (opcion) {
             case 'a': case 'h':
@@ -55,6 +152,35 @@ void analizar_argumentos(int argc, char *argv[]) {
                 printf("\t-h --help\tLista de ayuda y opciones\n");
                 printf("\t-4, --ipv4\tUsar direcciones de tipo IPv4\n");
                 printf("\t-6, --ipv6\tUsar direcciones de tipo IPv6\n");
+                printf("\t-b, --ambas\tAtender IPv4 e IPv6 con un solo socket ");
+                printf("IPv6(IPV6_V6ONLY en 0)\n");
+                printf("\t-p [PUERTO], --puerto [PUERTO]\tPuerto donde se ");
+                printf("atiende, o unix:/ruta(unix:@nombre) para un socket ");
+                printf("de dominio Unix\n");
+                printf("\t-u, --uring\tRecibir y responder con io_uring\n");
+                printf("\t-q, --silencioso\tNo mostrar cada mensaje recibido\n");
+                printf("\t-m [N], --muestreo [N]\tMostrar sólo uno de cada N ");
+                printf("mensajes recibidos\n");
+                printf("\t-e, --eco\tRegresar cada datagrama a quien lo envió\n");
+                printf("\t-S [SEG], --estadisticas [SEG]\tMostrar las ");
+                printf("estadísticas de los sockets cada SEG segundos\n");
+                printf("\t-L, --latencias\tMedir la latencia de cada ");
+                printf("operación de los sockets\n");
+                printf("\t-R, --confiable\tRecibir con entrega confiable y ");
+                printf("ordenada(sin --eco)\n");
+                printf("\t-x [P], --perdida [P]\tDescartar al azar el P%% de ");
+                printf("los ACKs enviados\n");
+                printf("\t-G, --gro\tRecibir datagramas agregados por el ");
+                printf("kernel(UDP_GRO) y separarlos\n");
+                printf("\t-g [GRUPO], --grupo [GRUPO]\tUnirse a un grupo ");
+                printf("multicast(por ejemplo 239.1.2.3 o ff02::1234)\n");
+                printf("\t-I [NOMBRE], --interfaz [NOMBRE]\tInterfaz donde ");
+                printf("se recibe el grupo(por ejemplo lo)\n");
+                printf("\t-T [PERFIL], --perfil [PERFIL]\tAjustes de los ");
+                printf("sockets: normal, baja-latencia o masivo\n");
+                printf("\t-O [CLAVE=VALOR], --ajuste [CLAVE=VALOR]\tCambiar ");
+                printf("una opción de los sockets, después de --perfil(ver ");
+                printf("funciones_ajustes.h)\n");
                 printf("\nNOTA: Si no se especifica tipo de dirección se usará");
                 printf(" 'IPv4'(--ipv4) por defecto\n\n");
                 exit(0);
@@ -64,6 +190,63 @@ void analizar_argumentos(int argc, char *argv[]) {
             case '6':
                 familia_direcciones =  kIPV6;
                 break;
+            case 'b':
+                familia_direcciones =  kAMBAS;
+                break;
+            case 'p':
+                puerto_servicio = optarg;
+                break;
+            case 'u':
+                usar_uring = 1;
+                break;
+            case 'q':
+                silencioso = 1;
+                break;
+            case 'm':
+                muestreo = atoi(optarg);
+                if (muestreo < 1) {
+                    fprintf(stderr, "\nMuestreo inválido: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'e':
+                eco = 1;
+                break;
+            case 'S':
+                segundos_estadisticas = atoi(optarg);
+                break;
+            case 'L':
+                medir_latencias = 1;
+                break;
+            case 'R':
+                confiable = 1;
+                break;
+            case 'x':
+                perdida_simulada = atof(optarg)/100;
+                if (perdida_simulada < 0 || perdida_simulada >= 1) {
+                    fprintf(stderr, "\nPérdida inválida: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'G':
+                usar_gro = 1;
+                break;
+            case 'g':
+                grupo_multicast = optarg;
+                break;
+            case 'I':
+                interfaz_multicast = optarg;
+                break;
+            case 'T':
+                if (seleccionar_perfil_socket(optarg) == -1) {
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'O':
+                if (cambiar_ajuste_socket(optarg) == -1) {
+                    exit(EXIT_FAILURE);
+                }
+                break;
             case '?': default: // si hay una opción no registrada o regresa 0
                 fprintf(stderr, "\nOpción inválida: -- %c\n", optopt);
                 fprintf(stderr, "Usa %s --help para más información.\n\n",argv[0]);
@@ -74,30 +257,410 @@ void analizar_argumentos(int argc, char *argv[]) {
 }
 
 
+/**
+ * Registra en la bitácora un mensaje entregado en orden por un canal
+ * confiable.
+ *
+ * @param canal canal del cliente, su campo 'datos' es la entrada del cliente en
+ *              la tabla de pares
+ * @param datos mensaje(terminado en '\0')
+ * @param tam longitud del mensaje
+ */
+void entregar_mensaje_confiable(Canal_confiable *canal, char *datos,
+        size_t tam) {
+    Par_dgram *par = (Par_dgram*)canal->datos;
+
+    mensajes_recibidos++;
+    registrar_mensaje_bitacora(&canal->remoto, par->ip, datos, tam);
+    salida_confiable |= strcmp(datos, kMsjSalida) == 0;
+}
+
+/**
+ * Acumula los contadores del canal de un cliente y lo libera; se llama al
+ * quitar al cliente de la tabla de pares y al terminar.
+ *
+ * @param par entrada del cliente
+ */
+void liberar_canal_par(Par_dgram *par) {
+    Canal_confiable *canal = (Canal_confiable*)par->datos;
+
+    if (canal != NULL) {
+        entregados_confiables += canal->entregados;
+        duplicados_confiables += canal->duplicados;
+        simulados_confiables += canal->simulados;
+        free(canal);
+        par->datos = NULL;
+    }
+}
+
+/**
+ * Procesa un paquete del protocolo confiable con el canal del cliente; el
+ * canal se crea con su primer paquete. Si el cliente no cupo en la tabla se le
+ * responde con un rechazo(avisando a lo más una vez por segundo).
+ *
+ * @param descriptor identificador del socket
+ * @param buffer paquete recibido
+ * @param bytes_recibidos número de bytes recibidos
+ * @param cliente dirección de quien envió el paquete
+ * @param par entrada del cliente en la tabla de pares, 'NULL' si no cupo
+ *
+ * @return 1 si se entregó el mensaje de salida, 0 en otro caso
+ */
+int procesar_paquete_cliente(int descriptor, char *buffer, int bytes_recibidos,
+        struct sockaddr_storage *cliente, Par_dgram *par) {
+    if (par == NULL) {
+        // sin entrada no hay dónde guardar su canal
+        time_t ahora = time(NULL);
+        if (ahora != ultimo_rechazo) {
+            char ip[INET6_ADDRSTRLEN];
+            escribir_direccion_imprimible((struct sockaddr*)cliente, ip,
+                sizeof(ip));
+            fprintf(stderr, "Tabla de clientes llena(%d), se rechaza a %s\n",
+                tabla_pares.num_pares, ip);
+            ultimo_rechazo = ahora;
+        }
+        rechazar_confiable(descriptor, (struct sockaddr*)cliente);
+        return 0;
+    }
+    Canal_confiable **canal = (Canal_confiable**)&par->datos;
+    if (*canal == NULL) {
+        *canal = (Canal_confiable*)malloc(sizeof(Canal_confiable));
+        if (*canal == NULL) {
+            fprintf(stderr,"\nError al reservar memoria para el canal\n");
+            return 0;
+        }
+        crear_canal_confiable(*canal, descriptor, (struct sockaddr*)cliente,
+            entregar_mensaje_confiable, perdida_simulada);
+    }
+    // el par puede moverse al quitar otros de la tabla, se actualiza siempre
+    (*canal)->datos = par;
+    procesar_paquete_confiable(*canal, buffer, bytes_recibidos);
+
+    return salida_confiable;
+}
+
+/**
+ * Registra un datagrama recibido en la tabla de pares y en la bitácora.
+ *
+ * @param descriptor identificador del socket
+ * @param buffer datos recibidos(con un byte libre para el fin de cadena)
+ * @param bytes_recibidos número de bytes recibidos
+ * @param cliente dirección de quien envió el datagrama
+ *
+ * @return 1 si se recibió el mensaje de salida, 0 en otro caso
+ */
+int procesar_datagrama(int descriptor, char *buffer, int bytes_recibidos,
+        struct sockaddr_storage *cliente) {
+    Par_dgram *par = registrar_paquete_par(&tabla_pares,
+        (struct sockaddr*)cliente, bytes_recibidos);
+
+    if (confiable) {
+        return procesar_paquete_cliente(descriptor, buffer, bytes_recibidos,
+            cliente, par);
+    }
+    buffer[bytes_recibidos] = '\0';
+    mensajes_recibidos++;
+    registrar_mensaje_bitacora(cliente, par != NULL ? par->ip : NULL, buffer,
+        bytes_recibidos);
+
+    return strcmp(buffer, kMsjSalida) == 0;
+}
+
+/**
+ * Recibe datagramas en lotes con 'recvmmsg()' hasta recibir el mensaje de
+ * salida.
+ *
+ * @param descriptor identificador del socket
+ * @param buffers arreglo de 'kMaxLote' buffers de 'tam_datagrama' bytes
+ *
+ * @return número de llamadas al sistema realizadas
+ */
+unsigned long atender_con_lotes(int descriptor, char **buffers) {
+    int bytes_recibidos[kMaxLote];
+    struct sockaddr_storage clientes[kMaxLote];
+    int num_recibidos, i, salir = 0;
+    unsigned long llamadas = 0;
+
+    while (!salir) {
+        // espera al primer datagrama y toma los demás que ya estén en cola
+        llamadas++;
+        num_recibidos = recibir_lote_dgram(descriptor, buffers, tam_datagrama-1,
+            bytes_recibidos, clientes, kMaxLote, MSG_WAITFORONE);
+        for (i = 0; i < num_recibidos; i++) {
+            salir |= procesar_datagrama(descriptor, buffers[i],
+                bytes_recibidos[i], &clientes[i]);
+        }
+        if (eco && num_recibidos > 0) {
+            llamadas++;
+            enviar_lote_dgram(descriptor, buffers, bytes_recibidos, clientes,
+                num_recibidos, 0);
+        }
+    }
+
+    return llamadas;
+}
+
+/**
+ * Recibe datagramas con io_uring hasta recibir el mensaje de salida. Se
+ * mantienen 'kMaxLote' recepciones('recvmsg()') pendientes, una por buffer; al
+ * procesar un completado se vuelve a pedir la recepción de su buffer. Con
+ * '--eco' primero se pide el envío del eco en el mismo anillo('sendmsg()') y
+ * la recepción se pide al completarse ese envío, así ninguna respuesta sale
+ * con una llamada al sistema aparte.
+ *
+ * @param descriptor identificador del socket
+ * @param buffers arreglo de 'kMaxLote' buffers de 'tam_datagrama' bytes
+ * @param anillo anillo de io_uring inicializado
+ *
+ * @return número de llamadas al sistema realizadas
+ */
+unsigned long atender_con_uring(int descriptor, char **buffers,
+        Anillo_uring *anillo) {
+    struct msghdr mensajes[kMaxLote], respuestas[kMaxLote];
+    struct iovec vectores[kMaxLote], vectores_eco[kMaxLote];
+    struct sockaddr_storage clientes[kMaxLote];
+    struct io_uring_cqe cqe;
+    Operacion_uring operacion;
+    int i, salir = 0;
+
+    memset(mensajes, 0, sizeof(struct msghdr)*kMaxLote);
+    memset(respuestas, 0, sizeof(struct msghdr)*kMaxLote);
+    for (i = 0; i < kMaxLote; i++) {
+        vectores[i].iov_base = buffers[i];
+        vectores[i].iov_len = tam_datagrama-1;
+        mensajes[i].msg_iov = &vectores[i];
+        mensajes[i].msg_iovlen = 1;
+        mensajes[i].msg_name = &clientes[i];
+        mensajes[i].msg_namelen = sizeof(struct sockaddr_storage);
+        // el eco sale del mismo buffer hacia la dirección de origen
+        vectores_eco[i].iov_base = buffers[i];
+        respuestas[i].msg_iov = &vectores_eco[i];
+        respuestas[i].msg_iovlen = 1;
+        respuestas[i].msg_name = &clientes[i];
+        // en lugar del descriptor se guarda el índice del buffer
+        preparar_recibir_mensaje_uring(anillo, descriptor, &mensajes[i],
+            codificar_datos_uring(kUringRecibirMensaje, 0, i));
+    }
+
+    while (!salir) {
+        if (enviar_solicitudes_uring(anillo, 1) == -1 && errno != EINTR) {
+            break;
+        }
+        while (obtener_completado_uring(anillo, &cqe)) {
+            operacion = (Operacion_uring)(cqe.user_data >> 56);
+            i = (int)(cqe.user_data & 0xffffffff);
+            if (operacion == kUringEnviarMensaje && cqe.res < 0) {
+                fprintf(stderr,"\nError al enviar eco(io_uring): %s\n",
+                    strerror(-cqe.res));
+            } else if (operacion == kUringRecibirMensaje && cqe.res >= 0) {
+                completar_direccion_unix(&clientes[i],
+                    mensajes[i].msg_namelen);
+                salir |= procesar_datagrama(descriptor, buffers[i], cqe.res,
+                    &clientes[i]);
+                // el buffer no puede recibir otra vez hasta que su eco salga
+                if (eco) {
+                    vectores_eco[i].iov_len = cqe.res;
+                    respuestas[i].msg_namelen = obtener_tam_sockaddr(
+                        (struct sockaddr*)&clientes[i]);
+                    if (preparar_enviar_mensaje_uring(anillo, descriptor,
+                            &respuestas[i], codificar_datos_uring(
+                                kUringEnviarMensaje, 0, i)) == 0) {
+                        continue;
+                    }
+                }
+            } else if (operacion == kUringRecibirMensaje) {
+                fprintf(stderr,"\nError al recibir datos(io_uring): %s\n",
+                    strerror(-cqe.res));
+            }
+            mensajes[i].msg_namelen = sizeof(struct sockaddr_storage);
+            preparar_recibir_mensaje_uring(anillo, descriptor, &mensajes[i],
+                codificar_datos_uring(kUringRecibirMensaje, 0, i));
+        }
+    }
+    // los últimos ecos salen antes de que se destruya el anillo
+    enviar_solicitudes_uring(anillo, 0);
+
+    return anillo->llamadas_sistema;
+}
+
+/**
+ * Recibe con UDP_GRO hasta recibir el mensaje de salida. Cada buffer puede
+ * traer varios datagramas del mismo cliente, del mismo tamaño salvo el
+ * último; se procesan uno por uno y, con '--eco', se regresan juntos con GSO.
+ *
+ * @param descriptor identificador del socket
+ * @param buffer buffer de 'kTamBufferGro' bytes
+ *
+ * @return número de llamadas al sistema realizadas
+ */
+unsigned long atender_con_gro(int descriptor, char *buffer) {
+    struct sockaddr_storage cliente;
+    int bytes_recibidos, tam_segmento, inicio, tam, salir = 0;
+    unsigned long llamadas = 0;
+
+    while (!salir) {
+        llamadas++;
+        bytes_recibidos = recibir_gro(descriptor, buffer, kTamBufferGro - 1,
+            &tam_segmento, &cliente, 0);
+        if (bytes_recibidos == -1) {
+            continue;
+        }
+        for (inicio = 0; inicio == 0 || inicio < bytes_recibidos;
+                inicio += tam_segmento) {
+            tam = bytes_recibidos - inicio < tam_segmento ?
+                bytes_recibidos - inicio : tam_segmento;
+            // el fin de cadena del segmento pisa el primer byte del siguiente
+            char siguiente = buffer[inicio + tam];
+            salir |= procesar_datagrama(descriptor, buffer + inicio, tam,
+                &cliente);
+            buffer[inicio + tam] = siguiente;
+        }
+        if (eco) {
+            llamadas++;
+            enviar_segmentos_gso(descriptor, buffer, bytes_recibidos,
+                tam_segmento, &cliente);
+        }
+    }
+
+    return llamadas;
+}
+
 int main(int argc,  char *argv[]) {
     analizar_argumentos(argc, argv);
+    if (puerto_servicio == NULL) {
+        puerto_servicio = kPuerto;
+    }
     printf("Se usará la familia de direcciones: '%s'\n\n",
-        familia_direcciones == kIPV4 ? kMensajeIPV4 : kMensajeIPV6);
+        es_direccion_unix(puerto_servicio) ? kMensajeUnix :
+        familia_direcciones == kIPV4 ? kMensajeIPV4 :
+        familia_direcciones == kIPV6 ? kMensajeIPV6 : kMensajeAmbas);
+
+    struct sockaddr_storage direccion_grupo;
+    int indice_interfaz = obtener_indice_interfaz(interfaz_multicast);
+    if (indice_interfaz == -1) {
+        exit(EXIT_FAILURE);
+    }
+    if (grupo_multicast != NULL && es_direccion_unix(puerto_servicio)) {
+        fprintf(stderr, "\nLos sockets de dominio Unix no tienen multicast\n");
+        exit(EXIT_FAILURE);
+    }
+    int descriptor = grupo_multicast != NULL ?
+        inicializar_receptor_multicast(grupo_multicast, puerto_servicio,
+            indice_interfaz, &direccion_grupo) :
+        inicializar_servidor(puerto_servicio, SOCK_DGRAM);
+    if (descriptor == -1) {
+        exit(EXIT_FAILURE);
+    }
+    if (grupo_multicast != NULL) {
+        char ip[INET6_ADDRSTRLEN];
+        printf("Unido al grupo multicast %s en el puerto %s\n",
+            escribir_direccion_imprimible((struct sockaddr*)&direccion_grupo,
+                ip, sizeof(ip)), puerto_servicio);
+    }
+    if (ajustes_socket.modificado) {
+        mostrar_ajustes_socket(descriptor, SOCK_DGRAM);
+    }
+
+    // los buffers del lote se toman de un pool(una sola losa)
+    Pool_buffers pool;
+    char *buffers[kMaxLote];
+    int i;
+    tam_datagrama = confiable ? kTamEncabezadoConfiable + kMaxDatosConfiable +
+        1 : kMaxBuffer;
+    if (confiable) {
+        eco = 0;  // los ecos no siguen el protocolo
+    }
+    if (crear_pool(&pool, tam_datagrama, kMaxLote) == -1 ||
+            crear_tabla_pares(&tabla_pares, kMaxPares) == -1) {
+        exit(EXIT_FAILURE);
+    }
+    if (confiable) {
+        tabla_pares.al_expirar = liberar_canal_par;
+    }
+    for (i = 0; i < kMaxLote; i++) {
+        buffers[i] = (char*)obtener_buffer_pool(&pool);
+    }
 
-    int descriptor = inicializar_servidor(kPuerto, SOCK_DGRAM);
+    if (iniciar_bitacora(stdout, kCapacidadBitacora, silencioso ? 0 :
+            muestreo) == -1) {
+        exit(EXIT_FAILURE);
+    }
+    if (medir_latencias && habilitar_latencias_socket() == -1) {
+        exit(EXIT_FAILURE);
+    }
+    if (segundos_estadisticas > 0 &&
+            iniciar_volcado_estadisticas(segundos_estadisticas) == -1) {
+        exit(EXIT_FAILURE);
+    }
 
-    char *buffer = (char*)malloc(sizeof(char)*kMaxBuffer);
+    // el buffer agregado no cabe en los buffers del pool
+    char *buffer_gro = NULL;
+    if (usar_gro && habilitar_gro(descriptor) == 0 &&
+            (buffer_gro = (char*)malloc(kTamBufferGro)) == NULL) {
+        fprintf(stderr,"\nError al reservar memoria para GRO\n");
+        exit(EXIT_FAILURE);
+    }
 
-    struct sockaddr_storage cliente;
-    int bytes_recibidos = 0;
+    Anillo_uring anillo;
+    unsigned long llamadas;
+    int estado_salida = EXIT_SUCCESS;
+    // el estado por hilo se reserva con la primera operación, aquí no cuenta
+    obtener_estadisticas_hilo();
+    if (bitacora.muestreo > 0) {
+        obtener_anillo_bitacora();
+    }
+#ifdef CONTAR_RESERVAS
+    unsigned long reservas = obtener_reservas_heap();
+#endif
+    if (buffer_gro != NULL) {
+        llamadas = atender_con_gro(descriptor, buffer_gro);
+        printf("\n%lu llamadas al sistema(recvmsg con GRO)\n", llamadas);
+    } else if (usar_uring && crear_anillo_uring(&anillo, kEntradasUring) == 0) {
+        llamadas = atender_con_uring(descriptor, buffers, &anillo);
+        destruir_anillo_uring(&anillo);
+        printf("\n%lu llamadas al sistema(io_uring)\n", llamadas);
+    } else {
+        if (usar_uring) {
+            fprintf(stderr, "Se usará recvmmsg\n");
+        }
+        llamadas = atender_con_lotes(descriptor, buffers);
+        printf("\n%lu llamadas al sistema(recvmmsg)\n", llamadas);
+    }
+    printf("%lu mensajes recibidos(%.1f por llamada)\n", mensajes_recibidos,
+        llamadas > 0 ? (double)mensajes_recibidos/llamadas : 0);
+#ifdef CONTAR_RESERVAS
+    reservas = obtener_reservas_heap() - reservas;
+    printf("%lu reservas de memoria del heap al atender %lu mensajes\n",
+        reservas, mensajes_recibidos);
+    if (!confiable && reservas > 0) {
+        fprintf(stderr, "\nAtender datagramas reservó memoria del heap\n");
+        estado_salida = EXIT_FAILURE;
+    }
+#endif
 
-    while (strcmp(buffer, kMsjSalida) != 0) {
-        bytes_recibidos = recibir_datos_dgram(descriptor, buffer, kMaxBuffer-1,
-            0, (struct sockaddr*)&cliente);
-        buffer[bytes_recibidos] = '\0';
-        printf("-------------------------------------------------\n");
-        printf("%d datos recibidos de %s\n", bytes_recibidos,
-            obtener_direccion_imprimible((struct sockaddr*)&cliente));
-        printf("El mensaje es: \"%s\"\n", buffer);
+    detener_bitacora();
+    mostrar_tabla_pares(&tabla_pares);
+    if (segundos_estadisticas > 0 || medir_latencias) {
+        mostrar_estadisticas_socket();
+    }
+
+    // libera los canales que quedan y acumula sus contadores
+    destruir_tabla_pares(&tabla_pares);
+    if (confiable) {
+        printf("\nEntrega confiable: %lu mensajes entregados en orden, ",
+            entregados_confiables);
+        printf("%lu duplicados, %lu ACKs descartados por la simulación\n",
+            duplicados_confiables, simulados_confiables);
     }
 
     printf("\nApagando servidor...\n");
-    close(descriptor);
+    destruir_pool(&pool);
+    free(buffer_gro);
+    if (grupo_multicast != NULL) {
+        dejar_grupo_multicast(descriptor, (struct sockaddr*)&direccion_grupo,
+            indice_interfaz);
+    }
+    cerrar_socket_servidor(descriptor);
 
-    return 0;
+    return estado_salida;
 }
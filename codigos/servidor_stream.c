@@ -4,24 +4,139 @@
  * Servidor para atender peticiones que usan protocolo TCP, y sockets de
  * datagramas(STREAM).
  *
- * Compilación: gcc servidor_stream.c -Wall -o servidor_stream
+ * Atiende a todos los clientes desde un solo proceso por medio de un reactor
+ * de eventos(epoll), ver 'funciones_epoll.h'. Con la opción '--workers N' se
+ * crean N hilos, cada uno con su propio socket(SO_REUSEPORT) en el mismo
+ * puerto y su propio reactor, así el kernel reparte las conexiones entre los
+ * núcleos. Los mensajes se reciben como tramas de longitud prefijada, ver
+ * 'funciones_tramas.h'. Con '--uring' cada reactor usa io_uring como motor de
+ * E/S en lugar de epoll(si el kernel no lo soporta se usa epoll), ver
+ * 'funciones_uring.h'. '--max-conexiones N' limita los descriptores del
+ * proceso y con ello la tabla de conexiones de cada reactor.
+ *
+ * Con '--ambas' cada trabajador asocia un socket por cada dirección propia
+ * (IPv4 e IPv6) y todos se atienden con el mismo reactor, así un solo proceso
+ * comparte la tabla de conexiones y los cachés entre ambas familias.
+ *
+ * Con '--puerto unix:/ruta'(o 'unix:@nombre', en el espacio abstracto) se
+ * atiende en un socket de dominio Unix en lugar de TCP, con un solo hilo; los
+ * clientes del mismo equipo se ahorran la pila de red(ver
+ * 'funciones_sockets.h').
+ *
+ * Con '--directorio DIR', si un cliente anuncia un archivo sus bytes se
+ * escriben en DIR con 'splice()' sin pasar por memoria del proceso('--copia'
+ * usa 'recv()' y 'write()'), ver 'funciones_transferencia.h'. Un archivo que
+ * ya existe no se reemplaza; sin '--directorio' los anuncios son mensajes
+ * comunes.
+ *
+ * Los buffers de tramas de las conexiones se toman de un pool con un caché por
+ * hilo(ver 'funciones_memoria.h'), así atender un mensaje no reserva memoria
+ * del heap. Compilado con '-DCONTAR_RESERVAS' el servidor lo comprueba: si al
+ * atender hubo reservas además de las losas nuevas del pool(sin '--difusion'
+ * ni '--directorio', que reservan por diseño) termina con EXIT_FAILURE.
+ *
+ * Los mensajes recibidos se muestran por medio de una bitácora asíncrona(ver
+ * 'funciones_bitacora.h'): los trabajadores sólo copian un registro a su
+ * anillo y un hilo de fondo los escribe. Con '--muestreo N' se muestra uno de
+ * cada N mensajes y con '--silencioso' ninguno.
+ *
+ * Con '--eco' cada mensaje se regresa sin cambios al cliente(ver
+ * 'funciones_ping.h'); los ecos de las tramas de un mismo bloque recibido se
+ * envían juntos con un solo 'writev()'.
+ *
+ * Con '--difusion' el servidor funciona como difusor(publicación/suscripción):
+ * los clientes que envían "#suscribir [tema]" reciben los mensajes que
+ * publican los demás, cada suscriptor con una cola acotada de mensajes
+ * compartidos y desconexión si se queda atrás, ver 'funciones_difusion.h'. El
+ * difusor se atiende con un solo hilo y epoll.
+ *
+ * Con '--memoria /NOMBRE' un hilo atiende además un canal de memoria
+ * compartida con un cliente del mismo equipo(sin llamadas al sistema por
+ * mensaje), ver 'funciones_memoria_compartida.h'.
+ *
+ * Con '--estadisticas SEG' se muestran cada SEG segundos(y al terminar) las
+ * llamadas, bytes y errores de las operaciones de los sockets de todos los
+ * hilos; con '--latencias' también sus latencias, ver
+ * 'funciones_estadisticas.h'.
+ *
+ * Compilación: gcc servidor_stream.c -Wall -pthread -o servidor_stream
  *
  * @version 2.0 - 03/04/16
  */
 
+#define _GNU_SOURCE  // 'accept4()'
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>  // memset
 #include <unistd.h>  // 'getopt()'
 #include <getopt.h>  // 'getopt()'
+#include <signal.h>  // 'signal()'
+#include <pthread.h>
+#include <sched.h>  // 'CPU_SET()'
+#include <time.h>  // 'clock_gettime()'
 
 #include "funciones_sockets.h"
+#include "funciones_epoll.h"
+#include "funciones_uring.h"
+#include "funciones_transferencia.h"
+#include "funciones_memoria.h"
+#include "funciones_bitacora.h"
+#include "funciones_memoria_compartida.h"
+#include "funciones_difusion.h"
 
 // constantes
 const char *kPuerto = "6666";  // puerto de servicio
-const int kMaxBuffer = 100;
+const int kTamLectura = 16384;  // bytes leídos por cada llamada a 'recv()'
 const char *kMsjSalida = "exit"; // Mensaje para salir del programa
-const int kMaxConexiones = 10; // Mensaje para salir del programa
+const int kMaxTrabajadores = 256;
+const int kTamBufferPool = 65536;  // buffers de tramas del pool
+const int kEsperaMemoriaMs = 100;  // revisar así si el servidor termina
+
+// hilo que atiende un subconjunto de las conexiones con su propio reactor
+typedef struct Trabajador {
+    pthread_t hilo;
+    int indice;
+    int descriptores[kMaxEscucha];  // sockets que escuchan de este trabajador
+    int num_descriptores;
+    Reactor reactor;
+    int usa_uring;  // 1 si el reactor usa io_uring como motor de E/S
+    Anillo_uring anillo;
+    Cache_pool cache;  // caché del pool de buffers de tramas
+    unsigned long mensajes;  // mensajes(tramas) atendidos
+} Trabajador;
+
+const char *puerto_servicio = NULL;  // puerto o 'unix:/ruta', 'kPuerto' si no
+int num_trabajadores = 1;  // número de hilos(y sockets) de servicio
+int fijar_cpu = 0;  // 1 para fijar cada trabajador a un núcleo
+int usar_uring = 0;  // 1 para usar io_uring en lugar de epoll
+// donde se guardan archivos recibidos, 'NULL' para no recibirlos
+const char *directorio_archivos = NULL;
+int copiar_archivos = 0;  // 1 para recibir archivos con copias
+int silencioso = 0;  // 1 para no mostrar cada mensaje recibido
+int muestreo = 1;  // mostrar uno de cada N mensajes recibidos
+int eco = 0;  // 1 para regresar cada mensaje al cliente
+int segundos_estadisticas = 0;  // periodo de volcado, 0 para no mostrar
+int medir_latencias = 0;  // 1 para medir la latencia de cada operación
+Pool_buffers pool_tramas;  // compartido por todos los trabajadores
+int difusion = 0;  // 1 para difundir los mensajes a los suscriptores
+uint32_t max_pendientes = kMaxPendientesDifusion;  // cola de cada suscriptor
+const char *nombre_memoria = NULL;  // segmento del canal de memoria compartida
+Canal_memoria canal_memoria;
+volatile int memoria_activa = 1;  // 0 para terminar 'atender_memoria()'
+// los hilos de servicio esperan aquí a que todos tengan su estado por hilo
+pthread_barrier_t hilos_listos;
+
+// estado de un archivo que se está recibiendo por una conexión
+typedef struct Transferencia {
+    int descriptor_archivo;
+    int tuberia[2];  // tubería para 'splice()'
+    char nombre[256];
+    long long tam_archivo;
+    long long pendientes;  // bytes que faltan por recibir
+    long long bytes_copiados;  // bytes que pasaron por memoria del proceso
+    struct timespec inicio;
+} Transferencia;
 
 /**
  * Analiza los argumentos introducidos por linea de comandos al ejecutar el
@@ -37,6 +152,24 @@ void analizar_argumentos(int argc, char *argv[]) {
             {"help", no_argument, 0, 'h'},
             {"ipv4", no_argument, 0, '4'},
             {"ipv6", no_argument, 0, '6'},
+            {"ambas", no_argument, 0, 'b'},
+            {"puerto", required_argument, 0, 'p'},
+            {"workers", required_argument, 0, 'w'},
+            {"max-conexiones", required_argument, 0, 'C'},
+            {"fijar-cpu", no_argument, 0, 'c'},
+            {"uring", no_argument, 0, 'u'},
+            {"directorio", required_argument, 0, 'r'},
+            {"copia", no_argument, 0, 'k'},
+            {"silencioso", no_argument, 0, 'q'},
+            {"muestreo", required_argument, 0, 'm'},
+            {"eco", no_argument, 0, 'e'},
+            {"estadisticas", required_argument, 0, 'S'},
+            {"latencias", no_argument, 0, 'L'},
+            {"memoria", required_argument, 0, 'M'},
+            {"difusion", no_argument, 0, 'd'},
+            {"cola", required_argument, 0, 'Q'},
+            {"perfil", required_argument, 0, 'T'},
+            {"ajuste", required_argument, 0, 'O'},
             {0, 0, 0, 0}
         };
     int referencia = 0;  // variable usada para las opciones de los argumentos
@@ -46,7 +179,7 @@ void analizar_argumentos(int argc, char *argv[]) {
 
     // si un argumento es obligatorio se colocan dos puntos después de la
     // 'opción'(corta) elegida
-    while ((opcion = getopt_long(argc, argv,"ha46",
+    while ((opcion = getopt_long(argc, argv,"ha46bp:w:C:cur:kqm:eS:LM:dQ:T:O:",
                    opciones_largas, &referencia)) != -1) {
         switch (opcion) {
             case 'a': case 'h':
@@ -56,6 +189,44 @@ void analizar_argumentos(int argc, char *argv[]) {
                 printf("\t-h --help\tLista de ayuda y opciones\n");
                 printf("\t-4, --ipv4\tUsar direcciones de tipo IPv4\n");
                 printf("\t-6, --ipv6\tUsar direcciones de tipo IPv6\n");
+                printf("\t-b, --ambas\tAtender IPv4 e IPv6 en el mismo ");
+                printf("proceso(un socket por familia)\n");
+                printf("\t-p [PUERTO], --puerto [PUERTO]\tPuerto donde se ");
+                printf("atiende, o unix:/ruta(unix:@nombre) para un socket ");
+                printf("de dominio Unix\n");
+                printf("\t-w [N], --workers [N]\tNúmero de hilos de servicio, ");
+                printf("cada uno con su socket(SO_REUSEPORT)\n");
+                printf("\t-C [N], --max-conexiones [N]\tDescriptores que ");
+                printf("puede usar el proceso(tamaño de la tabla de ");
+                printf("conexiones de cada hilo, %d por defecto)\n",
+                    kMaxDescriptores);
+                printf("\t-c, --fijar-cpu\tFijar cada hilo de servicio a un ");
+                printf("núcleo\n");
+                printf("\t-u, --uring\tUsar io_uring como motor de E/S\n");
+                printf("\t-r [DIR], --directorio [DIR]\tRecibir archivos y ");
+                printf("guardarlos en DIR(sin reemplazar los que existen)\n");
+                printf("\t-k, --copia\tRecibir archivos con recv/write en lugar ");
+                printf("de splice\n");
+                printf("\t-q, --silencioso\tNo mostrar cada mensaje recibido\n");
+                printf("\t-m [N], --muestreo [N]\tMostrar sólo uno de cada N ");
+                printf("mensajes recibidos\n");
+                printf("\t-e, --eco\tRegresar cada mensaje al cliente\n");
+                printf("\t-S [SEG], --estadisticas [SEG]\tMostrar las ");
+                printf("estadísticas de los sockets cada SEG segundos\n");
+                printf("\t-L, --latencias\tMedir la latencia de cada ");
+                printf("operación de los sockets\n");
+                printf("\t-M [NOMBRE], --memoria [NOMBRE]\tAtender también ");
+                printf("un canal de memoria compartida(por ejemplo /canal)\n");
+                printf("\t-d, --difusion\tDifundir cada mensaje a los ");
+                printf("clientes suscritos con \"#suscribir [tema]\"\n");
+                printf("\t-Q [N], --cola [N]\tMensajes pendientes por ");
+                printf("suscriptor antes de desconectarlo(%u por defecto)\n",
+                    kMaxPendientesDifusion);
+                printf("\t-T [PERFIL], --perfil [PERFIL]\tAjustes de los ");
+                printf("sockets: normal, baja-latencia o masivo\n");
+                printf("\t-O [CLAVE=VALOR], --ajuste [CLAVE=VALOR]\tCambiar ");
+                printf("una opción de los sockets, después de --perfil(ver ");
+                printf("funciones_ajustes.h)\n");
                 printf("\nNOTA: Si no se especifica tipo de dirección se usará");
                 printf(" 'IPv4'(--ipv4) por defecto\n\n");
                 exit(0);
@@ -65,6 +236,81 @@ void analizar_argumentos(int argc, char *argv[]) {
             case '6':
                 familia_direcciones =  kIPV6;
                 break;
+            case 'b':
+                familia_direcciones =  kAMBAS;
+                break;
+            case 'p':
+                puerto_servicio = optarg;
+                break;
+            case 'w':
+                num_trabajadores = atoi(optarg);
+                if (num_trabajadores < 1 || num_trabajadores > kMaxTrabajadores) {
+                    fprintf(stderr, "\nNúmero de hilos inválido: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'C':
+                max_descriptores = atoi(optarg);
+                if (max_descriptores < 64) {
+                    fprintf(stderr, "\nNúmero de conexiones inválido: %s\n",
+                        optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'c':
+                fijar_cpu = 1;
+                break;
+            case 'u':
+                usar_uring = 1;
+                break;
+            case 'r':
+                directorio_archivos = optarg;
+                break;
+            case 'k':
+                copiar_archivos = 1;
+                break;
+            case 'q':
+                silencioso = 1;
+                break;
+            case 'm':
+                muestreo = atoi(optarg);
+                if (muestreo < 1) {
+                    fprintf(stderr, "\nMuestreo inválido: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'e':
+                eco = 1;
+                break;
+            case 'S':
+                segundos_estadisticas = atoi(optarg);
+                break;
+            case 'L':
+                medir_latencias = 1;
+                break;
+            case 'M':
+                nombre_memoria = optarg;
+                break;
+            case 'd':
+                difusion = 1;
+                break;
+            case 'Q':
+                if (atoi(optarg) < 1) {
+                    fprintf(stderr, "\nTamaño de cola inválido: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                max_pendientes = atoi(optarg);
+                break;
+            case 'T':
+                if (seleccionar_perfil_socket(optarg) == -1) {
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'O':
+                if (cambiar_ajuste_socket(optarg) == -1) {
+                    exit(EXIT_FAILURE);
+                }
+                break;
             case '?': default: // si hay una opción no registrada o regresa 0
                 fprintf(stderr, "\nOpción inválida: -- %c\n", optopt);
                 fprintf(stderr, "Usa %s --help para más información.\n\n",argv[0]);
@@ -75,42 +321,736 @@ void analizar_argumentos(int argc, char *argv[]) {
 }
 
 
+/**
+ * Manejador vacío para SIGUSR1: sólo interrumpe 'epoll_wait()' en el hilo que
+ * la recibe para que revise si su reactor debe terminar.
+ *
+ * @param senal número de la señal recibida
+ */
+void despertar_trabajador(int senal) {}
+
+/**
+ * Termina la transferencia de una conexión: cierra el archivo y la tubería y,
+ * si se completó, muestra la tasa de transferencia.
+ *
+ * @param conexion conexión con una transferencia en curso
+ */
+void terminar_transferencia(Conexion *conexion) {
+    Transferencia *transferencia = (Transferencia*)conexion->datos;
+    char ip[INET6_ADDRSTRLEN];
+
+    if (transferencia->pendientes == 0) {
+        long long bytes_splice = transferencia->tam_archivo -
+            transferencia->bytes_copiados;
+        printf("-------------------------------------------------\n");
+        printf("Archivo \"%s\" recibido de %s: %lld bytes, %.2f MB/s\n",
+            transferencia->nombre,
+            escribir_direccion_imprimible((struct sockaddr*)&conexion->direccion,
+                ip, sizeof(ip)),
+            transferencia->tam_archivo,
+            calcular_mb_por_segundo(transferencia->tam_archivo,
+                &transferencia->inicio));
+        printf("\t%lld bytes con splice, %lld bytes con copia\n", bytes_splice,
+            transferencia->bytes_copiados);
+    } else {
+        fprintf(stderr, "\nArchivo \"%s\" incompleto, faltaron %lld bytes\n",
+            transferencia->nombre, transferencia->pendientes);
+    }
+
+    close(transferencia->descriptor_archivo);
+    if (transferencia->tuberia[0] != -1) {
+        close(transferencia->tuberia[0]);
+        close(transferencia->tuberia[1]);
+    }
+    free(transferencia);
+    conexion->datos = NULL;
+    conexion->lector = NULL;
+}
+
+/**
+ * Escribe en el archivo los bytes de una transferencia que ya están en memoria
+ * (recibidos junto con el anuncio, o por el motor io_uring).
+ *
+ * @param conexion conexión con una transferencia en curso
+ * @param datos bytes recibidos
+ * @param tam_datos número de bytes
+ *
+ * @return bytes que pertenecían al archivo(el resto son tramas), -1 en caso
+ *         de error
+ */
+int escribir_transferencia(Conexion *conexion, char *datos, int tam_datos) {
+    Transferencia *transferencia = (Transferencia*)conexion->datos;
+    int consumidos = transferencia->pendientes < tam_datos ?
+        (int)transferencia->pendientes : tam_datos;
+
+    if (write(transferencia->descriptor_archivo, datos, consumidos)
+            != consumidos) {
+        fprintf(stderr, "\nError al escribir archivo(write): %s\n",
+            strerror(errno));
+        return -1;
+    }
+    transferencia->pendientes -= consumidos;
+    transferencia->bytes_copiados += consumidos;
+    if (transferencia->pendientes == 0) {
+        terminar_transferencia(conexion);
+    }
+
+    return consumidos;
+}
+
+/**
+ * Lector de la conexión mientras se recibe un archivo: mueve los bytes del
+ * socket al archivo con 'splice()'(o con copias si se indicó '--copia').
+ *
+ * @param reactor reactor que atiende la conexión
+ * @param conexion conexión con una transferencia en curso
+ *
+ * @return 0 si no hay más datos por ahora, 1 al completar el archivo, -1 en
+ *         caso de error
+ */
+int leer_transferencia(Reactor *reactor, Conexion *conexion) {
+    Transferencia *transferencia = (Transferencia*)conexion->datos;
+    long long antes = transferencia->pendientes;
+    int res;
+
+    if (transferencia->tuberia[0] != -1) {
+        res = recibir_archivo_splice(conexion->descriptor,
+            transferencia->tuberia, transferencia->descriptor_archivo,
+            &transferencia->pendientes);
+    } else {
+        res = recibir_archivo_copia(conexion->descriptor,
+            transferencia->descriptor_archivo, &transferencia->pendientes,
+            reactor->buffer, reactor->tam_buffer);
+        transferencia->bytes_copiados += antes - transferencia->pendientes;
+    }
+    conexion->bytes_recibidos += antes - transferencia->pendientes;
+    reactor->total_bytes += antes - transferencia->pendientes;
+    reactor->llamadas_sistema++;
+
+    if (res == -1) {
+        return -1;
+    }
+    if (transferencia->pendientes == 0) {
+        terminar_transferencia(conexion);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Prepara la recepción de un archivo anunciado por el cliente: crea el archivo
+ * en el directorio de archivos(falla si ya existe) y, si se usa 'splice()', la
+ * tubería.
+ *
+ * @param conexion conexión que anunció el archivo
+ * @param nombre nombre del archivo
+ * @param tam_archivo tamaño del archivo
+ *
+ * @return 0 en caso de éxito, -1 en caso de error
+ */
+int iniciar_transferencia(Conexion *conexion, const char *nombre,
+        long long tam_archivo) {
+    char ruta[4096];
+    Transferencia *transferencia = (Transferencia*)calloc(1,
+        sizeof(Transferencia));
+    if (transferencia == NULL) {
+        return -1;
+    }
+
+    snprintf(ruta, sizeof(ruta), "%s/%s", directorio_archivos, nombre);
+    transferencia->descriptor_archivo = open(ruta, O_WRONLY | O_CREAT |
+        O_EXCL | O_CLOEXEC, 0644);
+    if (transferencia->descriptor_archivo == -1) {
+        fprintf(stderr, "\nError al crear archivo %s: %s\n", ruta,
+            strerror(errno));
+        free(transferencia);
+        return -1;
+    }
+    transferencia->tuberia[0] = transferencia->tuberia[1] = -1;
+    if (!copiar_archivos && crear_tuberia_splice(transferencia->tuberia) == -1) {
+        transferencia->tuberia[0] = transferencia->tuberia[1] = -1;
+    }
+    snprintf(transferencia->nombre, sizeof(transferencia->nombre), "%s", nombre);
+    transferencia->tam_archivo = transferencia->pendientes = tam_archivo;
+    clock_gettime(CLOCK_MONOTONIC, &transferencia->inicio);
+
+    conexion->datos = transferencia;
+    conexion->lector = leer_transferencia;
+    if (tam_archivo == 0) {
+        terminar_transferencia(conexion);
+    }
+
+    return 0;
+}
+
+/**
+ * Libera la transferencia de una conexión que se cierra y, si estaba
+ * suscrita, la quita del difusor.
+ *
+ * @param reactor reactor que atiende la conexión
+ * @param conexion conexión que se cerrará
+ */
+void al_cerrar_conexion(Reactor *reactor, Conexion *conexion) {
+    if (conexion->datos != NULL) {
+        terminar_transferencia(conexion);
+    }
+    if (difusion) {
+        quitar_suscriptor(conexion);
+    }
+}
+
+/**
+ * Registra un mensaje(trama) recibido en la bitácora. Si el cliente envía el
+ * mensaje de salida se cierra su conexión, el servidor continúa atendiendo a
+ * los demás. Con '--directorio', si el mensaje anuncia un archivo se inicia su
+ * recepción. Con '--difusion' el mensaje se publica a los suscriptores(o
+ * suscribe a la conexión).
+ *
+ * @param reactor reactor que atiende la conexión
+ * @param conexion conexión de donde proviene el mensaje
+ * @param mensaje datos de la trama
+ * @param tam_mensaje longitud de la trama
+ */
+void procesar_mensaje(Reactor *reactor, Conexion *conexion, char *mensaje,
+        uint32_t tam_mensaje) {
+    Trabajador *trabajador = (Trabajador*)reactor->datos;
+    char nombre[256];
+    long long tam_archivo;
+
+    trabajador->mensajes++;
+    if (directorio_archivos != NULL && interpretar_anuncio_archivo(mensaje,
+            tam_mensaje, &tam_archivo, nombre, sizeof(nombre))) {
+        if (iniciar_transferencia(conexion, nombre, tam_archivo) == -1) {
+            cerrar_conexion(reactor, conexion);
+        }
+        return;
+    }
+
+    registrar_mensaje_bitacora(&conexion->direccion, NULL, mensaje,
+        tam_mensaje);
+
+    if (tam_mensaje == strlen(kMsjSalida) &&
+            memcmp(mensaje, kMsjSalida, tam_mensaje) == 0) {
+        cerrar_conexion(reactor, conexion);
+        return;
+    }
+
+    // las suscripciones no se difunden; los mensajes se envían al terminar
+    // el bloque, en 'vaciar_difusor()'
+    if (difusion) {
+        int res = agregar_suscripcion(conexion, mensaje, tam_mensaje);
+        if (res == -1) {
+            cerrar_conexion(reactor, conexion);
+        } else if (res == 0) {
+            publicar_mensaje_difusion(reactor, mensaje, tam_mensaje);
+        }
+    }
+}
+
+/**
+ * Regresa al cliente los ecos acumulados con un solo 'writev()', sin esperar a
+ * que el socket tenga espacio: lo que no cabe se envía después desde el
+ * reactor, ver 'enviar_tramas_conexion()'. Con io_uring los ecos se envían
+ * desde el anillo del reactor. Si el envío falla o el cliente no lee sus ecos
+ * se cierra la conexión.
+ *
+ * @param reactor reactor que atiende la conexión
+ * @param conexion conexión a la que se envían los ecos
+ * @param ecos datos de cada trama
+ * @param tam_ecos longitud de cada trama
+ * @param num_ecos número de tramas
+ */
+void enviar_ecos(Reactor *reactor, Conexion *conexion, char **ecos,
+        uint32_t *tam_ecos, int num_ecos) {
+    if (num_ecos > 0 && conexion->activa && enviar_tramas_conexion(reactor,
+            conexion, ecos, tam_ecos, num_ecos) == -1) {
+        cerrar_conexion(reactor, conexion);
+    }
+}
+
+/**
+ * Acumula los bytes recibidos en el buffer de tramas de la conexión y procesa
+ * cada trama completa. Un solo bloque puede contener varias tramas o sólo una
+ * parte de una. Mientras hay una transferencia en curso los bytes pertenecen
+ * al archivo. Con '--eco' las tramas del bloque se regresan juntas al final, y
+ * con '--difusion' los mensajes publicados se envían a los suscriptores.
+ *
+ * @param reactor reactor que atiende la conexión
+ * @param conexion conexión de donde provienen los datos
+ * @param buffer datos recibidos
+ * @param bytes_recibidos número de bytes en el buffer
+ */
+void procesar_datos(Reactor *reactor, Conexion *conexion, char *buffer,
+        int bytes_recibidos) {
+    Buffer_tramas *entrada = &conexion->entrada;
+    char *mensaje;
+    uint32_t tam_mensaje;
+    int res;
+    // las tramas siguen en el buffer de la conexión hasta 'soltar_...()'
+    char *ecos[kMaxTramasLote];
+    uint32_t tam_ecos[kMaxTramasLote];
+    int num_ecos = 0;
+
+    // sin bytes acumulados, los del archivo se escriben sin copiarlos al
+    // buffer de tramas
+    if (conexion->datos != NULL && entrada->fin == entrada->inicio) {
+        res = escribir_transferencia(conexion, buffer, bytes_recibidos);
+        if (res == -1) {
+            cerrar_conexion(reactor, conexion);
+            return;
+        }
+        buffer += res;
+        bytes_recibidos -= res;
+    }
+    if (bytes_recibidos > 0 &&
+            agregar_datos_tramas(entrada, buffer, bytes_recibidos) == -1) {
+        cerrar_conexion(reactor, conexion);
+        return;
+    }
+
+    while (conexion->activa) {
+        if (conexion->datos != NULL) {
+            if (entrada->fin == entrada->inicio) {
+                break;
+            }
+            res = escribir_transferencia(conexion, entrada->datos +
+                entrada->inicio, entrada->fin - entrada->inicio);
+            if (res == -1) {
+                cerrar_conexion(reactor, conexion);
+                break;
+            }
+            entrada->inicio += res;
+            if (entrada->inicio == entrada->fin) {
+                entrada->inicio = entrada->fin = 0;
+            }
+            continue;
+        }
+
+        res = extraer_trama(entrada, &mensaje, &tam_mensaje);
+        if (res == 0) {
+            break;
+        }
+        if (res == -1) {
+            cerrar_conexion(reactor, conexion);  // trama inválida
+            break;
+        }
+        procesar_mensaje(reactor, conexion, mensaje, tam_mensaje);
+        // el anuncio de un archivo(o el mensaje de salida) no tiene eco
+        if (eco && conexion->activa && conexion->datos == NULL) {
+            ecos[num_ecos] = mensaje;
+            tam_ecos[num_ecos++] = tam_mensaje;
+            if (num_ecos == kMaxTramasLote) {
+                enviar_ecos(reactor, conexion, ecos, tam_ecos, num_ecos);
+                num_ecos = 0;
+            }
+        }
+    }
+    enviar_ecos(reactor, conexion, ecos, tam_ecos, num_ecos);
+    if (difusion) {
+        vaciar_difusor(reactor);
+    }
+    // sin bytes pendientes el buffer regresa al pool hasta el siguiente mensaje
+    soltar_buffer_tramas(entrada);
+}
+
+/**
+ * Reserva el estado por hilo(contadores de los sockets y anillo de la
+ * bitácora) antes de atender y espera a los demás hilos, así el primer mensaje
+ * no reserva memoria y el conteo de '-DCONTAR_RESERVAS' empieza con todos
+ * listos.
+ */
+void preparar_hilo_servicio(void) {
+    obtener_estadisticas_hilo();
+    if (bitacora.muestreo > 0) {
+        obtener_anillo_bitacora();
+    }
+    pthread_barrier_wait(&hilos_listos);
+}
+
+/**
+ * Función de cada hilo de servicio: opcionalmente se fija a un núcleo y
+ * ejecuta su reactor hasta que se detenga el servidor.
+ *
+ * @param argumento estructura 'Trabajador' del hilo
+ */
+void* ejecutar_trabajador(void *argumento) {
+    Trabajador *trabajador = (Trabajador*)argumento;
+
+    if (fijar_cpu) {
+        cpu_set_t nucleos;
+        CPU_ZERO(&nucleos);
+        CPU_SET(trabajador->indice % sysconf(_SC_NPROCESSORS_ONLN), &nucleos);
+        int res = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+            &nucleos);
+        if (res != 0) {
+            fprintf(stderr, "\nNo se pudo fijar el hilo %d a un núcleo: %s\n",
+                trabajador->indice, strerror(res));
+        }
+    }
+    preparar_hilo_servicio();
+
+    if (trabajador->usa_uring) {
+        ejecutar_reactor_uring(&trabajador->reactor, &trabajador->anillo);
+    } else {
+        ejecutar_reactor(&trabajador->reactor);
+    }
+    return NULL;
+}
+
+/**
+ * Hilo que atiende el canal de memoria compartida: cada registro es un
+ * mensaje que se registra en la bitácora y, con '--eco', se regresa al
+ * cliente. Cuando el cliente se va el canal se reinicia para el siguiente.
+ *
+ * @param argumento canal creado con 'crear_canal_memoria()'
+ */
+void* atender_memoria(void *argumento) {
+    Canal_memoria *canal = (Canal_memoria*)argumento;
+    struct sockaddr_storage origen;  // el canal no tiene dirección de red
+    int res;
+
+    char *buffer = (char*)malloc(canal->max_registro);
+    preparar_hilo_servicio();
+    if (buffer == NULL) {
+        fprintf(stderr, "\nError al reservar memoria para el canal\n");
+        return NULL;
+    }
+    memset(&origen, 0, sizeof(origen));
+    origen.ss_family = AF_UNSPEC;
+
+    while (memoria_activa) {
+        if (esperar_datos_memoria(canal, kEsperaMemoriaMs) == 0) {
+            continue;
+        }
+        res = recibir_datos_memoria(canal, buffer, canal->max_registro,
+            MSG_DONTWAIT);
+        if (res == 0) {
+            reiniciar_canal_memoria(canal);
+            continue;
+        }
+        if (res == -1) {
+            continue;
+        }
+        registrar_mensaje_bitacora(&origen, NULL, buffer, res);
+        // el mensaje de salida no tiene eco, el cliente cierra el canal; si
+        // el cliente no lee sus ecos y el anillo se llena, se descartan
+        if (eco && !(res == (int)strlen(kMsjSalida) &&
+                memcmp(buffer, kMsjSalida, res) == 0)) {
+            enviar_datos_memoria(canal, buffer, res, MSG_DONTWAIT);
+        }
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * Muestra las conexiones y bytes atendidos por cada trabajador y el
+ * porcentaje que representan del total, para revisar el balance de carga.
+ * Después muestra la tasa de aceptación y las conexiones rechazadas(sin
+ * descriptores libres), abortadas por el cliente o cerradas porque el
+ * cliente no leía lo que se le enviaba.
+ *
+ * @param trabajadores arreglo de trabajadores
+ * @param num número de trabajadores
+ * @param segundos tiempo que estuvo atendiendo el servidor
+ */
+void mostrar_balance(Trabajador *trabajadores, int num, double segundos) {
+    unsigned long total_conexiones = 0, total_bytes = 0;
+    unsigned long rechazadas = 0, abortadas = 0, lentas = 0, lotes = 0;
+    int i;
+    for (i = 0; i < num; i++) {
+        total_conexiones += trabajadores[i].reactor.total_conexiones;
+        total_bytes += trabajadores[i].reactor.total_bytes;
+        rechazadas += trabajadores[i].reactor.conexiones_rechazadas;
+        abortadas += trabajadores[i].reactor.conexiones_abortadas;
+        lentas += trabajadores[i].reactor.conexiones_lentas;
+        lotes += trabajadores[i].reactor.lotes_aceptados;
+    }
+    printf("\nBalance de carga(%d hilos):\n", num);
+    for (i = 0; i < num; i++) {
+        Reactor *reactor = &trabajadores[i].reactor;
+        printf("\tHilo %d: %lu conexiones(%.1f%%), %lu bytes(%.1f%%), ", i,
+            reactor->total_conexiones, total_conexiones == 0 ? 0.0 :
+            100.0*reactor->total_conexiones/total_conexiones,
+            reactor->total_bytes, total_bytes == 0 ? 0.0 :
+            100.0*reactor->total_bytes/total_bytes);
+        printf("%lu llamadas al sistema(%s)\n", reactor->llamadas_sistema,
+            trabajadores[i].usa_uring ? "io_uring" : "epoll");
+    }
+    printf("Aceptación: %lu conexiones en %.1f s(%.0f conexiones/s)",
+        total_conexiones, segundos, segundos > 0 ? total_conexiones/segundos :
+        0.0);
+    if (lotes > 0) {
+        printf(", %.1f por despertar", (double)total_conexiones/lotes);
+    }
+    printf("\n\t%lu rechazadas(sin descriptores), %lu abortadas por el "
+        "cliente, %lu cerradas por no leer\n", rechazadas, abortadas, lentas);
+}
+
+/**
+ * Muestra la dirección de cada socket que escucha de un trabajador.
+ *
+ * @param trabajador trabajador con sus sockets ya asociados
+ */
+void mostrar_sockets_escucha(Trabajador *trabajador) {
+    struct sockaddr_storage direccion;
+    socklen_t tam_dir;
+    char ip[INET6_ADDRSTRLEN];
+    int i;
+
+    for (i = 0; i < trabajador->num_descriptores; i++) {
+        tam_dir = sizeof(direccion);
+        if (getsockname(trabajador->descriptores[i],
+                (struct sockaddr*)&direccion, &tam_dir) == 0) {
+            printf("Escuchando en %s(%s)\n", escribir_direccion_imprimible(
+                (struct sockaddr*)&direccion, ip, sizeof(ip)),
+                direccion.ss_family == AF_INET ? kMensajeIPV4 :
+                direccion.ss_family == AF_UNIX ? kMensajeUnix : kMensajeIPV6);
+        }
+    }
+}
+
 int main(int argc,  char *argv[]) {
     analizar_argumentos(argc, argv);
+    if (puerto_servicio == NULL) {
+        puerto_servicio = kPuerto;
+    }
+    // SO_REUSEPORT no reparte conexiones de sockets de dominio Unix, y cada
+    // hilo borraría el archivo del socket de los demás al asociar el suyo
+    if (es_direccion_unix(puerto_servicio) && num_trabajadores > 1) {
+        printf("Los sockets de dominio Unix se atienden con un solo hilo\n");
+        num_trabajadores = 1;
+    }
+    // los suscriptores y sus colas son del hilo que los atiende
+    if (difusion && (num_trabajadores > 1 || usar_uring)) {
+        printf("El difusor se atiende con un solo hilo y epoll\n");
+        num_trabajadores = 1;
+        usar_uring = 0;
+    }
+    // los ecos y los mensajes difundidos no pueden intercalarse en el socket
+    if (difusion && eco) {
+        printf("El difusor no regresa ecos\n");
+        eco = 0;
+    }
     printf("Se usará la familia de direcciones: '%s'\n\n",
-        familia_direcciones == kIPV4? kMensajeIPV4 : kMensajeIPV6);
-
-    int descriptor = inicializar_servidor(kPuerto, SOCK_STREAM);
+        es_direccion_unix(puerto_servicio) ? kMensajeUnix :
+        familia_direcciones == kIPV4 ? kMensajeIPV4 :
+        familia_direcciones == kIPV6 ? kMensajeIPV6 : kMensajeAmbas);
 
-    escuchar(descriptor, kMaxConexiones);
+    // SIGINT y SIGTERM se bloquean en todos los hilos, el hilo principal las
+    // espera con 'sigwait()' para detener a los trabajadores
+    sigset_t senales;
+    sigemptyset(&senales);
+    sigaddset(&senales, SIGINT);
+    sigaddset(&senales, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &senales, NULL);
+    signal(SIGUSR1, despertar_trabajador);
+    signal(SIGPIPE, SIG_IGN);  // un cliente que cierra no termina el proceso
 
+    Trabajador *trabajadores = (Trabajador*)calloc(num_trabajadores,
+        sizeof(Trabajador));
+    int i, j;
 
+    if (crear_pool(&pool_tramas, kTamBufferPool, num_trabajadores*
+            kLoteCachePool) == -1) {
+        exit(EXIT_FAILURE);
+    }
 
-    char *buffer = (char*)malloc(sizeof(char)*kMaxBuffer);
+    // todos los sockets se asocian antes de atender, así el kernel reparte
+    // las conexiones desde el inicio
+    for (i = 0; i < num_trabajadores; i++) {
+        Trabajador *trabajador = &trabajadores[i];
+        trabajador->indice = i;
+        // con ambas familias se asocia un socket por cada dirección propia,
+        // todos atendidos por el mismo reactor
+        if (familia_direcciones == kAMBAS &&
+                !es_direccion_unix(puerto_servicio)) {
+            trabajador->num_descriptores = inicializar_servidores(
+                puerto_servicio, SOCK_STREAM, num_trabajadores > 1,
+                trabajador->descriptores, kMaxEscucha);
+        } else {
+            trabajador->descriptores[0] = num_trabajadores == 1 ?
+                inicializar_servidor(puerto_servicio, SOCK_STREAM) :
+                inicializar_servidor_compartido(puerto_servicio, SOCK_STREAM);
+            trabajador->num_descriptores =
+                trabajador->descriptores[0] == -1 ? -1 : 1;
+        }
+        if (trabajador->num_descriptores == -1) {
+            exit(EXIT_FAILURE);
+        }
 
-    struct sockaddr_storage cliente;
-    int bytes_recibidos = 0;
+        // la reserva de conexiones pendientes viene de los ajustes
+        for (j = 0; j < trabajador->num_descriptores; j++) {
+            if (escuchar(trabajador->descriptores[j], ajustes_socket.reserva)
+                    == -1) {
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (i == 0) {
+            mostrar_sockets_escucha(trabajador);
+            if (ajustes_socket.modificado) {
+                mostrar_ajustes_socket(trabajador->descriptores[0],
+                    SOCK_STREAM);
+            }
+        }
 
-    // debe implementarse como hilo
+        if (crear_reactor(&trabajador->reactor, trabajador->descriptores[0],
+                kTamLectura, procesar_datos) == -1) {
+            exit(EXIT_FAILURE);
+        }
+        for (j = 1; j < trabajador->num_descriptores; j++) {
+            if (agregar_escucha_reactor(&trabajador->reactor,
+                    trabajador->descriptores[j]) == -1) {
+                exit(EXIT_FAILURE);
+            }
+        }
+        trabajador->reactor.al_cerrar = al_cerrar_conexion;
+        trabajador->reactor.datos = trabajador;
+        inicializar_cache_pool(&trabajador->cache, &pool_tramas);
+        trabajador->reactor.cache = &trabajador->cache;
 
-    int descriptor_cliente = aceptar(descriptor, (struct sockaddr*)&cliente);
+        if (usar_uring) {
+            trabajador->usa_uring = crear_anillo_uring(&trabajador->anillo,
+                    kEntradasUring) == 0 &&
+                registrar_buffers_provistos_uring(&trabajador->anillo,
+                    kNumBuffersUring, kTamLectura) == 0 &&
+                registrar_envios_uring(&trabajador->anillo, kNumEnviosUring,
+                    kTamEnvioUring) == 0;
+            if (!trabajador->usa_uring) {
+                destruir_anillo_uring(&trabajador->anillo);
+                fprintf(stderr, "Hilo %d: se usará epoll\n", i);
+            }
+        }
+    }
 
-    while (strcmp(buffer, kMsjSalida) != 0) {
-        bytes_recibidos = recibir_datos_stream(descriptor_cliente, buffer,
-            kMaxBuffer-1, 0);
-        buffer[bytes_recibidos] = '\0';
-        printf("-------------------------------------------------\n");
-        printf("%d datos recibidos de %s\n", bytes_recibidos,
-            obtener_direccion_imprimible((struct sockaddr*)&cliente));
-        printf("El mensaje es: \"%s\"\n", buffer);
+    if (difusion && iniciar_difusor(trabajadores[0].reactor.max_conexiones,
+            max_pendientes) == -1) {
+        exit(EXIT_FAILURE);
+    }
+    // la bitácora, la calibración y el hilo de volcado van antes de crear los
+    // trabajadores
+    if (iniciar_bitacora(stdout, kCapacidadBitacora, silencioso ? 0 :
+            muestreo) == -1) {
+        exit(EXIT_FAILURE);
+    }
+    if (medir_latencias && habilitar_latencias_socket() == -1) {
+        exit(EXIT_FAILURE);
+    }
+    if (segundos_estadisticas > 0 &&
+            iniciar_volcado_estadisticas(segundos_estadisticas) == -1) {
+        exit(EXIT_FAILURE);
     }
 
-    close(descriptor_cliente);
+    // los trabajadores, el hilo de la memoria compartida y este hilo
+    pthread_barrier_init(&hilos_listos, NULL, num_trabajadores + 1 +
+        (nombre_memoria != NULL));
+    for (i = 0; i < num_trabajadores; i++) {
+        if (pthread_create(&trabajadores[i].hilo, NULL, ejecutar_trabajador,
+                &trabajadores[i]) != 0) {
+            fprintf(stderr, "\nError al crear hilo de servicio\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_t hilo_memoria;
+    if (nombre_memoria != NULL) {
+        if (crear_canal_memoria(&canal_memoria, nombre_memoria,
+                kCapacidadMemoria) == -1) {
+            exit(EXIT_FAILURE);
+        }
+        if (pthread_create(&hilo_memoria, NULL, atender_memoria,
+                &canal_memoria) != 0) {
+            fprintf(stderr, "\nError al crear hilo del canal de memoria\n");
+            exit(EXIT_FAILURE);
+        }
+        printf("Atendiendo el canal de memoria compartida %s\n",
+            nombre_memoria);
+    }
+    pthread_barrier_wait(&hilos_listos);
+    printf("Atendiendo en el puerto %s con %d hilo(s)\n", puerto_servicio,
+        num_trabajadores);
+    struct timespec inicio, fin;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    int estado_salida = EXIT_SUCCESS;
+#ifdef CONTAR_RESERVAS
+    unsigned long reservas = obtener_reservas_heap();
+    unsigned long losas = pool_tramas.num_losas;
+#endif
 
-    // termina proceso hilo
+    int senal;
+    sigwait(&senales, &senal);
 
+    clock_gettime(CLOCK_MONOTONIC, &fin);
     printf("\nApagando servidor...\n");
-    close(descriptor);
+    for (i = 0; i < num_trabajadores; i++) {
+        trabajadores[i].reactor.activo = 0;
+    }
+    // la señal se repite por si llegó antes de que el hilo entrara a
+    // 'epoll_wait()'
+    for (i = 0; i < num_trabajadores; i++) {
+        struct timespec limite;
+        do {
+            pthread_kill(trabajadores[i].hilo, SIGUSR1);
+            clock_gettime(CLOCK_REALTIME, &limite);
+            limite.tv_nsec += 100000000;  // 100 ms
+            if (limite.tv_nsec >= 1000000000) {
+                limite.tv_sec++;
+                limite.tv_nsec -= 1000000000;
+            }
+        } while (pthread_timedjoin_np(trabajadores[i].hilo, NULL, &limite)
+            == ETIMEDOUT);
+    }
+    if (nombre_memoria != NULL) {
+        memoria_activa = 0;
+        pthread_join(hilo_memoria, NULL);
+    }
 
-    return 0;
+    detener_bitacora();
+    mostrar_balance(trabajadores, num_trabajadores,
+        (fin.tv_sec - inicio.tv_sec) + (fin.tv_nsec - inicio.tv_nsec)/1e9);
+    if (segundos_estadisticas > 0 || medir_latencias) {
+        mostrar_estadisticas_socket();
+    }
+    if (difusion) {
+        mostrar_estadisticas_difusor();
+    }
+    if (nombre_memoria != NULL) {
+        mostrar_estadisticas_memoria(&canal_memoria);
+        cerrar_canal_memoria(&canal_memoria);
+    }
+#ifdef CONTAR_RESERVAS
+    unsigned long mensajes = 0;
+    for (i = 0; i < num_trabajadores; i++) {
+        mensajes += trabajadores[i].mensajes;
+    }
+    reservas = obtener_reservas_heap() - reservas;
+    losas = pool_tramas.num_losas - losas;
+    printf("%lu reservas de memoria del heap al atender %lu mensajes(%lu ",
+        reservas, mensajes, losas);
+    printf("losas nuevas en el pool)\n");
+    if (!difusion && directorio_archivos == NULL && reservas > losas) {
+        fprintf(stderr, "\nAtender mensajes reservó memoria del heap\n");
+        estado_salida = EXIT_FAILURE;
+    }
+#endif
+
+    for (i = 0; i < num_trabajadores; i++) {
+        if (trabajadores[i].usa_uring) {
+            destruir_anillo_uring(&trabajadores[i].anillo);
+        }
+        destruir_reactor(&trabajadores[i].reactor);
+        vaciar_cache_pool(&trabajadores[i].cache);
+        for (j = 0; j < trabajadores[i].num_descriptores; j++) {
+            cerrar_socket_servidor(trabajadores[i].descriptores[j]);
+        }
+    }
+    if (difusion) {
+        detener_difusor();  // después de cerrar las conexiones suscritas
+    }
+    destruir_pool(&pool_tramas);
+    free(trabajadores);
+    pthread_barrier_destroy(&hilos_listos);
+
+    return estado_salida;
 }